@@ -0,0 +1,329 @@
+#include <registration.h>
+#include <statistical_model.h>
+#include <synthetic_face.h>
+
+#include <pcl/console/parse.h>
+#include <pcl/console/time.h>
+
+#include <boost/bind.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/function.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Gives the benchmarks access to the private steps of Registration
+ */
+class RegistrationBench
+{
+  public:
+
+    template <typename PolicyT> static void
+    convertEigenToPointCLoud (Registration < PolicyT >* registration)
+    {
+      registration->convertEigenToPointCLoud ();
+    }
+
+    template <typename PolicyT> static void
+    setKdTree (Registration < PolicyT >* registration, pcl::PointCloud<pcl::PointNormal>::Ptr target_point_normal_cloud_ptr)
+    {
+      registration->setKdTree (target_point_normal_cloud_ptr);
+    }
+};
+
+/**
+ * @brief The times of one benchmark, in milliseconds
+ */
+struct Timing
+{
+  std::string name;
+
+  std::vector < double > samples;
+};
+
+/**
+ * @brief The inputs the benchmarks run on
+ */
+struct BenchInput
+{
+  std::string kind;
+
+  std::string database_path;
+
+  double scale;
+
+  pcl::PointCloud<pcl::PointNormal>::Ptr target_point_normal_cloud_ptr;
+
+  pcl::PointXYZ face_point;
+};
+
+/**
+ * @brief Runs body warmup times, then repetitions times timing each run. setup, if given, runs before each of them and is not timed
+ */
+
+static void
+measure (const std::string& name, boost::function<void ()> setup, boost::function<void ()> body, int warmup, int repetitions, std::vector < Timing >& timings)
+{
+  int i;
+
+  pcl::console::TicToc timer;
+
+  Timing timing;
+
+  timing.name = name;
+
+  for (i = 0; i < warmup + repetitions; ++i)
+  {
+    if (setup)
+    {
+      setup ();
+    }
+
+    timer.tic ();
+
+    body ();
+
+    if (i >= warmup)
+    {
+      timing.samples.push_back (timer.toc ());
+    }
+  }
+
+  timings.push_back (timing);
+}
+
+/**
+ * @brief Puts the model back as it was read and aligned, so every repetition of a step starts from the same state
+ */
+
+template <typename PolicyT> static void
+resetModel (Registration < PolicyT >* registration, typename StatisticalModel<PolicyT>::ConstPtr model_ptr)
+{
+  registration->setModel (model_ptr);
+  registration->alignModel ();
+}
+
+template <typename PolicyT> static void
+loadModel (const BenchInput* input)
+{
+  Registration < PolicyT > registration;
+
+  registration.getDataForModel (input->database_path, Eigen::Matrix3d::Identity (), Eigen::Vector3d::Zero (), input->scale);
+}
+
+template <typename PolicyT> static void
+filterCorrespondences (Registration < PolicyT >* registration, double angle_limit, double distance_limit, pcl::Correspondences* correspondences)
+{
+  registration->filterNonRigidCorrespondences (angle_limit, distance_limit, *correspondences);
+}
+
+template <typename PolicyT> static void
+rigidIteration (Registration < PolicyT >* registration, double angle_limit, double distance_limit)
+{
+  registration->calculateRigidRegistration (1, angle_limit, distance_limit, false);
+}
+
+template <typename PolicyT> static void
+nonRigidStep (Registration < PolicyT >* registration, int number_eigenvectors, double energy_weight, double angle_limit, double distance_limit)
+{
+  registration->calculateNonRigidRegistration (number_eigenvectors, energy_weight, angle_limit, distance_limit, false);
+}
+
+/**
+ * @brief Runs every benchmark on the input
+ */
+
+template <typename PolicyT> static std::vector < Timing >
+runBenchmarks (const BenchInput& input, int& number_eigenvectors, int warmup, int repetitions, int& number_model_points)
+{
+  double angle_limit = std::atan (1.0), distance_limit = 0.001, energy_weight = 0.001;
+
+  std::vector < Timing > timings;
+
+  pcl::Correspondences correspondences;
+
+  Registration < PolicyT > registration;
+
+  measure ("model_load", boost::function<void ()> (), boost::bind (&loadModel < PolicyT >, &input), std::min (warmup, 1), repetitions, timings);
+
+  typename StatisticalModel < PolicyT >::ConstPtr model_ptr (new StatisticalModel < PolicyT > (input.database_path, Eigen::Matrix3d::Identity (), Eigen::Vector3d::Zero (), input.scale));
+
+  number_model_points = model_ptr->getNumberPoints ();
+  number_eigenvectors = std::min (number_eigenvectors, static_cast<int> (model_ptr->getEigenVectors ().cols ()));
+
+  registration.setFaceCenterPoint (input.face_point);
+  resetModel (&registration, model_ptr);
+
+  measure ("normals", boost::function<void ()> (), boost::bind (&RegistrationBench::convertEigenToPointCLoud < PolicyT >, &registration), warmup, repetitions, timings);
+
+  measure ("kdtree", boost::function<void ()> (), boost::bind (&RegistrationBench::setKdTree < PolicyT >, &registration, input.target_point_normal_cloud_ptr), warmup, repetitions, timings);
+
+  /* setKdTree () is not given the face, so it is set again before the model is aligned */
+
+  registration.setFaceCenterPoint (input.face_point);
+  resetModel (&registration, model_ptr);
+
+  measure ("correspondences", boost::function<void ()> (), boost::bind (&filterCorrespondences < PolicyT >, &registration, angle_limit, distance_limit, &correspondences), warmup, repetitions, timings);
+
+  measure ("rigid_iteration", boost::bind (&resetModel < PolicyT >, &registration, model_ptr), boost::bind (&rigidIteration < PolicyT >, &registration, angle_limit, distance_limit), warmup, repetitions, timings);
+
+  measure ("non_rigid_step", boost::bind (&resetModel < PolicyT >, &registration, model_ptr), boost::bind (&nonRigidStep < PolicyT >, &registration, number_eigenvectors, energy_weight, angle_limit, distance_limit), warmup, repetitions, timings);
+
+  return (timings);
+}
+
+/**
+ * @brief Writes the results as one JSON object
+ */
+
+static void
+writeJson (std::ostream& out, const BenchInput& input, const std::string& precision, int number_model_points, int number_eigenvectors, int repetitions, const std::vector < Timing >& timings)
+{
+  int i, j;
+
+  double mean, variance;
+
+  std::vector < double > samples;
+
+  out.precision (6);
+
+  out << "{\n  \"benchmark\": \"face_bench\",\n  \"precision\": \"" << precision << "\",\n  \"input\": \"" << input.kind << "\",\n"
+      << "  \"model_points\": " << number_model_points << ",\n  \"eigenvectors\": " << number_eigenvectors << ",\n"
+      << "  \"target_points\": " << input.target_point_normal_cloud_ptr->size () << ",\n  \"repetitions\": " << repetitions << ",\n  \"results\": [\n";
+
+  for (i = 0; i < timings.size (); ++i)
+  {
+    samples = timings[i].samples;
+
+    std::sort (samples.begin (), samples.end ());
+
+    mean = variance = 0.0;
+
+    for (j = 0; j < samples.size (); ++j)
+    {
+      mean += samples[j] / samples.size ();
+    }
+
+    for (j = 0; j < samples.size (); ++j)
+    {
+      variance += (samples[j] - mean) * (samples[j] - mean) / samples.size ();
+    }
+
+    out << "    {\"name\": \"" << timings[i].name << "\", \"mean_ms\": " << mean << ", \"median_ms\": " << samples[samples.size () / 2]
+        << ", \"min_ms\": " << samples.front () << ", \"max_ms\": " << samples.back () << ", \"stddev_ms\": " << std::sqrt (variance) << "}"
+        << (i + 1 < timings.size () ? ",\n" : "\n");
+  }
+
+  out << "  ]\n}\n";
+}
+
+/**
+ * @brief Times the steps of the registration one by one.
+ * Synthetic inputs by default, sized by -model_points, -eigenvectors and -target_points; recorded ones with -database and -target, -x, -y and -z.
+ * The results go to -json as JSON, or to the standard output
+ */
+
+int
+main (int argc, char** argv)
+{
+  std::string precision ("double"), pcd_file, json_path;
+
+  int model_points = 5000, target_points = 20000, number_eigenvectors = 50, warmup = 2, repetitions = 20, number_model_points = 0, number_side;
+
+  float x = 0.0f, y = 0.0f, z = 0.0f;
+
+  std::vector < Timing > timings;
+
+  BenchInput input;
+
+  boost::filesystem::path model_path;
+
+  pcl::console::parse_argument (argc, argv, "-precision", precision);
+  pcl::console::parse_argument (argc, argv, "-model_points", model_points);
+  pcl::console::parse_argument (argc, argv, "-target_points", target_points);
+  pcl::console::parse_argument (argc, argv, "-eigenvectors", number_eigenvectors);
+  pcl::console::parse_argument (argc, argv, "-warmup", warmup);
+  pcl::console::parse_argument (argc, argv, "-repetitions", repetitions);
+  pcl::console::parse_argument (argc, argv, "-json", json_path);
+
+  repetitions = std::max (1, repetitions);
+
+  input.scale = 1.0;
+
+  if (pcl::console::parse_argument (argc, argv, "-target", pcd_file) >= 0)
+  {
+    input.kind = "recorded";
+    input.database_path = "PCA.txt";
+
+    pcl::console::parse_argument (argc, argv, "-database", input.database_path);
+    pcl::console::parse_argument (argc, argv, "-scale", input.scale);
+    pcl::console::parse_argument (argc, argv, "-x", x);
+    pcl::console::parse_argument (argc, argv, "-y", y);
+    pcl::console::parse_argument (argc, argv, "-z", z);
+
+    input.target_point_normal_cloud_ptr.reset (new pcl::PointCloud<pcl::PointNormal>);
+
+    if (pcl::io::loadPCDFile<pcl::PointNormal> (pcd_file, *input.target_point_normal_cloud_ptr) == -1)
+    {
+      PCL_ERROR ("Could not open file %s\n", pcd_file.c_str ());
+      exit (1);
+    }
+
+    input.face_point = pcl::PointXYZ (x, y, z);
+  }
+
+  else
+  {
+    /* The synthetic model is written to a file so that its loading is timed like the one of a real model */
+
+    input.kind = "synthetic";
+
+    number_side = std::max (4, static_cast<int> (std::sqrt (static_cast<double> (model_points))));
+
+    model_path = boost::filesystem::temp_directory_path () / boost::filesystem::unique_path ("face_bench_%%%%%%%%.txt");
+
+    input.database_path = model_path.string ();
+
+    SyntheticFace::writeModel (input.database_path, number_side, number_eigenvectors);
+
+    input.target_point_normal_cloud_ptr = SyntheticFace::makeTarget (target_points, input.face_point);
+  }
+
+  if (precision == "float")
+  {
+    timings = runBenchmarks < SinglePrecision > (input, number_eigenvectors, warmup, repetitions, number_model_points);
+  }
+
+  else
+  {
+    timings = runBenchmarks < DoublePrecision > (input, number_eigenvectors, warmup, repetitions, number_model_points);
+  }
+
+  if (!model_path.empty ())
+  {
+    boost::filesystem::remove (model_path);
+  }
+
+  if (json_path.empty ())
+  {
+    writeJson (std::cout, input, precision, number_model_points, number_eigenvectors, repetitions, timings);
+  }
+
+  else
+  {
+    std::ofstream out (json_path.c_str ());
+
+    writeJson (out, input, precision, number_model_points, number_eigenvectors, repetitions, timings);
+
+    PCL_INFO ("Results written to %s\n", json_path.c_str ());
+  }
+
+  return (0);
+}
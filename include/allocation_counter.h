@@ -0,0 +1,36 @@
+#ifndef ALLOCATION_COUNTER_H
+#define ALLOCATION_COUNTER_H
+
+/**
+ * @brief This class counts the calls to the global operator new. The counting is only compiled in when FACE_COUNT_ALLOCATIONS is defined (cmake -DCOUNT_ALLOCATIONS=ON)
+ */
+class AllocationCounter
+{
+  public:
+
+    /**
+     * @brief Method to check if the counting was compiled in
+     * @return True if operator new is being counted
+     */
+
+    static bool
+    isEnabled ();
+
+    /**
+     * @brief Method to get the number of allocations since the start of the program
+     * @return The number of calls to operator new and operator new[], nothrow ones included, 0 if the counting is disabled
+     */
+
+    static unsigned long
+    getCount ();
+
+    /**
+     * @brief Method to get the number of allocations made by the calling thread, which is not disturbed by the other fits running at the same time
+     * @return The number of calls to operator new and operator new[] from this thread, 0 if the counting is disabled
+     */
+
+    static unsigned long
+    getThreadCount ();
+};
+
+#endif // ALLOCATION_COUNTER_H
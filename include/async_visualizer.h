@@ -0,0 +1,151 @@
+#ifndef ASYNC_VISUALIZER_H
+#define ASYNC_VISUALIZER_H
+
+#include <pcl/common/common_headers.h>
+#include <pcl/visualization/pcl_visualizer.h>
+
+#include <boost/thread.hpp>
+
+#include <deque>
+
+/**
+ * @brief This class renders the intermediate steps of the registration on its own thread.
+ * The registration publishes immutable snapshots to a bounded queue and carries on, the viewer thread draws them at its own rate and the oldest snapshots are dropped when the queue is full
+ */
+class AsyncVisualizer
+{
+  public:
+
+    typedef pcl::PointCloud < pcl::PointNormal > Cloud;
+
+    typedef boost::function < void (const pcl::visualization::KeyboardEvent&) > KeyboardCallback;
+
+    /**
+     * @brief One immutable frame of the visualization
+     */
+
+    struct Snapshot
+    {
+      Cloud::ConstPtr model;
+      Cloud::ConstPtr target;
+      boost::shared_ptr < const pcl::Correspondences > correspondences;
+    };
+
+    /**
+     * @brief Creates the viewer thread, which owns the PCLVisualizer
+     * @param [in] The name of the window
+     * @param [in] The maximum number of snapshots waiting to be drawn
+     * @param [in] The time in milliseconds the viewer spends on each frame
+     */
+
+    AsyncVisualizer (const std::string& name, int queue_size = 2, int refresh_period = 30);
+
+    /**
+     * @brief Stops the viewer thread and closes the window
+     */
+
+    ~AsyncVisualizer ();
+
+    /**
+     * @brief Method to set a function to be called from the viewer thread for every key pressed in the window
+     */
+
+    void
+    setKeyboardCallback (KeyboardCallback callback);
+
+    /**
+     * @brief Method to make every publish () wait until the user presses 'n' in the window, so the registration can be followed step by step
+     */
+
+    void
+    setStepMode (bool step_mode);
+
+    /**
+     * @brief Method to hand a new frame to the viewer. The model and the correspondences are copied, the target is shared since it is never modified once set
+     * @param [in] The current model, may be NULL
+     * @param [in] The target, may be NULL
+     * @param [in] The correspondences between the two, may be NULL
+     */
+
+    void
+    publish (const Cloud::ConstPtr& model, const Cloud::ConstPtr& target, const pcl::Correspondences* correspondences = NULL);
+
+    /**
+     * @brief Method to show or hide a sphere, used to mark the center of the face
+     */
+
+    void
+    setMarker (bool visible, const pcl::PointXYZ& center, double radius = 0.025);
+
+    /**
+     * @brief Method to get the number of snapshots that were dropped before being drawn
+     */
+
+    int
+    getDroppedFrames ();
+
+  private:
+
+    /**
+     * @brief The loop of the viewer thread
+     */
+
+    void
+    run ();
+
+    /**
+     * @brief Method to draw one snapshot, called only from the viewer thread. The clouds carry no color, the model is drawn in blue and the target in green
+     */
+
+    void
+    draw (pcl::visualization::PCLVisualizer& visualizer, const Snapshot& snapshot);
+
+    /**
+     * @brief Callback of the PCLVisualizer, called from the viewer thread
+     */
+
+    void
+    keyboardCallback (const pcl::visualization::KeyboardEvent &event, void* viewer_void);
+
+    std::string name_;
+
+    int queue_size_;
+
+    int refresh_period_;
+
+    /**
+     * @brief The snapshots waiting to be drawn
+     */
+
+    std::deque < Snapshot > queue_;
+
+    int dropped_frames_;
+
+    bool marker_visible_;
+
+    bool marker_changed_;
+
+    pcl::PointXYZ marker_center_;
+
+    double marker_radius_;
+
+    bool step_mode_;
+
+    /**
+     * @brief Set by the 'n' key in step mode
+     */
+
+    bool step_requested_;
+
+    bool stop_;
+
+    KeyboardCallback keyboard_callback_;
+
+    boost::mutex mutex_;
+
+    boost::condition_variable step_condition_;
+
+    boost::thread thread_;
+};
+
+#endif // ASYNC_VISUALIZER_H
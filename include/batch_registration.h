@@ -0,0 +1,228 @@
+#ifndef BATCH_REGISTRATION_H
+#define BATCH_REGISTRATION_H
+
+#include "registration.h"
+#include "bounded_queue.h"
+
+#include <pcl/console/time.h>
+
+#include <boost/function.hpp>
+#include <boost/thread.hpp>
+
+#include <string>
+#include <vector>
+
+/**
+ * @brief This class fits one shared StatisticalModel on many targets read from .pcd files. The targets go through a pipeline of four stages linked by bounded queues: load, preprocess (crop, normals and kdtree), fit and write.
+ * Every stage has its own threads, so the targets ahead are read and prepared while the current ones are fitted. Every fit thread owns one Registration which is reused for all its targets, so only the deformed vertices and the buffers of the fit are per thread
+ * @tparam PolicyT ScalarPolicy which determines the precision of the fitting (SinglePrecision or DoublePrecision)
+ */
+template <typename PolicyT>
+class BatchRegistration
+{
+  public:
+
+    /**
+     * @brief The fit applied to every target, called once the model is aligned on the face
+     * @return The residual of the fit
+     */
+
+    typedef boost::function < double (Registration < PolicyT >&) > FitFunction;
+
+    /**
+     * @brief The stages of the pipeline, in the order the targets go through them
+     */
+
+    enum Stage
+    {
+      LOAD_STAGE,
+      PREPROCESS_STAGE,
+      FIT_STAGE,
+      WRITE_STAGE,
+      NUMBER_STAGES
+    };
+
+    /**
+     * @param [in] The model, which is only read by the threads
+     * @param [in] The number of fit threads, 0 to use one per core
+     */
+
+    BatchRegistration (typename StatisticalModel<PolicyT>::ConstPtr model_ptr, int number_threads = 0);
+
+    /**
+     * @brief Method to add a target to the batch
+     * @param [in] Path to the .pcd file of the target
+     * @param [in] The center of the face in the target
+     * @param [in] Path to which the result is written, as by Registration::writeDataToPCD()
+     */
+
+    void
+    addJob (std::string target_path, pcl::PointXYZ face_point, std::string result_path);
+
+    /**
+     * @brief Method to add the targets listed in a manifest or found in a directory.
+     * Every line of a manifest holds the path of a .pcd file followed by the x, y and z of the face, the paths being relative to the manifest. In a directory every target.pcd needs a target_face.txt holding the x, y and z of the face
+     * @param [in] Path to the manifest or to the directory
+     * @param [in] The results are written to this path followed by _ and the name of the target
+     */
+
+    void
+    readJobs (std::string jobs_path, std::string result_prefix);
+
+    /**
+     * @brief Method to set the thresholds used by the Registration of every thread, see Registration::setConvergenceThresholds()
+     */
+
+    void
+    setConvergenceThresholds (double rotation_threshold, double translation_threshold, double coefficient_threshold, double relative_residual_threshold);
+
+    /**
+     * @brief Method to set the number of threads of a stage, 1 by default except for the fit
+     */
+
+    void
+    setStageThreads (Stage stage, int number_threads);
+
+    /**
+     * @brief Method to set how many targets may wait in front of each stage, 4 by default
+     */
+
+    void
+    setQueueCapacity (int queue_capacity);
+
+    /**
+     * @brief Method to keep only the points of a target within a distance of its face, 0 by default to keep all of them
+     */
+
+    void
+    setCropRadius (double crop_radius);
+
+    /**
+     * @brief Method to fit all the targets and to report the latency of every job, the throughput of the batch and, for every stage, its utilization and the depth of the queue in front of it
+     * @param [in] The fit applied to every target
+     * @return The number of jobs which failed
+     */
+
+    int
+    run (const FitFunction& fit);
+
+    /**
+     * @brief Method to get the number of jobs
+     */
+
+    int
+    getNumberJobs ();
+
+  private:
+
+    /**
+     * @brief A target of the batch and, once it is fitted, the outcome
+     */
+
+    struct Job
+    {
+      std::string target_path;
+      pcl::PointXYZ face_point;
+      std::string result_path;
+
+      bool succeeded;
+      int number_points;
+      double latency;
+      double fit_time;
+      double residual;
+
+      pcl::console::TicToc timer;
+    };
+
+    /**
+     * @brief What is handed from one stage to the next. The clouds are shared, every stage only adds to them
+     */
+
+    struct Item
+    {
+      int job;
+      pcl::PointCloud<pcl::PointNormal>::Ptr target_point_normal_cloud_ptr;
+      pcl::search::KdTree<pcl::PointNormal>::Ptr kdtree_ptr;
+      pcl::PointCloud<pcl::PointNormal>::Ptr result_point_normal_cloud_ptr;
+    };
+
+    typedef BoundedQueue < Item > ItemQueue;
+
+    /**
+     * @brief The loops of the threads of every stage, each one runs until the queue in front of it is closed and empty
+     */
+
+    void
+    loadLoop ();
+
+    void
+    preprocessLoop ();
+
+    void
+    fitLoop (const FitFunction& fit);
+
+    void
+    writeLoop ();
+
+    /**
+     * @brief Method called by every thread of a stage when it is done. It adds the time the thread was busy and the last thread of the stage closes the queue behind it
+     */
+
+    void
+    finishStage (Stage stage, double busy_time);
+
+    /**
+     * @brief Method to keep the points within crop_radius_ of the face, the invalid points are dropped as well
+     */
+
+    void
+    cropTarget (const pcl::PointCloud<pcl::PointNormal>& target, pcl::PointXYZ face_point, pcl::PointCloud<pcl::PointNormal>& cropped_target);
+
+    typename StatisticalModel<PolicyT>::ConstPtr model_ptr_;
+
+    /**
+     * @brief The convergence thresholds, applied if has_thresholds_ is set
+     */
+
+    bool has_thresholds_;
+
+    double rotation_threshold_;
+
+    double translation_threshold_;
+
+    double coefficient_threshold_;
+
+    double relative_residual_threshold_;
+
+    int queue_capacity_;
+
+    double crop_radius_;
+
+    std::vector < Job > jobs_;
+
+    /**
+     * @brief The index of the next job to be loaded, guarded by stage_mutex_
+     */
+
+    int next_job_;
+
+    /**
+     * @brief The queue in front of every stage after the load
+     */
+
+    boost::shared_ptr < ItemQueue > queues_[NUMBER_STAGES];
+
+    /**
+     * @brief The threads of every stage, the threads still running and the time they have been busy, guarded by stage_mutex_
+     */
+
+    int stage_threads_[NUMBER_STAGES];
+
+    int running_threads_[NUMBER_STAGES];
+
+    double busy_times_[NUMBER_STAGES];
+
+    boost::mutex stage_mutex_;
+};
+
+#endif // BATCH_REGISTRATION_H
@@ -0,0 +1,192 @@
+#ifndef BOUNDED_QUEUE_H
+#define BOUNDED_QUEUE_H
+
+#include <boost/thread.hpp>
+
+#include <algorithm>
+#include <deque>
+
+/**
+ * @brief Queue between two stages of a pipeline, shared by any number of producer and consumer threads. A producer waits while the queue is full, so a fast stage never runs further ahead of a slow one than the capacity allows
+ */
+template <typename T>
+class BoundedQueue
+{
+  public:
+
+    /**
+     * @param [in] The maximum number of items held
+     */
+
+    BoundedQueue (int capacity)
+    {
+      capacity_ = std::max (1, capacity);
+      closed_ = false;
+      number_pushes_ = 0;
+      depth_sum_ = 0.0;
+      maximum_depth_ = 0;
+    }
+
+    /**
+     * @brief Method to add an item, waiting while the queue is full
+     * @return False if the queue was closed, the item is then dropped
+     */
+
+    bool
+    push (const T& item)
+    {
+      boost::mutex::scoped_lock lock (mutex_);
+
+      while (static_cast<int> (items_.size ()) >= capacity_ && !closed_)
+      {
+        not_full_.wait (lock);
+      }
+
+      if (closed_)
+      {
+        return (false);
+      }
+
+      /* The depth is sampled whenever an item arrives, a queue which stays full means the consumers are the bottleneck */
+
+      items_.push_back (item);
+
+      ++number_pushes_;
+      depth_sum_ += items_.size ();
+      maximum_depth_ = std::max (maximum_depth_, static_cast<int> (items_.size ()));
+
+      not_empty_.notify_one ();
+
+      return (true);
+    }
+
+    /**
+     * @brief Method to add an item only if there is room for it, without waiting
+     * @return False if the queue is full or closed, the item is then dropped
+     */
+
+    bool
+    tryPush (const T& item)
+    {
+      boost::mutex::scoped_lock lock (mutex_);
+
+      if (static_cast<int> (items_.size ()) >= capacity_ || closed_)
+      {
+        return (false);
+      }
+
+      items_.push_back (item);
+
+      ++number_pushes_;
+      depth_sum_ += items_.size ();
+      maximum_depth_ = std::max (maximum_depth_, static_cast<int> (items_.size ()));
+
+      not_empty_.notify_one ();
+
+      return (true);
+    }
+
+    /**
+     * @brief Method to get the number of items held
+     */
+
+    int
+    getDepth ()
+    {
+      boost::mutex::scoped_lock lock (mutex_);
+      return (static_cast<int> (items_.size ()));
+    }
+
+    /**
+     * @brief Method to take the oldest item, waiting while the queue is empty
+     * @return False once the queue is closed and empty
+     */
+
+    bool
+    pop (T& item)
+    {
+      boost::mutex::scoped_lock lock (mutex_);
+
+      while (items_.empty () && !closed_)
+      {
+        not_empty_.wait (lock);
+      }
+
+      if (items_.empty ())
+      {
+        return (false);
+      }
+
+      item = items_.front ();
+      items_.pop_front ();
+
+      not_full_.notify_one ();
+
+      return (true);
+    }
+
+    /**
+     * @brief Method to tell the consumers that no item will follow, the items still held are delivered first
+     */
+
+    void
+    close ()
+    {
+      boost::mutex::scoped_lock lock (mutex_);
+
+      closed_ = true;
+
+      not_empty_.notify_all ();
+      not_full_.notify_all ();
+    }
+
+    int
+    getCapacity ()
+    {
+      return (capacity_);
+    }
+
+    /**
+     * @brief Method to get the average number of items held, sampled at every push
+     */
+
+    double
+    getMeanDepth ()
+    {
+      boost::mutex::scoped_lock lock (mutex_);
+      return (number_pushes_ > 0 ? depth_sum_ / number_pushes_ : 0.0);
+    }
+
+    /**
+     * @brief Method to get the largest number of items held at once
+     */
+
+    int
+    getMaximumDepth ()
+    {
+      boost::mutex::scoped_lock lock (mutex_);
+      return (maximum_depth_);
+    }
+
+  private:
+
+    std::deque < T > items_;
+
+    int capacity_;
+
+    bool closed_;
+
+    long number_pushes_;
+
+    double depth_sum_;
+
+    int maximum_depth_;
+
+    boost::mutex mutex_;
+
+    boost::condition_variable not_empty_;
+
+    boost::condition_variable not_full_;
+};
+
+#endif // BOUNDED_QUEUE_H
@@ -1,10 +1,12 @@
 #ifndef CAMERA_GRABBER_H
 #define CAMERA_GRABBER_H
 
+#include "frame_source.h"
+#include "face_locator.h"
+
 #include <pcl/common/common_headers.h>
 #include <pcl/common/geometry.h>
 #include <pcl/io/pcd_io.h>
-#include <pcl/io/openni_grabber.h>
 #include <pcl/visualization/pcl_visualizer.h>
 
 #include <cstdlib>
@@ -16,7 +18,8 @@
 #include <opencv2/imgproc/imgproc.hpp>
 
 /**
- * @brief This class returns a simple point cloud and the coordinates of a face in the point cloud
+ * @brief This class returns a simple point cloud and the coordinates of a face in the point cloud.
+ * The source keeps running between the calls of getPointCloud(), so every call only waits for the next frame
  */
 class CameraGrabber
 {
@@ -25,50 +28,44 @@ class CameraGrabber
     CameraGrabber ();
 
     /**
-     * @brief Method for the
-     * @param [in] OpenCV code for the type of sensor to be used
-     * @param [in] path to the XML file containing the haarcascade file.
+     * @brief Stops the source
      */
 
-    void
-    setCamera (int device, std::string file_classifier);
+    ~CameraGrabber ();
 
     /**
-     * @brief Method to return the point cloud and the coordinates in the point cloud for the center of the face
-     * @param Reference for the std::pair in which the face coordinates are stored
-     * @return Pointer to the cloud obtained from the camera
+     * @brief Method to set the source of the frames and to start it
+     * @param [in] The source, either the Kinect/Xtion or a recording standing in for it
+     * @param [in] The method used to find the face
      */
 
-    pcl::PointCloud <pcl::PointXYZRGB >::Ptr
-    getPointCloud (std::pair < int, int >& center_coordinates);
-
-
-  private:
+    void
+    setCamera (FrameSource::Ptr source, FaceLocator::Ptr face_locator);
 
     /**
-     * @brief OpenCV VideoCapture
+     * @brief Method to return the point cloud and the center of the face.
+     * It waits for the frames of the source and uses the first one in which a face is found, the depth and the gray image of a frame being captured together
+     * @param [out] The center of the face
+     * @return Pointer to the cloud obtained from the camera, shared with the source and never modified
      */
 
-    cv::VideoCapture video_grabber_;
+    pcl::PointCloud <pcl::PointXYZ >::ConstPtr
+    getPointCloud (pcl::PointXYZ& face_center);
 
-    /**
-     * @brief OpenCV CascadeClassifier
-     */
-    cv::CascadeClassifier face_classifier_;
+
+  private:
 
     /**
-     * @brief DataStrucutre in which the scaned pointcloud is stored
+     * @brief The source of the depth and gray frames
      */
 
-    pcl::PointCloud <pcl::PointXYZRGB >::Ptr point_cloud_ptr_;
+    FrameSource::Ptr source_;
 
     /**
-     * @brief Callback method for the OpenNIGrabber
-     *
+     * @brief The method used to find the face
      */
 
-    void
-    getCloud (const pcl::PointCloud<pcl::PointXYZ>::ConstPtr &cloud);
+    FaceLocator::Ptr face_locator_ptr_;
 };
 
 #endif // CAMERA_GRABBER_H
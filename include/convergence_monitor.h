@@ -0,0 +1,89 @@
+#ifndef CONVERGENCE_MONITOR_H
+#define CONVERGENCE_MONITOR_H
+
+/**
+ * @brief This class decides when an iterative part of the fit has settled.
+ * It is considered converged when both the pose and the coefficients stopped changing, or when the residual stopped decreasing
+ */
+class ConvergenceMonitor
+{
+  public:
+
+    ConvergenceMonitor ();
+
+    /**
+     * @brief Method to set the thresholds under which a change is considered to be zero
+     * @param [in] The rotation angle of an update, in radians
+     * @param [in] The norm of the translation of an update
+     * @param [in] The norm of the change of the coefficients, measured in standard deviations of the model
+     * @param [in] The change of the residual relative to its previous value
+     */
+
+    void
+    setThresholds (double rotation_threshold, double translation_threshold, double coefficient_threshold, double relative_residual_threshold);
+
+    /**
+     * @brief Method to start monitoring a new loop
+     * @param [in] The number of iterations the loop would run without the monitor
+     */
+
+    void
+    reset (int maximum_iterations);
+
+    /**
+     * @brief Method to be called after every iteration of the loop
+     * @param [in] The rotation angle applied in this iteration
+     * @param [in] The norm of the translation applied in this iteration
+     * @param [in] The norm of the change of the coefficients in this iteration, 0 if the loop does not change them
+     * @param [in] The residual of this iteration
+     * @return True if the loop can stop
+     */
+
+    bool
+    update (double rotation_change, double translation_change, double coefficient_change, double residual);
+
+    /**
+     * @brief Method to check if the last update found the loop converged
+     */
+
+    bool
+    hasConverged () const;
+
+    /**
+     * @brief Method to get the number of iterations done since the last reset
+     */
+
+    int
+    getIterations () const;
+
+    /**
+     * @brief Method to get the number of iterations that were not run thanks to the monitor since the last reset
+     */
+
+    int
+    getIterationsSaved () const;
+
+  private:
+
+    double rotation_threshold_;
+
+    double translation_threshold_;
+
+    double coefficient_threshold_;
+
+    double relative_residual_threshold_;
+
+    /**
+     * @brief The residual of the previous iteration, negative if there was none
+     */
+
+    double previous_residual_;
+
+    int maximum_iterations_;
+
+    int iterations_;
+
+    bool converged_;
+};
+
+#endif // CONVERGENCE_MONITOR_H
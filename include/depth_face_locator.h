@@ -0,0 +1,86 @@
+#ifndef DEPTH_FACE_LOCATOR_H
+#define DEPTH_FACE_LOCATOR_H
+
+#include "face_locator.h"
+
+/**
+ * @brief FaceLocator which uses only the depth. The nearest surface in front of the sensor is grown into a blob, which is accepted as the head if its size fits a head.
+ * It needs neither the gray image nor the cascade
+ */
+class DepthFaceLocator : public FaceLocator
+{
+  public:
+
+    DepthFaceLocator ();
+
+    /**
+     * @brief Method to set the range of depths in which the head is searched
+     * @param [in] The nearest depth, closer points are ignored
+     * @param [in] The farthest depth
+     */
+
+    void
+    setDepthRange (double minimum_depth, double maximum_depth);
+
+    /**
+     * @brief Method to set the size of the head
+     * @param [in] The distance from the tip of the nose within which the points belong to the head
+     * @param [in] The smallest width and height of the blob to be accepted as a head, smaller blobs such as a hand in front of the face are skipped
+     */
+
+    void
+    setHeadSize (double head_radius, double minimum_head_width);
+
+    bool
+    locate (const Frame& frame, pcl::PointXYZ& face_center);
+
+    bool
+    needsGrayImage ();
+
+    void
+    printLatency (const Frame& frame, double latency);
+
+  private:
+
+    /**
+     * @brief Method to grow a blob from a seed over the neighboring pixels whose depth is continuous
+     * @param [in] The organized cloud
+     * @param [in] The index of the seed
+     * @param [out] The indices of the points of the blob
+     */
+
+    void
+    growBlob (const pcl::PointCloud<pcl::PointXYZ>& cloud, int seed, std::vector<int>& blob);
+
+    double minimum_depth_;
+
+    double maximum_depth_;
+
+    double head_radius_;
+
+    double minimum_head_width_;
+
+    /**
+     * @brief The biggest difference of depth between two neighboring pixels of the same blob
+     */
+
+    double maximum_depth_jump_;
+
+    /**
+     * @brief The maximum number of blobs tried in one frame
+     */
+
+    int maximum_attempts_;
+
+    /**
+     * @brief Buffers reused between the frames
+     */
+
+    std::vector < unsigned char > visited_;
+
+    std::vector < int > blob_;
+
+    std::vector < int > stack_;
+};
+
+#endif // DEPTH_FACE_LOCATOR_H
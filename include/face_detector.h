@@ -0,0 +1,161 @@
+#ifndef FACE_DETECTOR_H
+#define FACE_DETECTOR_H
+
+#include <pcl/common/common_headers.h>
+
+#include <opencv2/objdetect/objdetect.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+
+#include <boost/thread/mutex.hpp>
+
+/**
+ * @brief This class detects the face in the gray images with the Haar cascade of OpenCV.
+ * Once a face is found, the next image is only searched in a padded window around it, at a reduced resolution. The whole image is searched only to find the face again when it is lost
+ */
+class FaceDetector
+{
+  public:
+
+    /**
+     * @brief A loaded cascade, with the lock which serializes its use by the detectors that share it
+     */
+
+    struct Cascade
+    {
+      cv::CascadeClassifier classifier;
+      boost::mutex mutex;
+    };
+
+    FaceDetector ();
+
+    /**
+     * @brief Method to load the cascade. Every cascade file is parsed only once per process, the detectors which use the same file share it
+     * @param [in] Path to the XML file of the cascade
+     */
+
+    void
+    load (std::string file_classifier);
+
+    /**
+     * @brief Method to set the resolution at which the images are searched
+     * @param [in] Factor applied to the size of the image, 1.0 searches the image at full resolution
+     */
+
+    void
+    setScale (double scale);
+
+    /**
+     * @brief Method to enable the search around the previous face. With the tracking disabled and a scale of 1.0 every image is searched whole, as before
+     */
+
+    void
+    setTracking (bool tracking);
+
+    /**
+     * @brief Method to set the padding of the search window
+     * @param [in] The padding added on each side of the previous face, as a fraction of its size
+     */
+
+    void
+    setPadding (double padding);
+
+    /**
+     * @brief Method to find the face in an image
+     * @param [in] The gray image
+     * @param [out] The biggest face found, in the coordinates of the full image
+     * @return True if a face was found
+     */
+
+    bool
+    detect (const cv::Mat& gray, cv::Rect& face);
+
+    /**
+     * @brief Method to forget the previous face, so the next image is searched whole
+     */
+
+    void
+    reset ();
+
+    /**
+     * @brief Method to get the time spent in the last call of detect (), in milliseconds
+     */
+
+    double
+    getLastLatency ();
+
+    /**
+     * @brief Method to check if the last call of detect () searched the whole image
+     */
+
+    bool
+    wasFullSearch ();
+
+    /**
+     * @brief Method to get the average time of all the calls of detect (), in milliseconds
+     */
+
+    double
+    getAverageLatency ();
+
+  private:
+
+    /**
+     * @brief Method to get the cascade of a file, loading it if no other detector uses it
+     * @param [in] Path to the XML file of the cascade
+     * @return The cascade or NULL if the file could not be loaded
+     */
+
+    static boost::shared_ptr < Cascade >
+    getCascade (const std::string& file_classifier);
+
+    /**
+     * @brief Method to search one window of the image
+     * @param [in] The gray image
+     * @param [in] The window to be searched
+     * @param [in] The smallest face searched for, at full resolution
+     * @param [in] The biggest face searched for, at full resolution, or an empty size for no limit
+     * @param [out] The biggest face found, in the coordinates of the full image
+     * @return True if a face was found
+     */
+
+    bool
+    searchWindow (const cv::Mat& gray, const cv::Rect& window, cv::Size minimum_size, cv::Size maximum_size, cv::Rect& face);
+
+    /**
+     * @brief The shared cascade
+     */
+
+    boost::shared_ptr < Cascade > cascade_ptr_;
+
+    /**
+     * @brief Buffers reused between the images
+     */
+
+    cv::Mat scaled_image_;
+
+    cv::Mat equalized_image_;
+
+    double scale_;
+
+    double padding_;
+
+    bool tracking_;
+
+    /**
+     * @brief The face found in the previous image, valid if has_face_ is set
+     */
+
+    cv::Rect last_face_;
+
+    bool has_face_;
+
+    bool full_search_;
+
+    double last_latency_;
+
+    double total_latency_;
+
+    int number_detections_;
+};
+
+#endif // FACE_DETECTOR_H
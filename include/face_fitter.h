@@ -0,0 +1,215 @@
+#ifndef FACE_FITTER_H
+#define FACE_FITTER_H
+
+#include "registration.h"
+#include "statistical_model.h"
+
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+#include <pcl/kdtree/kdtree_flann.h>
+
+#include <vector>
+
+/**
+ * @brief A depth image owned by the caller, read in place by FaceFitter
+ */
+struct DepthBuffer
+{
+  enum Format {UINT16, FLOAT};
+
+  /**
+   * @brief The first pixel of the image, row after row
+   */
+
+  const void* data;
+
+  Format format;
+
+  int width;
+
+  int height;
+
+  /**
+   * @brief The number of bytes from one row to the next, 0 if the rows are contiguous
+   */
+
+  int stride;
+
+  /**
+   * @brief The meters per unit of a pixel, e.g. 0.001 for millimeters. Pixels equal to 0, and for FLOAT not finite, have no measurement
+   */
+
+  float depth_scale;
+
+  DepthBuffer ();
+};
+
+/**
+ * @brief The pinhole intrinsics of the depth camera, in pixels
+ */
+struct CameraIntrinsics
+{
+  float fx;
+
+  float fy;
+
+  float cx;
+
+  float cy;
+};
+
+/**
+ * @brief The rectangle of the face in the depth image, in pixels
+ */
+struct FaceRectangle
+{
+  int x;
+
+  int y;
+
+  int width;
+
+  int height;
+};
+
+/**
+ * @brief The result of a fit, written by FaceFitter into the storage given by the caller
+ */
+struct FitResult
+{
+  /**
+   * @brief The rigid transformation of the model, by rows
+   */
+
+  float pose[16];
+
+  double residual;
+
+  /**
+   * @brief The number of points back-projected from the rectangle
+   */
+
+  int number_target_points;
+
+  /**
+   * @brief The coefficients of the eigenvectors, coefficient_capacity of them at most are written to coefficients, which may be NULL. number_coefficients is their actual number
+   */
+
+  float* coefficients;
+
+  int coefficient_capacity;
+
+  int number_coefficients;
+
+  /**
+   * @brief The vertices of the fitted face as x, y, z, vertex_capacity of them at most are written to vertices, which may be NULL. number_vertices is their actual number
+   */
+
+  float* vertices;
+
+  int vertex_capacity;
+
+  int number_vertices;
+
+  FitResult ();
+};
+
+/**
+ * @brief In-process entry point of the fitting, for embedding it without writing the target to a file.
+ * The pixels of the face rectangle are back-projected straight from the buffer of the caller into a cloud kept by the fitter, so after the first call a fit allocates nothing for its target.
+ * A FaceFitter is used by one thread at a time; several of them may share one model
+ * @tparam PolicyT ScalarPolicy which determines the precision of the fitting (SinglePrecision or DoublePrecision)
+ */
+template <typename PolicyT>
+class FaceFitter
+{
+  public:
+
+    /**
+     * @param [in] The model, which is only read
+     */
+
+    FaceFitter (typename StatisticalModel<PolicyT>::ConstPtr model_ptr);
+
+    /**
+     * @brief Method to set the fit, see FitServer::setFitParameters()
+     */
+
+    void
+    setFitParameters (bool joint, int joint_iterations, double energy_weight, double angle_limit, double distance_limit);
+
+    /**
+     * @brief Method to set the thresholds of the Registration, see Registration::setConvergenceThresholds()
+     */
+
+    void
+    setConvergenceThresholds (double rotation_threshold, double translation_threshold, double coefficient_threshold, double relative_residual_threshold);
+
+    /**
+     * @brief Method to set which pixels of the rectangle are kept: the ones within depth_range meters of the median depth of the rectangle, so the background seen around the head is left out. 0 keeps every pixel
+     */
+
+    void
+    setDepthRange (float depth_range);
+
+    /**
+     * @brief Method to fit the model on the face in a depth image
+     * @param [in] The depth image, it is not copied and must stay valid during the call
+     * @param [in] The intrinsics of the camera which took it
+     * @param [in] The face, it is clipped to the image
+     * @param [out] The result, written in the storage it points to
+     * @return False if the rectangle holds too few measurements to fit, the result is then left untouched
+     */
+
+    bool
+    fit (const DepthBuffer& depth, const CameraIntrinsics& intrinsics, const FaceRectangle& rectangle, FitResult& result);
+
+  private:
+
+    /**
+     * @brief Method to back-project the rectangle into target_point_normal_cloud_ptr_
+     * @return The center of the face, with a NaN z if the rectangle has no measurement
+     */
+
+    pcl::PointXYZ
+    backProject (const DepthBuffer& depth, const CameraIntrinsics& intrinsics, int u_begin, int v_begin, int u_end, int v_end);
+
+    /**
+     * @brief Method to read one pixel in meters, NaN if it has no measurement
+     */
+
+    static float
+    readDepth (const DepthBuffer& depth, int stride, int u, int v);
+
+    Registration < PolicyT > registration_;
+
+    typename StatisticalModel<PolicyT>::ConstPtr model_ptr_;
+
+    /**
+     * @brief The target and its kdtree, reused from one fit to the next
+     */
+
+    pcl::PointCloud<pcl::PointNormal>::Ptr target_point_normal_cloud_ptr_;
+
+    pcl::search::KdTree<pcl::PointNormal>::Ptr kdtree_ptr_;
+
+    /**
+     * @brief The depths of the rectangle, used for the median
+     */
+
+    std::vector < float > depths_;
+
+    bool joint_;
+
+    int joint_iterations_;
+
+    double energy_weight_;
+
+    double angle_limit_;
+
+    double distance_limit_;
+
+    float depth_range_;
+};
+
+#endif // FACE_FITTER_H
@@ -0,0 +1,45 @@
+#ifndef FACE_LOCATOR_H
+#define FACE_LOCATOR_H
+
+#include "frame_source.h"
+
+/**
+ * @brief Interface for the methods which find the center of the face in a frame
+ */
+class FaceLocator
+{
+  public:
+
+    typedef boost::shared_ptr < FaceLocator > Ptr;
+
+    virtual
+    ~FaceLocator () {}
+
+    /**
+     * @brief Method to find the center of the face
+     * @param [in] The frame
+     * @param [out] The center of the face, in the coordinates of the cloud of the frame
+     * @return True if a face was found
+     */
+
+    virtual bool
+    locate (const Frame& frame, pcl::PointXYZ& face_center) = 0;
+
+    /**
+     * @brief Method to check if the locator needs the gray image of the frames
+     */
+
+    virtual bool
+    needsGrayImage () = 0;
+
+    /**
+     * @brief Method to print the latency of the last call of locate () at the debug level of the PCL console
+     * @param [in] The frame the face was searched in
+     * @param [in] The time of the call measured by the caller, in milliseconds
+     */
+
+    virtual void
+    printLatency (const Frame& frame, double latency) = 0;
+};
+
+#endif // FACE_LOCATOR_H
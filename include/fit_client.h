@@ -0,0 +1,73 @@
+#ifndef FIT_CLIENT_H
+#define FIT_CLIENT_H
+
+#include "local_socket.h"
+
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+
+#include <string>
+
+/**
+ * @brief Client of a FitServer. Every method opens a connection, sends one request and returns the whole response as it was received, see FitServer for the protocol
+ */
+class FitClient
+{
+  public:
+
+    /**
+     * @param [in] The path of the socket the server listens on
+     */
+
+    FitClient (std::string socket_path);
+
+    /**
+     * @brief Method to fit the target read by the server from a .pcd file
+     * @param [in] The path of the target, as seen by the server
+     * @param [in] The center of the face in the target
+     * @param [in] The options of the request separated by spaces, e.g. "joint=1 mesh=1", may be empty
+     * @param [out] The response
+     * @return False if the server could not be reached
+     */
+
+    bool
+    fit (std::string target_path, pcl::PointXYZ face_point, std::string options, std::string& response);
+
+    /**
+     * @brief Method to fit a target sent along with the request, only the coordinates of the points are sent
+     */
+
+    bool
+    fitPoints (const pcl::PointCloud<pcl::PointXYZ>& target, pcl::PointXYZ face_point, std::string options, std::string& response);
+
+    /**
+     * @brief Method to get the counters of the server
+     */
+
+    bool
+    getStats (std::string& response);
+
+    /**
+     * @brief Method to stop the server once the requests it has admitted are done
+     */
+
+    bool
+    stop (std::string& response);
+
+  private:
+
+    /**
+     * @brief Method to send a request and to wait for the response
+     * @param [in] The line of the request, without the newline
+     * @param [in] The bytes following the line, may be NULL
+     * @param [in] The number of bytes following the line
+     * @param [out] The response
+     */
+
+    bool
+    request (const std::string& line, const void* payload, size_t size, std::string& response);
+
+    std::string socket_path_;
+};
+
+#endif // FIT_CLIENT_H
@@ -0,0 +1,203 @@
+#ifndef FIT_SERVER_H
+#define FIT_SERVER_H
+
+#include "registration.h"
+#include "bounded_queue.h"
+#include "local_socket.h"
+
+#include <pcl/console/time.h>
+
+#include <boost/thread.hpp>
+
+#include <string>
+
+/**
+ * @brief Long-lived server which keeps one StatisticalModel in memory and fits it on the targets sent over a Unix domain socket, so the model is read once instead of for every fit.
+ * Every connection carries one request, a line of text optionally followed by a buffer of points, and gets one response before it is closed:
+ *
+ *   FIT <target.pcd> <x> <y> <z> [options]              fits the target read from the file, the face being at x, y, z
+ *   POINTS <number points> <x> <y> <z> [options]        fits the points following the line, as x, y, z floats in the byte order of the host, at most MAXIMUM_POINTS
+ *   STATS                                               reports the counters of the server
+ *   STOP                                                stops the server once the admitted requests are done
+ *
+ * The options are joint=0|1, iterations=<joint iterations>, energy_weight=<weight> and mesh=1, the defaults being the ones given to setFitParameters().
+ * A fit is answered by OK <latency ms> <residual>, then POSE and the 16 elements of the pose by rows, COEFFICIENTS with their number and values, with mesh=1 MESH with the number of vertices and faces followed by one line per vertex and per face, and END.
+ * A request which cannot be served is answered by ERROR <reason>, and by BUSY if max_pending requests are waiting already.
+ * The line is read by the accepting thread, which gives a client one second for it; the points are only read by the thread which fits them, so a large or slow upload never holds up the admission of the other requests
+ * @tparam PolicyT ScalarPolicy which determines the precision of the fitting (SinglePrecision or DoublePrecision)
+ */
+template <typename PolicyT>
+class FitServer
+{
+  public:
+
+    /**
+     * @param [in] The model, which is only read by the threads
+     * @param [in] The number of threads fitting the requests, 0 to use one per core
+     * @param [in] The number of requests which may wait for a thread, the following ones are turned away
+     */
+
+    FitServer (typename StatisticalModel<PolicyT>::ConstPtr model_ptr, int number_threads = 0, int max_pending = 8);
+
+    /**
+     * @brief Method to set the fit used when a request does not say otherwise
+     * @param [in] True for the joint solver, false for the alternating Rigid and Non Rigid Registrations
+     * @param [in] The number of iterations of the joint solver
+     * @param [in] The weight to which the Regulating Energy is multiplied by
+     * @param [in] The maximum allowed difference between the normals of two points to be considered correspondences
+     * @param [in] The maximum distance between two points to be considered correspondences
+     */
+
+    void
+    setFitParameters (bool joint, int joint_iterations, double energy_weight, double angle_limit, double distance_limit);
+
+    /**
+     * @brief Method to set the thresholds used by the Registration of every thread, see Registration::setConvergenceThresholds()
+     */
+
+    void
+    setConvergenceThresholds (double rotation_threshold, double translation_threshold, double coefficient_threshold, double relative_residual_threshold);
+
+    /**
+     * @brief Method to serve the requests until STOP is received
+     * @param [in] Path of the socket, an existing file there is replaced
+     * @return False if the socket could not be opened
+     */
+
+    bool
+    run (std::string socket_path);
+
+    /**
+     * @brief The largest number of points a POINTS request may send, more than a whole depth frame
+     */
+
+    static const int MAXIMUM_POINTS = 1000000;
+
+  private:
+
+    /**
+     * @brief A request admitted for a fit, with the connection on which it is answered
+     */
+
+    struct Request
+    {
+      LocalSocket::Ptr socket;
+      std::string target_path;
+      pcl::PointCloud<pcl::PointNormal>::Ptr target_point_normal_cloud_ptr;
+      pcl::PointXYZ face_point;
+
+      /**
+       * @brief The number of points following the line of a POINTS request, 0 for the others
+       */
+
+      int number_points;
+
+      bool joint;
+      int joint_iterations;
+      double energy_weight;
+      bool mesh;
+
+      pcl::console::TicToc timer;
+    };
+
+    /**
+     * @brief Method to read the line of a request from a new connection, on the accepting thread
+     * @param [in] The connection
+     * @param [out] The command
+     * @param [out] The request, filled in for FIT and POINTS except for the points themselves
+     * @param [out] The reason if the request is malformed
+     * @return False if the request is malformed
+     */
+
+    bool
+    readRequest (LocalSocket& socket, std::string& command, Request& request, std::string& error);
+
+    /**
+     * @brief Method to read the points of a POINTS request into its target, on the thread which fits it
+     * @return False if the client did not send them all in time
+     */
+
+    bool
+    readPoints (Request& request);
+
+    /**
+     * @brief The loop of every fit thread
+     */
+
+    void
+    workerLoop ();
+
+    /**
+     * @brief Method to fit one request with the Registration of the thread and to answer it
+     */
+
+    void
+    serveFit (Registration < PolicyT >& registration, Request& request);
+
+    /**
+     * @brief Method to format the counters of the server
+     */
+
+    std::string
+    getStats ();
+
+    typename StatisticalModel<PolicyT>::ConstPtr model_ptr_;
+
+    int number_threads_;
+
+    /**
+     * @brief The fit used when a request does not say otherwise
+     */
+
+    bool joint_;
+
+    int joint_iterations_;
+
+    double energy_weight_;
+
+    double angle_limit_;
+
+    double distance_limit_;
+
+    /**
+     * @brief The convergence thresholds, applied if has_thresholds_ is set
+     */
+
+    bool has_thresholds_;
+
+    double rotation_threshold_;
+
+    double translation_threshold_;
+
+    double coefficient_threshold_;
+
+    double relative_residual_threshold_;
+
+    /**
+     * @brief The requests admitted and waiting for a thread
+     */
+
+    BoundedQueue < Request > queue_;
+
+    /**
+     * @brief The counters reported by STATS, guarded by stats_mutex_
+     */
+
+    int served_requests_;
+
+    int failed_requests_;
+
+    int rejected_requests_;
+
+    int running_requests_;
+
+    double total_latency_;
+
+    double maximum_latency_;
+
+    pcl::console::TicToc uptime_timer_;
+
+    boost::mutex stats_mutex_;
+};
+
+#endif // FIT_SERVER_H
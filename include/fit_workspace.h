@@ -0,0 +1,235 @@
+#ifndef FIT_WORKSPACE_H
+#define FIT_WORKSPACE_H
+
+#include "scalar_policy.h"
+
+#include <pcl/correspondence.h>
+
+#include <vector>
+
+/**
+ * @brief Block of memory from which the buffers of a FitWorkspace are carved out. The block only grows, so once a fit is set up the following iterations never touch the heap
+ */
+class WorkspaceArena
+{
+  public:
+
+    WorkspaceArena ();
+
+    ~WorkspaceArena ();
+
+    /**
+     * @brief Method to make sure the arena can hold at least the given number of bytes. All the buffers handed out before are lost if the arena has to grow
+     * @param [in] The number of bytes needed
+     * @return True if the arena had to grow
+     */
+
+    bool
+    reserve (size_t number_bytes);
+
+    /**
+     * @brief Method to forget all the buffers handed out so far, without releasing the memory
+     */
+
+    void
+    reset ();
+
+    /**
+     * @brief Method to hand out an aligned buffer from the arena
+     * @param [in] The number of elements of the buffer
+     * @return Pointer to the buffer or NULL if the arena is too small
+     */
+
+    template <typename T> T*
+    allocate (size_t count)
+    {
+      size_t offset = (offset_ + ALIGNMENT - 1) & ~ (ALIGNMENT - 1);
+
+      if (offset + count * sizeof (T) > capacity_)
+      {
+        return (NULL);
+      }
+
+      offset_ = offset + count * sizeof (T);
+
+      return (reinterpret_cast<T*> (data_ + offset));
+    }
+
+    /**
+     * @brief Method to get the size of the arena in bytes
+     */
+
+    size_t
+    getCapacity () const;
+
+    /**
+     * @brief The alignment of every buffer, large enough for the vectorized Eigen code
+     */
+
+    static const size_t ALIGNMENT = 16;
+
+  private:
+
+    WorkspaceArena (const WorkspaceArena&);
+
+    WorkspaceArena&
+    operator= (const WorkspaceArena&);
+
+    unsigned char* data_;
+
+    size_t capacity_;
+
+    size_t offset_;
+};
+
+/**
+ * @brief This class holds every buffer used by the iterations of the Registration, so that calculateAlternativeRegistrations() allocates only when the fit starts
+ * @tparam PolicyT ScalarPolicy of the Registration that owns the workspace
+ */
+template <typename PolicyT>
+class FitWorkspace
+{
+  public:
+
+    typedef typename PolicyT::Scalar Scalar;
+    typedef typename PolicyT::MatrixX MatrixX;
+    typedef typename PolicyT::VectorX VectorX;
+    typedef typename PolicyT::Vector6 Vector6;
+    typedef typename PolicyT::Matrix6 Matrix6;
+
+    FitWorkspace ();
+
+    /**
+     * @brief Method to size the workspace for a model. It only allocates if the model is bigger than anything seen before
+     * @param [in] Number of points of the model
+     * @param [in] Number of eigenvectors used by the Non Rigid Registration
+     */
+
+    void
+    reserve (int number_points, int number_eigenvectors);
+
+    /**
+     * @brief The left side of the regularized Non Rigid system, only the lower triangle is filled
+     */
+
+    Eigen::Map < MatrixX, Eigen::Aligned >
+    getNonRigidSystem (int number_eigenvectors);
+
+    /**
+     * @brief The right side of the Non Rigid system
+     */
+
+    Eigen::Map < VectorX, Eigen::Aligned >
+    getNonRigidRightSide (int number_eigenvectors);
+
+    /**
+     * @brief One row of the Non Rigid Jacobian
+     */
+
+    Eigen::Map < VectorX, Eigen::Aligned >
+    getJacobianRow (int number_eigenvectors);
+
+    /**
+     * @brief The coefficients of the eigenvectors calculated in one Non Rigid step
+     */
+
+    Eigen::Map < VectorX, Eigen::Aligned >
+    getCoefficients (int number_eigenvectors);
+
+    /**
+     * @brief The left side of the joint system, the 6 pose parameters followed by the coefficients of the eigenvectors. It shares its memory with the Non Rigid system
+     */
+
+    Eigen::Map < MatrixX, Eigen::Aligned >
+    getJointSystem (int number_eigenvectors);
+
+    /**
+     * @brief The right side of the joint system
+     */
+
+    Eigen::Map < VectorX, Eigen::Aligned >
+    getJointRightSide (int number_eigenvectors);
+
+    /**
+     * @brief One row of the joint Jacobian
+     */
+
+    Eigen::Map < VectorX, Eigen::Aligned >
+    getJointJacobianRow (int number_eigenvectors);
+
+    /**
+     * @brief The pose parameters and coefficients calculated in one joint step
+     */
+
+    Eigen::Map < VectorX, Eigen::Aligned >
+    getJointSolution (int number_eigenvectors);
+
+    /**
+     * @brief The area-weighted sum of the normals of the quads around each point of the model, stored as x,y,z for each point
+     */
+
+    Eigen::Map < VectorX, Eigen::Aligned >
+    getNormalAccumulator ();
+
+    /**
+     * @brief The left side of the linearized Rigid system
+     */
+
+    Matrix6 rigid_system;
+
+    /**
+     * @brief The right side of the linearized Rigid system
+     */
+
+    Vector6 rigid_right_side;
+
+    /**
+     * @brief Solver for the Rigid system, it is fixed-size so it never allocates
+     */
+
+    Eigen::LDLT < Matrix6 > rigid_solver;
+
+    /**
+     * @brief Solver for the Non Rigid system, its storage is reused between the steps
+     */
+
+    Eigen::LDLT < MatrixX > non_rigid_solver;
+
+    /**
+     * @brief Solver for the joint system
+     */
+
+    Eigen::LDLT < MatrixX > joint_solver;
+
+    /**
+     * @brief The correspondences of the current iteration
+     */
+
+    pcl::Correspondences correspondences;
+
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+  private:
+
+    WorkspaceArena arena_;
+
+    int number_points_;
+
+    int number_eigenvectors_;
+
+    /**
+     * @brief The system buffers are sized for the joint system, the Non Rigid maps use only their first part
+     */
+
+    Scalar* system_;
+
+    Scalar* right_side_;
+
+    Scalar* jacobian_row_;
+
+    Scalar* solution_;
+
+    Scalar* normal_accumulator_;
+};
+
+#endif // FIT_WORKSPACE_H
@@ -0,0 +1,165 @@
+#ifndef FRAME_SOURCE_H
+#define FRAME_SOURCE_H
+
+#include <pcl/common/common_headers.h>
+
+#include <opencv2/core/core.hpp>
+
+#include <vector>
+
+/**
+ * @brief One frame delivered by a FrameSource
+ */
+struct Frame
+{
+  /**
+   * @brief Position of the frame in the stream, starting at 0
+   */
+
+  unsigned int index;
+
+  /**
+   * @brief Capture time in seconds
+   */
+
+  double timestamp;
+
+  /**
+   * @brief Time in seconds of FrameSource::getTime () at which the source received the frame, the start of its latency through the tracker
+   */
+
+  double receive_time;
+
+  /**
+   * @brief The size of the depth image
+   */
+
+  int width;
+
+  int height;
+
+  /**
+   * @brief The focal length in pixels used to back-project the depth
+   */
+
+  float focal_length;
+
+  /**
+   * @brief The organized point cloud of the frame. Sources which deliver only the depth leave it empty, it is then made by getCloud ()
+   */
+
+  pcl::PointCloud < pcl::PointXYZ >::ConstPtr cloud;
+
+  /**
+   * @brief The raw depth of every pixel in millimeters, 0 where the sensor has no measurement. It has width * height elements
+   */
+
+  boost::shared_ptr < const std::vector < unsigned short > > depth;
+
+  /**
+   * @brief The gray image used to detect the face, empty if the source has none
+   */
+
+  cv::Mat gray;
+
+  Frame ();
+
+  /**
+   * @brief Method to get the organized point cloud of the frame. If the source did not deliver it, the whole depth image is back-projected on every call, so the result should be kept by the caller
+   */
+
+  pcl::PointCloud < pcl::PointXYZ >::ConstPtr
+  getCloud () const;
+
+  /**
+   * @brief Method to get the point of a single pixel without back-projecting the whole frame
+   * @param [in] The column of the pixel
+   * @param [in] The row of the pixel
+   * @param [out] The point
+   * @return False if the pixel is outside of the image or has no measurement
+   */
+
+  bool
+  getPoint (int u, int v, pcl::PointXYZ& point) const;
+};
+
+/**
+ * @brief Interface for everything that produces depth frames, either a live sensor or a recording
+ */
+class FrameSource
+{
+  public:
+
+    typedef boost::shared_ptr < FrameSource > Ptr;
+
+    virtual
+    ~FrameSource () {}
+
+    /**
+     * @brief Method to start producing frames
+     */
+
+    virtual void
+    start () = 0;
+
+    /**
+     * @brief Method to stop producing frames
+     */
+
+    virtual void
+    stop () = 0;
+
+    /**
+     * @brief Method to get the next frame. The frames are never modified after they are returned, so they can be kept by the caller
+     * @param [out] The frame
+     * @param [in] Maximum time to wait for the frame, in milliseconds
+     * @return True if a frame was returned, false on timeout or at the end of a recording
+     */
+
+    virtual bool
+    grab (Frame& frame, int timeout) = 0;
+
+    /**
+     * @brief Method to check if the source will not deliver any more frames
+     */
+
+    virtual bool
+    isFinished () = 0;
+
+    /**
+     * @brief Method to get the number of frames which were skipped because the consumer was too slow
+     */
+
+    virtual unsigned int
+    getDroppedFrames () = 0;
+
+    /**
+     * @brief Method to get the time of the host clock in seconds, the clock of Frame::receive_time
+     */
+
+    static double
+    getTime ();
+
+    /**
+     * @brief Method to turn a depth image into an organized point cloud, with the principal point in the middle of the image
+     * @param [in] The depth in millimeters, 0 for invalid pixels
+     * @param [in] The width of the image
+     * @param [in] The height of the image
+     * @param [in] The focal length in pixels
+     * @return The cloud, with NaN for the invalid pixels
+     */
+
+    static pcl::PointCloud < pcl::PointXYZ >::Ptr
+    backProject (const std::vector < unsigned short >& depth, int width, int height, float focal_length);
+
+    /**
+     * @brief Method to get the depth image of an organized point cloud
+     * @param [in] The cloud
+     * @return The depth in millimeters, 0 for the NaN points
+     */
+
+    static boost::shared_ptr < std::vector < unsigned short > >
+    extractDepth (const pcl::PointCloud < pcl::PointXYZ >& cloud);
+};
+
+#endif // FRAME_SOURCE_H
@@ -0,0 +1,68 @@
+#ifndef FUSION_BACKEND_H
+#define FUSION_BACKEND_H
+
+#include "frame_source.h"
+
+#include <Eigen/Geometry>
+
+/**
+ * @brief Interface for the methods which fuse the depth frames into a volume and track the camera meanwhile. The coordinates of the volume have their origin in one corner of it
+ */
+class FusionBackend
+{
+  public:
+
+    typedef boost::shared_ptr < FusionBackend > Ptr;
+
+    virtual
+    ~FusionBackend () {}
+
+    /**
+     * @brief Method to track the camera in a frame and fuse the frame into the volume
+     * @param [in] The frame
+     * @return False if the camera was lost in the frame, it is then not fused
+     */
+
+    virtual bool
+    integrate (const Frame& frame) = 0;
+
+    /**
+     * @brief Method to get the pose of the camera in the last frame, in the coordinates of the volume
+     */
+
+    virtual Eigen::Affine3f
+    getCameraPose () = 0;
+
+    /**
+     * @brief Method to tell the backend where the face is, so it may leave out the rest of the scene
+     * @param [in] The center of the face, in the coordinates of the volume
+     */
+
+    virtual void
+    setFaceCenter (const Eigen::Vector3f& face_center) {}
+
+    /**
+     * @brief Method to get the surface stored in the volume
+     * @param [out] The points of the surface, in the coordinates of the volume
+     */
+
+    virtual void
+    extractCloud (pcl::PointCloud < pcl::PointXYZ >& cloud) = 0;
+
+    /**
+     * @brief Method to get a measure of the surface fused so far, which grows as new parts of the face are seen
+     * @return The measure, 0 if the backend cannot tell
+     */
+
+    virtual size_t
+    getSurfaceSize () { return (0); }
+
+    /**
+     * @brief Method to get a printable name of the backend
+     */
+
+    virtual const char*
+    getName () = 0;
+};
+
+#endif // FUSION_BACKEND_H
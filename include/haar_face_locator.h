@@ -0,0 +1,41 @@
+#ifndef HAAR_FACE_LOCATOR_H
+#define HAAR_FACE_LOCATOR_H
+
+#include "face_locator.h"
+#include "face_detector.h"
+
+/**
+ * @brief FaceLocator which detects the face in the gray image with the Haar cascade and takes the point of the cloud under the center of the face
+ */
+class HaarFaceLocator : public FaceLocator
+{
+  public:
+
+    /**
+     * @param [in] Path to the XML file of the cascade
+     */
+
+    HaarFaceLocator (std::string file_classifier);
+
+    bool
+    locate (const Frame& frame, pcl::PointXYZ& face_center);
+
+    bool
+    needsGrayImage ();
+
+    void
+    printLatency (const Frame& frame, double latency);
+
+    /**
+     * @brief Method to get the detector of the face, to configure it
+     */
+
+    FaceDetector&
+    getFaceDetector ();
+
+  private:
+
+    FaceDetector face_detector_;
+};
+
+#endif // HAAR_FACE_LOCATOR_H
@@ -0,0 +1,50 @@
+#ifndef KINFU_BACKEND_H
+#define KINFU_BACKEND_H
+
+#include "fusion_backend.h"
+
+#include <pcl/gpu/kinfu/kinfu.h>
+
+/**
+ * @brief FusionBackend running the pcl::gpu::KinfuTracker on the graphics card. It is only built with the CMake option WITH_KINFU
+ */
+class KinfuBackend : public FusionBackend
+{
+  public:
+
+    /**
+     * @param [in] The length of the edges of the volume in meters, the camera starts in the middle of the front face of it
+     */
+
+    KinfuBackend (float volume_size = 1.2f);
+
+    bool
+    integrate (const Frame& frame);
+
+    Eigen::Affine3f
+    getCameraPose ();
+
+    void
+    extractCloud (pcl::PointCloud < pcl::PointXYZ >& cloud);
+
+    const char*
+    getName ();
+
+  private:
+
+    pcl::gpu::KinfuTracker kinfu_;
+
+    /**
+     * @brief The depth of the frame on the graphics card
+     */
+
+    pcl::gpu::KinfuTracker::DepthMap depth_device_;
+
+    /**
+     * @brief Buffer on the graphics card to which the surface is extracted
+     */
+
+    pcl::gpu::DeviceArray<pcl::PointXYZ> cloud_buffer_device_;
+};
+
+#endif // KINFU_BACKEND_H
@@ -0,0 +1,63 @@
+#ifndef LATENCY_HISTOGRAM_H
+#define LATENCY_HISTOGRAM_H
+
+#include <boost/thread/mutex.hpp>
+
+#include <vector>
+
+/**
+ * @brief Histogram of latencies in milliseconds with buckets growing by 10 percent from 10 microseconds up, so the percentiles are known within 10 percent whatever the range. It can be filled by one thread while others read it
+ */
+class LatencyHistogram
+{
+  public:
+
+    LatencyHistogram ();
+
+    /**
+     * @brief Method to count one latency
+     * @param [in] The latency in milliseconds
+     */
+
+    void
+    add (double latency);
+
+    /**
+     * @brief Method to forget all the latencies counted so far
+     */
+
+    void
+    reset ();
+
+    unsigned long
+    getCount () const;
+
+    double
+    getMean () const;
+
+    double
+    getMaximum () const;
+
+    /**
+     * @brief Method to get a percentile of the latencies
+     * @param [in] The percentile, between 0 and 100
+     * @return The upper bound of the bucket holding the percentile, never more than the maximum, 0 if nothing was counted
+     */
+
+    double
+    getPercentile (double percentile) const;
+
+  private:
+
+    std::vector < unsigned long > buckets_;
+
+    unsigned long count_;
+
+    double sum_;
+
+    double maximum_;
+
+    mutable boost::mutex mutex_;
+};
+
+#endif // LATENCY_HISTOGRAM_H
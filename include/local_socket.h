@@ -0,0 +1,128 @@
+#ifndef LOCAL_SOCKET_H
+#define LOCAL_SOCKET_H
+
+#include <boost/shared_ptr.hpp>
+
+#include <string>
+
+/**
+ * @brief Stream socket in the Unix domain, used between the FitServer and its clients. The socket is closed when the object is destroyed
+ */
+class LocalSocket
+{
+  public:
+
+    typedef boost::shared_ptr < LocalSocket > Ptr;
+
+    /**
+     * @param [in] The descriptor of an open socket, owned by the object afterwards
+     */
+
+    explicit LocalSocket (int descriptor);
+
+    ~LocalSocket ();
+
+    /**
+     * @brief Method to connect to a listening socket
+     * @param [in] The path of the socket
+     * @return The connection, or an empty pointer if nobody listens there
+     */
+
+    static Ptr
+    connect (const std::string& path);
+
+    /**
+     * @brief Method to listen on a path, an existing file there is replaced
+     * @param [in] The path of the socket
+     * @param [in] The number of connections which may wait to be accepted
+     * @return The listening socket, or an empty pointer if the path cannot be bound
+     */
+
+    static Ptr
+    listen (const std::string& path, int backlog);
+
+    /**
+     * @brief Method to wait for the next connection on a listening socket
+     * @return The connection, or an empty pointer on failure
+     */
+
+    Ptr
+    accept ();
+
+    /**
+     * @brief Method to limit the time all the following reads may take together, so a peer sending a byte now and then cannot hold a reader longer than that
+     * @param [in] The time from now, in seconds
+     */
+
+    void
+    setDeadline (double seconds);
+
+    /**
+     * @brief Method to read up to the next newline, which is dropped
+     * @return False if the connection was closed, the deadline passed or the line is longer than MAXIMUM_LINE
+     */
+
+    bool
+    readLine (std::string& line);
+
+    /**
+     * @brief Method to read exactly the given number of bytes
+     */
+
+    bool
+    readBytes (void* data, size_t size);
+
+    /**
+     * @brief Method to read until the other side closes the connection. A peer closing without reading all that was sent to it ends the data as well
+     */
+
+    bool
+    readAll (std::string& data);
+
+    /**
+     * @brief Method to write all the given bytes
+     */
+
+    bool
+    writeBytes (const void* data, size_t size);
+
+    bool
+    writeString (const std::string& data);
+
+    /**
+     * @brief Method to tell the other side that nothing more is written, the reading goes on
+     */
+
+    void
+    shutdownWrite ();
+
+    static const int MAXIMUM_LINE = 4096;
+
+  private:
+
+    /**
+     * @brief Method to wait until data can be read or the deadline passes
+     * @return False if the deadline passed first
+     */
+
+    bool
+    waitForData ();
+
+    int descriptor_;
+
+    /**
+     * @brief The deadline of the reads on the monotonic clock in seconds, if has_deadline_ is set
+     */
+
+    bool has_deadline_;
+
+    double deadline_;
+
+    /**
+     * @brief The path a listening socket is bound to, removed when it is closed
+     */
+
+    std::string path_;
+};
+
+#endif // LOCAL_SOCKET_H
@@ -0,0 +1,140 @@
+#ifndef OPENNI_FRAME_SOURCE_H
+#define OPENNI_FRAME_SOURCE_H
+
+#include "frame_source.h"
+
+#include <pcl/io/openni_grabber.h>
+#include <pcl/io/openni_camera/openni_depth_image.h>
+#include <pcl/io/openni_camera/openni_image.h>
+
+#include <boost/atomic.hpp>
+
+/**
+ * @brief FrameSource for a live Kinect or Xtion. The callbacks of the OpenNIGrabber push the frames into a small ring without taking a lock, grab () returns the newest one and skips the older ones.
+ * The depth buffers are allocated with the first frame and reused afterwards, the point cloud is not back-projected here. The gray image is delivered if the device has a color stream.
+ * There must be only one thread calling grab ()
+ */
+class OpenNIFrameSource : public FrameSource
+{
+  public:
+
+    /**
+     * @param [in] False to use only the depth stream, even if the device has a color stream
+     */
+
+    OpenNIFrameSource (bool gray_image = true);
+
+    ~OpenNIFrameSource ();
+
+    void
+    start ();
+
+    void
+    stop ();
+
+    bool
+    grab (Frame& frame, int timeout);
+
+    bool
+    isFinished ();
+
+    /**
+     * @brief Method to get the number of frames which were not grabbed, the sum of getOverflowFrames () and getSkippedFrames ()
+     */
+
+    unsigned int
+    getDroppedFrames ();
+
+    /**
+     * @brief Method to get the number of frames which were thrown away by the callback because the ring was full
+     */
+
+    unsigned int
+    getOverflowFrames ();
+
+    /**
+     * @brief Method to get the number of frames in the ring which were skipped by grab () because a newer one was there
+     */
+
+    unsigned int
+    getSkippedFrames ();
+
+  private:
+
+    typedef boost::shared_ptr<openni_wrapper::DepthImage> DepthImagePtr;
+
+    typedef boost::shared_ptr<openni_wrapper::Image> ImagePtr;
+
+    /**
+     * @brief Callback method for the OpenNIGrabber, used when the device has a color stream
+     */
+
+    void
+    imageDepthCallback (const ImagePtr& image, const DepthImagePtr& depth_image, float constant);
+
+    /**
+     * @brief Callback method for the OpenNIGrabber, used for devices with a depth stream only
+     */
+
+    void
+    depthCallback (const DepthImagePtr& depth_image);
+
+    /**
+     * @brief Method to store a new frame, called from the callbacks
+     */
+
+    void
+    storeFrame (const ImagePtr& image, const DepthImagePtr& depth_image);
+
+    /**
+     * @brief Method to get a depth buffer which is not held by anybody else, only called from the callbacks
+     * @param [in] The number of pixels of the depth image
+     */
+
+    boost::shared_ptr < std::vector < unsigned short > >
+    getFreeDepthBuffer (int size);
+
+    pcl::OpenNIGrabber::Ptr grabber_;
+
+    /**
+     * @brief The number of slots of the ring
+     */
+
+    static const unsigned int RING_SIZE = 4;
+
+    /**
+     * @brief The frames between read_index_ and write_index_ are waiting to be grabbed. A slot belongs to the callback until write_index_ passes it and to grab () until read_index_ passes it
+     */
+
+    Frame ring_[RING_SIZE];
+
+    /**
+     * @brief Counters of the frames written and read, the slot is the counter modulo RING_SIZE
+     */
+
+    boost::atomic < unsigned int > write_index_;
+
+    boost::atomic < unsigned int > read_index_;
+
+    /**
+     * @brief The depth buffers handed out with the frames, a buffer is reused once the consumer has released it
+     */
+
+    std::vector < boost::shared_ptr < std::vector < unsigned short > > > depth_buffers_;
+
+    unsigned int frame_counter_;
+
+    boost::atomic < unsigned int > overflow_frames_;
+
+    boost::atomic < unsigned int > skipped_frames_;
+
+    /**
+     * @brief Only used to let grab () sleep until a frame arrives, the ring itself is not protected by it
+     */
+
+    boost::mutex wait_mutex_;
+
+    boost::condition_variable frame_condition_;
+};
+
+#endif // OPENNI_FRAME_SOURCE_H
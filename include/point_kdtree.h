@@ -0,0 +1,80 @@
+#ifndef POINT_KDTREE_H
+#define POINT_KDTREE_H
+
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+
+#include <vector>
+
+/**
+ * @brief Kdtree over the coordinates of a cloud which answers nearest neighbour queries without touching the heap. The queries of pcl::search::KdTree allocate their
+ * result vectors and FLANN allocates a distance vector inside every search, so the correspondences of the Registration are looked up here instead
+ */
+class PointKdTree
+{
+  public:
+
+    PointKdTree ();
+
+    /**
+     * @brief Method to build the tree over a cloud. The coordinates are copied, the points which are not finite are left out, and the buffers of a previous tree are
+     * reused, so it only allocates if the cloud is bigger than anything seen before
+     * @param [in] The cloud to be indexed
+     */
+
+    void
+    setInputCloud (const pcl::PointCloud<pcl::PointNormal>& cloud);
+
+    /**
+     * @brief Method to find the point of the cloud which is closest to a query point
+     * @param [in] The query point
+     * @param [out] The index of the closest point in the cloud given to setInputCloud()
+     * @param [out] The squared distance to the closest point
+     * @return False if the tree is empty
+     */
+
+    bool
+    nearest (const pcl::PointNormal& point, int& index, float& squared_distance) const;
+
+    /**
+     * @brief Method to get the number of points in the tree
+     */
+
+    int
+    size () const;
+
+  private:
+
+    /**
+     * @brief Method to split a range of order_ at its median and to split both halves again, down to the leaves
+     */
+
+    void
+    build (const pcl::PointCloud<pcl::PointNormal>& cloud, int begin, int end);
+
+    /**
+     * @brief The coordinates of the points, stored as x,y,z in the order of the tree. The node of a range is the point in its middle
+     */
+
+    std::vector < float > coordinates_;
+
+    /**
+     * @brief The index in the cloud of each point of the tree
+     */
+
+    std::vector < int > indices_;
+
+    /**
+     * @brief The dimension each node splits its range on
+     */
+
+    std::vector < unsigned char > split_dimensions_;
+
+    /**
+     * @brief Order of the points while the tree is built
+     */
+
+    std::vector < int > order_;
+};
+
+#endif // POINT_KDTREE_H
@@ -0,0 +1,189 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include "allocation_counter.h"
+
+#include <boost/atomic.hpp>
+
+#include <limits>
+#include <string>
+
+/**
+ * @brief Records the time and the counters of the stages of the fits, from every thread, into a file given by -profile.
+ * The events are written either one JSON object per line or as a Chrome trace (chrome://tracing, Perfetto). Until open() is called nothing is recorded and a ProfileScope costs one test
+ */
+class Profiler
+{
+  public:
+
+    enum Format {JSON_LINES, CHROME_TRACE};
+
+    /**
+     * @brief One timed stage
+     */
+
+    struct Event
+    {
+      /**
+       * @brief The name of the stage, a string literal
+       */
+
+      const char* name;
+
+      int thread;
+
+      /**
+       * @brief Start and duration in microseconds, the start being counted from open()
+       */
+
+      double start;
+
+      double duration;
+
+      /**
+       * @brief The counters, -1 (NaN for the residual) where the stage does not set them
+       */
+
+      int iteration;
+
+      int points;
+
+      int correspondences;
+
+      int rejected;
+
+      double residual;
+
+      long allocations;
+    };
+
+    /**
+     * @brief Method to start recording into a file, which is overwritten
+     * @return False if the file could not be opened
+     */
+
+    static bool
+    open (const std::string& path, Format format);
+
+    /**
+     * @brief Method to write the events left and to stop recording, called at exit once open () succeeded
+     */
+
+    static void
+    close ();
+
+    static bool
+    isEnabled ()
+    {
+      return (enabled_);
+    }
+
+    /**
+     * @brief Method to get the time since open () in microseconds
+     */
+
+    static double
+    getTime ();
+
+    /**
+     * @brief Method to get a small number for the calling thread, the same for all its events
+     */
+
+    static int
+    getThread ();
+
+    /**
+     * @brief Method to record an event, it is written to the file in batches
+     */
+
+    static void
+    record (const Event& event);
+
+  private:
+
+    /**
+     * @brief Read without the lock by every fitting thread, while close () clears it at exit
+     */
+
+    static boost::atomic < bool > enabled_;
+};
+
+/**
+ * @brief Times the stage of the scope it is declared in and records it with its counters when the scope ends
+ */
+class ProfileScope
+{
+  public:
+
+    /**
+     * @param [in] The name of the stage, a string literal
+     * @param [in] The iteration of the stage, -1 if it is not part of a loop
+     */
+
+    ProfileScope (const char* name, int iteration = -1)
+    {
+      active_ = Profiler::isEnabled ();
+
+      if (active_)
+      {
+        event_.name = name;
+        event_.iteration = iteration;
+        event_.points = -1;
+        event_.correspondences = -1;
+        event_.rejected = -1;
+        event_.residual = std::numeric_limits<double>::quiet_NaN ();
+        event_.allocations = AllocationCounter::isEnabled () ? static_cast<long> (AllocationCounter::getThreadCount ()) : -1;
+        event_.start = Profiler::getTime ();
+      }
+    }
+
+    ~ProfileScope ()
+    {
+      if (active_)
+      {
+        event_.duration = Profiler::getTime () - event_.start;
+
+        /* Counted before getThread (), which allocates the index of a new thread */
+
+        if (event_.allocations >= 0)
+        {
+          event_.allocations = static_cast<long> (AllocationCounter::getThreadCount ()) - event_.allocations;
+        }
+
+        event_.thread = Profiler::getThread ();
+
+        Profiler::record (event_);
+      }
+    }
+
+    void
+    setPoints (int points)
+    {
+      event_.points = points;
+    }
+
+    /**
+     * @brief Method to set the correspondences kept and the ones rejected by the distance and the angle limits
+     */
+
+    void
+    setCorrespondences (int correspondences, int rejected)
+    {
+      event_.correspondences = correspondences;
+      event_.rejected = rejected;
+    }
+
+    void
+    setResidual (double residual)
+    {
+      event_.residual = residual;
+    }
+
+  private:
+
+    bool active_;
+
+    Profiler::Event event_;
+};
+
+#endif // PROFILER_H
@@ -1,23 +1,40 @@
 #ifndef REGISTRATION_H
 #define REGISTRATION_H
 
-#include "position_model.h"
+#include "statistical_model.h"
+#include "scalar_policy.h"
+#include "fit_workspace.h"
+#include "point_kdtree.h"
 #include "camera_grabber.h"
 #include "tracker.h"
 #include <pcl/io/pcd_io.h>
 #include <pcl/kdtree/kdtree_flann.h>
 #include <pcl/filters/statistical_outlier_removal.h>
 #include <pcl/features/normal_3d.h>
-#include <pcl/registration/default_convergence_criteria.h>
+#include "convergence_monitor.h"
+#include "async_visualizer.h"
+#include "frame_source.h"
+
+#include <deque>
 
 
 /**
  * @brief This class returns the shaped, statistical model
+ * @tparam PolicyT ScalarPolicy which determines the precision of the fitting (SinglePrecision or DoublePrecision)
  */
+template <typename PolicyT>
 class Registration
 {
   public:
 
+    typedef typename PolicyT::Scalar Scalar;
+    typedef typename PolicyT::MatrixX MatrixX;
+    typedef typename PolicyT::VectorX VectorX;
+    typedef typename PolicyT::Matrix3 Matrix3;
+    typedef typename PolicyT::Matrix4 Matrix4;
+    typedef typename PolicyT::Vector3 Vector3;
+    typedef typename PolicyT::Vector6 Vector6;
+
     Registration ();
     /**
      * @brief Deprecated method used for debugging in the first stages
@@ -39,13 +56,27 @@ class Registration
     getDataForModel (std::string database_path, Eigen::MatrixX3d transformation_matrix, Eigen::Vector3d translation, double scale);
 
     /**
-     * @brief Method for a simple scanning of a face and for determining the coordinates of the face
-     * @param [in] device OpenCV code for the type of device used for scanning. FOr example: CV_CAP_OPENNI_ASUS
-     * @param [in] file_classifier Path to the XML file used by the OpenCV face detection function
+     * @brief Method to fit a model which was already read, e.g. one shared with other Registration objects. The fit starts again from the mean face
+     * @param [in] The model, which is only read
+     */
+
+    void
+    setModel (typename StatisticalModel<PolicyT>::ConstPtr model_ptr);
+
+    /**
+     * @brief Method to get the model which is fitted
+     */
+
+    typename StatisticalModel<PolicyT>::ConstPtr
+    getModel ();
+
+    /**
+     * @brief Method for a simple scanning of a face and for determining the coordinates of the face with the locator set by setFaceLocator(). The source is started on the first call and kept running for the following ones
+     * @param [in] source The source of the frames, either the Kinect/Xtion or a recording standing in for it
      */
 
     void
-    getTargetPointCloudFromCamera (int device, std::string file_classifier);
+    getTargetPointCloudFromCamera (FrameSource::Ptr source);
 
     /**
      * @brief Deprecated method to get the target point-cloud from a .pcd file
@@ -55,6 +86,34 @@ class Registration
     void
     getTargetPointCloudFromFile (std::string pcd_file, pcl::PointXYZ face_point);
 
+    /**
+     * @brief Method to make a cloud the target, its normals are calculated in place
+     * @param [in] The target, shared and not copied
+     * @param [in] The center of the face in the target, used by alignModel()
+     */
+
+    void
+    setTargetPointCloud (pcl::PointCloud<pcl::PointNormal>::Ptr target_point_normal_cloud_ptr, pcl::PointXYZ face_point);
+
+    /**
+     * @brief Method to index a cloud with a kdtree and to calculate its normals in place, without making it the target. It uses no member, so the targets can be prepared on other threads than the fit
+     * @param [in] The scaned pointcloud, its normals are overwritten
+     * @param [in] The kdtree which indexes it afterwards
+     */
+
+    static void
+    prepareTarget (pcl::PointCloud<pcl::PointNormal>::Ptr target_point_normal_cloud_ptr, pcl::search::KdTree<pcl::PointNormal>::Ptr kdtree_ptr);
+
+    /**
+     * @brief Method to make a cloud prepared by prepareTarget() the target, nothing is calculated again
+     * @param [in] The target, shared and not copied
+     * @param [in] The kdtree of the target
+     * @param [in] The center of the face in the target, used by alignModel()
+     */
+
+    void
+    setPreparedTarget (pcl::PointCloud<pcl::PointNormal>::Ptr target_point_normal_cloud_ptr, pcl::search::KdTree<pcl::PointNormal>::Ptr kdtree_ptr, pcl::PointXYZ face_point);
+
     /**
      * @brief Method to apply the Rigid Registration on the statistical model by operating on iteration_source_point_normal_cloud_ptr_
      * @param [in] Number of maximum iterations to apply
@@ -92,17 +151,132 @@ class Registration
     void
     calculateAlternativeRegistrations (int number_eigenvectors, double reg_weight, int number_of_total_iterations, int number_of_rigid_iterations, double angle_limit, double distance_limit, bool visualize = false);
 
+    /**
+     * @brief Method to estimate the pose and the shape together. Every iteration solves one regularized system for the 6 pose parameters and the coefficients of the eigenvectors, using a single set of correspondences
+     * @param [in] Number of Eigenvectors to be used for the shape
+     * @param [in] The weight to which the Regulating Energy is multiplied by
+     * @param [in] Number of iterations to apply
+     * @param [in] The maximum allowed difference between the normals of two points to be considered correspondences
+     * @param [in] The maximum distance between two points to be considered correspondences
+     * @param [in] Boolean to set the PCLVisualizer to debug mode
+     */
+
+    void
+    calculateJointRegistration (int number_eigenvectors, double reg_weight, int number_of_iterations, double angle_limit, double distance_limit, bool visualize = false);
+
+    /**
+     * @brief Method to set when the Rigid Registration, the joint solver and the outer loop of calculateAlternativeRegistrations() are considered converged
+     * @param [in] The rotation angle of an update, in radians, under which the pose is considered unchanged
+     * @param [in] The norm of the translation of an update under which the pose is considered unchanged
+     * @param [in] The norm of the update of the coefficients, in standard deviations of the model, under which the shape is considered unchanged
+     * @param [in] The relative change of the residual under which the fit is considered stalled
+     */
+
+    void
+    setConvergenceThresholds (double rotation_threshold, double translation_threshold, double coefficient_threshold, double relative_residual_threshold);
+
+    /**
+     * @brief Method to get how many times the correspondences between the model and the target were searched for since the object was created
+     * @return The number of correspondence passes
+     */
+
+    int
+    getCorrespondencePasses ();
+
+    /**
+     * @brief Method to check if the last calculateAlternativeRegistrations() or calculateJointRegistration() stopped because the fit settled, rather than because it ran out of iterations or correspondences
+     */
+
+    bool
+    hasConverged ();
 
     /**
      * @brief Method to scan the target point-cloud using the Kinfu Algorithm
+     * @param [in] The source of the depth and gray frames, either a live sensor or a recording
+     * @param [in] The method used to fuse the frames, the KinfuTracker on the graphics card or the TsdfFusion on the CPU
      * @param [in] Number of Eigenvectors to be used in the Non-Rigid Registration step
      * @param [in] Regularizing to be used in the Non-Rigid Registration step
      * @param [in] Number of iterations to apply the Rigid Registration
      * @param [in] The angle limit used for both Registration types
      * @param [in] The maximum distance to be used for both the registration steps
+     * @param [in] False to run without the window, which needs the scan policy of setScanPolicy() since no key can be pressed. It then runs until the source is finished
      */
     void
-    calculateKinfuTrackerRegistrations (int device, int number_eigenvectors, double reg_weight, int number_of_rigid_iterations, double angle_limit, double distance_limit);
+    calculateKinfuTrackerRegistrations (FrameSource::Ptr source, FusionBackend::Ptr fusion, int number_eigenvectors, double reg_weight, int number_of_rigid_iterations, double angle_limit, double distance_limit,
+                                        bool visualize = true);
+
+    /**
+     * @brief Method to let calculateKinfuTrackerRegistrations() scan and fit on its own instead of waiting for ' p ' and ' t '. The first scan gets the whole fit, every following one a short joint refinement starting from the previous fit
+     * @param [in] The distance the camera has to move for a new scan, in meters, 0 to disable
+     * @param [in] The angle the camera has to turn for a new scan, in radians, 0 to disable
+     * @param [in] The growth of the fused surface for a new scan, relative to the one of the last scan, 0 to disable
+     * @param [in] Maximum number of iterations of the joint solver for each refinement
+     */
+
+    void
+    setScanPolicy (float translation_threshold, float rotation_threshold, float surface_growth, int refinement_iterations);
+
+    /**
+     * @brief Method to set the latency above which calculateKinfuTrackerRegistrations() counts a frame as late, see Tracker::setLateThreshold()
+     * @param [in] The latency in milliseconds
+     */
+
+    void
+    setLateThreshold (double late_threshold);
+
+    /**
+     * @brief Method to fit the model on every frame delivered by a FrameSource. Each frame starts from the pose and the shape of the previous one, so a few iterations of the joint solver are enough to follow the face
+     * @param [in] The source of the frames, either a live sensor or a recording
+     * @param [in] Number of Eigenvectors to be used for the shape
+     * @param [in] The weight to which the Regulating Energy is multiplied by
+     * @param [in] Number of iterations of the joint solver on the first frame, where the model is only roughly aligned
+     * @param [in] Maximum number of iterations of the joint solver on the following frames
+     * @param [in] The maximum allowed difference between the normals of two points to be considered correspondences
+     * @param [in] The maximum distance between two points to be considered correspondences
+     * @param [in] Distance around the model within which the points of a frame are kept as target
+     * @param [in] Path to the file where the pose and the coefficients of every frame are written
+     * @param [in] Boolean to show the fit of every frame in the PCLVisualizer
+     */
+
+    void
+    calculateStreamingRegistrations (FrameSource& source, int number_eigenvectors, double reg_weight, int number_of_initial_iterations, int number_of_frame_iterations,
+                                     double angle_limit, double distance_limit, double crop_margin, std::string output_path, bool visualize = false);
+
+    /**
+     * @brief Method to set how the face is found by getTargetPointCloudFromCamera() and calculateKinfuTrackerRegistrations()
+     * @param [in] The locator, either the Haar cascade on the gray image or the depth-only one
+     */
+
+    void
+    setFaceLocator (FaceLocator::Ptr face_locator);
+
+    /**
+     * @brief Method to set the center of the face used by alignModel()
+     */
+
+    void
+    setFaceCenterPoint (pcl::PointXYZ face_point);
+
+    /**
+     * @brief Method to get the rigid transformation applied to the model since it was read, including the alignment on the face
+     */
+
+    Matrix4
+    getPose ();
+
+    /**
+     * @brief Method to get the sum of all the coefficients of the eigenvectors applied to the model since it was read
+     */
+
+    VectorX
+    getCoefficients ();
+
+    /**
+     * @brief Method to get the model as it is fitted so far, with its normals. The cloud is overwritten by the next iterations
+     */
+
+    pcl::PointCloud<pcl::PointNormal>::ConstPtr
+    getModelPointCloud ();
 
     /**
      * @brief Method to bring the model close to the center of the face in the scan
@@ -119,8 +293,25 @@ class Registration
     void
     writeDataToPCD (std::string file_path);
 
-    pcl::Correspondences
-    filterNonRigidCorrespondences (double angle_limit, double distance_limit);
+    /**
+     * @brief Method to establish the correspondences between the model and the target which are used by the Non Rigid Registration
+     * @param [in] The maximum allowed difference between the normals of two points to be considered correspondences
+     * @param [in] The maximum distance between two points to be considered correspondences
+     * @param [out] The correspondences, the vector is cleared first so its capacity can be reused
+     */
+
+    void
+    filterNonRigidCorrespondences (double angle_limit, double distance_limit, pcl::Correspondences& correspondences);
+
+    /**
+     * @brief Method to calculate the root mean square of the point-to-plane distances between the model and the target
+     * @param [in] The maximum allowed difference between the normals of two points to be considered correspondences
+     * @param [in] The maximum distance between two points to be considered correspondences
+     * @return The residual of the current fit
+     */
+
+    double
+    computeResidual (double angle_limit, double distance_limit);
 
     /**
      * @brief Method to calculate an inside point of the model to be used as reference against the center of the face
@@ -134,12 +325,35 @@ class Registration
   private:
 
     /**
-     * @brief Callback method for the visualizer
+     * @brief The microbenchmarks of bench/face_bench.cpp time the private steps one by one
+     */
+
+    friend class RegistrationBench;
+
+    /**
+     * @brief Callback method for the visualizer, run on its thread. It only queues the key for handlePressedKeys ()
      */
 
     void
     keyboardCallback (const pcl::visualization::KeyboardEvent &event, void* viewer_void);
 
+    /**
+     * @brief Method to handle the keys queued since the last call, run by the capture loop of calculateKinfuTrackerRegistrations()
+     * @param [in] True if fit_thread_ is running, the model is then being written by it
+     */
+
+    void
+    handlePressedKeys (bool fit_running);
+
+    /**
+     * @brief Method to act on one key pressed in the window
+     * @param [in] The key
+     * @param [in] True if fit_thread_ is running, the model is then being written by it
+     */
+
+    void
+    handleKey (char c, bool fit_running);
+
 
     /**
      * @brief Method to store the points from iteration_source_point_normal_cloud_ptr_ in eigen_source_points_
@@ -156,67 +370,114 @@ class Registration
     convertEigenToPointCLoud ();
 
     /**
-     * @brief Method to create the kdtree of the scanned pointcloud and to calculate its normals
-     * @param [in] The scaned pointcloud
+     * @brief Method to apply a rigid transformation on both eigen_source_points_ and iteration_source_point_normal_cloud_ptr_
+     * @param [in] The homogeneous transformation, kept in the precision of the policy
      */
 
     void
-    setKdTree (pcl::PointCloud<pcl::PointXYZ>::Ptr target_point_cloud_ptr);
+    applyRigidTransformToModel (const Matrix4& transformation);
 
     /**
-     * @brief The kdtree for target_point_normal_cloud_ptr_ to be used for establishing the correspondences
+     * @brief Method to measure an update of the coefficients of the eigenvectors
+     * @param [in] The update
+     * @return The norm of the update, each coefficient being divided by the standard deviation of its eigenvector
      */
 
-    pcl::search::KdTree<pcl::PointXYZRGBNormal> kdtree_;
+    template <typename DerivedT> double
+    calculateCoefficientChange (const Eigen::MatrixBase<DerivedT>& coefficients);
+
+    /**
+     * @brief Method to make a cloud the target, to create its kdtree and to calculate its normals. The cloud is shared, not copied
+     * @param [in] The scaned pointcloud, its normals are overwritten
+     */
 
+    void
+    setKdTree (pcl::PointCloud<pcl::PointNormal>::Ptr target_point_normal_cloud_ptr);
 
     /**
-     * @brief The scanned point cloud is stored in this data structure
+     * @brief Method run on fit_thread_ when ' t ' is pressed in the Kinfu approach: the Rigid Registration followed by the Non Rigid one, on the target set when it started
      */
 
+    void
+    calculateKinfuFit (int number_eigenvectors, double reg_weight, int number_of_rigid_iterations, double angle_limit, double distance_limit, bool visualize);
 
-    pcl::PointCloud<pcl::PointXYZRGBNormal>::Ptr target_point_normal_cloud_ptr_;
+    /**
+     * @brief Method run on fit_thread_ for the scans of the scan policy after the first one: a few iterations of the joint solver from the current pose and shape
+     */
+
+    void
+    calculateKinfuRefinement (int number_eigenvectors, double reg_weight, double angle_limit, double distance_limit, bool visualize);
 
     /**
-     * @brief The statistical model is stored in this data structure for an optimal application of the Rigid Registration
+     * @brief Method to keep the points of a frame which lie inside the bounding box of the model, enlarged by a margin. The invalid points of the organized cloud are dropped as well
+     * @param [in] The frame
+     * @param [in] The margin added on every side of the bounding box
+     * @param [out] The points which are kept
      */
-    pcl::PointCloud<pcl::PointXYZRGBNormal>::Ptr iteration_source_point_normal_cloud_ptr_;
 
-    pcl::visualization::PCLVisualizer::Ptr visualizer_ptr_;
+    void
+    cropTargetAroundModel (const pcl::PointCloud<pcl::PointXYZ>& frame_cloud, double crop_margin, pcl::PointCloud<pcl::PointNormal>& cropped_cloud);
 
     /**
-     * @brief The vertices of the mesh stored in obj format
+     * @brief The kdtree for target_point_normal_cloud_ptr_, used for its normals
      */
 
-    std::vector <  pcl::Vertices > model_mesh_;
+    pcl::search::KdTree<pcl::PointNormal>::Ptr kdtree_ptr_;
 
     /**
-     * @brief The vertices of the mesh stored in pcl format
+     * @brief The tree of target_point_normal_cloud_ptr_ used for establishing the correspondences, its queries never allocate. It is rebuilt whenever the target is replaced
      */
-    std::vector <  pcl::Vertices > debug_model_mesh_;
+
+    PointKdTree target_tree_;
 
 
     /**
-     * @brief The statistical model is stored in this data structure for an optimal application of the Non Rigid Registration
+     * @brief The scanned point cloud is stored in this data structure
      */
 
-    Eigen::VectorXd eigen_source_points_;
+
+    pcl::PointCloud<pcl::PointNormal>::Ptr target_point_normal_cloud_ptr_;
 
     /**
-     * @brief The eigenvalues of the model are stored in this data structure
+     * @brief The statistical model is stored in this data structure for an optimal application of the Rigid Registration
      */
-    Eigen::VectorXd eigenvalues_vector_;
+    pcl::PointCloud<pcl::PointNormal>::Ptr iteration_source_point_normal_cloud_ptr_;
 
     /**
-     * @brief The eigenvectors of the model are stored in this data structure
+     * @brief The viewer, which draws the snapshots published by the registration on its own thread
      */
-    Eigen::MatrixXd eigenvectors_matrix_;
+
+    boost::shared_ptr < AsyncVisualizer > visualizer_ptr_;
+
+    /**
+     * @brief The mean face, its mesh and the eigenvectors, shared with the other Registration objects fitting the same model
+     */
+
+    typename StatisticalModel<PolicyT>::ConstPtr model_ptr_;
+
+    /**
+     * @brief The vertices of the model being fitted are stored in this data structure for an optimal application of the Non Rigid Registration
+     */
+
+    VectorX eigen_source_points_;
 
     /**
      * @brief The average point of the model is stored in this data structure
      */
 
-    Eigen::Vector3d model_center_point_;
+    Vector3 model_center_point_;
+
+    /**
+     * @brief The rigid transformation applied to the model so far
+     */
+
+    Matrix4 pose_;
+
+    /**
+     * @brief The coefficients of the eigenvectors applied to the model so far
+     */
+
+    VectorX coefficients_;
 
     /**
      * @brief The center of the face, detected with OpenCV, is stored in this structure
@@ -224,6 +485,18 @@ class Registration
 
     pcl::PointXYZ face_center_point_;
 
+    /**
+     * @brief The grabber used by getTargetPointCloudFromCamera(), kept between the calls
+     */
+
+    boost::shared_ptr < CameraGrabber > camera_grabber_ptr_;
+
+    /**
+     * @brief The method used to find the face, shared by the camera grabber and the tracker
+     */
+
+    FaceLocator::Ptr face_locator_ptr_;
+
     /**
      * @brief Pointer to the Tracker object
      */
@@ -242,6 +515,14 @@ class Registration
 
     bool continue_tracking_;
 
+    /**
+     * @brief The keys pressed in the window and not handled yet, guarded by key_mutex_. continue_tracking_, calculate_ and the scan of the tracker are only touched by the capture loop
+     */
+
+    std::deque < char > pressed_keys_;
+
+    boost::mutex key_mutex_;
+
     /**
      * @brief Boolean value used in the KinfuTracker approach to determine if a face was detected
      */
@@ -257,8 +538,94 @@ class Registration
 
     bool calculate_;
 
+    /**
+     * @brief The thread of the fit in the Kinfu approach. While it runs, the target and its kdtree are not replaced, new scans wait until it is done
+     */
+
+    boost::thread fit_thread_;
+
+    /**
+     * @brief The scan policy of the Kinfu approach, used if auto_scan_ is set
+     */
+
+    bool auto_scan_;
+
+    float scan_translation_threshold_;
+
+    float scan_rotation_threshold_;
+
+    float scan_surface_growth_;
+
+    int refinement_iterations_;
+
+    /**
+     * @brief The latency above which the tracker counts a frame as late, in milliseconds
+     */
+
+    double late_threshold_;
+
+    /**
+     * @brief Number of searches for correspondences done so far, each one costs a kdtree query for every point of the model
+     */
+
+    int correspondence_passes_;
+
+    /**
+     * @brief Monitor for the iterations of the Rigid Registration
+     */
+
+    ConvergenceMonitor rigid_monitor_;
+
+    /**
+     * @brief Monitor for the rounds of calculateAlternativeRegistrations() and for the iterations of the joint solver
+     */
+
+    ConvergenceMonitor outer_monitor_;
+
+    /**
+     * @brief Number of Rigid iterations skipped during the current fit
+     */
+
+    int rigid_iterations_saved_;
+
+    /**
+     * @brief The rotation angle applied by the last Rigid Registration
+     */
+
+    double last_rotation_change_;
+
+    /**
+     * @brief The norm of the translation applied by the last Rigid Registration
+     */
+
+    double last_translation_change_;
+
+    /**
+     * @brief The change of the coefficients applied by the last Non Rigid Registration
+     */
+
+    double last_coefficient_change_;
+
+    /**
+     * @brief The mean squared point-to-plane residual of the last Non Rigid Registration
+     */
+
+    double last_residual_;
+
+    /**
+     * @brief Buffers reused by every iteration of the registrations
+     */
+
+    FitWorkspace < PolicyT > workspace_;
+
+  public:
+
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
 
 
 };
 
+typedef Registration < SinglePrecision > RegistrationF;
+typedef Registration < DoublePrecision > RegistrationD;
+
 #endif // REGISTRATION_H
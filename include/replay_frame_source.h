@@ -0,0 +1,118 @@
+#ifndef REPLAY_FRAME_SOURCE_H
+#define REPLAY_FRAME_SOURCE_H
+
+#include "frame_source.h"
+
+#include <pcl/io/pcd_io.h>
+
+#include <opencv2/highgui/highgui.hpp>
+
+/**
+ * @brief FrameSource which replays a recording, so the per-frame modes can be run and measured without a sensor.
+ * A recording is a directory of organized .pcd files or 16 bit depth .png files in millimeters, played in the order of their names.
+ * The gray image of a frame, if any, is the .png file with the same name followed by "_gray". The optional file timestamps.txt holds the capture time of every frame in seconds
+ */
+class ReplayFrameSource : public FrameSource
+{
+  public:
+
+    /**
+     * @param [in] Path to the directory of the recording
+     * @param [in] Frame rate of the recording, used for the timestamps if there is no timestamps.txt
+     * @param [in] Focal length in pixels used to turn the depth images into clouds
+     */
+
+    ReplayFrameSource (const std::string& directory, double frame_rate = 30.0, float focal_length = 525.0f);
+
+    /**
+     * @brief Method to choose how the frames are delivered. At the recorded timing the frames which are due are skipped if the consumer is late, like a sensor does.
+     * Otherwise every frame is delivered as soon as it is asked for, which measures the throughput of the consumer
+     * @param [in] True for the recorded timing, false for maximum speed (the default)
+     */
+
+    void
+    setRealTime (bool real_time);
+
+    void
+    start ();
+
+    /**
+     * @brief Method to stop the replay and to report the frames per second seen by the consumer
+     */
+
+    void
+    stop ();
+
+    bool
+    grab (Frame& frame, int timeout);
+
+    bool
+    isFinished ();
+
+    unsigned int
+    getDroppedFrames ();
+
+    /**
+     * @brief Method to get the number of frames in the recording
+     */
+
+    int
+    getNumberFrames ();
+
+    /**
+     * @brief Method to get the number of frames delivered per second since start() was called
+     */
+
+    double
+    getFrameRate ();
+
+  private:
+
+    /**
+     * @brief Method to read one frame of the recording
+     */
+
+    void
+    loadFrame (int frame_number, Frame& frame);
+
+    /**
+     * @brief Method to get the time in seconds since start() was called
+     */
+
+    double
+    getElapsedTime ();
+
+    /**
+     * @brief The paths of the frames, sorted
+     */
+
+    std::vector < std::string > frame_paths_;
+
+    /**
+     * @brief The paths of the gray images, empty for the frames without one
+     */
+
+    std::vector < std::string > gray_paths_;
+
+    /**
+     * @brief The capture time of each frame
+     */
+
+    std::vector < double > timestamps_;
+
+    float focal_length_;
+
+    bool real_time_;
+
+    int next_frame_;
+
+    bool running_;
+
+    unsigned int delivered_frames_;
+
+    unsigned int dropped_frames_;
+
+    boost::posix_time::ptime start_time_;
+};
+
+#endif // REPLAY_FRAME_SOURCE_H
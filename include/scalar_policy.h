@@ -0,0 +1,56 @@
+#ifndef SCALAR_POLICY_H
+#define SCALAR_POLICY_H
+
+#include <Eigen/Dense>
+
+/**
+ * @brief Policy which fixes the floating point type used by the fitting core of the Registration.
+ * The PCL clouds always store floats, the policy only decides in which precision the model, the Jacobians and the solutions are kept
+ */
+template <typename ScalarT>
+struct ScalarPolicy
+{
+  typedef ScalarT Scalar;
+
+  typedef Eigen::Matrix < Scalar, Eigen::Dynamic, Eigen::Dynamic > MatrixX;
+  typedef Eigen::Matrix < Scalar, Eigen::Dynamic, 1 > VectorX;
+  typedef Eigen::Matrix < Scalar, 3, 3 > Matrix3;
+  typedef Eigen::Matrix < Scalar, 4, 4 > Matrix4;
+  typedef Eigen::Matrix < Scalar, 3, 1 > Vector3;
+  typedef Eigen::Matrix < Scalar, 6, 1 > Vector6;
+  typedef Eigen::Matrix < Scalar, 6, 6 > Matrix6;
+
+  /**
+   * @brief Method to get a printable name of the policy
+   * @return "float" or "double"
+   */
+
+  static const char*
+  name ();
+};
+
+/**
+ * @brief Policy to be used for real-time fitting
+ */
+
+typedef ScalarPolicy < float > SinglePrecision;
+
+/**
+ * @brief Policy to be used for offline fitting, where the accuracy matters more than the speed
+ */
+
+typedef ScalarPolicy < double > DoublePrecision;
+
+template <> inline const char*
+ScalarPolicy < float >::name ()
+{
+  return ("float");
+}
+
+template <> inline const char*
+ScalarPolicy < double >::name ()
+{
+  return ("double");
+}
+
+#endif // SCALAR_POLICY_H
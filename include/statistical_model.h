@@ -0,0 +1,94 @@
+#ifndef STATISTICAL_MODEL_H
+#define STATISTICAL_MODEL_H
+
+#include "position_model.h"
+#include "scalar_policy.h"
+
+#include <pcl/Vertices.h>
+
+#include <boost/shared_ptr.hpp>
+
+#include <string>
+#include <vector>
+
+/**
+ * @brief The statistical model of the face: the mean face, its mesh and the eigenvalues and eigenvectors of the shape. It is never modified once read, so one instance is shared by all the Registration objects fitting it, also from several threads
+ * @tparam PolicyT ScalarPolicy which determines the precision in which the model is kept
+ */
+template <typename PolicyT>
+class StatisticalModel
+{
+  public:
+
+    typedef typename PolicyT::Scalar Scalar;
+    typedef typename PolicyT::MatrixX MatrixX;
+    typedef typename PolicyT::VectorX VectorX;
+
+    typedef boost::shared_ptr < const StatisticalModel > ConstPtr;
+
+    /**
+     * @brief Calculates the statistical model or reads it from a file depending on where the database_path points to
+     * @param [in] database_path Path to either the file that contains information about the model or to the directory that contains the Facewarehouse Database
+     * @param [in] transformation_matrix Matrix used for bringing the statistical model to PCL scale
+     * @param [in] translation Translation vector to be applied to the model.
+     * @param [in] scale The scale applied to the model read from a file
+     */
+
+    StatisticalModel (std::string database_path, Eigen::MatrixX3d transformation_matrix, Eigen::Vector3d translation, double scale);
+
+    /**
+     * @brief Method to get the coordinates of the vertices of the mean face, stored as x, y, z one after the other
+     */
+
+    const VectorX&
+    getMeanPoints () const;
+
+    /**
+     * @brief Method to get the eigenvalues of the model, the variance of every eigenvector
+     */
+
+    const VectorX&
+    getEigenValues () const;
+
+    /**
+     * @brief Method to get the eigenvectors of the model, one per column
+     */
+
+    const MatrixX&
+    getEigenVectors () const;
+
+    /**
+     * @brief Method to get the mesh as it is stored in obj format, the indices starting at 1
+     */
+
+    const std::vector < pcl::Vertices >&
+    getMesh () const;
+
+    /**
+     * @brief Method to get the mesh in pcl format, the indices starting at 0
+     */
+
+    const std::vector < pcl::Vertices >&
+    getPclMesh () const;
+
+    /**
+     * @brief Method to get the number of vertices of the model
+     */
+
+    int
+    getNumberPoints () const;
+
+  private:
+
+    VectorX mean_points_;
+
+    VectorX eigenvalues_;
+
+    MatrixX eigenvectors_;
+
+    std::vector < pcl::Vertices > mesh_;
+
+    std::vector < pcl::Vertices > pcl_mesh_;
+};
+
+#endif // STATISTICAL_MODEL_H
@@ -0,0 +1,40 @@
+#ifndef SYNTHETIC_FACE_H
+#define SYNTHETIC_FACE_H
+
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+
+#include <string>
+
+/**
+ * @brief A smooth synthetic face, so the benchmarks and the tests can run the registration without a real model or scan
+ */
+class SyntheticFace
+{
+  public:
+
+    /**
+     * @brief Method to get the depth of the face relative to its center: a bump towards the camera
+     */
+
+    static float
+    getDepth (float x, float y);
+
+    /**
+     * @brief Method to write a model in the format read by StatisticalModel: a grid of side number_side over the face, its quads, and number_eigenvectors smooth modes with decreasing eigenvalues
+     */
+
+    static void
+    writeModel (const std::string& path, int number_side, int number_eigenvectors);
+
+    /**
+     * @brief Method to make a target: the same face sampled on a finer grid, number_points points in total, 0.8 meters in front of the camera and 3 millimeters aside
+     * @param [in] The number of points of the target
+     * @param [out] The face point to give to the registration with the target
+     */
+
+    static pcl::PointCloud<pcl::PointNormal>::Ptr
+    makeTarget (int number_points, pcl::PointXYZ& face_point);
+};
+
+#endif // SYNTHETIC_FACE_H
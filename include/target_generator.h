@@ -0,0 +1,191 @@
+#ifndef TARGET_GENERATOR_H
+#define TARGET_GENERATOR_H
+
+#include "statistical_model.h"
+
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+
+#include <boost/random/mersenne_twister.hpp>
+
+#include <Eigen/Dense>
+
+#include <string>
+#include <vector>
+
+/**
+ * @brief The known answer of a generated target: the face it was rendered from is pose * (mean + eigenvectors * coefficients)
+ */
+struct GroundTruth
+{
+  Eigen::Matrix4d pose;
+
+  Eigen::VectorXd coefficients;
+
+  /**
+   * @brief The point given to the fit as the center of the face, see Registration::alignModel()
+   */
+
+  pcl::PointXYZ face_point;
+
+  /**
+   * @brief Method to write the ground truth as text: the pose by rows, the face point, then the number of coefficients and their values
+   */
+
+  bool
+  write (const std::string& path) const;
+
+  /**
+   * @brief Method to read a ground truth written by write()
+   * @return False if the file is missing or malformed
+   */
+
+  bool
+  read (const std::string& path);
+
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+};
+
+/**
+ * @brief Generates targets with a known answer from the statistical model: the coefficients are drawn following the eigenvalues, the face is moved by a random pose and rendered from the camera into an organized cloud with the noise, the holes and the background of a depth sensor
+ * @tparam PolicyT ScalarPolicy of the model (SinglePrecision or DoublePrecision)
+ */
+template <typename PolicyT>
+class TargetGenerator
+{
+  public:
+
+    /**
+     * @param [in] The model the faces are drawn from
+     * @param [in] The seed of the random numbers, the same seed gives the same targets
+     */
+
+    TargetGenerator (typename StatisticalModel<PolicyT>::ConstPtr model_ptr, unsigned int seed = 1);
+
+    /**
+     * @brief Method to set the depth camera, 640 x 480 with a focal length of 525 pixels by default
+     */
+
+    void
+    setCamera (int width, int height, float focal_length);
+
+    /**
+     * @brief Method to set how the face is placed
+     * @param [in] The mean distance of the face from the camera in meters, 0.8 by default
+     * @param [in] The largest offset of the face from the axis of the camera and from the mean distance in meters, 0.05 by default
+     * @param [in] The largest rotation of the face in radians, 15 degrees by default
+     */
+
+    void
+    setPoseRange (double distance, double offset_range, double rotation_range);
+
+    /**
+     * @brief Method to set the number of eigenvectors with a nonzero coefficient, all of them by default
+     */
+
+    void
+    setNumberEigenvectors (int number_eigenvectors);
+
+    /**
+     * @brief Method to set the standard deviation of the depth noise at one meter in meters, 0.0012 by default. It grows with the square of the depth as for a structured light sensor
+     */
+
+    void
+    setNoise (double noise);
+
+    /**
+     * @brief Method to set the holes punched into the face, 4 disks of 5 pixels by default
+     */
+
+    void
+    setHoles (int number_holes, int hole_radius);
+
+    /**
+     * @brief Method to set the background: a wall wall_distance meters behind the face and number_clutter boxes between the two, 0.6 and 5 by default. A wall_distance of 0 leaves the background empty
+     */
+
+    void
+    setClutter (double wall_distance, int number_clutter);
+
+    /**
+     * @brief Method to set the largest error of the face point in meters, as made by a face detector, 0.01 by default
+     */
+
+    void
+    setFaceJitter (double face_jitter);
+
+    /**
+     * @brief Method to generate one target
+     * @param [out] The organized cloud seen by the camera, NaN where there is no measurement
+     * @param [out] Its ground truth
+     */
+
+    void
+    generate (pcl::PointCloud<pcl::PointXYZ>& target, GroundTruth& truth);
+
+    /**
+     * @brief Method to calculate the vertices of the face of a ground truth, in the order of the model
+     * @param [in] The model the ground truth was drawn from
+     * @param [in] The ground truth
+     * @return The vertices as x, y, z one after the other
+     */
+
+    static Eigen::VectorXd
+    getVertices (const StatisticalModel<PolicyT>& model, const GroundTruth& truth);
+
+  private:
+
+    /**
+     * @brief Method to draw a fronto-parallel rectangle at depth z into the depth buffer
+     */
+
+    void
+    renderRectangle (double x_min, double y_min, double x_max, double y_max, double z);
+
+    /**
+     * @brief Method to draw a triangle into the depth buffer
+     */
+
+    void
+    renderTriangle (const Eigen::Vector3d& a, const Eigen::Vector3d& b, const Eigen::Vector3d& c, bool face);
+
+    typename StatisticalModel<PolicyT>::ConstPtr model_ptr_;
+
+    boost::mt19937 random_generator_;
+
+    int width_;
+
+    int height_;
+
+    float focal_length_;
+
+    double distance_;
+
+    double offset_range_;
+
+    double rotation_range_;
+
+    int number_eigenvectors_;
+
+    double noise_;
+
+    int number_holes_;
+
+    int hole_radius_;
+
+    double wall_distance_;
+
+    int number_clutter_;
+
+    double face_jitter_;
+
+    /**
+     * @brief The depth of every pixel and whether it shows the face, reused from one target to the next
+     */
+
+    std::vector < double > depth_buffer_;
+
+    std::vector < bool > face_buffer_;
+};
+
+#endif // TARGET_GENERATOR_H
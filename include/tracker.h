@@ -1,9 +1,11 @@
 #ifndef TRACKER_H
 #define TRACKER_H
 
-#include <pcl/gpu/kinfu/kinfu.h>
-#include <pcl/io/openni_grabber.h>
-#include <pcl/io/openni_camera/openni_depth_image.h>
+#include "frame_source.h"
+#include "face_locator.h"
+#include "fusion_backend.h"
+#include "latency_histogram.h"
+
 #include <pcl/io/pcd_io.h>
 #include <pcl/common/common_headers.h>
 #include <pcl/common/transforms.h>
@@ -15,24 +17,39 @@
 #include <opencv2/highgui/highgui.hpp>
 #include <opencv2/imgproc/imgproc.hpp>
 
+#include <boost/thread.hpp>
+
+#include <deque>
+#include <string>
 
 
-class Tracker : public pcl::OpenNIGrabber
+
+/**
+ * @brief This class fuses the depth frames of a FrameSource with a FusionBackend and finds the face in them.
+ * The face is searched on a worker thread, so the fusion never waits for the locator. The worker always takes the newest frame and the scan uses the result of the frame closest in time
+ */
+class Tracker
 {
 
   public:
 
-    typedef boost::shared_ptr<openni_wrapper::DepthImage> DepthImagePtr;
+    /**
+     * @brief The latencies measured for every frame. The queue, detection and frame latencies run from the time the source received the frame, the integration and scan ones are the durations of these steps
+     */
+
+    enum CaptureStage {QUEUE_STAGE, INTEGRATION_STAGE, DETECTION_STAGE, SCAN_STAGE, FRAME_STAGE, NUMBER_CAPTURE_STAGES};
 
     /**
      * @brief Tracker
-     * @param [in] OpenCV code for the type of sensor to be used
+     * @param [in] The source of the frames, either a live sensor or a recording
+     * @param [in] The method used to find the face
+     * @param [in] The method used to fuse the frames, either the KinfuTracker or the CPU fusion
      */
 
-    Tracker (int device);
+    Tracker (FrameSource::Ptr source, FaceLocator::Ptr face_locator, FusionBackend::Ptr fusion);
 
 
-    ~Tracker () throw ();
+    ~Tracker ();
 
     /**
      * @brief Method to return the accumulated point cloud
@@ -59,7 +76,7 @@ class Tracker : public pcl::OpenNIGrabber
     isFaceFound ();
 
     /**
-     * @brief Set method for the scan_ attribute
+     * @brief Set method for the scan_ attribute, to be called from the thread which calls execute ()
      * @param scan
      */
 
@@ -67,14 +84,24 @@ class Tracker : public pcl::OpenNIGrabber
     setScan (bool scan);
 
     /**
-     * @brief Method for starting the thread of the recording
+     * @brief Method to let the tracker scan on its own, once a face has been found and then whenever the camera has moved enough or enough new surface has been fused since the last scan. A threshold of 0 disables its criterion
+     * @param [in] The distance the camera has to move, in meters
+     * @param [in] The angle the camera has to turn, in radians
+     * @param [in] The growth of the surface of the fusion, relative to the one of the last scan
+     */
+
+    void
+    setScanPolicy (float translation_threshold, float rotation_threshold, float surface_growth);
+
+    /**
+     * @brief Method for starting the source and the thread which searches the face
      */
 
     void
     startUp ();
 
     /**
-     * @brief Method to close the recording thread and for clean-up
+     * @brief Method to stop the source and the thread which searches the face
      */
 
     void
@@ -88,54 +115,148 @@ class Tracker : public pcl::OpenNIGrabber
     bool
     execute ();
 
+    /**
+     * @brief Method to check if the source has no more frames to deliver
+     */
+
+    bool
+    isFinished ();
+
+    /**
+     * @brief Method to set the latency above which a frame counts as late, by default one frame period at 30 Hz
+     * @param [in] The latency from the reception of the frame to the end of its processing, in milliseconds
+     */
+
+    void
+    setLateThreshold (double late_threshold);
+
+    /**
+     * @brief Method to get the latencies of one stage, it can be called from any thread while the tracker runs
+     */
+
+    const LatencyHistogram&
+    getLatencyHistogram (CaptureStage stage) const;
+
+    /**
+     * @brief Method to get the number of frames whose processing ended later than the late threshold after their reception
+     */
+
+    unsigned int
+    getLateFrames ();
+
+    /**
+     * @brief Method to get the number of calls to execute () which waited for a frame in vain
+     */
+
+    unsigned int
+    getGrabTimeouts ();
+
+    /**
+     * @brief Method to get the number of frames replaced in the slot of the worker before it could search them
+     */
+
+    unsigned int
+    getSkippedDetections ();
+
+    /**
+     * @brief Method to get the number of frames the fusion could not align
+     */
+
+    unsigned int
+    getLostFrames ();
+
+    /**
+     * @brief Method to get the latencies and the counters of the dropped and late frames as text, it is also printed once by close ()
+     */
+
+    std::string
+    getCaptureReport ();
+
 
 
 
   private:
 
     /**
-     * @brief CallBack method to be run in the OpenNIGrabber and stored an ordered cloud component in cloud_depth_ptr_
-     * @param [in]
-     *
+     * @brief The result of the search for the face in one frame
+     */
+
+    struct Detection
+    {
+      double timestamp;
+      bool found;
+      pcl::PointXYZ face_center;
+
+      /**
+       * @brief The pose of the camera after the fusion of the searched frame, which moves its face into the coordinates of the volume
+       */
+
+      Eigen::Matrix3f camera_rotation;
+      Eigen::Vector3f camera_translation;
+    };
+
+    /**
+     * @brief Method that takes the position of the face found closest in time to the frame and stores the tracked point cloud in cloud_kinfu_ptr_
+     * @param [in] The scanned frame
+     */
+
+    void
+    takeKinfuCloud (const Frame& frame);
+
+    /**
+     * @brief Method to check if the scan policy asks for a scan in the current frame
+     */
+
+    bool
+    isScanDue ();
+
+    /**
+     * @brief Method to hand a frame to the worker, replacing the one it has not started on yet
+     * @param [in] The frame
+     * @param [in] The pose of the camera after the fusion of the frame
      */
 
     void
-    source_cb1_device (const boost::shared_ptr<openni_wrapper::DepthImage>& depth_wrapper);
+    postDetectionFrame (const Frame& frame, const Eigen::Affine3f& camera_pose);
 
     /**
-     * @brief Method that determines the position of the face and stores the tracked point cloud in cloud_kinfu_ptr_
+     * @brief Method to pass the newest face found by the worker to the fusion
      */
 
     void
-    takeKinfuCloud ();
+    updateFaceRegion ();
 
     /**
-     * @brief connection_
+     * @brief Method to check if the worker has searched at least one frame
      */
 
-    boost::signals2::connection connection_;
+    bool
+    hasDetection ();
 
     /**
-     * @brief OpenCV VideoCapture
+     * @brief The loop of the worker thread
      */
 
-    cv::VideoCapture video_grabber_;
+    void
+    detectionLoop ();
 
     /**
-     * @brief OpenCV CascadeClassifier
+     * @brief The source of the depth and gray frames
      */
 
-    cv::CascadeClassifier face_classifier_;
+    FrameSource::Ptr source_;
 
     /**
-     * @brief KinfuTracker
+     * @brief The method used to find the face
      */
-    pcl::gpu::KinfuTracker kinfu_;
+
+    FaceLocator::Ptr face_locator_ptr_;
 
     /**
-     * @brief DepthMap to be updated in execute()
+     * @brief The method used to fuse the frames
      */
-    pcl::gpu::KinfuTracker::DepthMap depth_device_;
+
+    FusionBackend::Ptr fusion_;
 
     /**
      * @brief Pointer to the cloud where the accumulated pointcloud is stored
@@ -144,57 +265,108 @@ class Tracker : public pcl::OpenNIGrabber
     pcl::PointCloud <pcl::PointXYZ>::Ptr cloud_kinfu_ptr_;
 
     /**
-     * @brief Pointer to an ordered cloud which represents one phase of the scanning
+     * @brief PCL point which represents the center of the face detected in the last scanning
      */
-    pcl::PointCloud <pcl::PointXYZ>::Ptr cloud_depth_ptr_;
+
+    pcl::PointXYZ face_center_;
+
 
     /**
-     * @brief PCL point which represents the center of the face detected in the last scanning
+     * @brief Boolean value that determines when a snapshot of the cloud should be taken
      */
 
-    pcl::PointXYZ face_center_;
+    bool scan_;
 
     /**
-     * @brief DeviceArray to get data from GPU
+     * @brief The thresholds of the scan policy, auto_scan_ is set once setScanPolicy () was called
      */
-    pcl::gpu::DeviceArray<pcl::PointXYZ> cloud_buffer_device_;
 
+    bool auto_scan_;
+
+    float scan_translation_threshold_;
+
+    float scan_rotation_threshold_;
+
+    float scan_surface_growth_;
 
     /**
-     * @brief Data structure used in the callback function
+     * @brief The pose of the camera and the size of the surface of the fusion at the last scan, has_scanned_ is set after the first one
      */
 
+    bool has_scanned_;
+
+    Eigen::Matrix3f scan_rotation_;
 
-    pcl::gpu::PtrStepSz<const unsigned short> depth_;
+    Eigen::Vector3f scan_translation_;
 
-    boost::mutex data_ready_mutex_;
-    boost::condition_variable data_ready_cond_;
+    size_t scan_surface_;
 
     /**
-     * @brief Data structure used in the callback function
+     * @brief Boolean value to determine weather a face was detected
      */
+    bool face_found_;
 
+    /**
+     * @brief The single slot from which the worker takes the next frame, with the pose of the camera in its frame, valid if has_detection_frame_ is set
+     */
+
+    Frame detection_frame_;
+
+    Eigen::Matrix3f detection_rotation_;
+
+    Eigen::Vector3f detection_translation_;
 
-    std::vector<unsigned short> source_depth_data_;
+    bool has_detection_frame_;
 
     /**
-     * @brief Translation vector used for the calibration of the KinfuTracker
+     * @brief The results of the last searches, the newest at the back
      */
 
-    Eigen::Vector3f translation_;
+    std::deque < Detection > detections_;
+
+    /**
+     * @brief The number of results kept for the matching with the scanned frames
+     */
 
-    boost::shared_ptr < boost::unique_lock < boost::mutex > > lock_ptr_;
+    static const int DETECTION_HISTORY = 16;
 
     /**
-     * @brief Boolean value that determines when a snapshot of the cloud should be taken
+     * @brief The timestamp of the frame whose face was passed last to the fusion
      */
 
-    bool scan_;
+    double region_timestamp_;
+
+    bool stop_detection_;
+
+    boost::mutex detection_mutex_;
+
+    boost::condition_variable detection_condition_;
+
+    boost::thread detection_thread_;
 
     /**
-     * @brief Boolean value to determine weather a face was detected
+     * @brief The latencies of every stage, each histogram has its own lock
      */
-    bool face_found_;
+
+    LatencyHistogram latencies_[NUMBER_CAPTURE_STAGES];
+
+    /**
+     * @brief The counters of the frames, guarded by statistics_mutex_ since they are read while the tracker runs
+     */
+
+    double late_threshold_;
+
+    unsigned int late_frames_;
+
+    unsigned int grab_timeouts_;
+
+    unsigned int skipped_detections_;
+
+    unsigned int lost_frames_;
+
+    bool report_printed_;
+
+    boost::mutex statistics_mutex_;
 
 
 
@@ -0,0 +1,452 @@
+#ifndef TSDF_FUSION_H
+#define TSDF_FUSION_H
+
+#include "fusion_backend.h"
+
+#include <boost/cstdint.hpp>
+#include <boost/function.hpp>
+#include <boost/thread.hpp>
+#include <boost/unordered_map.hpp>
+#include <boost/unordered_set.hpp>
+
+#include <vector>
+
+/**
+ * @brief FusionBackend running on the CPU, so --kinfu works without a graphics card. The camera is tracked with projective point-to-plane ICP against the surface raycast from the volume, then the frame is fused into a truncated signed distance volume.
+ * The volume is sparse: it is made of blocks of voxels stored in a hash map, which are only allocated around the surfaces seen. Until the face is found the blocks are limited to a head-sized box centered on what is in front of the camera in the first frame, afterwards to a sphere around the face.
+ * The surface of a block is extracted again only if the block has changed. Every step is split over the cores, by threads started once with the object and woken for each step
+ */
+class TsdfFusion : public FusionBackend
+{
+  public:
+
+    /**
+     * @param [in] The length of the edges of the box in which the blocks are allocated until the face is found, in meters
+     * @param [in] The number of voxels along each edge of the box, which sets the size of the voxels
+     * @param [in] The number of threads, 0 to use one per core
+     */
+
+    TsdfFusion (float volume_size = 0.4f, int resolution = 128, int number_threads = 0);
+
+    ~TsdfFusion ();
+
+    /**
+     * @brief Method to set how far in front and behind the surface the distance is stored, 0.01 meters by default
+     */
+
+    void
+    setTruncationDistance (float truncation_distance);
+
+    /**
+     * @brief Method to set the maximum number of ICP iterations per frame, 10 by default
+     */
+
+    void
+    setIcpIterations (int icp_iterations);
+
+    /**
+     * @brief Method to set the radius of the sphere around the face in which the blocks are allocated once the face is found, 0.2 meters by default
+     */
+
+    void
+    setRegionRadius (float region_radius);
+
+    bool
+    integrate (const Frame& frame);
+
+    Eigen::Affine3f
+    getCameraPose ();
+
+    void
+    extractCloud (pcl::PointCloud < pcl::PointXYZ >& cloud);
+
+    void
+    setFaceCenter (const Eigen::Vector3f& face_center);
+
+    /**
+     * @brief Method to get the number of blocks allocated, which are only allocated around the surfaces seen
+     */
+
+    size_t
+    getSurfaceSize ();
+
+    const char*
+    getName ();
+
+    /**
+     * @brief Method to get the number of threads used
+     */
+
+    int
+    getNumberThreads ();
+
+    /**
+     * @brief Method to get the number of blocks allocated
+     */
+
+    int
+    getNumberBlocks ();
+
+    /**
+     * @brief Method to get the memory used by the blocks and their extracted points, in bytes
+     */
+
+    size_t
+    getMemoryUsage ();
+
+    /**
+     * @brief Method to get the number of blocks whose surface was extracted again by the last call of extractCloud (), the other ones kept their points
+     */
+
+    int
+    getExtractedBlocks ();
+
+  private:
+
+    typedef std::vector < pcl::PointXYZ, Eigen::aligned_allocator < pcl::PointXYZ > > PointVector;
+
+    typedef Eigen::Matrix < double, 6, 6 > Matrix6d;
+
+    typedef Eigen::Matrix < double, 6, 1 > Vector6d;
+
+    /**
+     * @brief The number of voxels along each edge of a block
+     */
+
+    static const int BLOCK_SIZE = 8;
+
+    static const int BLOCK_VOXELS = BLOCK_SIZE * BLOCK_SIZE * BLOCK_SIZE;
+
+    /**
+     * @brief A cube of BLOCK_SIZE^3 voxels, x runs fastest inside of it
+     */
+
+    struct Block
+    {
+      /**
+       * @brief The position of the block, in blocks
+       */
+
+      int x, y, z;
+
+      /**
+       * @brief The distance of every voxel divided by the truncation distance
+       */
+
+      float tsdf[BLOCK_VOXELS];
+
+      /**
+       * @brief The number of frames fused into every voxel, 0 for voxels never seen
+       */
+
+      unsigned char weights[BLOCK_VOXELS];
+
+      /**
+       * @brief Set when the surface in the block may have changed since the last extraction, that is when a voxel inside of the truncation band was updated or a voxel changed sign. Free space seen again leaves it alone
+       */
+
+      bool touched;
+
+      /**
+       * @brief The points of the surface found in the block by the last extraction
+       */
+
+      PointVector points;
+    };
+
+    typedef boost::unordered_map < boost::uint64_t, Block* > BlockMap;
+
+    /**
+     * @brief Method to get the key of a block in the hash map
+     */
+
+    static boost::uint64_t
+    getBlockKey (int x, int y, int z);
+
+    /**
+     * @brief Method to find a block
+     * @return The block, or NULL if it was never allocated
+     */
+
+    Block*
+    findBlock (int x, int y, int z) const;
+
+    /**
+     * @brief Method to get the distance stored in a voxel
+     * @param [in] The position of the voxel, in voxels
+     * @param [in,out] The block of the last lookup, replaced by the block of the voxel. It is NULL afterwards if the block was never allocated
+     * @param [out] The distance
+     * @return False if the voxel has never been seen
+     */
+
+    bool
+    getVoxel (int x, int y, int z, Block*& block, float& value) const;
+
+    /**
+     * @brief Method to check if a block may be allocated, that is if it lies in the box of the first frame or, once the face is known, in the sphere around it
+     */
+
+    bool
+    isInRegion (int x, int y, int z) const;
+
+    /**
+     * @brief Method to run a job over the range [0, count), split in one contiguous part per thread
+     * @param [in] The job, called with the begin and the end of its part and the number of its thread
+     * @param [in] The size of the range
+     */
+
+    void
+    runParallel (const boost::function < void (int, int, int) >& job, int count);
+
+    /**
+     * @brief The loop of every thread of the pool, which runs its part of each job given to runParallel ()
+     * @param [in] The number of the thread, from 1 since the calling thread takes the first part
+     */
+
+    void
+    workerLoop (int thread);
+
+    /**
+     * @brief Method to place the volume around the median depth of the middle of the first frame
+     */
+
+    void
+    placeVolume (const Frame& frame);
+
+    /**
+     * @brief Method to fill the vertices_ of the rows [begin, end) from the depth of current_frame_, at half its resolution
+     */
+
+    void
+    computeVertices (int begin, int end, int thread);
+
+    /**
+     * @brief Method to fill the normals_ of the rows [begin, end) from the vertices_
+     */
+
+    void
+    computeNormals (int begin, int end, int thread);
+
+    /**
+     * @brief Method to track the camera from the pose of the previous frame
+     * @return False if too few points of the frame matched the surface
+     */
+
+    bool
+    trackCamera ();
+
+    /**
+     * @brief Method to sum the ICP system of the rows [begin, end) into icp_systems_[thread] and icp_right_sides_[thread]
+     */
+
+    void
+    accumulateIcp (int begin, int end, int thread);
+
+    /**
+     * @brief Method to collect the keys of the blocks around the vertices_ of the rows [begin, end) into allocation_keys_[thread]
+     */
+
+    void
+    collectBlocks (int begin, int end, int thread);
+
+    /**
+     * @brief Method to allocate the blocks around the surface of the current frame
+     */
+
+    void
+    allocateBlocks ();
+
+    /**
+     * @brief Method to free the blocks left outside of the sphere around the face after it moved or shrank, so the memory follows the face instead of growing with the path of the camera
+     */
+
+    void
+    evictBlocks ();
+
+    /**
+     * @brief Method to fuse the depth of current_frame_ into the blocks [begin, end) of block_list_
+     */
+
+    void
+    integrateBlocks (int begin, int end, int thread);
+
+    /**
+     * @brief Method to fill the model_vertices_ and model_normals_ of the rows [begin, end) by casting rays into the volume from the current pose
+     */
+
+    void
+    raycastRows (int begin, int end, int thread);
+
+    /**
+     * @brief Method to collect again the zero crossings of the blocks [begin, end) of block_list_ which have changed, or whose neighbors have
+     */
+
+    void
+    extractBlocks (int begin, int end, int thread);
+
+    /**
+     * @brief Method to get the distance at a point of the volume by trilinear interpolation
+     * @param [in] The point, in the coordinates of the volume
+     * @param [out] The distance, between -1 and 1
+     * @return False if the point is next to a voxel which has never been seen
+     */
+
+    bool
+    interpolate (const Eigen::Vector3f& point, float& value) const;
+
+    float volume_size_;
+
+    int resolution_;
+
+    float voxel_size_;
+
+    float truncation_distance_;
+
+    int icp_iterations_;
+
+    int number_threads_;
+
+    /**
+     * @brief The blocks, each allocated on its own so it never moves and can be freed when the face region leaves it
+     */
+
+    BlockMap block_map_;
+
+    /**
+     * @brief Pointers to the blocks, to split them over the threads. They are owned by the object
+     */
+
+    std::vector < Block* > block_list_;
+
+    /**
+     * @brief The box around all the blocks, in the coordinates of the volume. The rays are only marched inside of it
+     */
+
+    Eigen::Vector3f bounds_minimum_;
+
+    Eigen::Vector3f bounds_maximum_;
+
+    bool volume_placed_;
+
+    /**
+     * @brief The sphere around the face, used once has_region_ is set
+     */
+
+    bool has_region_;
+
+    Eigen::Vector3f region_center_;
+
+    float region_radius_;
+
+    /**
+     * @brief Set when the sphere moved or shrank, the blocks outside of it are freed before the next frame is fused
+     */
+
+    bool region_changed_;
+
+    /**
+     * @brief The pose of the camera, from the coordinates of the camera to the ones of the volume
+     */
+
+    Eigen::Matrix3f rotation_;
+
+    Eigen::Vector3f translation_;
+
+    /**
+     * @brief The pose estimated by the current ICP iteration
+     */
+
+    Eigen::Matrix3f estimated_rotation_;
+
+    Eigen::Vector3f estimated_translation_;
+
+    /**
+     * @brief The frame being fused, only valid during integrate ()
+     */
+
+    const Frame* current_frame_;
+
+    /**
+     * @brief The size and the intrinsics of the maps used for the tracking, half the resolution of the frames
+     */
+
+    int map_width_;
+
+    int map_height_;
+
+    float map_focal_length_;
+
+    float map_center_x_;
+
+    float map_center_y_;
+
+    /**
+     * @brief The points and normals of the current frame, in the coordinates of the camera. NaN where there is no measurement
+     */
+
+    std::vector < Eigen::Vector3f > vertices_;
+
+    std::vector < Eigen::Vector3f > normals_;
+
+    /**
+     * @brief The surface seen from the pose of the previous frame, in the coordinates of the volume. NaN where the rays missed it
+     */
+
+    std::vector < Eigen::Vector3f > model_vertices_;
+
+    std::vector < Eigen::Vector3f > model_normals_;
+
+    /**
+     * @brief The part of the ICP system summed by every thread
+     */
+
+    std::vector < Matrix6d, Eigen::aligned_allocator < Matrix6d > > icp_systems_;
+
+    std::vector < Vector6d, Eigen::aligned_allocator < Vector6d > > icp_right_sides_;
+
+    std::vector < int > icp_counts_;
+
+    /**
+     * @brief The keys of the blocks found by every thread in the current frame
+     */
+
+    std::vector < boost::unordered_set < boost::uint64_t > > allocation_keys_;
+
+    /**
+     * @brief The number of blocks extracted again by every thread
+     */
+
+    std::vector < int > extracted_blocks_;
+
+    /**
+     * @brief The number of blocks extracted again by the last extractCloud ()
+     */
+
+    int last_extracted_blocks_;
+
+    /**
+     * @brief The pool of number_threads_ - 1 threads, started by the constructor since a step runs dozens of times per frame. The job and its range are guarded by pool_mutex_, job_generation_ counts the jobs so every thread runs each of them once
+     */
+
+    boost::thread_group workers_;
+
+    boost::mutex pool_mutex_;
+
+    boost::condition_variable job_condition_;
+
+    boost::condition_variable done_condition_;
+
+    const boost::function < void (int, int, int) >* job_;
+
+    int job_count_;
+
+    int job_part_;
+
+    unsigned long job_generation_;
+
+    int pending_workers_;
+
+    bool stop_workers_;
+};
+
+#endif // TSDF_FUSION_H
@@ -0,0 +1,135 @@
+#include <allocation_counter.h>
+
+#include <cstdlib>
+#include <new>
+#include <boost/detail/atomic_count.hpp>
+
+#ifdef FACE_COUNT_ALLOCATIONS
+
+/* Dynamic exception specifications were removed by C++17, the replacements must still match the declarations of <new> in C++03 */
+
+#if __cplusplus < 201103L
+#define FACE_THROW_BAD_ALLOC throw (std::bad_alloc)
+#define FACE_NO_THROW throw ()
+#else
+#define FACE_THROW_BAD_ALLOC
+#define FACE_NO_THROW noexcept
+#endif
+
+/* The count of each thread cannot use boost::thread_specific_ptr, which allocates */
+
+#if __cplusplus < 201103L
+#define FACE_THREAD_LOCAL __thread
+#else
+#define FACE_THREAD_LOCAL thread_local
+#endif
+
+namespace
+{
+  boost::detail::atomic_count allocation_count (0);
+
+  FACE_THREAD_LOCAL unsigned long thread_allocation_count = 0;
+}
+
+void*
+operator new (std::size_t size) FACE_THROW_BAD_ALLOC
+{
+  ++allocation_count;
+  ++thread_allocation_count;
+
+  void* pointer = std::malloc (size == 0 ? 1 : size);
+
+  if (pointer == NULL)
+  {
+    throw std::bad_alloc ();
+  }
+
+  return (pointer);
+}
+
+void*
+operator new[] (std::size_t size) FACE_THROW_BAD_ALLOC
+{
+  return (operator new (size));
+}
+
+/* The nothrow variants would otherwise go to the allocator of the library, uncounted and paired with the free () below */
+
+void*
+operator new (std::size_t size, const std::nothrow_t&) FACE_NO_THROW
+{
+  ++allocation_count;
+  ++thread_allocation_count;
+
+  return (std::malloc (size == 0 ? 1 : size));
+}
+
+void*
+operator new[] (std::size_t size, const std::nothrow_t& nothrow) FACE_NO_THROW
+{
+  return (operator new (size, nothrow));
+}
+
+void
+operator delete (void* pointer) FACE_NO_THROW
+{
+  std::free (pointer);
+}
+
+void
+operator delete[] (void* pointer) FACE_NO_THROW
+{
+  std::free (pointer);
+}
+
+void
+operator delete (void* pointer, const std::nothrow_t&) FACE_NO_THROW
+{
+  std::free (pointer);
+}
+
+void
+operator delete[] (void* pointer, const std::nothrow_t&) FACE_NO_THROW
+{
+  std::free (pointer);
+}
+
+bool
+AllocationCounter::isEnabled ()
+{
+  return (true);
+}
+
+unsigned long
+AllocationCounter::getCount ()
+{
+  return (static_cast<unsigned long> (allocation_count));
+}
+
+unsigned long
+AllocationCounter::getThreadCount ()
+{
+  return (thread_allocation_count);
+}
+
+#else
+
+bool
+AllocationCounter::isEnabled ()
+{
+  return (false);
+}
+
+unsigned long
+AllocationCounter::getCount ()
+{
+  return (0);
+}
+
+unsigned long
+AllocationCounter::getThreadCount ()
+{
+  return (0);
+}
+
+#endif
@@ -0,0 +1,215 @@
+#include <async_visualizer.h>
+
+#include <algorithm>
+
+AsyncVisualizer::AsyncVisualizer (const std::string& name, int queue_size, int refresh_period)
+{
+  name_ = name;
+  queue_size_ = std::max (queue_size, 1);
+  refresh_period_ = refresh_period;
+
+  dropped_frames_ = 0;
+  marker_visible_ = false;
+  marker_changed_ = false;
+  marker_radius_ = 0.025;
+  step_mode_ = false;
+  step_requested_ = false;
+  stop_ = false;
+
+  thread_ = boost::thread (&AsyncVisualizer::run, this);
+}
+
+AsyncVisualizer::~AsyncVisualizer ()
+{
+  {
+    boost::mutex::scoped_lock lock (mutex_);
+    stop_ = true;
+    step_condition_.notify_all ();
+  }
+
+  thread_.join ();
+}
+
+void
+AsyncVisualizer::setKeyboardCallback (KeyboardCallback callback)
+{
+  boost::mutex::scoped_lock lock (mutex_);
+  keyboard_callback_ = callback;
+}
+
+void
+AsyncVisualizer::setStepMode (bool step_mode)
+{
+  boost::mutex::scoped_lock lock (mutex_);
+  step_mode_ = step_mode;
+}
+
+void
+AsyncVisualizer::publish (const Cloud::ConstPtr& model, const Cloud::ConstPtr& target, const pcl::Correspondences* correspondences)
+{
+  Snapshot snapshot;
+
+  /* The copies are made outside of the lock, so the viewer thread is never blocked by them */
+
+  if (model)
+  {
+    snapshot.model.reset (new Cloud (*model));
+  }
+
+  snapshot.target = target;
+
+  if (correspondences != NULL)
+  {
+    snapshot.correspondences.reset (new pcl::Correspondences (*correspondences));
+  }
+
+  boost::mutex::scoped_lock lock (mutex_);
+
+  if (static_cast<int> (queue_.size ()) >= queue_size_)
+  {
+    queue_.pop_front ();
+    ++dropped_frames_;
+  }
+
+  queue_.push_back (snapshot);
+
+  /* In step mode the registration waits for the user, like PCLVisualizer::spin () did before */
+
+  if (step_mode_)
+  {
+    step_requested_ = false;
+
+    while (!step_requested_ && !stop_)
+    {
+      step_condition_.wait (lock);
+    }
+  }
+}
+
+void
+AsyncVisualizer::setMarker (bool visible, const pcl::PointXYZ& center, double radius)
+{
+  boost::mutex::scoped_lock lock (mutex_);
+
+  marker_visible_ = visible;
+  marker_center_ = center;
+  marker_radius_ = radius;
+  marker_changed_ = true;
+}
+
+int
+AsyncVisualizer::getDroppedFrames ()
+{
+  boost::mutex::scoped_lock lock (mutex_);
+  return (dropped_frames_);
+}
+
+void
+AsyncVisualizer::run ()
+{
+  /* VTK has to be used from the thread that created it, so the PCLVisualizer lives only here */
+
+  pcl::visualization::PCLVisualizer visualizer (name_);
+
+  visualizer.setBackgroundColor (1, 1, 1);
+  visualizer.initCameraParameters ();
+  visualizer.registerKeyboardCallback <AsyncVisualizer> (&AsyncVisualizer::keyboardCallback, *this, (void*) &visualizer);
+
+  while (true)
+  {
+    Snapshot snapshot;
+    bool has_snapshot = false, marker_changed, marker_visible;
+    pcl::PointXYZ marker_center;
+    double marker_radius;
+
+    {
+      boost::mutex::scoped_lock lock (mutex_);
+
+      if (stop_)
+      {
+        break;
+      }
+
+      if (!queue_.empty ())
+      {
+        snapshot = queue_.front ();
+        queue_.pop_front ();
+        has_snapshot = true;
+      }
+
+      marker_changed = marker_changed_;
+      marker_visible = marker_visible_;
+      marker_center = marker_center_;
+      marker_radius = marker_radius_;
+      marker_changed_ = false;
+    }
+
+    if (has_snapshot)
+    {
+      draw (visualizer, snapshot);
+    }
+
+    if (marker_changed)
+    {
+      visualizer.removeShape ("sphere");
+
+      if (marker_visible)
+      {
+        visualizer.addSphere < pcl::PointXYZ > (marker_center, marker_radius, "sphere");
+      }
+    }
+
+    visualizer.spinOnce (refresh_period_);
+  }
+
+  visualizer.close ();
+}
+
+void
+AsyncVisualizer::draw (pcl::visualization::PCLVisualizer& visualizer, const Snapshot& snapshot)
+{
+  visualizer.removeAllPointClouds ();
+  visualizer.removeCorrespondences ();
+
+  if (snapshot.model)
+  {
+    pcl::visualization::PointCloudColorHandlerCustom<pcl::PointNormal> blue_model (snapshot.model, 0, 0, 255);
+    visualizer.addPointCloud < pcl::PointNormal > (snapshot.model, blue_model, "source");
+  }
+
+  if (snapshot.target)
+  {
+    pcl::visualization::PointCloudColorHandlerCustom<pcl::PointNormal> green_target (snapshot.target, 0, 255, 0);
+    visualizer.addPointCloud < pcl::PointNormal > (snapshot.target, green_target, "scan");
+  }
+
+  if (snapshot.model && snapshot.target && snapshot.correspondences)
+  {
+    visualizer.addCorrespondences <pcl::PointNormal> (snapshot.model, snapshot.target, *snapshot.correspondences);
+  }
+}
+
+void
+AsyncVisualizer::keyboardCallback (const pcl::visualization::KeyboardEvent &event, void* viewer_void)
+{
+  KeyboardCallback callback;
+
+  {
+    boost::mutex::scoped_lock lock (mutex_);
+
+    if (event.keyDown () && event.getKeyCode () == 'n' && step_mode_)
+    {
+      step_requested_ = true;
+      step_condition_.notify_all ();
+    }
+
+    callback = keyboard_callback_;
+  }
+
+  /* The callback is called without the lock, so it may set the marker */
+
+  if (callback)
+  {
+    callback (event);
+  }
+}
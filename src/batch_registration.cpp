@@ -0,0 +1,482 @@
+#include <batch_registration.h>
+
+#include <pcl/console/time.h>
+
+#include <boost/filesystem.hpp>
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+
+template <typename PolicyT>
+BatchRegistration<PolicyT>::BatchRegistration (typename StatisticalModel<PolicyT>::ConstPtr model_ptr, int number_threads)
+{
+  int i;
+
+  model_ptr_ = model_ptr;
+
+  has_thresholds_ = false;
+  rotation_threshold_ = 0.0;
+  translation_threshold_ = 0.0;
+  coefficient_threshold_ = 0.0;
+  relative_residual_threshold_ = 0.0;
+
+  queue_capacity_ = 4;
+  crop_radius_ = 0.0;
+
+  next_job_ = 0;
+
+  for (i = 0; i < NUMBER_STAGES; ++i)
+  {
+    stage_threads_[i] = 1;
+    running_threads_[i] = 0;
+    busy_times_[i] = 0.0;
+  }
+
+  /* Reading, preparing and writing a target take a fraction of its fit, so one thread is enough for each of them */
+
+  stage_threads_[FIT_STAGE] = number_threads > 0 ? number_threads : std::max (1u, boost::thread::hardware_concurrency ());
+}
+
+template <typename PolicyT> void
+BatchRegistration<PolicyT>::addJob (std::string target_path, pcl::PointXYZ face_point, std::string result_path)
+{
+  Job job;
+
+  job.target_path = target_path;
+  job.face_point = face_point;
+  job.result_path = result_path;
+
+  job.succeeded = false;
+  job.number_points = 0;
+  job.latency = 0.0;
+  job.fit_time = 0.0;
+  job.residual = 0.0;
+
+  jobs_.push_back (job);
+}
+
+template <typename PolicyT> void
+BatchRegistration<PolicyT>::readJobs (std::string jobs_path, std::string result_prefix)
+{
+  int i;
+
+  float x, y, z;
+
+  std::string line, target;
+
+  std::vector < std::string > target_paths;
+
+  boost::filesystem::path path (jobs_path);
+
+  if ( !boost::filesystem::exists (path) )
+  {
+    PCL_ERROR ("Could not find the targets %s\n", jobs_path.c_str ());
+    exit (1);
+  }
+
+  /* In a directory the face of every target is read from the file next to it */
+
+  if ( boost::filesystem::is_directory (path) )
+  {
+    for (boost::filesystem::directory_iterator it (path); it != boost::filesystem::directory_iterator (); ++it)
+    {
+      if ( boost::filesystem::is_regular_file (it->status ()) && it->path ().extension ().string () == ".pcd" )
+      {
+        target_paths.push_back (it->path ().string ());
+      }
+    }
+
+    std::sort (target_paths.begin (), target_paths.end ());
+
+    for (i = 0; i < target_paths.size (); ++i)
+    {
+      boost::filesystem::path face_path (target_paths[i]);
+
+      face_path.replace_extension ();
+      face_path = face_path.string () + "_face.txt";
+
+      std::ifstream face_file (face_path.string ().c_str ());
+
+      if ( !(face_file >> x >> y >> z) )
+      {
+        PCL_WARN ("Skipping %s, %s is missing\n", target_paths[i].c_str (), face_path.string ().c_str ());
+        continue;
+      }
+
+      addJob (target_paths[i], pcl::PointXYZ (x, y, z), result_prefix + "_" + boost::filesystem::path (target_paths[i]).stem ().string ());
+    }
+
+    return;
+  }
+
+  /* In a manifest every line is a target followed by its face, the empty lines and the ones starting with # are skipped */
+
+  std::ifstream manifest (jobs_path.c_str ());
+
+  while ( std::getline (manifest, line) )
+  {
+    if ( line.empty () || line[0] == '#' )
+    {
+      continue;
+    }
+
+    std::istringstream iss (line);
+
+    if ( !(iss >> target >> x >> y >> z) )
+    {
+      PCL_ERROR ("Could not read the line \"%s\" of %s\n", line.c_str (), jobs_path.c_str ());
+      exit (1);
+    }
+
+    boost::filesystem::path target_path (target);
+
+    if ( target_path.is_relative () )
+    {
+      target_path = path.parent_path () / target_path;
+    }
+
+    addJob (target_path.string (), pcl::PointXYZ (x, y, z), result_prefix + "_" + target_path.stem ().string ());
+  }
+}
+
+template <typename PolicyT> void
+BatchRegistration<PolicyT>::setConvergenceThresholds (double rotation_threshold, double translation_threshold, double coefficient_threshold, double relative_residual_threshold)
+{
+  has_thresholds_ = true;
+  rotation_threshold_ = rotation_threshold;
+  translation_threshold_ = translation_threshold;
+  coefficient_threshold_ = coefficient_threshold;
+  relative_residual_threshold_ = relative_residual_threshold;
+}
+
+template <typename PolicyT> void
+BatchRegistration<PolicyT>::setStageThreads (Stage stage, int number_threads)
+{
+  stage_threads_[stage] = std::max (1, number_threads);
+}
+
+template <typename PolicyT> void
+BatchRegistration<PolicyT>::setQueueCapacity (int queue_capacity)
+{
+  queue_capacity_ = queue_capacity;
+}
+
+template <typename PolicyT> void
+BatchRegistration<PolicyT>::setCropRadius (double crop_radius)
+{
+  crop_radius_ = crop_radius;
+}
+
+template <typename PolicyT> int
+BatchRegistration<PolicyT>::getNumberJobs ()
+{
+  return (static_cast<int> (jobs_.size ()));
+}
+
+template <typename PolicyT> int
+BatchRegistration<PolicyT>::run (const FitFunction& fit)
+{
+  int i, j, number_failed = 0, number_succeeded = 0;
+
+  double wall_time, total_latency = 0.0, maximum_latency = 0.0;
+
+  const char* stage_names[NUMBER_STAGES] = {"load", "preprocess", "fit", "write"};
+
+  std::vector < double > latencies;
+
+  boost::thread_group workers;
+
+  pcl::console::TicToc timer;
+
+  next_job_ = 0;
+
+  for (i = 0; i < NUMBER_STAGES; ++i)
+  {
+    queues_[i].reset (new ItemQueue (queue_capacity_));
+    running_threads_[i] = stage_threads_[i];
+    busy_times_[i] = 0.0;
+  }
+
+  timer.tic ();
+
+  /* The stages are started from the last one, so every queue has its consumers before its producers */
+
+  for (j = 0; j < stage_threads_[WRITE_STAGE]; ++j)
+  {
+    workers.create_thread (boost::bind (&BatchRegistration::writeLoop, this));
+  }
+
+  for (j = 0; j < stage_threads_[FIT_STAGE]; ++j)
+  {
+    workers.create_thread (boost::bind (&BatchRegistration::fitLoop, this, boost::cref (fit)));
+  }
+
+  for (j = 0; j < stage_threads_[PREPROCESS_STAGE]; ++j)
+  {
+    workers.create_thread (boost::bind (&BatchRegistration::preprocessLoop, this));
+  }
+
+  for (j = 0; j < stage_threads_[LOAD_STAGE]; ++j)
+  {
+    workers.create_thread (boost::bind (&BatchRegistration::loadLoop, this));
+  }
+
+  workers.join_all ();
+
+  wall_time = timer.toc ();
+
+  for (i = 0; i < jobs_.size (); ++i)
+  {
+    if (!jobs_[i].succeeded)
+    {
+      ++number_failed;
+      continue;
+    }
+
+    ++number_succeeded;
+
+    latencies.push_back (jobs_[i].latency);
+    total_latency += jobs_[i].latency;
+    maximum_latency = std::max (maximum_latency, jobs_[i].latency);
+  }
+
+  PCL_INFO ("Batch of %d targets: %d fitted, %d failed in %f s, %f targets per second\n", getNumberJobs (), number_succeeded, number_failed,
+            wall_time / 1000.0, number_succeeded * 1000.0 / wall_time);
+
+  if (!latencies.empty ())
+  {
+    std::sort (latencies.begin (), latencies.end ());
+
+    PCL_INFO ("Latency per target: mean %f ms, median %f ms, maximum %f ms\n", total_latency / latencies.size (), latencies[latencies.size () / 2], maximum_latency);
+  }
+
+  /* A stage whose threads are busy all the time is the bottleneck, the queue in front of it stays full */
+
+  for (i = 0; i < NUMBER_STAGES; ++i)
+  {
+    if (i == LOAD_STAGE)
+    {
+      PCL_INFO ("Stage %s: %d threads, %.1f%% busy\n", stage_names[i], stage_threads_[i], 100.0 * busy_times_[i] / (stage_threads_[i] * wall_time));
+      continue;
+    }
+
+    PCL_INFO ("Stage %s: %d threads, %.1f%% busy, queue of %d with %.2f targets on average and %d at most\n", stage_names[i], stage_threads_[i],
+              100.0 * busy_times_[i] / (stage_threads_[i] * wall_time), queues_[i]->getCapacity (), queues_[i]->getMeanDepth (), queues_[i]->getMaximumDepth ());
+  }
+
+  return (number_failed);
+}
+
+template <typename PolicyT> void
+BatchRegistration<PolicyT>::finishStage (Stage stage, double busy_time)
+{
+  boost::mutex::scoped_lock lock (stage_mutex_);
+
+  busy_times_[stage] += busy_time;
+
+  if (--running_threads_[stage] == 0 && stage + 1 < NUMBER_STAGES)
+  {
+    queues_[stage + 1]->close ();
+  }
+}
+
+template <typename PolicyT> void
+BatchRegistration<PolicyT>::loadLoop ()
+{
+  Item item;
+
+  double busy_time = 0.0;
+
+  pcl::console::TicToc timer;
+
+  while (true)
+  {
+    {
+      boost::mutex::scoped_lock lock (stage_mutex_);
+
+      if ( next_job_ >= getNumberJobs () )
+      {
+        break;
+      }
+
+      item.job = next_job_++;
+    }
+
+    Job& job = jobs_[item.job];
+
+    job.timer.tic ();
+    timer.tic ();
+
+    /* A target which cannot be read fails its job only, the rest of the batch goes on */
+
+    item.target_point_normal_cloud_ptr.reset (new pcl::PointCloud<pcl::PointNormal>);
+
+    if (pcl::io::loadPCDFile<pcl::PointNormal> (job.target_path, *item.target_point_normal_cloud_ptr) == -1 || item.target_point_normal_cloud_ptr->empty ())
+    {
+      PCL_WARN ("Could not read the target %s\n", job.target_path.c_str ());
+      busy_time += timer.toc ();
+      continue;
+    }
+
+    busy_time += timer.toc ();
+
+    if ( !queues_[PREPROCESS_STAGE]->push (item) )
+    {
+      break;
+    }
+  }
+
+  finishStage (LOAD_STAGE, busy_time);
+}
+
+template <typename PolicyT> void
+BatchRegistration<PolicyT>::preprocessLoop ()
+{
+  Item item;
+
+  double busy_time = 0.0;
+
+  pcl::console::TicToc timer;
+
+  while ( queues_[PREPROCESS_STAGE]->pop (item) )
+  {
+    timer.tic ();
+
+    if (crop_radius_ > 0.0)
+    {
+      pcl::PointCloud<pcl::PointNormal>::Ptr cropped_cloud_ptr (new pcl::PointCloud<pcl::PointNormal>);
+
+      cropTarget (*item.target_point_normal_cloud_ptr, jobs_[item.job].face_point, *cropped_cloud_ptr);
+
+      item.target_point_normal_cloud_ptr = cropped_cloud_ptr;
+
+      /* Like a target which cannot be read, a crop which leaves too few points to fit fails its job only */
+
+      if (item.target_point_normal_cloud_ptr->size () < 6)
+      {
+        PCL_WARN ("Only %d points of the target %s are within %f m of the face\n", static_cast<int> (item.target_point_normal_cloud_ptr->size ()), jobs_[item.job].target_path.c_str (), crop_radius_);
+        busy_time += timer.toc ();
+        continue;
+      }
+    }
+
+    /* The normals and the kdtree are the same for any fit, so they are computed here instead of on the fit threads */
+
+    item.kdtree_ptr.reset (new pcl::search::KdTree<pcl::PointNormal>);
+
+    Registration < PolicyT >::prepareTarget (item.target_point_normal_cloud_ptr, item.kdtree_ptr);
+
+    busy_time += timer.toc ();
+
+    if ( !queues_[FIT_STAGE]->push (item) )
+    {
+      break;
+    }
+  }
+
+  finishStage (PREPROCESS_STAGE, busy_time);
+}
+
+template <typename PolicyT> void
+BatchRegistration<PolicyT>::fitLoop (const FitFunction& fit)
+{
+  Item item;
+
+  double busy_time = 0.0;
+
+  pcl::console::TicToc timer;
+
+  /* The Registration keeps its buffers from one target to the next, the model itself is shared */
+
+  boost::shared_ptr < Registration < PolicyT > > registration (new Registration < PolicyT >);
+
+  if (has_thresholds_)
+  {
+    registration->setConvergenceThresholds (rotation_threshold_, translation_threshold_, coefficient_threshold_, relative_residual_threshold_);
+  }
+
+  while ( queues_[FIT_STAGE]->pop (item) )
+  {
+    Job& job = jobs_[item.job];
+
+    timer.tic ();
+
+    registration->setModel (model_ptr_);
+    registration->setPreparedTarget (item.target_point_normal_cloud_ptr, item.kdtree_ptr, job.face_point);
+    registration->alignModel ();
+
+    job.residual = fit (*registration);
+
+    /* The model cloud of the Registration is overwritten by the next target, so the result is copied for the write stage */
+
+    item.result_point_normal_cloud_ptr.reset (new pcl::PointCloud<pcl::PointNormal> (*registration->getModelPointCloud ()));
+    item.kdtree_ptr.reset ();
+
+    job.fit_time = timer.toc ();
+    busy_time += job.fit_time;
+
+    if ( !queues_[WRITE_STAGE]->push (item) )
+    {
+      break;
+    }
+  }
+
+  finishStage (FIT_STAGE, busy_time);
+}
+
+template <typename PolicyT> void
+BatchRegistration<PolicyT>::writeLoop ()
+{
+  Item item;
+
+  double busy_time = 0.0;
+
+  pcl::console::TicToc timer;
+
+  pcl::PCDWriter pcd_writer;
+
+  while ( queues_[WRITE_STAGE]->pop (item) )
+  {
+    Job& job = jobs_[item.job];
+
+    timer.tic ();
+
+    /* The same files as Registration::writeDataToPCD () */
+
+    pcd_writer.writeBinary < pcl::PointNormal > (job.result_path + ".pcd", *item.result_point_normal_cloud_ptr);
+    pcd_writer.writeBinary < pcl::PointNormal > (job.result_path + "_target.pcd", *item.target_point_normal_cloud_ptr);
+
+    busy_time += timer.toc ();
+
+    job.number_points = static_cast<int> (item.target_point_normal_cloud_ptr->size ());
+    job.latency = job.timer.toc ();
+    job.succeeded = true;
+
+    PCL_INFO ("Target %s: %d points, %f ms from load to write of which %f ms of fit, residual %e\n", job.target_path.c_str (), job.number_points, job.latency, job.fit_time, job.residual);
+  }
+
+  finishStage (WRITE_STAGE, busy_time);
+}
+
+template <typename PolicyT> void
+BatchRegistration<PolicyT>::cropTarget (const pcl::PointCloud<pcl::PointNormal>& target, pcl::PointXYZ face_point, pcl::PointCloud<pcl::PointNormal>& cropped_target)
+{
+  int i;
+
+  double squared_radius = crop_radius_ * crop_radius_;
+
+  cropped_target.clear ();
+  cropped_target.reserve (target.size ());
+
+  for (i = 0; i < target.size (); ++i)
+  {
+    if ( pcl_isfinite (target[i].z) && (target[i].getVector3fMap () - face_point.getVector3fMap ()).squaredNorm () <= squared_radius )
+    {
+      cropped_target.push_back (target[i]);
+    }
+  }
+}
+
+template class BatchRegistration < SinglePrecision >;
+template class BatchRegistration < DoublePrecision >;
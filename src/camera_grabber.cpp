@@ -1,125 +1,67 @@
 #include <camera_grabber.h>
 
+#include <pcl/console/time.h>
+
 CameraGrabber::CameraGrabber ()
 {
-  point_cloud_ptr_.reset (new pcl::PointCloud <pcl::PointXYZRGB >);
 }
 
-void
-CameraGrabber::setCamera (int device, std::string file_classifier)
+CameraGrabber::~CameraGrabber ()
 {
-
-  if ( !video_grabber_.open (device) )
-  {
-    PCL_ERROR ("The camera is disconnected\n");
-    exit (-1);
-  }
-
-  if ( !face_classifier_.load ( file_classifier ) )
+  if (source_)
   {
-    PCL_ERROR ("Did not find the XML file\n");
-    exit (-1);
+    source_->stop ();
   }
-
-
 }
 
 void
-CameraGrabber::getCloud (const pcl::PointCloud<pcl::PointXYZ>::ConstPtr &cloud_ptr)
+CameraGrabber::setCamera (FrameSource::Ptr source, FaceLocator::Ptr face_locator)
 {
-  int i;
-  pcl::copyPointCloud (*cloud_ptr,*point_cloud_ptr_);
-
-  uint32_t rgb;
-  uint8_t value (255);
-
-  rgb = ( (uint32_t ) value) <<16;
 
-  for ( i = 0; i < cloud_ptr->points.size (); ++i)
-  {
-    point_cloud_ptr_->points[i].rgb = *reinterpret_cast<float*> (&rgb);
-  }
+  face_locator_ptr_ = face_locator;
 
+  source_ = source;
+  source_->start ();
 
 }
 
-pcl::PointCloud <pcl::PointXYZRGB >::Ptr
-CameraGrabber::getPointCloud (std::pair < int, int >& center_coordinates)
+pcl::PointCloud <pcl::PointXYZ >::ConstPtr
+CameraGrabber::getPointCloud (pcl::PointXYZ& face_center)
 {
-  std::vector<cv::Rect> faces;
-  cv::Mat frame, frame_gray;
-
-  int i,j;
+  pcl::console::TicToc timer;
 
-  uint32_t rgb;
-  uint8_t value (255);
+  Frame frame;
 
-  for (i = 0; i < 10; ++i)
-  {
-    video_grabber_.grab ();
-
-    video_grabber_.retrieve ( frame, CV_CAP_OPENNI_GRAY_IMAGE );
+  bool found = false;
 
-  }
-
-
-  pcl::OpenNIGrabber::Ptr openni_grabber (new pcl::OpenNIGrabber);
-
-  boost::function<void (const pcl::PointCloud<pcl::PointXYZ>::ConstPtr&)> function_grabber =
-    boost::bind (&CameraGrabber::getCloud, this, _1);
+  int i;
 
-  openni_grabber->registerCallback (function_grabber);
+  /* Number of frames searched for a face before giving up, about one second of the sensor */
 
+  const int maximum_frames = 30;
 
-  openni_grabber->start ();
+  /* The source wakes us up as soon as a frame is complete, the first frames may be too dark until the exposure of the sensor has settled so a few are tried */
 
-  for (i = 0; i < 3; ++i)
+  for (i = 0; i < maximum_frames && !found && !source_->isFinished (); ++i)
   {
-    boost::this_thread::sleep (boost::posix_time::seconds (1));
-  }
-
-  openni_grabber->stop ();
-
+    if ( !source_->grab (frame, 1000) || (face_locator_ptr_->needsGrayImage () && frame.gray.empty ()) )
+    {
+      continue;
+    }
 
+    timer.tic ();
 
-  cv::equalizeHist ( frame, frame_gray);
+    found = face_locator_ptr_->locate (frame, face_center);
 
-  face_classifier_.detectMultiScale (frame_gray, faces, 1.1, 2, 0|CV_HAAR_SCALE_IMAGE, cv::Size (30, 30));
+    face_locator_ptr_->printLatency (frame, timer.toc ());
+  }
 
-  if (faces.size () != 1)
+  if (!found)
   {
     PCL_ERROR ("No faces detected\n");
     exit (1);
   }
 
-  pcl::PointXYZRGB center;
-
-  center = point_cloud_ptr_->at (faces[0].x + faces[0].width/2, faces[0].y + faces[0].height/2);
-
-
-  rgb = ( (uint32_t)value) << 8;
-
-  for (i = 0; i < point_cloud_ptr_->width; ++i)
-  {
-    for (j = 0; j < point_cloud_ptr_->height; ++j)
-    {
-      point_cloud_ptr_->at (i,j).rgb = *reinterpret_cast<float*> (&rgb);
-    }
-  }
-
-  rgb = ( (uint32_t)value) << 16;
-
-  for ( i = faces[0].x; i < faces[0].x + faces[0].width; ++i)
-  {
-    for ( j = faces[0].y; j < faces[0].y + faces[0].height; ++j)
-    {
-      point_cloud_ptr_->at (i,j).rgb = *reinterpret_cast<float*> (&rgb);
-    }
-  }
-
-  center_coordinates.first = faces[0].x + faces[0].width/2;
-  center_coordinates.second = faces[0].y + faces[0].height/2;
-
-  return (point_cloud_ptr_);
+  return (frame.getCloud ());
 
 }
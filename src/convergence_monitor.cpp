@@ -0,0 +1,77 @@
+#include <convergence_monitor.h>
+
+#include <cmath>
+
+ConvergenceMonitor::ConvergenceMonitor ()
+{
+  rotation_threshold_ = 1e-4;
+  translation_threshold_ = 1e-5;
+  coefficient_threshold_ = 1e-3;
+  relative_residual_threshold_ = 1e-4;
+
+  reset (0);
+}
+
+void
+ConvergenceMonitor::setThresholds (double rotation_threshold, double translation_threshold, double coefficient_threshold, double relative_residual_threshold)
+{
+  rotation_threshold_ = rotation_threshold;
+  translation_threshold_ = translation_threshold;
+  coefficient_threshold_ = coefficient_threshold;
+  relative_residual_threshold_ = relative_residual_threshold;
+}
+
+void
+ConvergenceMonitor::reset (int maximum_iterations)
+{
+  maximum_iterations_ = maximum_iterations;
+  iterations_ = 0;
+  previous_residual_ = -1.0;
+  converged_ = false;
+}
+
+bool
+ConvergenceMonitor::update (double rotation_change, double translation_change, double coefficient_change, double residual)
+{
+  ++iterations_;
+
+  bool settled = rotation_change < rotation_threshold_ && translation_change < translation_threshold_ && coefficient_change < coefficient_threshold_;
+
+  /* The residual is compared with the one of the previous iteration, so it cannot decide the convergence on the first one */
+
+  bool stalled = false;
+
+  if (previous_residual_ > 0.0)
+  {
+    stalled = std::fabs (previous_residual_ - residual) / previous_residual_ < relative_residual_threshold_;
+  }
+
+  previous_residual_ = residual;
+
+  converged_ = settled || stalled;
+
+  return (converged_);
+}
+
+bool
+ConvergenceMonitor::hasConverged () const
+{
+  return (converged_);
+}
+
+int
+ConvergenceMonitor::getIterations () const
+{
+  return (iterations_);
+}
+
+int
+ConvergenceMonitor::getIterationsSaved () const
+{
+  if (iterations_ >= maximum_iterations_)
+  {
+    return (0);
+  }
+
+  return (maximum_iterations_ - iterations_);
+}
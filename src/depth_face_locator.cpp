@@ -0,0 +1,182 @@
+#include <depth_face_locator.h>
+
+#include <limits>
+
+DepthFaceLocator::DepthFaceLocator ()
+{
+  minimum_depth_ = 0.4;
+  maximum_depth_ = 2.0;
+  head_radius_ = 0.18;
+  minimum_head_width_ = 0.12;
+  maximum_depth_jump_ = 0.03;
+  maximum_attempts_ = 5;
+}
+
+void
+DepthFaceLocator::setDepthRange (double minimum_depth, double maximum_depth)
+{
+  minimum_depth_ = minimum_depth;
+  maximum_depth_ = maximum_depth;
+}
+
+void
+DepthFaceLocator::setHeadSize (double head_radius, double minimum_head_width)
+{
+  head_radius_ = head_radius;
+  minimum_head_width_ = minimum_head_width;
+}
+
+bool
+DepthFaceLocator::locate (const Frame& frame, pcl::PointXYZ& face_center)
+{
+  int i, j, attempt, seed;
+
+  float nearest_depth, distance, nearest_distance;
+
+  pcl::PointCloud<pcl::PointXYZ>::ConstPtr cloud_ptr = frame.getCloud ();
+
+  const pcl::PointCloud<pcl::PointXYZ>& cloud = *cloud_ptr;
+
+  if (cloud.height < 2)
+  {
+    PCL_WARN ("The depth-only face locator needs an organized cloud\n");
+    return (false);
+  }
+
+  visited_.assign (cloud.size (), 0);
+
+  for (attempt = 0; attempt < maximum_attempts_; ++attempt)
+  {
+
+    /* The seed is the nearest point not yet part of a rejected blob, for a person facing the sensor it is usually the tip of the nose */
+
+    seed = -1;
+    nearest_depth = maximum_depth_;
+
+    for (i = 0; i < cloud.size (); ++i)
+    {
+      float z = cloud.points[i].z;
+
+      if ( !visited_[i] && z >= minimum_depth_ && z < nearest_depth )
+      {
+        nearest_depth = z;
+        seed = i;
+      }
+    }
+
+    if (seed == -1)
+    {
+      return (false);
+    }
+
+    growBlob (cloud, seed, blob_);
+
+    /* The head-size prior: the blob has to be at least as wide and as high as a head */
+
+    Eigen::Vector3f minimum_point = cloud.points[seed].getVector3fMap (), maximum_point = minimum_point, centroid = Eigen::Vector3f::Zero ();
+
+    for (j = 0; j < blob_.size (); ++j)
+    {
+      minimum_point = minimum_point.cwiseMin (cloud.points[blob_[j]].getVector3fMap ());
+      maximum_point = maximum_point.cwiseMax (cloud.points[blob_[j]].getVector3fMap ());
+      centroid += cloud.points[blob_[j]].getVector3fMap ();
+    }
+
+    if ( maximum_point[0] - minimum_point[0] < minimum_head_width_ || maximum_point[1] - minimum_point[1] < minimum_head_width_ )
+    {
+      continue;
+    }
+
+    centroid /= blob_.size ();
+
+    /* The center of the face is the point of the surface in front of the centroid of the head, like the point under the center of a detected face */
+
+    nearest_distance = std::numeric_limits<float>::max ();
+
+    for (j = 0; j < blob_.size (); ++j)
+    {
+      distance = (cloud.points[blob_[j]].getVector3fMap ().head<2> () - centroid.head<2> ()).squaredNorm ();
+
+      if (distance < nearest_distance)
+      {
+        nearest_distance = distance;
+        face_center = cloud.points[blob_[j]];
+      }
+    }
+
+    return (true);
+  }
+
+  return (false);
+}
+
+bool
+DepthFaceLocator::needsGrayImage ()
+{
+  return (false);
+}
+
+void
+DepthFaceLocator::printLatency (const Frame& frame, double latency)
+{
+  PCL_DEBUG ("Face location of frame %u: %f ms\n", frame.index, latency);
+}
+
+void
+DepthFaceLocator::growBlob (const pcl::PointCloud<pcl::PointXYZ>& cloud, int seed, std::vector<int>& blob)
+{
+  int index, u, v, k, neighbor;
+
+  int width = cloud.width, height = cloud.height;
+
+  const int offset_u[4] = {1, -1, 0, 0};
+  const int offset_v[4] = {0, 0, 1, -1};
+
+  Eigen::Vector3f seed_point = cloud.points[seed].getVector3fMap ();
+
+  float squared_radius = head_radius_ * head_radius_;
+
+  blob.clear ();
+  stack_.clear ();
+
+  stack_.push_back (seed);
+  visited_[seed] = 1;
+
+  /* The blob is grown over the 4-neighborhood while the depth is continuous, and never farther from the seed than the size of a head */
+
+  while (!stack_.empty ())
+  {
+    index = stack_.back ();
+    stack_.pop_back ();
+
+    blob.push_back (index);
+
+    u = index % width;
+    v = index / width;
+
+    for (k = 0; k < 4; ++k)
+    {
+      if (u + offset_u[k] < 0 || u + offset_u[k] >= width || v + offset_v[k] < 0 || v + offset_v[k] >= height)
+      {
+        continue;
+      }
+
+      neighbor = index + offset_v[k] * width + offset_u[k];
+
+      const pcl::PointXYZ& point = cloud.points[neighbor];
+
+      if ( visited_[neighbor] || !pcl_isfinite (point.z) || std::abs (point.z - cloud.points[index].z) > maximum_depth_jump_ )
+      {
+        continue;
+      }
+
+      if ( (point.getVector3fMap () - seed_point).squaredNorm () > squared_radius )
+      {
+        continue;
+      }
+
+      visited_[neighbor] = 1;
+      stack_.push_back (neighbor);
+    }
+  }
+}
@@ -0,0 +1,206 @@
+#include <face_detector.h>
+
+#include <pcl/console/time.h>
+
+#include <algorithm>
+#include <map>
+
+/* The cascades loaded so far, a cascade is released when its last detector is destroyed */
+
+static std::map < std::string, boost::weak_ptr < FaceDetector::Cascade > > cascade_cache;
+
+static boost::mutex cascade_cache_mutex;
+
+FaceDetector::FaceDetector ()
+{
+  scale_ = 0.5;
+  padding_ = 0.5;
+  tracking_ = true;
+  has_face_ = false;
+  full_search_ = false;
+  last_latency_ = 0.0;
+  total_latency_ = 0.0;
+  number_detections_ = 0;
+}
+
+void
+FaceDetector::load (std::string file_classifier)
+{
+  cascade_ptr_ = getCascade (file_classifier);
+
+  if (!cascade_ptr_)
+  {
+    PCL_ERROR ("Did not find the XML file\n");
+    exit (-1);
+  }
+}
+
+void
+FaceDetector::setScale (double scale)
+{
+  scale_ = std::min (std::max (scale, 0.1), 1.0);
+}
+
+void
+FaceDetector::setTracking (bool tracking)
+{
+  tracking_ = tracking;
+  has_face_ = false;
+}
+
+void
+FaceDetector::setPadding (double padding)
+{
+  padding_ = padding;
+}
+
+bool
+FaceDetector::detect (const cv::Mat& gray, cv::Rect& face)
+{
+  pcl::console::TicToc timer;
+
+  bool found = false;
+
+  timer.tic ();
+
+  full_search_ = !tracking_ || !has_face_;
+
+  /* The previous face is searched for in a window around it, with sizes close to its own */
+
+  if (!full_search_)
+  {
+    int pad_x = last_face_.width * padding_, pad_y = last_face_.height * padding_;
+
+    cv::Rect window (last_face_.x - pad_x, last_face_.y - pad_y, last_face_.width + 2 * pad_x, last_face_.height + 2 * pad_y);
+
+    window = window & cv::Rect (0, 0, gray.cols, gray.rows);
+
+    found = searchWindow (gray, window, cv::Size (last_face_.width * 0.6, last_face_.height * 0.6), cv::Size (last_face_.width * 1.6, last_face_.height * 1.6), face);
+
+    full_search_ = !found;
+  }
+
+  /* The whole image is searched at the start and whenever the face was lost */
+
+  if (full_search_)
+  {
+    found = searchWindow (gray, cv::Rect (0, 0, gray.cols, gray.rows), cv::Size (30, 30), cv::Size (), face);
+  }
+
+  has_face_ = found;
+
+  if (found)
+  {
+    last_face_ = face;
+  }
+
+  last_latency_ = timer.toc ();
+  total_latency_ += last_latency_;
+  ++number_detections_;
+
+  return (found);
+}
+
+void
+FaceDetector::reset ()
+{
+  has_face_ = false;
+}
+
+double
+FaceDetector::getLastLatency ()
+{
+  return (last_latency_);
+}
+
+bool
+FaceDetector::wasFullSearch ()
+{
+  return (full_search_);
+}
+
+double
+FaceDetector::getAverageLatency ()
+{
+  return (number_detections_ > 0 ? total_latency_ / number_detections_ : 0.0);
+}
+
+bool
+FaceDetector::searchWindow (const cv::Mat& gray, const cv::Rect& window, cv::Size minimum_size, cv::Size maximum_size, cv::Rect& face)
+{
+  int i, biggest = -1;
+
+  std::vector<cv::Rect> faces;
+
+  if (window.area () == 0)
+  {
+    return (false);
+  }
+
+  /* Only the window is scaled and equalized, the cascade cannot find faces smaller than its 20 x 20 training size so the minimum is clamped to it */
+
+  if (scale_ < 1.0)
+  {
+    cv::resize (gray (window), scaled_image_, cv::Size (window.width * scale_, window.height * scale_), 0, 0, CV_INTER_AREA);
+    cv::equalizeHist (scaled_image_, equalized_image_);
+  }
+
+  else
+  {
+    cv::equalizeHist (gray (window), equalized_image_);
+  }
+
+  minimum_size = cv::Size (std::max (static_cast<int> (minimum_size.width * scale_), 20), std::max (static_cast<int> (minimum_size.height * scale_), 20));
+
+  if (maximum_size.area () > 0)
+  {
+    maximum_size = cv::Size (maximum_size.width * scale_, maximum_size.height * scale_);
+  }
+
+  {
+    boost::mutex::scoped_lock lock (cascade_ptr_->mutex);
+    cascade_ptr_->classifier.detectMultiScale (equalized_image_, faces, 1.1, 2, 0|CV_HAAR_SCALE_IMAGE, minimum_size, maximum_size);
+  }
+
+  for (i = 0; i < faces.size (); ++i)
+  {
+    if (biggest == -1 || faces[i].area () > faces[biggest].area ())
+    {
+      biggest = i;
+    }
+  }
+
+  if (biggest == -1)
+  {
+    return (false);
+  }
+
+  face.x = window.x + faces[biggest].x / scale_;
+  face.y = window.y + faces[biggest].y / scale_;
+  face.width = faces[biggest].width / scale_;
+  face.height = faces[biggest].height / scale_;
+
+  return (true);
+}
+
+boost::shared_ptr < FaceDetector::Cascade >
+FaceDetector::getCascade (const std::string& file_classifier)
+{
+  boost::mutex::scoped_lock lock (cascade_cache_mutex);
+
+  boost::shared_ptr < Cascade > cascade_ptr = cascade_cache[file_classifier].lock ();
+
+  if (!cascade_ptr)
+  {
+    cascade_ptr.reset (new Cascade);
+
+    if ( !cascade_ptr->classifier.load (file_classifier) )
+    {
+      return (boost::shared_ptr < Cascade > ());
+    }
+
+    cascade_cache[file_classifier] = cascade_ptr;
+  }
+
+  return (cascade_ptr);
+}
@@ -0,0 +1,251 @@
+#include <face_fitter.h>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+DepthBuffer::DepthBuffer ()
+{
+  data = NULL;
+  format = UINT16;
+  width = 0;
+  height = 0;
+  stride = 0;
+  depth_scale = 0.001f;
+}
+
+FitResult::FitResult ()
+{
+  std::fill (pose, pose + 16, 0.0f);
+  residual = 0.0;
+  number_target_points = 0;
+  coefficients = NULL;
+  coefficient_capacity = 0;
+  number_coefficients = 0;
+  vertices = NULL;
+  vertex_capacity = 0;
+  number_vertices = 0;
+}
+
+template <typename PolicyT>
+FaceFitter<PolicyT>::FaceFitter (typename StatisticalModel<PolicyT>::ConstPtr model_ptr)
+{
+  model_ptr_ = model_ptr;
+
+  target_point_normal_cloud_ptr_.reset (new pcl::PointCloud<pcl::PointNormal>);
+  kdtree_ptr_.reset (new pcl::search::KdTree<pcl::PointNormal>);
+
+  joint_ = false;
+  joint_iterations_ = 30;
+  energy_weight_ = 0.001;
+  angle_limit_ = std::atan (1.0);
+  distance_limit_ = 0.001;
+
+  depth_range_ = 0.15f;
+}
+
+template <typename PolicyT> void
+FaceFitter<PolicyT>::setFitParameters (bool joint, int joint_iterations, double energy_weight, double angle_limit, double distance_limit)
+{
+  joint_ = joint;
+  joint_iterations_ = joint_iterations;
+  energy_weight_ = energy_weight;
+  angle_limit_ = angle_limit;
+  distance_limit_ = distance_limit;
+}
+
+template <typename PolicyT> void
+FaceFitter<PolicyT>::setConvergenceThresholds (double rotation_threshold, double translation_threshold, double coefficient_threshold, double relative_residual_threshold)
+{
+  registration_.setConvergenceThresholds (rotation_threshold, translation_threshold, coefficient_threshold, relative_residual_threshold);
+}
+
+template <typename PolicyT> void
+FaceFitter<PolicyT>::setDepthRange (float depth_range)
+{
+  depth_range_ = depth_range;
+}
+
+template <typename PolicyT> bool
+FaceFitter<PolicyT>::fit (const DepthBuffer& depth, const CameraIntrinsics& intrinsics, const FaceRectangle& rectangle, FitResult& result)
+{
+  int i, j, u_begin, v_begin, u_end, v_end;
+
+  pcl::PointXYZ face_point;
+
+  if (depth.data == NULL || intrinsics.fx <= 0.0f || intrinsics.fy <= 0.0f)
+  {
+    return (false);
+  }
+
+  u_begin = std::max (rectangle.x, 0);
+  v_begin = std::max (rectangle.y, 0);
+  u_end = std::min (rectangle.x + rectangle.width, depth.width);
+  v_end = std::min (rectangle.y + rectangle.height, depth.height);
+
+  if (u_begin >= u_end || v_begin >= v_end)
+  {
+    return (false);
+  }
+
+  face_point = backProject (depth, intrinsics, u_begin, v_begin, u_end, v_end);
+
+  /* The normals need 10 neighbors */
+
+  if ( !pcl_isfinite (face_point.z) || target_point_normal_cloud_ptr_->size () < 10 )
+  {
+    return (false);
+  }
+
+  Registration<PolicyT>::prepareTarget (target_point_normal_cloud_ptr_, kdtree_ptr_);
+
+  registration_.setModel (model_ptr_);
+  registration_.setPreparedTarget (target_point_normal_cloud_ptr_, kdtree_ptr_, face_point);
+  registration_.alignModel ();
+
+  if (joint_)
+  {
+    registration_.calculateJointRegistration (50, energy_weight_, joint_iterations_, angle_limit_, distance_limit_);
+  }
+
+  else
+  {
+    registration_.calculateAlternativeRegistrations (50, energy_weight_, 15, 100, angle_limit_, distance_limit_);
+  }
+
+  result.residual = registration_.computeResidual (angle_limit_, distance_limit_);
+  result.number_target_points = target_point_normal_cloud_ptr_->size ();
+
+  typename Registration<PolicyT>::Matrix4 pose = registration_.getPose ();
+  typename Registration<PolicyT>::VectorX coefficients = registration_.getCoefficients ();
+
+  for (i = 0; i < 4; ++i)
+  {
+    for (j = 0; j < 4; ++j)
+    {
+      result.pose[4 * i + j] = static_cast<float> (pose (i, j));
+    }
+  }
+
+  result.number_coefficients = coefficients.rows ();
+
+  for (i = 0; result.coefficients != NULL && i < std::min (result.coefficient_capacity, result.number_coefficients); ++i)
+  {
+    result.coefficients[i] = static_cast<float> (coefficients[i]);
+  }
+
+  pcl::PointCloud<pcl::PointNormal>::ConstPtr model_cloud = registration_.getModelPointCloud ();
+
+  result.number_vertices = model_cloud->size ();
+
+  for (i = 0; result.vertices != NULL && i < std::min (result.vertex_capacity, result.number_vertices); ++i)
+  {
+    result.vertices[3 * i] = model_cloud->points[i].x;
+    result.vertices[3 * i + 1] = model_cloud->points[i].y;
+    result.vertices[3 * i + 2] = model_cloud->points[i].z;
+  }
+
+  return (true);
+}
+
+template <typename PolicyT> pcl::PointXYZ
+FaceFitter<PolicyT>::backProject (const DepthBuffer& depth, const CameraIntrinsics& intrinsics, int u_begin, int v_begin, int u_end, int v_end)
+{
+  int u, v, stride;
+
+  float z, median_depth, constant_x = 1.0f / intrinsics.fx, constant_y = 1.0f / intrinsics.fy;
+
+  pcl::PointNormal point;
+
+  pcl::PointXYZ face_point;
+
+  stride = depth.stride > 0 ? depth.stride : depth.width * (depth.format == DepthBuffer::UINT16 ? sizeof (unsigned short) : sizeof (float));
+
+  /* The median depth of the rectangle is the one of the face, the background only shows in its corners */
+
+  depths_.clear ();
+
+  for (v = v_begin; v < v_end; ++v)
+  {
+    for (u = u_begin; u < u_end; ++u)
+    {
+      z = readDepth (depth, stride, u, v);
+
+      if (pcl_isfinite (z))
+      {
+        depths_.push_back (z);
+      }
+    }
+  }
+
+  target_point_normal_cloud_ptr_->points.clear ();
+
+  if (depths_.empty ())
+  {
+    face_point.x = face_point.y = face_point.z = std::numeric_limits<float>::quiet_NaN ();
+    return (face_point);
+  }
+
+  std::nth_element (depths_.begin (), depths_.begin () + depths_.size () / 2, depths_.end ());
+
+  median_depth = depths_[depths_.size () / 2];
+
+  /* The buffer is read a second time instead of keeping the pixel coordinates of every depth, the points go straight into the cloud whose capacity is kept from the previous fits */
+
+  for (v = v_begin; v < v_end; ++v)
+  {
+    for (u = u_begin; u < u_end; ++u)
+    {
+      z = readDepth (depth, stride, u, v);
+
+      if ( !pcl_isfinite (z) || (depth_range_ > 0.0f && std::abs (z - median_depth) > depth_range_) )
+      {
+        continue;
+      }
+
+      point.x = (u - intrinsics.cx) * z * constant_x;
+      point.y = (v - intrinsics.cy) * z * constant_y;
+      point.z = z;
+
+      target_point_normal_cloud_ptr_->points.push_back (point);
+    }
+  }
+
+  target_point_normal_cloud_ptr_->width = target_point_normal_cloud_ptr_->points.size ();
+  target_point_normal_cloud_ptr_->height = 1;
+  target_point_normal_cloud_ptr_->is_dense = true;
+
+  face_point.x = ( (u_begin + u_end) * 0.5f - intrinsics.cx ) * median_depth * constant_x;
+  face_point.y = ( (v_begin + v_end) * 0.5f - intrinsics.cy ) * median_depth * constant_y;
+  face_point.z = median_depth;
+
+  return (face_point);
+}
+
+template <typename PolicyT> float
+FaceFitter<PolicyT>::readDepth (const DepthBuffer& depth, int stride, int u, int v)
+{
+  float z;
+
+  const char* row = static_cast<const char*> (depth.data) + static_cast<size_t> (v) * stride;
+
+  if (depth.format == DepthBuffer::UINT16)
+  {
+    z = reinterpret_cast<const unsigned short*> (row)[u];
+  }
+
+  else
+  {
+    z = reinterpret_cast<const float*> (row)[u];
+  }
+
+  if (z == 0.0f || !pcl_isfinite (z))
+  {
+    return (std::numeric_limits<float>::quiet_NaN ());
+  }
+
+  return (z * depth.depth_scale);
+}
+
+template class FaceFitter < SinglePrecision >;
+template class FaceFitter < DoublePrecision >;
@@ -0,0 +1,75 @@
+#include <fit_client.h>
+
+#include <sstream>
+#include <vector>
+
+FitClient::FitClient (std::string socket_path)
+{
+  socket_path_ = socket_path;
+}
+
+bool
+FitClient::fit (std::string target_path, pcl::PointXYZ face_point, std::string options, std::string& response)
+{
+  std::ostringstream line;
+
+  line.precision (9);
+  line << "FIT " << target_path << " " << face_point.x << " " << face_point.y << " " << face_point.z << " " << options;
+
+  return (request (line.str (), NULL, 0, response));
+}
+
+bool
+FitClient::fitPoints (const pcl::PointCloud<pcl::PointXYZ>& target, pcl::PointXYZ face_point, std::string options, std::string& response)
+{
+  int i;
+
+  std::ostringstream line;
+
+  std::vector < float > coordinates (3 * target.size ());
+
+  for (i = 0; i < target.size (); ++i)
+  {
+    coordinates[3 * i] = target.points[i].x;
+    coordinates[3 * i + 1] = target.points[i].y;
+    coordinates[3 * i + 2] = target.points[i].z;
+  }
+
+  line.precision (9);
+  line << "POINTS " << target.size () << " " << face_point.x << " " << face_point.y << " " << face_point.z << " " << options;
+
+  return (request (line.str (), coordinates.empty () ? NULL : &coordinates[0], coordinates.size () * sizeof (float), response));
+}
+
+bool
+FitClient::getStats (std::string& response)
+{
+  return (request ("STATS", NULL, 0, response));
+}
+
+bool
+FitClient::stop (std::string& response)
+{
+  return (request ("STOP", NULL, 0, response));
+}
+
+bool
+FitClient::request (const std::string& line, const void* payload, size_t size, std::string& response)
+{
+  LocalSocket::Ptr socket = LocalSocket::connect (socket_path_);
+
+  bool written;
+
+  if (!socket)
+  {
+    return (false);
+  }
+
+  written = socket->writeString (line + "\n") && (size == 0 || socket->writeBytes (payload, size));
+
+  /* The server answers once and closes the connection, a BUSY or an ERROR may come before it has read the points, so the answer is read even if they could not all be sent */
+
+  socket->shutdownWrite ();
+
+  return ( socket->readAll (response) && (written || !response.empty ()) );
+}
@@ -0,0 +1,409 @@
+#include <fit_server.h>
+
+#include <cmath>
+#include <sstream>
+
+namespace
+{
+  /* The time a client gets to send the line of a request, and then its points, in seconds. Both are totals, not limits on each read */
+
+  const double LINE_DEADLINE = 1.0;
+
+  const double POINTS_DEADLINE = 10.0;
+}
+
+template <typename PolicyT>
+FitServer<PolicyT>::FitServer (typename StatisticalModel<PolicyT>::ConstPtr model_ptr, int number_threads, int max_pending) : queue_ (max_pending)
+{
+  model_ptr_ = model_ptr;
+
+  number_threads_ = number_threads > 0 ? number_threads : std::max (1u, boost::thread::hardware_concurrency ());
+
+  joint_ = false;
+  joint_iterations_ = 30;
+  energy_weight_ = 0.001;
+  angle_limit_ = std::atan (1.0);
+  distance_limit_ = 0.001;
+
+  has_thresholds_ = false;
+  rotation_threshold_ = 0.0;
+  translation_threshold_ = 0.0;
+  coefficient_threshold_ = 0.0;
+  relative_residual_threshold_ = 0.0;
+
+  served_requests_ = 0;
+  failed_requests_ = 0;
+  rejected_requests_ = 0;
+  running_requests_ = 0;
+  total_latency_ = 0.0;
+  maximum_latency_ = 0.0;
+}
+
+template <typename PolicyT> void
+FitServer<PolicyT>::setFitParameters (bool joint, int joint_iterations, double energy_weight, double angle_limit, double distance_limit)
+{
+  joint_ = joint;
+  joint_iterations_ = joint_iterations;
+  energy_weight_ = energy_weight;
+  angle_limit_ = angle_limit;
+  distance_limit_ = distance_limit;
+}
+
+template <typename PolicyT> void
+FitServer<PolicyT>::setConvergenceThresholds (double rotation_threshold, double translation_threshold, double coefficient_threshold, double relative_residual_threshold)
+{
+  has_thresholds_ = true;
+  rotation_threshold_ = rotation_threshold;
+  translation_threshold_ = translation_threshold;
+  coefficient_threshold_ = coefficient_threshold;
+  relative_residual_threshold_ = relative_residual_threshold;
+}
+
+template <typename PolicyT> bool
+FitServer<PolicyT>::run (std::string socket_path)
+{
+  int i;
+
+  std::string command, error;
+
+  boost::thread_group workers;
+
+  LocalSocket::Ptr listener = LocalSocket::listen (socket_path, 64);
+
+  if (!listener)
+  {
+    PCL_ERROR ("Could not listen on %s\n", socket_path.c_str ());
+    return (false);
+  }
+
+  uptime_timer_.tic ();
+
+  for (i = 0; i < number_threads_; ++i)
+  {
+    workers.create_thread (boost::bind (&FitServer::workerLoop, this));
+  }
+
+  PCL_INFO ("Serving fits on %s with %d threads and at most %d requests waiting\n", socket_path.c_str (), number_threads_, queue_.getCapacity ());
+
+  while (true)
+  {
+    Request request;
+
+    request.socket = listener->accept ();
+
+    if (!request.socket)
+    {
+      PCL_WARN ("Could not accept a connection\n");
+      continue;
+    }
+
+    request.timer.tic ();
+
+    /* Only the line is read on this thread, the deadline keeps a client which sends it slowly or not at all from holding up the others */
+
+    request.socket->setDeadline (LINE_DEADLINE);
+
+    if ( !readRequest (*request.socket, command, request, error) )
+    {
+      request.socket->writeString ("ERROR " + error + "\n");
+
+      boost::mutex::scoped_lock lock (stats_mutex_);
+      ++failed_requests_;
+      continue;
+    }
+
+    if (command == "STATS")
+    {
+      request.socket->writeString (getStats ());
+      continue;
+    }
+
+    if (command == "STOP")
+    {
+      request.socket->writeString ("OK\n");
+      break;
+    }
+
+    /* The admission is bounded, a request which would have to wait behind max_pending others is turned away at once */
+
+    if ( !queue_.tryPush (request) )
+    {
+      request.socket->writeString ("BUSY\n");
+
+      boost::mutex::scoped_lock lock (stats_mutex_);
+      ++rejected_requests_;
+    }
+  }
+
+  /* The requests admitted before STOP are still answered */
+
+  queue_.close ();
+  workers.join_all ();
+
+  PCL_INFO ("%s", getStats ().c_str ());
+
+  return (true);
+}
+
+template <typename PolicyT> bool
+FitServer<PolicyT>::readRequest (LocalSocket& socket, std::string& command, Request& request, std::string& error)
+{
+  std::string line, option;
+
+  if ( !socket.readLine (line) )
+  {
+    error = "no request";
+    return (false);
+  }
+
+  std::istringstream iss (line);
+
+  iss >> command;
+
+  if (command == "STATS" || command == "STOP")
+  {
+    return (true);
+  }
+
+  request.joint = joint_;
+  request.joint_iterations = joint_iterations_;
+  request.energy_weight = energy_weight_;
+  request.mesh = false;
+  request.number_points = 0;
+
+  if (command == "FIT")
+  {
+    iss >> request.target_path;
+  }
+
+  else if (command == "POINTS")
+  {
+    iss >> request.number_points;
+  }
+
+  else
+  {
+    error = "unknown command " + command;
+    return (false);
+  }
+
+  if ( !(iss >> request.face_point.x >> request.face_point.y >> request.face_point.z) )
+  {
+    error = "malformed request";
+    return (false);
+  }
+
+  while (iss >> option)
+  {
+    std::string key = option.substr (0, option.find ('='));
+    std::istringstream value (option.find ('=') == std::string::npos ? std::string () : option.substr (option.find ('=') + 1));
+
+    if ( !( (key == "joint" && value >> request.joint) || (key == "iterations" && value >> request.joint_iterations) ||
+            (key == "energy_weight" && value >> request.energy_weight) || (key == "mesh" && value >> request.mesh) ) )
+    {
+      error = "unknown option " + option;
+      return (false);
+    }
+  }
+
+  /* The points themselves are read by the thread which fits them */
+
+  if ( command == "POINTS" && (request.number_points < 6 || request.number_points > MAXIMUM_POINTS) )
+  {
+    error = "bad number of points";
+    return (false);
+  }
+
+  return (true);
+}
+
+template <typename PolicyT> bool
+FitServer<PolicyT>::readPoints (Request& request)
+{
+  int i;
+
+  std::vector < float > coordinates (3 * request.number_points);
+
+  /* The points of an inline target follow the line, three floats each */
+
+  request.socket->setDeadline (POINTS_DEADLINE);
+
+  if ( !request.socket->readBytes (&coordinates[0], coordinates.size () * sizeof (float)) )
+  {
+    return (false);
+  }
+
+  request.target_point_normal_cloud_ptr.reset (new pcl::PointCloud<pcl::PointNormal> (request.number_points, 1));
+
+  for (i = 0; i < request.number_points; ++i)
+  {
+    request.target_point_normal_cloud_ptr->points[i].x = coordinates[3 * i];
+    request.target_point_normal_cloud_ptr->points[i].y = coordinates[3 * i + 1];
+    request.target_point_normal_cloud_ptr->points[i].z = coordinates[3 * i + 2];
+  }
+
+  return (true);
+}
+
+template <typename PolicyT> void
+FitServer<PolicyT>::workerLoop ()
+{
+  Request request;
+
+  /* Every thread keeps its Registration and its buffers from one request to the next, the model itself is shared */
+
+  boost::shared_ptr < Registration < PolicyT > > registration (new Registration < PolicyT >);
+
+  if (has_thresholds_)
+  {
+    registration->setConvergenceThresholds (rotation_threshold_, translation_threshold_, coefficient_threshold_, relative_residual_threshold_);
+  }
+
+  while ( queue_.pop (request) )
+  {
+    {
+      boost::mutex::scoped_lock lock (stats_mutex_);
+      ++running_requests_;
+    }
+
+    serveFit (*registration, request);
+
+    /* The connection is closed here, the client reads until then */
+
+    request.socket.reset ();
+  }
+}
+
+template <typename PolicyT> void
+FitServer<PolicyT>::serveFit (Registration < PolicyT >& registration, Request& request)
+{
+  int i, j;
+
+  double residual, latency;
+
+  std::ostringstream response;
+
+  if ( request.number_points > 0 && !readPoints (request) )
+  {
+    request.socket->writeString ("ERROR missing points\n");
+
+    boost::mutex::scoped_lock lock (stats_mutex_);
+    --running_requests_;
+    ++failed_requests_;
+    return;
+  }
+
+  if (!request.target_point_normal_cloud_ptr)
+  {
+    request.target_point_normal_cloud_ptr.reset (new pcl::PointCloud<pcl::PointNormal>);
+
+    if (pcl::io::loadPCDFile<pcl::PointNormal> (request.target_path, *request.target_point_normal_cloud_ptr) == -1 || request.target_point_normal_cloud_ptr->size () < 6)
+    {
+      request.socket->writeString ("ERROR could not read " + request.target_path + "\n");
+
+      boost::mutex::scoped_lock lock (stats_mutex_);
+      --running_requests_;
+      ++failed_requests_;
+      return;
+    }
+  }
+
+  registration.setModel (model_ptr_);
+  registration.setTargetPointCloud (request.target_point_normal_cloud_ptr, request.face_point);
+  registration.alignModel ();
+
+  if (request.joint)
+  {
+    registration.calculateJointRegistration (50, request.energy_weight, request.joint_iterations, angle_limit_, distance_limit_);
+  }
+
+  else
+  {
+    registration.calculateAlternativeRegistrations (50, request.energy_weight, 15, 100, angle_limit_, distance_limit_);
+  }
+
+  residual = registration.computeResidual (angle_limit_, distance_limit_);
+
+  typename Registration<PolicyT>::Matrix4 pose = registration.getPose ();
+  typename Registration<PolicyT>::VectorX coefficients = registration.getCoefficients ();
+
+  response.precision (9);
+
+  latency = request.timer.toc ();
+
+  response << "OK " << latency << " " << residual << "\nPOSE";
+
+  for (i = 0; i < 4; ++i)
+  {
+    for (j = 0; j < 4; ++j)
+    {
+      response << " " << pose (i, j);
+    }
+  }
+
+  response << "\nCOEFFICIENTS " << coefficients.rows ();
+
+  for (i = 0; i < coefficients.rows (); ++i)
+  {
+    response << " " << coefficients[i];
+  }
+
+  response << "\n";
+
+  /* The faces of the mesh are the ones of the model, in pcl numbering */
+
+  if (request.mesh)
+  {
+    pcl::PointCloud<pcl::PointNormal>::ConstPtr model_cloud = registration.getModelPointCloud ();
+
+    const std::vector < pcl::Vertices >& mesh = model_ptr_->getPclMesh ();
+
+    response << "MESH " << model_cloud->size () << " " << mesh.size () << "\n";
+
+    for (i = 0; i < model_cloud->size (); ++i)
+    {
+      response << model_cloud->points[i].x << " " << model_cloud->points[i].y << " " << model_cloud->points[i].z << "\n";
+    }
+
+    for (i = 0; i < mesh.size (); ++i)
+    {
+      response << mesh[i].vertices.size ();
+
+      for (j = 0; j < mesh[i].vertices.size (); ++j)
+      {
+        response << " " << mesh[i].vertices[j];
+      }
+
+      response << "\n";
+    }
+  }
+
+  response << "END\n";
+
+  request.socket->writeString (response.str ());
+
+  boost::mutex::scoped_lock lock (stats_mutex_);
+
+  --running_requests_;
+  ++served_requests_;
+  total_latency_ += latency;
+  maximum_latency_ = std::max (maximum_latency_, latency);
+}
+
+template <typename PolicyT> std::string
+FitServer<PolicyT>::getStats ()
+{
+  std::ostringstream stats;
+
+  boost::mutex::scoped_lock lock (stats_mutex_);
+
+  stats << "STATS served=" << served_requests_ << " failed=" << failed_requests_ << " rejected=" << rejected_requests_
+        << " running=" << running_requests_ << " waiting=" << queue_.getDepth () << " threads=" << number_threads_
+        << " mean_latency_ms=" << (served_requests_ > 0 ? total_latency_ / served_requests_ : 0.0) << " max_latency_ms=" << maximum_latency_
+        << " uptime_s=" << uptime_timer_.toc () / 1000.0 << "\n";
+
+  return (stats.str ());
+}
+
+template class FitServer < SinglePrecision >;
+template class FitServer < DoublePrecision >;
@@ -0,0 +1,147 @@
+#include <fit_workspace.h>
+
+#include <Eigen/Core>
+
+#include <algorithm>
+
+WorkspaceArena::WorkspaceArena ()
+{
+  data_ = NULL;
+  capacity_ = 0;
+  offset_ = 0;
+}
+
+WorkspaceArena::~WorkspaceArena ()
+{
+  Eigen::internal::aligned_free (data_);
+}
+
+bool
+WorkspaceArena::reserve (size_t number_bytes)
+{
+  offset_ = 0;
+
+  if (number_bytes <= capacity_)
+  {
+    return (false);
+  }
+
+  Eigen::internal::aligned_free (data_);
+
+  data_ = static_cast<unsigned char*> (Eigen::internal::aligned_malloc (number_bytes));
+  capacity_ = number_bytes;
+
+  return (true);
+}
+
+void
+WorkspaceArena::reset ()
+{
+  offset_ = 0;
+}
+
+size_t
+WorkspaceArena::getCapacity () const
+{
+  return (capacity_);
+}
+
+template <typename PolicyT>
+FitWorkspace<PolicyT>::FitWorkspace ()
+{
+  number_points_ = 0;
+  number_eigenvectors_ = 0;
+
+  system_ = NULL;
+  right_side_ = NULL;
+  jacobian_row_ = NULL;
+  solution_ = NULL;
+  normal_accumulator_ = NULL;
+}
+
+template <typename PolicyT> void
+FitWorkspace<PolicyT>::reserve (int number_points, int number_eigenvectors)
+{
+  if (number_points <= number_points_ && number_eigenvectors <= number_eigenvectors_)
+  {
+    return;
+  }
+
+  number_points_ = std::max (number_points, number_points_);
+  number_eigenvectors_ = std::max (number_eigenvectors, number_eigenvectors_);
+
+  /* The system buffers are big enough for the joint system, which has 6 more unknowns. Every buffer may be padded up to the alignment, hence the extra space */
+
+  size_t system_size = number_eigenvectors_ + 6;
+  size_t number_scalars = system_size * system_size + 3 * system_size + 3 * number_points_;
+
+  arena_.reserve (number_scalars * sizeof (Scalar) + 5 * WorkspaceArena::ALIGNMENT);
+
+  system_ = arena_.allocate<Scalar> (system_size * system_size);
+  right_side_ = arena_.allocate<Scalar> (system_size);
+  jacobian_row_ = arena_.allocate<Scalar> (system_size);
+  solution_ = arena_.allocate<Scalar> (system_size);
+  normal_accumulator_ = arena_.allocate<Scalar> (3 * number_points_);
+
+  non_rigid_solver = Eigen::LDLT < MatrixX > (number_eigenvectors_);
+  joint_solver = Eigen::LDLT < MatrixX > (system_size);
+
+  correspondences.reserve (number_points_);
+}
+
+template <typename PolicyT> Eigen::Map < typename PolicyT::MatrixX, Eigen::Aligned >
+FitWorkspace<PolicyT>::getNonRigidSystem (int number_eigenvectors)
+{
+  return (Eigen::Map < MatrixX, Eigen::Aligned > (system_, number_eigenvectors, number_eigenvectors));
+}
+
+template <typename PolicyT> Eigen::Map < typename PolicyT::VectorX, Eigen::Aligned >
+FitWorkspace<PolicyT>::getNonRigidRightSide (int number_eigenvectors)
+{
+  return (Eigen::Map < VectorX, Eigen::Aligned > (right_side_, number_eigenvectors));
+}
+
+template <typename PolicyT> Eigen::Map < typename PolicyT::VectorX, Eigen::Aligned >
+FitWorkspace<PolicyT>::getJacobianRow (int number_eigenvectors)
+{
+  return (Eigen::Map < VectorX, Eigen::Aligned > (jacobian_row_, number_eigenvectors));
+}
+
+template <typename PolicyT> Eigen::Map < typename PolicyT::VectorX, Eigen::Aligned >
+FitWorkspace<PolicyT>::getCoefficients (int number_eigenvectors)
+{
+  return (Eigen::Map < VectorX, Eigen::Aligned > (solution_, number_eigenvectors));
+}
+
+template <typename PolicyT> Eigen::Map < typename PolicyT::MatrixX, Eigen::Aligned >
+FitWorkspace<PolicyT>::getJointSystem (int number_eigenvectors)
+{
+  return (Eigen::Map < MatrixX, Eigen::Aligned > (system_, number_eigenvectors + 6, number_eigenvectors + 6));
+}
+
+template <typename PolicyT> Eigen::Map < typename PolicyT::VectorX, Eigen::Aligned >
+FitWorkspace<PolicyT>::getJointRightSide (int number_eigenvectors)
+{
+  return (Eigen::Map < VectorX, Eigen::Aligned > (right_side_, number_eigenvectors + 6));
+}
+
+template <typename PolicyT> Eigen::Map < typename PolicyT::VectorX, Eigen::Aligned >
+FitWorkspace<PolicyT>::getJointJacobianRow (int number_eigenvectors)
+{
+  return (Eigen::Map < VectorX, Eigen::Aligned > (jacobian_row_, number_eigenvectors + 6));
+}
+
+template <typename PolicyT> Eigen::Map < typename PolicyT::VectorX, Eigen::Aligned >
+FitWorkspace<PolicyT>::getJointSolution (int number_eigenvectors)
+{
+  return (Eigen::Map < VectorX, Eigen::Aligned > (solution_, number_eigenvectors + 6));
+}
+
+template <typename PolicyT> Eigen::Map < typename PolicyT::VectorX, Eigen::Aligned >
+FitWorkspace<PolicyT>::getNormalAccumulator ()
+{
+  return (Eigen::Map < VectorX, Eigen::Aligned > (normal_accumulator_, 3 * number_points_));
+}
+
+template class FitWorkspace < SinglePrecision >;
+template class FitWorkspace < DoublePrecision >;
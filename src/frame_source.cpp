@@ -0,0 +1,120 @@
+#include <frame_source.h>
+
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+#include <limits>
+
+Frame::Frame ()
+{
+  index = 0;
+  timestamp = 0.0;
+  receive_time = 0.0;
+  width = 0;
+  height = 0;
+  focal_length = 0.0f;
+}
+
+pcl::PointCloud < pcl::PointXYZ >::ConstPtr
+Frame::getCloud () const
+{
+  if (cloud || !depth)
+  {
+    return (cloud);
+  }
+
+  return (FrameSource::backProject (*depth, width, height, focal_length));
+}
+
+bool
+Frame::getPoint (int u, int v, pcl::PointXYZ& point) const
+{
+  unsigned short pixel_depth;
+
+  if (u < 0 || v < 0 || u >= width || v >= height)
+  {
+    return (false);
+  }
+
+  if (cloud)
+  {
+    point = cloud->at (u, v);
+    return ( pcl_isfinite (point.z) );
+  }
+
+  pixel_depth = (*depth)[v * width + u];
+
+  if (pixel_depth == 0)
+  {
+    return (false);
+  }
+
+  /* Same projection as in FrameSource::backProject () */
+
+  point.z = pixel_depth * 0.001f;
+  point.x = (u - (width >> 1)) * point.z / focal_length;
+  point.y = (v - (height >> 1)) * point.z / focal_length;
+
+  return (true);
+}
+
+double
+FrameSource::getTime ()
+{
+  static const boost::posix_time::ptime epoch (boost::gregorian::date (1970, 1, 1));
+
+  return ( (boost::posix_time::microsec_clock::universal_time () - epoch).total_microseconds () * 1e-6 );
+}
+
+pcl::PointCloud < pcl::PointXYZ >::Ptr
+FrameSource::backProject (const std::vector < unsigned short >& depth, int width, int height, float focal_length)
+{
+  int u,v,i = 0;
+
+  float z, center_x = width >> 1, center_y = height >> 1, constant = 1.0f / focal_length, bad_point = std::numeric_limits<float>::quiet_NaN ();
+
+  pcl::PointCloud < pcl::PointXYZ >::Ptr cloud_ptr (new pcl::PointCloud < pcl::PointXYZ > (width, height));
+
+  cloud_ptr->is_dense = false;
+
+  /* Same projection as the one used by pcl::OpenNIGrabber, so the clouds of a recording match the ones of the sensor */
+
+  for (v = 0; v < height; ++v)
+  {
+    for (u = 0; u < width; ++u, ++i)
+    {
+      pcl::PointXYZ& point = cloud_ptr->points[i];
+
+      if (depth[i] == 0)
+      {
+        point.x = point.y = point.z = bad_point;
+        continue;
+      }
+
+      z = depth[i] * 0.001f;
+
+      point.x = (u - center_x) * z * constant;
+      point.y = (v - center_y) * z * constant;
+      point.z = z;
+    }
+  }
+
+  return (cloud_ptr);
+}
+
+boost::shared_ptr < std::vector < unsigned short > >
+FrameSource::extractDepth (const pcl::PointCloud < pcl::PointXYZ >& cloud)
+{
+  int i;
+
+  boost::shared_ptr < std::vector < unsigned short > > depth_ptr (new std::vector < unsigned short > (cloud.size (), 0));
+
+  for (i = 0; i < cloud.size (); ++i)
+  {
+    if ( pcl_isfinite (cloud.points[i].z) && cloud.points[i].z > 0 )
+    {
+      (*depth_ptr)[i] = static_cast<unsigned short> (cloud.points[i].z * 1000.0f + 0.5f);
+    }
+  }
+
+  return (depth_ptr);
+}
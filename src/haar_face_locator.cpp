@@ -0,0 +1,48 @@
+#include <haar_face_locator.h>
+
+HaarFaceLocator::HaarFaceLocator (std::string file_classifier)
+{
+  face_detector_.load (file_classifier);
+}
+
+bool
+HaarFaceLocator::locate (const Frame& frame, pcl::PointXYZ& face_center)
+{
+  cv::Rect face;
+
+  if (frame.gray.empty ())
+  {
+    PCL_WARN ("Frame %u has no gray image to detect the face in\n", frame.index);
+    return (false);
+  }
+
+  if ( !face_detector_.detect (frame.gray, face) )
+  {
+    return (false);
+  }
+
+  /* Only the center of the face is back-projected, the cloud of the frame is not needed */
+
+  return ( frame.getPoint (face.x + face.width/2, face.y + face.height/2, face_center) );
+}
+
+bool
+HaarFaceLocator::needsGrayImage ()
+{
+  return (true);
+}
+
+void
+HaarFaceLocator::printLatency (const Frame& frame, double latency)
+{
+  /* The window search is compared with the full one (-full_detection) through the average of all the detections */
+
+  PCL_DEBUG ("Face location of frame %u: %f ms, %s search %f ms, %f ms on average\n", frame.index, latency, face_detector_.wasFullSearch () ? "full" : "window",
+             face_detector_.getLastLatency (), face_detector_.getAverageLatency ());
+}
+
+FaceDetector&
+HaarFaceLocator::getFaceDetector ()
+{
+  return (face_detector_);
+}
@@ -0,0 +1,50 @@
+#ifdef FACE_WITH_KINFU
+
+#include <kinfu_backend.h>
+
+KinfuBackend::KinfuBackend (float volume_size)
+{
+  Eigen::Vector3f size = Eigen::Vector3f::Constant (volume_size);
+  kinfu_.volume ().setSize (size);
+
+  Eigen::Matrix3f R = Eigen::Matrix3f::Identity ();
+  Eigen::Vector3f translation = size * 0.5f - Eigen::Vector3f (0, 0, size (2) / 2 * 1.2f);
+
+  Eigen::Affine3f pose = Eigen::Translation3f (translation) * Eigen::AngleAxisf (R);
+
+  kinfu_.setInitalCameraPose (pose);
+  kinfu_.setCameraMovementThreshold (0.001f);
+}
+
+bool
+KinfuBackend::integrate (const Frame& frame)
+{
+  depth_device_.upload (&(*frame.depth)[0], frame.width * sizeof (unsigned short), frame.height, frame.width);
+
+  return (kinfu_ (depth_device_));
+}
+
+Eigen::Affine3f
+KinfuBackend::getCameraPose ()
+{
+  return (kinfu_.getCameraPose ());
+}
+
+void
+KinfuBackend::extractCloud (pcl::PointCloud < pcl::PointXYZ >& cloud)
+{
+  pcl::gpu::DeviceArray<pcl::PointXYZ> extracted = kinfu_.volume ().fetchCloud (cloud_buffer_device_);
+
+  extracted.download (cloud.points);
+
+  cloud.width = (int) cloud.points.size ();
+  cloud.height = 1;
+}
+
+const char*
+KinfuBackend::getName ()
+{
+  return ("kinfu");
+}
+
+#endif // FACE_WITH_KINFU
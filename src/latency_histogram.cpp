@@ -0,0 +1,116 @@
+#include <latency_histogram.h>
+
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+  /* 200 buckets from 0.01 ms growing by 10 % reach beyond 30 minutes, the last bucket takes everything above */
+
+  const int NUMBER_BUCKETS = 200;
+
+  const double MINIMUM_LATENCY = 0.01;
+
+  const double BUCKET_GROWTH = 1.1;
+
+  int
+  getBucket (double latency)
+  {
+    if (latency <= MINIMUM_LATENCY)
+    {
+      return (0);
+    }
+
+    return ( std::min (NUMBER_BUCKETS - 1, 1 + static_cast<int> (std::log (latency / MINIMUM_LATENCY) / std::log (BUCKET_GROWTH))) );
+  }
+
+  double
+  getUpperBound (int bucket)
+  {
+    return (MINIMUM_LATENCY * std::pow (BUCKET_GROWTH, bucket));
+  }
+}
+
+LatencyHistogram::LatencyHistogram () : buckets_ (NUMBER_BUCKETS, 0)
+{
+  count_ = 0;
+  sum_ = 0.0;
+  maximum_ = 0.0;
+}
+
+void
+LatencyHistogram::add (double latency)
+{
+  boost::mutex::scoped_lock lock (mutex_);
+
+  ++buckets_[getBucket (latency)];
+  ++count_;
+  sum_ += latency;
+  maximum_ = std::max (maximum_, latency);
+}
+
+void
+LatencyHistogram::reset ()
+{
+  boost::mutex::scoped_lock lock (mutex_);
+
+  std::fill (buckets_.begin (), buckets_.end (), 0);
+  count_ = 0;
+  sum_ = 0.0;
+  maximum_ = 0.0;
+}
+
+unsigned long
+LatencyHistogram::getCount () const
+{
+  boost::mutex::scoped_lock lock (mutex_);
+
+  return (count_);
+}
+
+double
+LatencyHistogram::getMean () const
+{
+  boost::mutex::scoped_lock lock (mutex_);
+
+  return (count_ > 0 ? sum_ / count_ : 0.0);
+}
+
+double
+LatencyHistogram::getMaximum () const
+{
+  boost::mutex::scoped_lock lock (mutex_);
+
+  return (maximum_);
+}
+
+double
+LatencyHistogram::getPercentile (double percentile) const
+{
+  int i;
+
+  unsigned long rank, cumulated = 0;
+
+  boost::mutex::scoped_lock lock (mutex_);
+
+  if (count_ == 0)
+  {
+    return (0.0);
+  }
+
+  /* The rank of the percentile counted from 1, e.g. the 99th percentile of 100 latencies is the 99th smallest */
+
+  rank = std::max (1ul, static_cast<unsigned long> (std::ceil (percentile * 0.01 * count_)));
+
+  for (i = 0; i < NUMBER_BUCKETS; ++i)
+  {
+    cumulated += buckets_[i];
+
+    if (cumulated >= rank)
+    {
+      return (std::min (getUpperBound (i), maximum_));
+    }
+  }
+
+  return (maximum_);
+}
@@ -0,0 +1,305 @@
+#include <local_socket.h>
+
+#include <cerrno>
+#include <cstring>
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+/**
+ * @brief Fills the address of a socket path
+ * @return False if the path does not fit into the address
+ */
+
+static bool
+makeAddress (const std::string& path, sockaddr_un& address)
+{
+  std::memset (&address, 0, sizeof (address));
+  address.sun_family = AF_UNIX;
+
+  if (path.size () >= sizeof (address.sun_path))
+  {
+    return (false);
+  }
+
+  std::strcpy (address.sun_path, path.c_str ());
+
+  return (true);
+}
+
+/**
+ * @brief Gets the time of the monotonic clock in seconds, which does not jump with the time of day
+ */
+
+static double
+getMonotonicTime ()
+{
+  timespec time;
+
+  ::clock_gettime (CLOCK_MONOTONIC, &time);
+
+  return (time.tv_sec + time.tv_nsec * 1e-9);
+}
+
+LocalSocket::LocalSocket (int descriptor)
+{
+  descriptor_ = descriptor;
+  has_deadline_ = false;
+  deadline_ = 0.0;
+}
+
+LocalSocket::~LocalSocket ()
+{
+  ::close (descriptor_);
+
+  if (!path_.empty ())
+  {
+    ::unlink (path_.c_str ());
+  }
+}
+
+LocalSocket::Ptr
+LocalSocket::connect (const std::string& path)
+{
+  sockaddr_un address;
+
+  int descriptor;
+
+  if ( !makeAddress (path, address) || (descriptor = ::socket (AF_UNIX, SOCK_STREAM, 0)) == -1 )
+  {
+    return (Ptr ());
+  }
+
+  if ( ::connect (descriptor, reinterpret_cast<sockaddr*> (&address), sizeof (address)) == -1 )
+  {
+    ::close (descriptor);
+    return (Ptr ());
+  }
+
+  return (Ptr (new LocalSocket (descriptor)));
+}
+
+LocalSocket::Ptr
+LocalSocket::listen (const std::string& path, int backlog)
+{
+  sockaddr_un address;
+
+  int descriptor;
+
+  Ptr socket;
+
+  if ( !makeAddress (path, address) || (descriptor = ::socket (AF_UNIX, SOCK_STREAM, 0)) == -1 )
+  {
+    return (Ptr ());
+  }
+
+  /* A socket file left behind by a server which did not stop cleanly would make the bind fail */
+
+  ::unlink (path.c_str ());
+
+  if ( ::bind (descriptor, reinterpret_cast<sockaddr*> (&address), sizeof (address)) == -1 || ::listen (descriptor, backlog) == -1 )
+  {
+    ::close (descriptor);
+    return (Ptr ());
+  }
+
+  socket.reset (new LocalSocket (descriptor));
+  socket->path_ = path;
+
+  return (socket);
+}
+
+LocalSocket::Ptr
+LocalSocket::accept ()
+{
+  int descriptor;
+
+  do
+  {
+    descriptor = ::accept (descriptor_, NULL, NULL);
+  }
+  while (descriptor == -1 && errno == EINTR);
+
+  if (descriptor == -1)
+  {
+    return (Ptr ());
+  }
+
+  return (Ptr (new LocalSocket (descriptor)));
+}
+
+void
+LocalSocket::setDeadline (double seconds)
+{
+  has_deadline_ = true;
+  deadline_ = getMonotonicTime () + seconds;
+}
+
+bool
+LocalSocket::waitForData ()
+{
+  pollfd descriptor;
+
+  int result;
+
+  double remaining;
+
+  if (!has_deadline_)
+  {
+    return (true);
+  }
+
+  descriptor.fd = descriptor_;
+  descriptor.events = POLLIN;
+
+  do
+  {
+    remaining = deadline_ - getMonotonicTime ();
+
+    if (remaining <= 0.0)
+    {
+      return (false);
+    }
+
+    result = ::poll (&descriptor, 1, static_cast<int> (remaining * 1000.0) + 1);
+  }
+  while (result == -1 && errno == EINTR);
+
+  /* A closed or failed connection is readable too, the recv () which follows reports it */
+
+  return (result > 0);
+}
+
+bool
+LocalSocket::readLine (std::string& line)
+{
+  char character;
+
+  line.clear ();
+
+  /* The lines are short, so they are read byte by byte and nothing past the newline is taken from the socket */
+
+  while ( readBytes (&character, 1) )
+  {
+    if (character == '\n')
+    {
+      return (true);
+    }
+
+    if (static_cast<int> (line.size ()) >= MAXIMUM_LINE)
+    {
+      return (false);
+    }
+
+    line.push_back (character);
+  }
+
+  return (false);
+}
+
+bool
+LocalSocket::readBytes (void* data, size_t size)
+{
+  ssize_t count;
+
+  char* position = static_cast<char*> (data);
+
+  while (size > 0)
+  {
+    if ( !waitForData () )
+    {
+      return (false);
+    }
+
+    count = ::recv (descriptor_, position, size, 0);
+
+    if (count == -1 && errno == EINTR)
+    {
+      continue;
+    }
+
+    if (count <= 0)
+    {
+      return (false);
+    }
+
+    position += count;
+    size -= count;
+  }
+
+  return (true);
+}
+
+bool
+LocalSocket::readAll (std::string& data)
+{
+  char buffer[4096];
+
+  ssize_t count;
+
+  data.clear ();
+
+  while (true)
+  {
+    count = ::recv (descriptor_, buffer, sizeof (buffer), 0);
+
+    if (count == -1 && errno == EINTR)
+    {
+      continue;
+    }
+
+    /* A peer which closes with some of our data unread resets the connection, what it wrote before is still delivered */
+
+    if (count <= 0)
+    {
+      return (count == 0 || errno == ECONNRESET);
+    }
+
+    data.append (buffer, count);
+  }
+}
+
+bool
+LocalSocket::writeBytes (const void* data, size_t size)
+{
+  ssize_t count;
+
+  const char* position = static_cast<const char*> (data);
+
+  while (size > 0)
+  {
+    /* A client which went away must not kill the server with SIGPIPE */
+
+    count = ::send (descriptor_, position, size, MSG_NOSIGNAL);
+
+    if (count == -1 && errno == EINTR)
+    {
+      continue;
+    }
+
+    if (count <= 0)
+    {
+      return (false);
+    }
+
+    position += count;
+    size -= count;
+  }
+
+  return (true);
+}
+
+bool
+LocalSocket::writeString (const std::string& data)
+{
+  return (writeBytes (data.data (), data.size ()));
+}
+
+void
+LocalSocket::shutdownWrite ()
+{
+  ::shutdown (descriptor_, SHUT_WR);
+}
@@ -1,8 +1,393 @@
 #include <registration.h>
+#include <batch_registration.h>
+#include <fit_server.h>
+#include <fit_client.h>
+#include <face_fitter.h>
+#include <target_generator.h>
+#include <profiler.h>
 #include <camera_grabber.h>
+#include <openni_frame_source.h>
+#include <replay_frame_source.h>
+#include <haar_face_locator.h>
+#include <depth_face_locator.h>
+#include <tsdf_fusion.h>
+#ifdef FACE_WITH_KINFU
+#include <kinfu_backend.h>
+#endif
 #include <pcl/console/parse.h>
+#include <pcl/console/time.h>
 
-int main(int argc, char** argv)
+/**
+ * @brief Fits the model on the target, either with the alternating Rigid and Non Rigid Registrations or with the joint solver
+ * @return The residual of the fit
+ */
+
+template <typename PolicyT> double
+fitTarget (Registration < PolicyT >& registrator, bool joint, int joint_iterations, double energy_weight, double angle_limit, double distance_limit, bool debug)
+{
+  if (joint)
+  {
+    registrator.calculateJointRegistration(50,energy_weight,joint_iterations,angle_limit,distance_limit,debug);
+  }
+
+  else
+  {
+    registrator.calculateAlternativeRegistrations(50,energy_weight,15,100,angle_limit,distance_limit,debug);
+  }
+
+  return (registrator.computeResidual (angle_limit,distance_limit));
+}
+
+/**
+ * @brief Fits the model on the target and reports the cost and the residual of the fit
+ */
+
+template <typename PolicyT> void
+fitModel (Registration < PolicyT >& registrator, bool joint, int joint_iterations, double energy_weight, double angle_limit, double distance_limit, bool debug)
+{
+  double residual = fitTarget (registrator, joint, joint_iterations, energy_weight, angle_limit, distance_limit, debug);
+
+  PCL_INFO ("Correspondence passes: %d, residual: %e\n", registrator.getCorrespondencePasses (), residual);
+}
+
+/**
+ * @brief Creates the method used to find the face: the Haar cascade on the gray image, or with -locator depth the nearest head-sized blob of the depth
+ */
+
+FaceLocator::Ptr
+createFaceLocator (int argc, char** argv)
+{
+  std::string locator ("haar"), xml_file ("haarcascade_frontalface_alt.xml");
+
+  double detection_scale = 0.5;
+
+  pcl::console::parse_argument (argc, argv, "-locator", locator);
+
+  if (locator == "depth")
+  {
+    return (FaceLocator::Ptr (new DepthFaceLocator));
+  }
+
+  pcl::console::parse_argument (argc, argv, "-xml_file", xml_file);
+  pcl::console::parse_argument (argc, argv, "-detection_scale", detection_scale);
+
+  boost::shared_ptr < HaarFaceLocator > haar_locator (new HaarFaceLocator (xml_file));
+
+  /* The gray images are searched at -detection_scale of their size, around the previous face. -full_detection searches every image whole at full resolution */
+
+  if (pcl::console::find_switch (argc, argv, "-full_detection"))
+  {
+    haar_locator->getFaceDetector ().setScale (1.0);
+    haar_locator->getFaceDetector ().setTracking (false);
+  }
+
+  else
+  {
+    haar_locator->getFaceDetector ().setScale (detection_scale);
+  }
+
+  return (haar_locator);
+}
+
+/**
+ * @brief Creates the source of the frames for the per-frame modes: the recording given by -recording if there is one, the Kinect/Xtion otherwise
+ * @param [in] False if the face is not searched in the gray images, so the sensor does not need to stream them
+ */
+
+FrameSource::Ptr
+createFrameSource (int argc, char** argv, bool gray_image)
+{
+  std::string recording_path;
+
+  double frame_rate = 30.0;
+
+  float focal_length = 525.0f;
+
+  pcl::console::parse_argument (argc, argv, "-recording", recording_path);
+
+  if (recording_path.empty ())
+  {
+    return (FrameSource::Ptr (new OpenNIFrameSource (gray_image)));
+  }
+
+  /* The frame rate is used if the recording has no timestamps.txt, the focal length to turn the depth images into clouds */
+
+  pcl::console::parse_argument (argc, argv, "-frame_rate", frame_rate);
+  pcl::console::parse_argument (argc, argv, "-focal_length", focal_length);
+
+  boost::shared_ptr < ReplayFrameSource > replay_source (new ReplayFrameSource (recording_path, frame_rate, focal_length));
+
+  /* With -real_time the recording is played at the speed it was recorded, otherwise as fast as the frames are consumed */
+
+  replay_source->setRealTime (pcl::console::find_switch (argc, argv, "-real_time"));
+
+  return (replay_source);
+}
+
+/**
+ * @brief Creates the method used to fuse the frames in --kinfu mode: the KinfuTracker if it was built, or with -fusion cpu the TsdfFusion
+ */
+
+FusionBackend::Ptr
+createFusionBackend (int argc, char** argv)
+{
+#ifdef FACE_WITH_KINFU
+  std::string fusion ("kinfu");
+#else
+  std::string fusion ("cpu");
+#endif
+
+  float volume_size = 0.4f, region_radius = 0.2f;
+
+  int volume_resolution = 128, fusion_threads = 0;
+
+  pcl::console::parse_argument (argc, argv, "-fusion", fusion);
+
+#ifdef FACE_WITH_KINFU
+  if (fusion == "kinfu")
+  {
+    return (FusionBackend::Ptr (new KinfuBackend));
+  }
+#endif
+
+  if (fusion != "cpu")
+  {
+    PCL_ERROR ("Unknown fusion %s, -fusion kinfu needs a build with WITH_KINFU\n", fusion.c_str ());
+    exit (1);
+  }
+
+  /* The CPU fusion holds only the head: the blocks stay in a box of -volume_size meters until the face is found, then within -region_radius of it */
+
+  pcl::console::parse_argument (argc, argv, "-volume_size", volume_size);
+  pcl::console::parse_argument (argc, argv, "-volume_resolution", volume_resolution);
+  pcl::console::parse_argument (argc, argv, "-region_radius", region_radius);
+  pcl::console::parse_argument (argc, argv, "-fusion_threads", fusion_threads);
+
+  boost::shared_ptr < TsdfFusion > tsdf_fusion (new TsdfFusion (volume_size, volume_resolution, fusion_threads));
+
+  tsdf_fusion->setRegionRadius (region_radius);
+
+  return (tsdf_fusion);
+}
+
+/**
+ * @brief Writes -count targets with their ground truth into the directory -output: for each the organized cloud, the face point in _face.txt and the ground truth in _truth.txt, and a manifest of all of them for --batch and --accuracy
+ */
+
+template <typename PolicyT> int
+generateTargets (int argc, char** argv, typename StatisticalModel < PolicyT >::ConstPtr model)
+{
+  std::string output_path ("synthetic"), name;
+
+  int i, count = 10, seed = 1, number_eigenvectors = 0, number_holes = 4, hole_radius = 5, number_clutter = 5, width = 640, height = 480;
+
+  double distance = 0.8, offset_range = 0.05, rotation_range = 15.0, noise = 0.0012, wall_distance = 0.6, face_jitter = 0.01;
+
+  float focal_length = 525.0f;
+
+  char index[16];
+
+  pcl::PointCloud<pcl::PointXYZ> target;
+
+  GroundTruth truth;
+
+  pcl::console::parse_argument (argc, argv, "-output", output_path);
+  pcl::console::parse_argument (argc, argv, "-count", count);
+  pcl::console::parse_argument (argc, argv, "-seed", seed);
+  pcl::console::parse_argument (argc, argv, "-eigenvectors", number_eigenvectors);
+  pcl::console::parse_argument (argc, argv, "-face_distance", distance);
+  pcl::console::parse_argument (argc, argv, "-offset_range", offset_range);
+  pcl::console::parse_argument (argc, argv, "-rotation_range", rotation_range);
+  pcl::console::parse_argument (argc, argv, "-noise", noise);
+  pcl::console::parse_argument (argc, argv, "-holes", number_holes);
+  pcl::console::parse_argument (argc, argv, "-hole_radius", hole_radius);
+  pcl::console::parse_argument (argc, argv, "-wall_distance", wall_distance);
+  pcl::console::parse_argument (argc, argv, "-clutter", number_clutter);
+  pcl::console::parse_argument (argc, argv, "-face_jitter", face_jitter);
+  pcl::console::parse_argument (argc, argv, "-width", width);
+  pcl::console::parse_argument (argc, argv, "-height", height);
+  pcl::console::parse_argument (argc, argv, "-focal_length", focal_length);
+
+  TargetGenerator < PolicyT > generator (model, seed);
+
+  generator.setCamera (width, height, focal_length);
+  generator.setPoseRange (distance, offset_range, rotation_range * std::atan (1.0) / 45.0);
+  generator.setNumberEigenvectors (number_eigenvectors);
+  generator.setNoise (noise);
+  generator.setHoles (number_holes, hole_radius);
+  generator.setClutter (wall_distance, number_clutter);
+  generator.setFaceJitter (face_jitter);
+
+  boost::filesystem::create_directories (output_path);
+
+  std::ofstream manifest ( (boost::filesystem::path (output_path) / "manifest.txt").string ().c_str () );
+
+  for (i = 0; i < count; ++i)
+  {
+    generator.generate (target, truth);
+
+    std::sprintf (index, "%04d", i);
+
+    name = (boost::filesystem::path (output_path) / ("synthetic_" + std::string (index))).string ();
+
+    pcl::io::savePCDFile (name + ".pcd", target, true);
+
+    truth.write (name + "_truth.txt");
+
+    std::ofstream face_file ((name + "_face.txt").c_str ());
+
+    face_file << truth.face_point.x << " " << truth.face_point.y << " " << truth.face_point.z << "\n";
+
+    manifest << name << ".pcd " << truth.face_point.x << " " << truth.face_point.y << " " << truth.face_point.z << "\n";
+  }
+
+  PCL_INFO ("Wrote %d targets to %s\n", count, output_path.c_str ());
+
+  return (0);
+}
+
+/**
+ * @brief Fits every target of the manifest -targets written by --generate and reports the error of the fit against the ground truth next to its time, so that a faster setting can be checked for a loss of accuracy.
+ * The error is the distance between the fitted vertices and the true ones, the time the one of the normals, the kdtree and the fit. With -json the results are also written as JSON
+ */
+
+template <typename PolicyT> int
+measureAccuracy (int argc, char** argv, typename StatisticalModel < PolicyT >::ConstPtr model, bool joint, int joint_iterations, double energy_weight, double angle_limit, double distance_limit,
+                 double rotation_epsilon, double translation_epsilon, double coefficient_epsilon, double residual_epsilon)
+{
+  std::string targets_path ("synthetic/manifest.txt"), json_path, line, target_path;
+
+  int i, number_targets = 0;
+
+  float x, y, z;
+
+  double time, residual, squared_error, error, maximum_error, total_time = 0.0, total_rms = 0.0, worst_rms = 0.0;
+
+  std::vector < double > rms_errors;
+
+  std::ostringstream json;
+
+  pcl::console::TicToc timer;
+
+  GroundTruth truth;
+
+  pcl::console::parse_argument (argc, argv, "-targets", targets_path);
+  pcl::console::parse_argument (argc, argv, "-json", json_path);
+
+  std::ifstream manifest (targets_path.c_str ());
+
+  if (!manifest)
+  {
+    PCL_ERROR ("Could not open the targets %s\n", targets_path.c_str ());
+    exit (1);
+  }
+
+  json << "{\n  \"precision\": \"" << PolicyT::name () << "\",\n  \"joint\": " << (joint ? "true" : "false")
+       << ",\n  \"joint_iterations\": " << joint_iterations << ",\n  \"energy_weight\": " << energy_weight << ",\n  \"targets\": [\n";
+
+  while ( std::getline (manifest, line) )
+  {
+    std::istringstream iss (line);
+
+    if ( line.empty () || line[0] == '#' || !(iss >> target_path >> x >> y >> z) )
+    {
+      continue;
+    }
+
+    boost::filesystem::path truth_path (target_path);
+
+    truth_path.replace_extension ();
+
+    if ( !truth.read (truth_path.string () + "_truth.txt") )
+    {
+      PCL_WARN ("Skipping %s, its ground truth is missing\n", target_path.c_str ());
+      continue;
+    }
+
+    pcl::PointCloud<pcl::PointNormal>::Ptr target_point_normal_cloud_ptr (new pcl::PointCloud<pcl::PointNormal>);
+
+    if (pcl::io::loadPCDFile<pcl::PointNormal> (target_path, *target_point_normal_cloud_ptr) == -1)
+    {
+      PCL_WARN ("Skipping %s, it could not be read\n", target_path.c_str ());
+      continue;
+    }
+
+    Registration < PolicyT > registrator;
+
+    registrator.setConvergenceThresholds ( rotation_epsilon, translation_epsilon, coefficient_epsilon, residual_epsilon );
+    registrator.setModel (model);
+
+    /* The file is read before the timer starts, the time is the one of the normals, the kdtree and the fit */
+
+    timer.tic ();
+
+    registrator.setTargetPointCloud (target_point_normal_cloud_ptr, pcl::PointXYZ (x, y, z));
+    registrator.alignModel ();
+
+    residual = fitTarget (registrator, joint, joint_iterations, energy_weight, angle_limit, distance_limit, false);
+
+    time = timer.toc ();
+
+    Eigen::VectorXd true_vertices = TargetGenerator < PolicyT >::getVertices (*model, truth);
+
+    pcl::PointCloud<pcl::PointNormal>::ConstPtr model_cloud = registrator.getModelPointCloud ();
+
+    squared_error = maximum_error = 0.0;
+
+    for (i = 0; i < model_cloud->size (); ++i)
+    {
+      error = (model_cloud->points[i].getVector3fMap ().template cast<double> () - true_vertices.segment<3> (3 * i)).norm ();
+
+      squared_error += error * error;
+      maximum_error = std::max (maximum_error, error);
+    }
+
+    error = std::sqrt (squared_error / std::max (static_cast<size_t> (1), model_cloud->size ()));
+
+    PCL_INFO ("%s: %g ms, vertex error %g mm (max %g mm), residual %e\n", target_path.c_str (), time, error * 1000.0, maximum_error * 1000.0, residual);
+
+    json << (number_targets > 0 ? ",\n" : "") << "    {\"target\": \"" << target_path << "\", \"time_ms\": " << time << ", \"rms_error_mm\": " << error * 1000.0
+         << ", \"max_error_mm\": " << maximum_error * 1000.0 << ", \"residual\": " << residual << "}";
+
+    rms_errors.push_back (error);
+
+    total_time += time;
+    total_rms += error;
+    worst_rms = std::max (worst_rms, error);
+
+    ++number_targets;
+  }
+
+  if (number_targets == 0)
+  {
+    PCL_ERROR ("No targets with a ground truth in %s\n", targets_path.c_str ());
+    exit (1);
+  }
+
+  std::sort (rms_errors.begin (), rms_errors.end ());
+
+  PCL_INFO ("%d targets: mean time %g ms, vertex error mean %g mm, median %g mm, worst %g mm\n", number_targets, total_time / number_targets,
+            total_rms / number_targets * 1000.0, rms_errors[rms_errors.size () / 2] * 1000.0, worst_rms * 1000.0);
+
+  json << "\n  ],\n  \"mean_time_ms\": " << total_time / number_targets << ",\n  \"mean_rms_error_mm\": " << total_rms / number_targets * 1000.0
+       << ",\n  \"median_rms_error_mm\": " << rms_errors[rms_errors.size () / 2] * 1000.0 << ",\n  \"worst_rms_error_mm\": " << worst_rms * 1000.0 << "\n}\n";
+
+  if (!json_path.empty ())
+  {
+    std::ofstream json_file (json_path.c_str ());
+
+    json_file << json.str ();
+  }
+
+  return (0);
+}
+
+/**
+ * @brief Runs the program with the fitting core instantiated for the given ScalarPolicy
+ */
+
+template <typename PolicyT> int
+run (int argc, char** argv)
 {
 
   std::string database_path,result_path;
@@ -20,9 +405,11 @@ int main(int argc, char** argv)
 
   double energy_weight = 0.001;
 
-  int device = CV_CAP_OPENNI;
+  int joint_iterations = 30;
 
-  Registration registrator;
+  double rotation_epsilon = 1e-4, translation_epsilon = 1e-5, coefficient_epsilon = 1e-3, residual_epsilon = 1e-4;
+
+  Registration < PolicyT > registrator;
 
   /* Path to the database of the model */
 
@@ -48,6 +435,21 @@ int main(int argc, char** argv)
 
   pcl::console::parse_argument (argc, argv, "-energy_weight", energy_weight);
 
+  /* Estimate the pose and the shape together instead of alternating the two Registrations */
+
+  bool joint = pcl::console::find_switch (argc, argv, "-joint");
+
+  /* The number of iterations of the joint solver */
+
+  pcl::console::parse_argument (argc, argv, "-joint_iterations", joint_iterations);
+
+  /* The thresholds under which the pose, the coefficients and the relative decrease of the residual are considered converged */
+
+  pcl::console::parse_argument (argc, argv, "-rotation_epsilon", rotation_epsilon);
+  pcl::console::parse_argument (argc, argv, "-translation_epsilon", translation_epsilon);
+  pcl::console::parse_argument (argc, argv, "-coefficient_epsilon", coefficient_epsilon);
+  pcl::console::parse_argument (argc, argv, "-residual_epsilon", residual_epsilon);
+
 
   Eigen::Matrix3d transform_matrix = Eigen::Matrix3d::Identity();
   Eigen::Vector3d translation = Eigen::Vector3d::Zero();
@@ -65,26 +467,190 @@ int main(int argc, char** argv)
 
   bool debug = pcl::console::find_switch (argc, argv, "-debug");
 
-  if( pcl::console::find_switch (argc, argv, "-Asus") )
+  registrator.setDebugMode ( debug );
+  registrator.setConvergenceThresholds ( rotation_epsilon, translation_epsilon, coefficient_epsilon, residual_epsilon );
+
+  /* In this if branch the model is read once and fitted concurrently on every target listed by -targets, a manifest or a directory */
+
+  if(pcl::console::find_switch (argc, argv, "--batch"))
+  {
+
+    std::string targets_path ("targets.txt");
+
+    int batch_threads = 0, load_threads = 1, preprocess_threads = 1, write_threads = 1, queue_depth = 4;
+
+    double crop_radius = 0.0;
+
+    pcl::console::parse_argument (argc, argv, "-targets", targets_path);
+    pcl::console::parse_argument (argc, argv, "-batch_threads", batch_threads);
+    pcl::console::parse_argument (argc, argv, "-load_threads", load_threads);
+    pcl::console::parse_argument (argc, argv, "-preprocess_threads", preprocess_threads);
+    pcl::console::parse_argument (argc, argv, "-write_threads", write_threads);
+    pcl::console::parse_argument (argc, argv, "-queue_depth", queue_depth);
+    pcl::console::parse_argument (argc, argv, "-crop_radius", crop_radius);
+
+    typename StatisticalModel < PolicyT >::ConstPtr model (new StatisticalModel < PolicyT > (database_path, transform_matrix, translation, scale));
+
+    BatchRegistration < PolicyT > batch (model, batch_threads);
+
+    /* The targets are read, prepared, fitted and written by separate stages, -batch_threads being the threads of the fit */
+
+    batch.setStageThreads (BatchRegistration < PolicyT >::LOAD_STAGE, load_threads);
+    batch.setStageThreads (BatchRegistration < PolicyT >::PREPROCESS_STAGE, preprocess_threads);
+    batch.setStageThreads (BatchRegistration < PolicyT >::WRITE_STAGE, write_threads);
+    batch.setQueueCapacity (queue_depth);
+    batch.setCropRadius (crop_radius);
+
+    batch.setConvergenceThresholds ( rotation_epsilon, translation_epsilon, coefficient_epsilon, residual_epsilon );
+    batch.readJobs (targets_path, result_path);
+
+    if (batch.getNumberJobs () == 0)
+    {
+      PCL_ERROR ("No targets found in %s\n", targets_path.c_str ());
+      exit (1);
+    }
+
+    /* Every result is written next to -result, the single result of the other modes is not */
+
+    return (batch.run (boost::bind (&fitTarget < PolicyT >, _1, joint, joint_iterations, energy_weight, angle_limit, distance_limit, false)) == 0 ? 0 : 1);
+  }
+
+  /* In this if branch the model is kept in memory and fitted on the requests sent to the socket given by -socket, until a client sends STOP */
+
+  if(pcl::console::find_switch (argc, argv, "--serve"))
   {
-    device = CV_CAP_OPENNI_ASUS;
+
+    std::string socket_path ("/tmp/face.sock");
+
+    int server_threads = 0, max_pending = 8;
+
+    pcl::console::parse_argument (argc, argv, "-socket", socket_path);
+    pcl::console::parse_argument (argc, argv, "-server_threads", server_threads);
+    pcl::console::parse_argument (argc, argv, "-max_pending", max_pending);
+
+    typename StatisticalModel < PolicyT >::ConstPtr model (new StatisticalModel < PolicyT > (database_path, transform_matrix, translation, scale));
+
+    FitServer < PolicyT > server (model, server_threads, max_pending);
+
+    server.setFitParameters (joint, joint_iterations, energy_weight, angle_limit, distance_limit);
+    server.setConvergenceThresholds ( rotation_epsilon, translation_epsilon, coefficient_epsilon, residual_epsilon );
+
+    return (server.run (socket_path) ? 0 : 1);
   }
 
-  registrator.setDebugMode ( debug );
+  /* In these if branches targets with a known answer are drawn from the model, and the fits of such targets are compared with the answer */
 
-  /* In this if branch the target cloud is a simple snapshot from the Kinect/Xtion */
+  if(pcl::console::find_switch (argc, argv, "--generate"))
+  {
+    typename StatisticalModel < PolicyT >::ConstPtr model (new StatisticalModel < PolicyT > (database_path, transform_matrix, translation, scale));
 
-  if(pcl::console::find_switch (argc, argv, "--camera"))
+    return (generateTargets < PolicyT > (argc, argv, model));
+  }
+
+  if(pcl::console::find_switch (argc, argv, "--accuracy"))
+  {
+    typename StatisticalModel < PolicyT >::ConstPtr model (new StatisticalModel < PolicyT > (database_path, transform_matrix, translation, scale));
+
+    return (measureAccuracy < PolicyT > (argc, argv, model, joint, joint_iterations, energy_weight, angle_limit, distance_limit, rotation_epsilon, translation_epsilon, coefficient_epsilon, residual_epsilon));
+  }
+
+  /* In this if branch the face given by -face_x, -face_y, -face_width and -face_height is fitted straight from the 16 bit depth image given by -target, through the library API of FaceFitter */
+
+  if(pcl::console::find_switch (argc, argv, "--depth"))
   {
 
-    std::string xml_file("haarcascade_frontalface_alt.xml");
+    std::string depth_file ("target.png");
+
+    int i;
+
+    FaceRectangle rectangle;
+
+    CameraIntrinsics intrinsics;
+
+    DepthBuffer depth;
+
+    FitResult result;
+
+    pcl::console::TicToc timer;
+
+    pcl::console::parse_argument (argc, argv, "-target", depth_file);
+
+    cv::Mat depth_image = cv::imread (depth_file, CV_LOAD_IMAGE_ANYDEPTH);
+
+    if (depth_image.empty () || depth_image.type () != CV_16UC1)
+    {
+      PCL_ERROR ("%s is not a 16 bit depth image\n", depth_file.c_str ());
+      exit (1);
+    }
+
+    intrinsics.fx = intrinsics.fy = 525.0f;
+    intrinsics.cx = depth_image.cols >> 1;
+    intrinsics.cy = depth_image.rows >> 1;
+
+    rectangle.x = rectangle.y = 0;
+    rectangle.width = depth_image.cols;
+    rectangle.height = depth_image.rows;
+
+    pcl::console::parse_argument (argc, argv, "-fx", intrinsics.fx);
+    pcl::console::parse_argument (argc, argv, "-fy", intrinsics.fy);
+    pcl::console::parse_argument (argc, argv, "-cx", intrinsics.cx);
+    pcl::console::parse_argument (argc, argv, "-cy", intrinsics.cy);
+    pcl::console::parse_argument (argc, argv, "-face_x", rectangle.x);
+    pcl::console::parse_argument (argc, argv, "-face_y", rectangle.y);
+    pcl::console::parse_argument (argc, argv, "-face_width", rectangle.width);
+    pcl::console::parse_argument (argc, argv, "-face_height", rectangle.height);
+
+    /* The image is handed over as it was decoded, in millimeters */
+
+    depth.data = depth_image.data;
+    depth.format = DepthBuffer::UINT16;
+    depth.width = depth_image.cols;
+    depth.height = depth_image.rows;
+    depth.stride = depth_image.step;
+    depth.depth_scale = 0.001f;
+
+    typename StatisticalModel < PolicyT >::ConstPtr model (new StatisticalModel < PolicyT > (database_path, transform_matrix, translation, scale));
 
-    pcl::console::parse_argument (argc, argv, "-xml_file", xml_file);
+    std::vector < float > coefficients (model->getEigenVectors ().cols ());
 
-    registrator.getTargetPointCloudFromCamera(device,xml_file);
+    result.coefficients = coefficients.empty () ? NULL : &coefficients[0];
+    result.coefficient_capacity = coefficients.size ();
+
+    FaceFitter < PolicyT > fitter (model);
+
+    fitter.setFitParameters (joint, joint_iterations, energy_weight, angle_limit, distance_limit);
+    fitter.setConvergenceThresholds ( rotation_epsilon, translation_epsilon, coefficient_epsilon, residual_epsilon );
+
+    timer.tic ();
+
+    if ( !fitter.fit (depth, intrinsics, rectangle, result) )
+    {
+      PCL_ERROR ("Too few measurements in the face rectangle of %s\n", depth_file.c_str ());
+      exit (1);
+    }
+
+    PCL_INFO ("Fitted %d points in %g ms, residual %g\n", result.number_target_points, timer.toc (), result.residual);
+
+    for (i = 0; i < 4; ++i)
+    {
+      PCL_INFO ("%g %g %g %g\n", result.pose[4 * i], result.pose[4 * i + 1], result.pose[4 * i + 2], result.pose[4 * i + 3]);
+    }
+
+    return (0);
+  }
+
+  /* In this if branch the target cloud is a simple snapshot from the Kinect/Xtion, or from the recording given by -recording */
+
+  if(pcl::console::find_switch (argc, argv, "--camera"))
+  {
+
+    FaceLocator::Ptr face_locator = createFaceLocator (argc, argv);
+
+    registrator.setFaceLocator (face_locator);
+    registrator.getTargetPointCloudFromCamera(createFrameSource (argc, argv, face_locator->needsGrayImage ()));
     registrator.getDataForModel(database_path, transform_matrix, translation, scale);
     registrator.alignModel();
-    registrator.calculateAlternativeRegistrations(50,energy_weight,15,100,angle_limit,distance_limit,debug);
+    fitModel (registrator, joint, joint_iterations, energy_weight, angle_limit, distance_limit, debug);
 
   }
 
@@ -109,7 +675,7 @@ int main(int argc, char** argv)
     registrator.getTargetPointCloudFromFile(pcd_file, face);
     registrator.getDataForModel(database_path, transform_matrix, translation, scale);
     registrator.alignModel();
-    registrator.calculateAlternativeRegistrations(50,energy_weight,15,100,angle_limit,distance_limit,debug);
+    fitModel (registrator, joint, joint_iterations, energy_weight, angle_limit, distance_limit, debug);
 
   }
 
@@ -120,7 +686,78 @@ int main(int argc, char** argv)
   {
 
     registrator.getDataForModel (database_path, transform_matrix, translation, scale);
-    registrator.calculateKinfuTrackerRegistrations (device,50,energy_weight,100,angle_limit,distance_limit);
+    FaceLocator::Ptr face_locator = createFaceLocator (argc, argv);
+
+    registrator.setFaceLocator (face_locator);
+
+    /* With -auto_scan the scans are taken when the camera has moved or new surface was fused, and each one refines the previous fit. -headless runs it without the window, e.g. on a recording */
+
+    bool headless = pcl::console::find_switch (argc, argv, "-headless");
+
+    if (headless || pcl::console::find_switch (argc, argv, "-auto_scan"))
+    {
+      float scan_translation = 0.05f, scan_rotation = 10.0f, scan_surface = 0.2f;
+
+      int refine_iterations = 5;
+
+      pcl::console::parse_argument (argc, argv, "-scan_translation", scan_translation);
+      pcl::console::parse_argument (argc, argv, "-scan_rotation", scan_rotation);
+      pcl::console::parse_argument (argc, argv, "-scan_surface", scan_surface);
+      pcl::console::parse_argument (argc, argv, "-refine_iterations", refine_iterations);
+
+      registrator.setScanPolicy (scan_translation, scan_rotation * pi / 180.0f, scan_surface, refine_iterations);
+    }
+
+    /* A frame counts as late when its processing ends more than -late_threshold milliseconds after it was received, by default one frame period at 30 Hz */
+
+    double late_threshold = 1000.0 / 30.0;
+
+    pcl::console::parse_argument (argc, argv, "-late_threshold", late_threshold);
+
+    registrator.setLateThreshold (late_threshold);
+
+    registrator.calculateKinfuTrackerRegistrations (createFrameSource (argc, argv, face_locator->needsGrayImage ()),createFusionBackend (argc, argv),50,energy_weight,100,angle_limit,distance_limit,!headless);
+  }
+
+  /* In this if branch the model follows the face in every frame, either from the Kinect/Xtion or from a recording given by -recording */
+
+  if(pcl::console::find_switch (argc, argv, "--stream"))
+  {
+
+    std::string tracking_path ("tracking.txt");
+
+    int frame_iterations = 3;
+
+    double crop_margin = 0.1;
+
+    float x,y,z;
+
+    pcl::console::parse_argument (argc, argv, "-frame_iterations", frame_iterations);
+    pcl::console::parse_argument (argc, argv, "-crop_margin", crop_margin);
+    pcl::console::parse_argument (argc, argv, "-tracking_output", tracking_path);
+
+    FrameSource::Ptr source;
+
+    /* The face is located once, either given by -x, -y and -z or found in the source, the following frames are tracked from the previous fit */
+
+    if (pcl::console::parse_argument (argc, argv, "-x", x) != -1 && pcl::console::parse_argument (argc, argv, "-y", y) != -1 && pcl::console::parse_argument (argc, argv, "-z", z) != -1)
+    {
+      source = createFrameSource (argc, argv, false);
+      registrator.setFaceCenterPoint (pcl::PointXYZ (x,y,z));
+    }
+
+    else
+    {
+      FaceLocator::Ptr face_locator = createFaceLocator (argc, argv);
+
+      source = createFrameSource (argc, argv, face_locator->needsGrayImage ());
+
+      registrator.setFaceLocator (face_locator);
+      registrator.getTargetPointCloudFromCamera(source);
+    }
+
+    registrator.getDataForModel (database_path, transform_matrix, translation, scale);
+    registrator.calculateStreamingRegistrations (*source,50,energy_weight,joint_iterations,frame_iterations,angle_limit,distance_limit,crop_margin,tracking_path,debug);
   }
 
 
@@ -130,3 +767,174 @@ int main(int argc, char** argv)
 
   return (0);
 }
+
+/**
+ * @brief Fits the same target with both the float and the double instantiation and reports the speed difference and the final residual delta
+ */
+
+int
+comparePrecision (int argc, char** argv)
+{
+  std::string database_path ("PCA.txt"), pcd_file ("target.pcd");
+
+  double pi =  4 * atan(1);
+
+  double distance_limit = 0.001, angle_limit = pi * 0.25, scale = 1.0, energy_weight = 0.001;
+
+  float x = 0.0f, y = 0.0f, z = 0.0f;
+
+  pcl::console::parse_argument (argc, argv, "-database", database_path);
+  pcl::console::parse_argument (argc, argv, "-target", pcd_file);
+  pcl::console::parse_argument (argc, argv, "-distance", distance_limit);
+  pcl::console::parse_argument (argc, argv, "-angle", angle_limit);
+  pcl::console::parse_argument (argc, argv, "-scale", scale);
+  pcl::console::parse_argument (argc, argv, "-energy_weight", energy_weight);
+  pcl::console::parse_argument (argc, argv, "-x", x);
+  pcl::console::parse_argument (argc, argv, "-y", y);
+  pcl::console::parse_argument (argc, argv, "-z", z);
+
+  Eigen::Matrix3d transform_matrix = Eigen::Matrix3d::Identity() * scale;
+  Eigen::Vector3d translation = Eigen::Vector3d::Zero();
+
+  transform_matrix = Eigen::AngleAxisd(pi,Eigen::Vector3d::UnitX()) * transform_matrix;
+
+  pcl::PointXYZ face(x,y,z);
+
+  pcl::console::TicToc timer;
+
+  RegistrationF float_registrator;
+  RegistrationD double_registrator;
+
+  float_registrator.getTargetPointCloudFromFile(pcd_file, face);
+  float_registrator.getDataForModel(database_path, transform_matrix, translation, scale);
+  float_registrator.alignModel();
+
+  timer.tic ();
+  float_registrator.calculateAlternativeRegistrations(50,energy_weight,15,100,angle_limit,distance_limit);
+  double float_time = timer.toc ();
+
+  double_registrator.getTargetPointCloudFromFile(pcd_file, face);
+  double_registrator.getDataForModel(database_path, transform_matrix, translation, scale);
+  double_registrator.alignModel();
+
+  timer.tic ();
+  double_registrator.calculateAlternativeRegistrations(50,energy_weight,15,100,angle_limit,distance_limit);
+  double double_time = timer.toc ();
+
+  double float_residual = float_registrator.computeResidual (angle_limit,distance_limit);
+  double double_residual = double_registrator.computeResidual (angle_limit,distance_limit);
+
+  PCL_INFO ("%s: %f ms, residual %e\n", SinglePrecision::name (), float_time, float_residual);
+  PCL_INFO ("%s: %f ms, residual %e\n", DoublePrecision::name (), double_time, double_residual);
+  PCL_INFO ("Speed-up of the float fit: %f, residual delta: %e\n", double_time / float_time, float_residual - double_residual);
+
+  return (0);
+}
+
+/**
+ * @brief Sends one request to a server started with --serve and prints the response: a fit of -target with the face at -x, -y and -z, or with -stats or -stop the matching command
+ */
+
+int
+runClient (int argc, char** argv)
+{
+  std::string socket_path ("/tmp/face.sock"), pcd_file ("target.pcd"), options, response;
+
+  float x = 0.0f, y = 0.0f, z = 0.0f;
+
+  bool sent;
+
+  pcl::console::parse_argument (argc, argv, "-socket", socket_path);
+  pcl::console::parse_argument (argc, argv, "-target", pcd_file);
+  pcl::console::parse_argument (argc, argv, "-options", options);
+  pcl::console::parse_argument (argc, argv, "-x", x);
+  pcl::console::parse_argument (argc, argv, "-y", y);
+  pcl::console::parse_argument (argc, argv, "-z", z);
+
+  FitClient client (socket_path);
+
+  if (pcl::console::find_switch (argc, argv, "-stats"))
+  {
+    sent = client.getStats (response);
+  }
+
+  else if (pcl::console::find_switch (argc, argv, "-stop"))
+  {
+    sent = client.stop (response);
+  }
+
+  /* With -inline the target is read here and its points are sent, otherwise the server reads the file itself */
+
+  else if (pcl::console::find_switch (argc, argv, "-inline"))
+  {
+    pcl::PointCloud<pcl::PointXYZ> target;
+
+    if (pcl::io::loadPCDFile<pcl::PointXYZ> (pcd_file, target) == -1)
+    {
+      PCL_ERROR ("Could not open file %s\n", pcd_file.c_str ());
+      return (1);
+    }
+
+    sent = client.fitPoints (target, pcl::PointXYZ (x,y,z), options, response);
+  }
+
+  else
+  {
+    sent = client.fit (pcd_file, pcl::PointXYZ (x,y,z), options, response);
+  }
+
+  if (!sent)
+  {
+    PCL_ERROR ("No server on %s\n", socket_path.c_str ());
+    return (1);
+  }
+
+  std::cout << response;
+
+  return (response.compare (0, 2, "OK") == 0 || response.compare (0, 5, "STATS") == 0 ? 0 : 1);
+}
+
+int main(int argc, char** argv)
+{
+  std::string precision ("double"), profile_path, profile_format ("lines");
+
+  /* With -profile every stage of the fits is recorded into that file, one JSON object per line or with -profile_format trace as a Chrome trace. The file is completed at exit, also after an error */
+
+  if (pcl::console::parse_argument (argc, argv, "-profile", profile_path) >= 0)
+  {
+    pcl::console::parse_argument (argc, argv, "-profile_format", profile_format);
+
+    if ( !Profiler::open (profile_path, profile_format == "trace" ? Profiler::CHROME_TRACE : Profiler::JSON_LINES) )
+    {
+      PCL_ERROR ("Could not open %s\n", profile_path.c_str ());
+      exit (1);
+    }
+
+    std::atexit (&Profiler::close);
+  }
+
+  /* The client of --serve needs no model */
+
+  if (pcl::console::find_switch (argc, argv, "--client"))
+  {
+    return (runClient (argc, argv));
+  }
+
+  /* Compares the float and the double fitting core on the target given by -target, -x, -y and -z */
+
+  if (pcl::console::find_switch (argc, argv, "--compare_precision"))
+  {
+    return (comparePrecision (argc, argv));
+  }
+
+  /* The precision of the fitting core: "float" for real-time use or "double" for offline accuracy */
+
+  pcl::console::parse_argument (argc, argv, "-precision", precision);
+
+  if (precision == "float")
+  {
+    return (run < SinglePrecision > (argc, argv));
+  }
+
+  return (run < DoublePrecision > (argc, argv));
+}
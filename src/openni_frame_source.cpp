@@ -0,0 +1,204 @@
+#include <openni_frame_source.h>
+
+OpenNIFrameSource::OpenNIFrameSource (bool gray_image)
+{
+  write_index_ = 0;
+  read_index_ = 0;
+  frame_counter_ = 0;
+  overflow_frames_ = 0;
+  skipped_frames_ = 0;
+
+  grabber_.reset (new pcl::OpenNIGrabber);
+
+  typedef void (ImageDepthCallback) (const ImagePtr&, const DepthImagePtr&, float);
+  typedef void (DepthCallback) (const DepthImagePtr&);
+
+  if ( gray_image && grabber_->providesCallback<ImageDepthCallback> () )
+  {
+    boost::function<ImageDepthCallback> function_grabber = boost::bind (&OpenNIFrameSource::imageDepthCallback, this, _1, _2, _3);
+    grabber_->registerCallback (function_grabber);
+  }
+
+  else
+  {
+    boost::function<DepthCallback> function_grabber = boost::bind (&OpenNIFrameSource::depthCallback, this, _1);
+    grabber_->registerCallback (function_grabber);
+  }
+}
+
+OpenNIFrameSource::~OpenNIFrameSource ()
+{
+  stop ();
+}
+
+void
+OpenNIFrameSource::start ()
+{
+  if (!grabber_->isRunning ())
+  {
+    grabber_->start ();
+  }
+}
+
+void
+OpenNIFrameSource::stop ()
+{
+  if (grabber_->isRunning ())
+  {
+    grabber_->stop ();
+  }
+}
+
+bool
+OpenNIFrameSource::grab (Frame& frame, int timeout)
+{
+  unsigned int read = read_index_.load (boost::memory_order_relaxed), write = write_index_.load (boost::memory_order_acquire);
+
+  if (read == write)
+  {
+    boost::mutex::scoped_lock lock (wait_mutex_);
+
+    boost::system_time deadline = boost::get_system_time () + boost::posix_time::millisec (timeout);
+
+    while ( (write = write_index_.load (boost::memory_order_acquire)) == read )
+    {
+      if ( !frame_condition_.timed_wait (lock, deadline) )
+      {
+        write = write_index_.load (boost::memory_order_acquire);
+        break;
+      }
+    }
+  }
+
+  if (read == write)
+  {
+    return (false);
+  }
+
+  /* Only the newest frame is returned, the slots are cleared so their depth buffers can be reused */
+
+  for (; write - read > 1; ++read)
+  {
+    ring_[read % RING_SIZE] = Frame ();
+    ++skipped_frames_;
+  }
+
+  frame = ring_[read % RING_SIZE];
+  ring_[read % RING_SIZE] = Frame ();
+
+  read_index_.store (read + 1, boost::memory_order_release);
+
+  return (true);
+}
+
+bool
+OpenNIFrameSource::isFinished ()
+{
+  return (false);
+}
+
+unsigned int
+OpenNIFrameSource::getDroppedFrames ()
+{
+  return (overflow_frames_ + skipped_frames_);
+}
+
+unsigned int
+OpenNIFrameSource::getOverflowFrames ()
+{
+  return (overflow_frames_);
+}
+
+unsigned int
+OpenNIFrameSource::getSkippedFrames ()
+{
+  return (skipped_frames_);
+}
+
+void
+OpenNIFrameSource::imageDepthCallback (const ImagePtr& image, const DepthImagePtr& depth_image, float constant)
+{
+  storeFrame (image, depth_image);
+}
+
+void
+OpenNIFrameSource::depthCallback (const DepthImagePtr& depth_image)
+{
+  storeFrame (ImagePtr (), depth_image);
+}
+
+void
+OpenNIFrameSource::storeFrame (const ImagePtr& image, const DepthImagePtr& depth_image)
+{
+  int width = depth_image->getWidth (), height = depth_image->getHeight ();
+
+  double receive_time = getTime ();
+
+  unsigned int write = write_index_.load (boost::memory_order_relaxed), index = frame_counter_++;
+
+  /* A full ring means grab () has not been called for a while, the new frame is thrown away before anything is copied */
+
+  if (write - read_index_.load (boost::memory_order_acquire) >= RING_SIZE)
+  {
+    ++overflow_frames_;
+    return;
+  }
+
+  boost::shared_ptr < std::vector < unsigned short > > depth_ptr = getFreeDepthBuffer (width * height);
+
+  depth_image->fillDepthImageRaw (width, height, &(*depth_ptr)[0]);
+
+  Frame& frame = ring_[write % RING_SIZE];
+
+  frame.index = index;
+  frame.timestamp = depth_image->getTimeStamp () * 1e-6;
+  frame.receive_time = receive_time;
+  frame.width = width;
+  frame.height = height;
+  frame.focal_length = depth_image->getFocalLength ();
+  frame.depth = depth_ptr;
+  frame.cloud.reset ();
+  frame.gray = cv::Mat ();
+
+  if (image)
+  {
+    frame.gray.create (image->getHeight (), image->getWidth (), CV_8UC1);
+    image->fillGrayscale (image->getWidth (), image->getHeight (), frame.gray.data);
+  }
+
+  write_index_.store (write + 1, boost::memory_order_release);
+
+  boost::mutex::scoped_lock lock (wait_mutex_);
+  frame_condition_.notify_one ();
+}
+
+boost::shared_ptr < std::vector < unsigned short > >
+OpenNIFrameSource::getFreeDepthBuffer (int size)
+{
+  int i;
+
+  /* The ring, the frame being grabbed and the one kept by the consumer may each hold a buffer, so that many are allocated at once */
+
+  if (depth_buffers_.empty ())
+  {
+    for (i = 0; i < RING_SIZE + 2; ++i)
+    {
+      depth_buffers_.push_back (boost::shared_ptr < std::vector < unsigned short > > (new std::vector < unsigned short > (size)));
+    }
+  }
+
+  for (i = 0; i < depth_buffers_.size (); ++i)
+  {
+    if (depth_buffers_[i].use_count () == 1)
+    {
+      depth_buffers_[i]->resize (size);
+      return (depth_buffers_[i]);
+    }
+  }
+
+  /* Every buffer is still held, e.g. by a scan in progress, so the pool grows */
+
+  depth_buffers_.push_back (boost::shared_ptr < std::vector < unsigned short > > (new std::vector < unsigned short > (size)));
+
+  return (depth_buffers_.back ());
+}
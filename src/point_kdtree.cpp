@@ -0,0 +1,225 @@
+#include <point_kdtree.h>
+
+#include <algorithm>
+#include <limits>
+
+namespace
+{
+  /* Ranges of at most 8 points are not split, they are searched one point after the other */
+
+  const int LEAF_SIZE = 8;
+
+  /* Every level of the tree halves the ranges, so 64 pending ranges are more than enough for any cloud that fits in memory */
+
+  const int MAXIMUM_DEPTH = 64;
+
+  struct CompareCoordinate
+  {
+    CompareCoordinate (const pcl::PointCloud<pcl::PointNormal>& cloud, int dimension) : cloud_ (cloud), dimension_ (dimension)
+    {
+    }
+
+    bool
+    operator() (int first, int second) const
+    {
+      return (cloud_.points[first].data[dimension_] < cloud_.points[second].data[dimension_]);
+    }
+
+    const pcl::PointCloud<pcl::PointNormal>& cloud_;
+
+    int dimension_;
+  };
+
+  struct PendingRange
+  {
+    int begin;
+
+    int end;
+
+    float squared_distance;
+  };
+}
+
+PointKdTree::PointKdTree ()
+{
+}
+
+void
+PointKdTree::setInputCloud (const pcl::PointCloud<pcl::PointNormal>& cloud)
+{
+  int i;
+
+  order_.clear ();
+
+  for (i = 0; i < cloud.size (); ++i)
+  {
+    if (pcl_isfinite (cloud.points[i].x) && pcl_isfinite (cloud.points[i].y) && pcl_isfinite (cloud.points[i].z))
+    {
+      order_.push_back (i);
+    }
+  }
+
+  split_dimensions_.assign (order_.size (), 0);
+
+  build (cloud, 0, order_.size ());
+
+  /* The coordinates are stored in the order of the tree, so the points of a range are next to each other in memory */
+
+  coordinates_.resize (3 * order_.size ());
+  indices_.resize (order_.size ());
+
+  for (i = 0; i < order_.size (); ++i)
+  {
+    coordinates_[3 * i] = cloud.points[order_[i]].x;
+    coordinates_[3 * i + 1] = cloud.points[order_[i]].y;
+    coordinates_[3 * i + 2] = cloud.points[order_[i]].z;
+
+    indices_[i] = order_[i];
+  }
+}
+
+void
+PointKdTree::build (const pcl::PointCloud<pcl::PointNormal>& cloud, int begin, int end)
+{
+  int i, dimension, middle;
+
+  float minimum[3], maximum[3];
+
+  if (end - begin <= LEAF_SIZE)
+  {
+    return;
+  }
+
+  /* Every range is split on the dimension in which its points spread the most, at the median */
+
+  for (dimension = 0; dimension < 3; ++dimension)
+  {
+    minimum[dimension] = std::numeric_limits<float>::max ();
+    maximum[dimension] = -std::numeric_limits<float>::max ();
+  }
+
+  for (i = begin; i < end; ++i)
+  {
+    for (dimension = 0; dimension < 3; ++dimension)
+    {
+      minimum[dimension] = std::min (minimum[dimension], cloud.points[order_[i]].data[dimension]);
+      maximum[dimension] = std::max (maximum[dimension], cloud.points[order_[i]].data[dimension]);
+    }
+  }
+
+  dimension = 0;
+
+  for (i = 1; i < 3; ++i)
+  {
+    if (maximum[i] - minimum[i] > maximum[dimension] - minimum[dimension])
+    {
+      dimension = i;
+    }
+  }
+
+  middle = begin + (end - begin) / 2;
+
+  std::nth_element (order_.begin () + begin, order_.begin () + middle, order_.begin () + end, CompareCoordinate (cloud, dimension));
+
+  split_dimensions_[middle] = dimension;
+
+  build (cloud, begin, middle);
+  build (cloud, middle + 1, end);
+}
+
+bool
+PointKdTree::nearest (const pcl::PointNormal& point, int& index, float& squared_distance) const
+{
+  int i, begin, end, middle, best = -1, number_pending = 0;
+
+  float difference, distance, best_distance = std::numeric_limits<float>::max ();
+
+  const float* node;
+
+  PendingRange pending[MAXIMUM_DEPTH];
+
+  pending[number_pending].begin = 0;
+  pending[number_pending].end = indices_.size ();
+  pending[number_pending].squared_distance = 0.0f;
+  ++number_pending;
+
+  while (number_pending > 0)
+  {
+    --number_pending;
+
+    begin = pending[number_pending].begin;
+    end = pending[number_pending].end;
+
+    /* The range lies entirely beyond its splitting plane, it cannot hold a closer point if the plane is already too far */
+
+    if (pending[number_pending].squared_distance >= best_distance)
+    {
+      continue;
+    }
+
+    /* The search walks down to the side of the query point, the other side of every node is kept for later */
+
+    while (end - begin > LEAF_SIZE)
+    {
+      middle = begin + (end - begin) / 2;
+      node = &coordinates_[3 * middle];
+
+      distance = (point.x - node[0]) * (point.x - node[0]) + (point.y - node[1]) * (point.y - node[1]) + (point.z - node[2]) * (point.z - node[2]);
+
+      if (distance < best_distance)
+      {
+        best_distance = distance;
+        best = middle;
+      }
+
+      difference = point.data[split_dimensions_[middle]] - node[split_dimensions_[middle]];
+
+      if (difference * difference < best_distance)
+      {
+        pending[number_pending].begin = difference < 0.0f ? middle + 1 : begin;
+        pending[number_pending].end = difference < 0.0f ? end : middle;
+        pending[number_pending].squared_distance = difference * difference;
+        ++number_pending;
+      }
+
+      if (difference < 0.0f)
+      {
+        end = middle;
+      }
+
+      else
+      {
+        begin = middle + 1;
+      }
+    }
+
+    for (i = begin; i < end; ++i)
+    {
+      node = &coordinates_[3 * i];
+
+      distance = (point.x - node[0]) * (point.x - node[0]) + (point.y - node[1]) * (point.y - node[1]) + (point.z - node[2]) * (point.z - node[2]);
+
+      if (distance < best_distance)
+      {
+        best_distance = distance;
+        best = i;
+      }
+    }
+  }
+
+  if (best < 0)
+  {
+    return (false);
+  }
+
+  index = indices_[best];
+  squared_distance = best_distance;
+
+  return (true);
+}
+
+int
+PointKdTree::size () const
+{
+  return (indices_.size ());
+}
@@ -0,0 +1,184 @@
+#include <profiler.h>
+
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/math/special_functions/fpclassify.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/tss.hpp>
+
+#include <fstream>
+#include <sstream>
+#include <vector>
+
+boost::atomic < bool > Profiler::enabled_ (false);
+
+namespace
+{
+  /* The state of the profiler, guarded by profile_mutex except for the start time, which is only written by open () */
+
+  boost::mutex profile_mutex;
+
+  std::ofstream profile_file;
+
+  Profiler::Format profile_format;
+
+  boost::posix_time::ptime start_time;
+
+  std::vector < Profiler::Event > pending_events;
+
+  bool first_event;
+
+  int number_threads;
+
+  boost::thread_specific_ptr < int > thread_index;
+
+  /* The events are kept in memory and written by batches, so a fit only takes the lock for an append */
+
+  const size_t BATCH_SIZE = 1024;
+
+  void
+  writeEvents ()
+  {
+    size_t i;
+
+    for (i = 0; i < pending_events.size (); ++i)
+    {
+      const Profiler::Event& event = pending_events[i];
+
+      std::ostringstream counters;
+
+      if (event.iteration >= 0)
+      {
+        counters << ", \"iteration\": " << event.iteration;
+      }
+
+      if (event.points >= 0)
+      {
+        counters << ", \"points\": " << event.points;
+      }
+
+      if (event.correspondences >= 0)
+      {
+        counters << ", \"correspondences\": " << event.correspondences << ", \"rejected\": " << event.rejected;
+      }
+
+      if ( !(boost::math::isnan) (event.residual) )
+      {
+        counters << ", \"residual\": " << event.residual;
+      }
+
+      if (event.allocations >= 0)
+      {
+        counters << ", \"allocations\": " << event.allocations;
+      }
+
+      if (profile_format == Profiler::CHROME_TRACE)
+      {
+        /* A complete event, its counters shown as the arguments of the slice; the leading ", " of the counters is dropped */
+
+        profile_file << (first_event ? "" : ",\n") << "{\"name\": \"" << event.name << "\", \"ph\": \"X\", \"pid\": 1, \"tid\": " << event.thread
+                     << ", \"ts\": " << event.start << ", \"dur\": " << event.duration << ", \"args\": {" << (counters.str ().empty () ? "" : counters.str ().substr (2)) << "}}";
+      }
+
+      else
+      {
+        profile_file << "{\"name\": \"" << event.name << "\", \"thread\": " << event.thread << ", \"start_us\": " << event.start << ", \"duration_us\": " << event.duration
+                     << counters.str () << "}\n";
+      }
+
+      first_event = false;
+    }
+
+    pending_events.clear ();
+  }
+}
+
+bool
+Profiler::open (const std::string& path, Format format)
+{
+  boost::mutex::scoped_lock lock (profile_mutex);
+
+  profile_file.open (path.c_str ());
+
+  if (!profile_file)
+  {
+    return (false);
+  }
+
+  profile_file.precision (15);
+
+  profile_format = format;
+  first_event = true;
+  number_threads = 0;
+
+  pending_events.reserve (BATCH_SIZE);
+
+  if (format == CHROME_TRACE)
+  {
+    profile_file << "[\n";
+  }
+
+  start_time = boost::posix_time::microsec_clock::universal_time ();
+
+  enabled_ = true;
+
+  return (true);
+}
+
+void
+Profiler::close ()
+{
+  boost::mutex::scoped_lock lock (profile_mutex);
+
+  if (!enabled_)
+  {
+    return;
+  }
+
+  enabled_ = false;
+
+  writeEvents ();
+
+  if (profile_format == CHROME_TRACE)
+  {
+    profile_file << "\n]\n";
+  }
+
+  profile_file.close ();
+}
+
+double
+Profiler::getTime ()
+{
+  return ( (boost::posix_time::microsec_clock::universal_time () - start_time).total_microseconds () );
+}
+
+int
+Profiler::getThread ()
+{
+  if (thread_index.get () == NULL)
+  {
+    boost::mutex::scoped_lock lock (profile_mutex);
+
+    thread_index.reset (new int (number_threads++));
+  }
+
+  return (*thread_index);
+}
+
+void
+Profiler::record (const Event& event)
+{
+  boost::mutex::scoped_lock lock (profile_mutex);
+
+  if (!enabled_)
+  {
+    return;
+  }
+
+  pending_events.push_back (event);
+
+  if (pending_events.size () >= BATCH_SIZE)
+  {
+    writeEvents ();
+  }
+}
@@ -1,312 +1,285 @@
 #include <registration.h>
+#include <allocation_counter.h>
+#include <profiler.h>
 #include <pcl/registration/transformation_estimation_svd.h>
+#include <pcl/console/time.h>
 
-Registration::Registration ()
+#include <fstream>
+#include <limits>
+
+template <typename PolicyT>
+Registration<PolicyT>::Registration ()
 {
-  target_point_normal_cloud_ptr_.reset (new pcl::PointCloud<pcl::PointXYZRGBNormal>);
-  iteration_source_point_normal_cloud_ptr_.reset (new pcl::PointCloud<pcl::PointXYZRGBNormal>);
+  target_point_normal_cloud_ptr_.reset (new pcl::PointCloud<pcl::PointNormal>);
+  kdtree_ptr_.reset (new pcl::search::KdTree<pcl::PointNormal>);
+  iteration_source_point_normal_cloud_ptr_.reset (new pcl::PointCloud<pcl::PointNormal>);
 
   index_ = 0;
   continue_tracking_ = true;
   first_face_found_ = false;
   debug_mode_on_ = false;
   calculate_ = false;
+  auto_scan_ = false;
+  scan_translation_threshold_ = 0.0f;
+  scan_rotation_threshold_ = 0.0f;
+  scan_surface_growth_ = 0.0f;
+  refinement_iterations_ = 0;
+  late_threshold_ = 1000.0 / 30.0;
+  correspondence_passes_ = 0;
+  rigid_iterations_saved_ = 0;
+  last_rotation_change_ = 0.0;
+  last_translation_change_ = 0.0;
+  last_coefficient_change_ = 0.0;
+  last_residual_ = 0.0;
+
+  pose_ = Matrix4::Identity ();
 
 }
 
-void
-Registration::setDebugMode (bool debug_mode)
+template <typename PolicyT> void
+Registration<PolicyT>::setDebugMode (bool debug_mode)
 {
   debug_mode_on_ = debug_mode;
 }
 
-void
-Registration::getDataForModel (std::string database_path, Eigen::MatrixX3d transformation_matrix, Eigen::Vector3d translation, double scale)
+template <typename PolicyT> void
+Registration<PolicyT>::getDataForModel (std::string database_path, Eigen::MatrixX3d transformation_matrix, Eigen::Vector3d translation, double scale)
 {
-  int i,j;
-
-  boost::filesystem::path data_path (database_path);
-
-
-
-  if ( boost::filesystem::exists (data_path) )
-  {
-    /* In case the database_path is a folder, the information is calculated from scratch with the methods from PositionModel */
-    if ( boost::filesystem::is_directory (data_path) )
-    {
-      PositionModel position_model;
-
-      position_model.readDataFromFolders (database_path,150,4,transformation_matrix,translation);
-
-      eigen_source_points_ = position_model.calculateMeanFace (true);
-
-      position_model.calculateEigenValuesAndVectors ();
-
-      model_mesh_ = position_model.getMeshes (true);
-
-      eigenvalues_vector_ = position_model.getEigenValues (true);
-      eigenvectors_matrix_ = position_model.getEigenVectors (true);
-      PCL_INFO ("Done with eigenvectors\n");
-    }
-
-    /* In case the database_path is a folder, the information is calculated from scratch with the methods from PositionModel */
-
-    else if ( boost::filesystem::is_regular_file (data_path))
-    {
-
-      /* This section will read the coordinates of the of the vertices of the model */
-
-      std::ifstream ins (database_path.c_str ());
-
-      int i,j,rows,cols;
-
-      uint32_t vertice;
-
-      std::string line;
+  setModel (typename StatisticalModel<PolicyT>::ConstPtr (new StatisticalModel<PolicyT> (database_path, transformation_matrix, translation, scale)));
+}
 
-      ins >> rows;
+template <typename PolicyT> void
+Registration<PolicyT>::setModel (typename StatisticalModel<PolicyT>::ConstPtr model_ptr)
+{
 
-      eigen_source_points_.resize (rows);
+  /* Only the vertices are copied, they are deformed by the fit while the eigenvectors and the mesh stay shared */
 
-      double aux;
+  model_ptr_ = model_ptr;
 
+  eigen_source_points_ = model_ptr_->getMeanPoints ();
 
-      for (i = 0; i < rows; ++i)
-      {
-        ins >> aux;
-        eigen_source_points_ (i) = aux * scale;
-      }
+  convertEigenToPointCLoud ();
 
-      std::getline (ins,line);
-      std::getline (ins,line);
+  /* The pose and the coefficients are counted from the model as it was read */
 
-      /* This section will read the mesh the model */
+  pose_ = Matrix4::Identity ();
+  coefficients_ = VectorX::Zero (model_ptr_->getEigenVectors ().cols ());
 
-      while (true)
-      {
-        std::getline (ins,line);
+  calculateModelCenterPoint ();
 
-        if (line == "")
-        {
-          break;
-        }
+}
 
-        std::istringstream iss (line);
+template <typename PolicyT> typename StatisticalModel<PolicyT>::ConstPtr
+Registration<PolicyT>::getModel ()
+{
+  return (model_ptr_);
+}
 
-        pcl::Vertices vertice_vector;
+template <typename PolicyT> void
+Registration<PolicyT>::calculateModelCenterPoint ()
+{
 
-        while (iss >> vertice)
-        {
-          vertice_vector.vertices.push_back (vertice);
-        }
+  model_center_point_ = Vector3::Zero ();
+  int i;
 
-        model_mesh_.push_back (vertice_vector);
+  for ( i = 0; i < eigen_source_points_.rows (); i = i+3)
+  {
+    model_center_point_ += eigen_source_points_.template segment<3> (i);
+  }
 
-      }
+  model_center_point_ /= static_cast<Scalar> (eigen_source_points_.rows () / 3);
 
-      /* This section will read the eigenvalues and eigenvectors */
+}
 
-      ins >> rows;
 
-      eigenvalues_vector_.resize (rows);
+template <typename PolicyT> void
+Registration<PolicyT>::getTargetPointCloudFromCamera (FrameSource::Ptr source)
+{
 
+  pcl::PointCloud<pcl::PointNormal>::Ptr target_point_normal_cloud_ptr (new pcl::PointCloud<pcl::PointNormal>);
 
-      for (i = 0; i < rows; ++i)
-      {
-        ins >> eigenvalues_vector_ (i);
-        eigenvalues_vector_ (i) *= scale;
-      }
+  if (!camera_grabber_ptr_)
+  {
+    camera_grabber_ptr_.reset (new CameraGrabber);
+    camera_grabber_ptr_->setCamera (source,face_locator_ptr_);
+  }
 
-      std::getline (ins,line);
+  /* The cloud of the frame is shared with the source, it is copied once into the target, which then gets its normals in place */
 
+  pcl::copyPointCloud (* (camera_grabber_ptr_->getPointCloud (face_center_point_)),*target_point_normal_cloud_ptr);
 
-      ins >> rows >> cols;
+  setKdTree (target_point_normal_cloud_ptr);
 
-      eigenvectors_matrix_.resize (rows,cols);
+  PCL_INFO ("Done with camera scanning\n");
 
+}
 
+template <typename PolicyT> void
+Registration<PolicyT>::getTargetPointCloudFromFile (std::string pcd_file, pcl::PointXYZ face_point)
+{
 
-      for (j = 0; j < cols; ++j)
-      {
-        for (i = 0; i < rows; ++i)
-        {
-          ins >> eigenvectors_matrix_ (i,j);
-          eigenvectors_matrix_ (i,j) *= scale;
-        }
-      }
 
-    }
+  /* The file is read straight into the target, the normals are filled in by setKdTree () */
 
-    else
-    {
-      PCL_ERROR ("Unknown file type\n");
-      exit (1);
-    }
-  }
+  pcl::PointCloud<pcl::PointNormal>::Ptr target_point_normal_cloud_ptr (new pcl::PointCloud<pcl::PointNormal>);
 
-  else
+  if (pcl::io::loadPCDFile<pcl::PointNormal> (pcd_file, *target_point_normal_cloud_ptr) == -1)
   {
-    PCL_ERROR ("Could not find database\n");
+    PCL_ERROR ("Could not open file %s\n", pcd_file.c_str ());
     exit (1);
   }
 
-  /* This part will decrement the indices from the OBJ mesh in order to be used as PCL meshes since the numerotation in PCL starts at 0 and in OBJ at 1  */
-
-  debug_model_mesh_ = model_mesh_;
-
-  for (i = 0; i < debug_model_mesh_.size (); ++i)
-  {
-    for (j = 0; j < debug_model_mesh_[i].vertices.size (); ++j)
-    {
-      debug_model_mesh_[i].vertices[j] = debug_model_mesh_[i].vertices[j] - 1;
-    }
-  }
-
-  convertEigenToPointCLoud ();
-
-
-
-  uint32_t rgb;
-  uint8_t value (255);
-
-  rgb = ( (uint32_t)value);
-
-  calculateModelCenterPoint ();
-
-
-  PCL_INFO ("Done with reading the statistical model\n");
-
+  setTargetPointCloud (target_point_normal_cloud_ptr, face_point);
 }
 
-void
-Registration::calculateModelCenterPoint ()
+template <typename PolicyT> void
+Registration<PolicyT>::setTargetPointCloud (pcl::PointCloud<pcl::PointNormal>::Ptr target_point_normal_cloud_ptr, pcl::PointXYZ face_point)
 {
+  face_center_point_ = face_point;
 
-  model_center_point_ = Eigen::Vector3d::Zero ();
-  int i;
+  setKdTree (target_point_normal_cloud_ptr);
+}
 
-  for ( i = 0; i < iteration_source_point_normal_cloud_ptr_->points.size (); ++i)
-  {
-    model_center_point_ += iteration_source_point_normal_cloud_ptr_->points[i].getVector3fMap ().cast<double> ();
-  }
+template <typename PolicyT> void
+Registration<PolicyT>::setPreparedTarget (pcl::PointCloud<pcl::PointNormal>::Ptr target_point_normal_cloud_ptr, pcl::search::KdTree<pcl::PointNormal>::Ptr kdtree_ptr, pcl::PointXYZ face_point)
+{
+  face_center_point_ = face_point;
 
-  model_center_point_ /= static_cast<double> (iteration_source_point_normal_cloud_ptr_->points.size ());
+  target_point_normal_cloud_ptr_ = target_point_normal_cloud_ptr;
+  kdtree_ptr_ = kdtree_ptr;
 
+  target_tree_.setInputCloud (*target_point_normal_cloud_ptr_);
 }
 
-
-void
-Registration::getTargetPointCloudFromCamera (int device, std::string file_classifier)
+template <typename PolicyT> void
+Registration<PolicyT>::setFaceLocator (FaceLocator::Ptr face_locator)
 {
+  face_locator_ptr_ = face_locator;
+}
 
-  pcl::PointCloud<pcl::PointXYZ>::Ptr target_point_cloud_ptr (new pcl::PointCloud<pcl::PointXYZ>);
+template <typename PolicyT> void
+Registration<PolicyT>::setFaceCenterPoint (pcl::PointXYZ face_point)
+{
+  face_center_point_ = face_point;
+}
 
-  std::pair<int,int> center_coordinates;
+template <typename PolicyT> typename Registration<PolicyT>::Matrix4
+Registration<PolicyT>::getPose ()
+{
+  return (pose_);
+}
 
+template <typename PolicyT> typename Registration<PolicyT>::VectorX
+Registration<PolicyT>::getCoefficients ()
+{
+  return (coefficients_);
+}
 
-  CameraGrabber camera;
+template <typename PolicyT> pcl::PointCloud<pcl::PointNormal>::ConstPtr
+Registration<PolicyT>::getModelPointCloud ()
+{
+  return (iteration_source_point_normal_cloud_ptr_);
+}
 
-  camera.setCamera (device,file_classifier);
 
-  pcl::copyPointCloud (* (camera.getPointCloud (center_coordinates)),*target_point_cloud_ptr);
+template <typename PolicyT> void
+Registration<PolicyT>::alignModel ()
+{
 
-  setKdTree (target_point_cloud_ptr);
+  Matrix4 transformation = Matrix4::Identity ();
 
-  face_center_point_.x = target_point_normal_cloud_ptr_->at (center_coordinates.first,center_coordinates.second).x;
-  face_center_point_.y = target_point_normal_cloud_ptr_->at (center_coordinates.first,center_coordinates.second).y;
-  face_center_point_.z = target_point_normal_cloud_ptr_->at (center_coordinates.first,center_coordinates.second).z;
+  Vector3 translation = face_center_point_.getVector3fMap ().template cast<Scalar> () - model_center_point_;
 
+  translation[2] += 0.05;
 
+  transformation.block (0, 3, 3, 1) = translation;
 
-  PCL_INFO ("Done with camera scanning\n");
+  applyRigidTransformToModel (transformation);
 
 }
 
-void
-Registration::getTargetPointCloudFromFile (std::string pcd_file, pcl::PointXYZ face_point)
+template <typename PolicyT> void
+Registration<PolicyT>::convertPointCloudToEigen ()
 {
+  int i,j=0;
 
 
-  pcl::PointCloud<pcl::PointXYZ>::Ptr target_point_cloud_ptr (new pcl::PointCloud<pcl::PointXYZ>);
 
-  if (pcl::io::loadPCDFile<pcl::PointXYZ> (pcd_file, *target_point_cloud_ptr) == -1)
+  for (i = 0; i < iteration_source_point_normal_cloud_ptr_->size (); ++i)
   {
-    PCL_ERROR ("Could not open file %s\n", pcd_file.c_str ());
-    exit (1);
+    eigen_source_points_[j++] = iteration_source_point_normal_cloud_ptr_->at (i).x;
+    eigen_source_points_[j++] = iteration_source_point_normal_cloud_ptr_->at (i).y;
+    eigen_source_points_[j++] = iteration_source_point_normal_cloud_ptr_->at (i).z;
   }
 
-  face_center_point_ = face_point;
-
-  setKdTree (target_point_cloud_ptr);
 }
 
-
-void
-Registration::alignModel ()
+template <typename PolicyT> void
+Registration<PolicyT>::applyRigidTransformToModel (const Matrix4& transformation)
 {
+  int i;
 
-  Eigen::Vector3d translation = face_center_point_.getVector3fMap ().cast<double> () - model_center_point_;
+  Matrix3 rotation = transformation.block (0, 0, 3, 3);
+  Vector3 translation = transformation.block (0, 3, 3, 1);
 
-  translation[2] += 0.05;
+  /* The model is transformed in the precision of the policy, so that the double version does not lose accuracy by going through the float cloud */
 
-  pcl::transformPointCloudWithNormals (*iteration_source_point_normal_cloud_ptr_,*iteration_source_point_normal_cloud_ptr_,translation,Eigen::Quaternion<double>::Identity ());
+  for (i = 0; i < eigen_source_points_.rows (); i = i+3)
+  {
+    eigen_source_points_.template segment<3> (i) = rotation * eigen_source_points_.template segment<3> (i) + translation;
+  }
 
-}
+  pcl::transformPointCloudWithNormals (*iteration_source_point_normal_cloud_ptr_,*iteration_source_point_normal_cloud_ptr_,transformation);
 
-void
-Registration::convertPointCloudToEigen ()
-{
-  int i,j=0;
+  pose_ = transformation * pose_;
 
+}
 
 
-  for (i = 0; i < iteration_source_point_normal_cloud_ptr_->size (); ++i)
-  {
-    eigen_source_points_[j++] = iteration_source_point_normal_cloud_ptr_->at (i).x;
-    eigen_source_points_[j++] = iteration_source_point_normal_cloud_ptr_->at (i).y;
-    eigen_source_points_[j++] = iteration_source_point_normal_cloud_ptr_->at (i).z;
-  }
+template <typename PolicyT> void
+Registration<PolicyT>::convertEigenToPointCLoud ()
+{
+   int i,k;
+   int number_points = eigen_source_points_.rows () / 3;
 
-}
+   const std::vector <  pcl::Vertices >& model_mesh = model_ptr_->getMesh ();
 
+   workspace_.reserve (number_points, 0);
 
-void
-Registration::convertEigenToPointCLoud ()
-{
-   pcl::PointXYZRGBNormal pcl_point;
-   int i,j,k;
+   /* The cloud keeps its size between the calls, only the coordinates are overwritten */
 
-   iteration_source_point_normal_cloud_ptr_->clear ();
+   iteration_source_point_normal_cloud_ptr_->resize (number_points);
 
-   for (i = 0; i < eigen_source_points_.rows (); i = i+3)
+   for (i = 0; i < number_points; ++i)
    {
-     pcl_point.x = eigen_source_points_[i];
-     pcl_point.y = eigen_source_points_[i+1];
-     pcl_point.z = eigen_source_points_[i+2];
-
-     iteration_source_point_normal_cloud_ptr_->push_back (pcl_point);
+     iteration_source_point_normal_cloud_ptr_->points[i].x = eigen_source_points_[3 * i];
+     iteration_source_point_normal_cloud_ptr_->points[i].y = eigen_source_points_[3 * i + 1];
+     iteration_source_point_normal_cloud_ptr_->points[i].z = eigen_source_points_[3 * i + 2];
    }
 
-   /* This part will calculate the normals for each quad of the mesh */
+   /* This part will calculate the normals for each quad of the mesh
+    * The normal of a point is the average of the normals of the triangles around it, weighted by their areas, so it is enough to accumulate area * normal for each point
+    */
+
+   Eigen::Map < VectorX, Eigen::Aligned > normal_accumulator = workspace_.getNormalAccumulator ();
 
-   std::vector < std::vector < Eigen::Vector3d > > normal_vector (iteration_source_point_normal_cloud_ptr_->points.size ());
-   std::vector < std::vector < double > > surface_vector (iteration_source_point_normal_cloud_ptr_->points.size ());
+   normal_accumulator.head (3 * number_points).setZero ();
 
-   for ( k = 0; k < model_mesh_.size (); ++k)
+   for ( k = 0; k < model_mesh.size (); ++k)
    {
 
      Eigen::Vector3d eigen_vector_1,eigen_vector_2;
 
      int maximum_index = 0;
-     int number_vertices = model_mesh_[k].vertices.size ();
+     int number_vertices = model_mesh[k].vertices.size ();
      double angle, maximum_angle = 0.0;
 
      /* The following for-loop will determine which angle is the biggest for the current quad by comparing the dot products of the vectors that form an angle  */
 
-     for ( i = model_mesh_[k].vertices.size (); i < model_mesh_[k].vertices.size () * 2; ++i)
+     for ( i = model_mesh[k].vertices.size (); i < model_mesh[k].vertices.size () * 2; ++i)
      {
-       eigen_vector_1 = iteration_source_point_normal_cloud_ptr_->points[model_mesh_[k].vertices[ (i - 1) % number_vertices ] - 1].getVector3fMap ().cast<double> () - iteration_source_point_normal_cloud_ptr_->points[ model_mesh_[k].vertices[ i % number_vertices ] - 1].getVector3fMap ().cast<double> ();
-       eigen_vector_2 = iteration_source_point_normal_cloud_ptr_->points[model_mesh_[k].vertices[ (i + 1) % number_vertices ] - 1].getVector3fMap ().cast<double> () - iteration_source_point_normal_cloud_ptr_->points[model_mesh_[k].vertices[ i % number_vertices ] - 1].getVector3fMap ().cast<double> ();
+       eigen_vector_1 = iteration_source_point_normal_cloud_ptr_->points[model_mesh[k].vertices[ (i - 1) % number_vertices ] - 1].getVector3fMap ().cast<double> () - iteration_source_point_normal_cloud_ptr_->points[ model_mesh[k].vertices[ i % number_vertices ] - 1].getVector3fMap ().cast<double> ();
+       eigen_vector_2 = iteration_source_point_normal_cloud_ptr_->points[model_mesh[k].vertices[ (i + 1) % number_vertices ] - 1].getVector3fMap ().cast<double> () - iteration_source_point_normal_cloud_ptr_->points[model_mesh[k].vertices[ i % number_vertices ] - 1].getVector3fMap ().cast<double> ();
 
        eigen_vector_1.normalize ();
        eigen_vector_2.normalize ();
@@ -322,171 +295,109 @@ Registration::convertEigenToPointCLoud ()
        }
      }
 
-     /* The following part will store for each 2 triangles forming a quad, the area of the triangle and its normal */
+     /* The following part will add for each 2 triangles forming a quad, the area of the triangle multiplied by its normal */
 
      Eigen::Vector3d edge,normal_1,normal_2;
 
 
-     edge = iteration_source_point_normal_cloud_ptr_->points[model_mesh_[k].vertices[ (maximum_index + number_vertices - 2) % number_vertices ] - 1].getVector3fMap ().cast<double> () - iteration_source_point_normal_cloud_ptr_->points[model_mesh_[k].vertices[ maximum_index ] - 1].getVector3fMap ().cast<double> ();
-     eigen_vector_1 = iteration_source_point_normal_cloud_ptr_->points[model_mesh_[k].vertices[ (maximum_index + number_vertices - 1) % number_vertices ] - 1].getVector3fMap ().cast<double> () - iteration_source_point_normal_cloud_ptr_->points[model_mesh_[k].vertices[ maximum_index ] - 1].getVector3fMap ().cast<double> ();
-     eigen_vector_2 = iteration_source_point_normal_cloud_ptr_->points[model_mesh_[k].vertices[ (maximum_index + number_vertices + 1) % number_vertices ] - 1].getVector3fMap ().cast<double> () - iteration_source_point_normal_cloud_ptr_->points[model_mesh_[k].vertices[ maximum_index ] - 1].getVector3fMap ().cast<double> ();
-
-     normal_1 = edge.cross (eigen_vector_1);
-     normal_2 = eigen_vector_2.cross (edge);
-
-     double area_1,area_2;
-
-     area_1 = normal_1.norm () * 0.5;
-     area_2 = normal_2.norm () * 0.5;
-
-     normal_1.normalize ();
-     normal_2.normalize ();
-
-
-     normal_vector [ model_mesh_[k].vertices [maximum_index] - 1 ].push_back (normal_1);
-     normal_vector [ model_mesh_[k].vertices [maximum_index] - 1 ].push_back (normal_2);
-     surface_vector[ model_mesh_[k].vertices [maximum_index] - 1 ].push_back (area_1);
-     surface_vector[ model_mesh_[k].vertices [maximum_index] - 1 ].push_back (area_2);
+     edge = iteration_source_point_normal_cloud_ptr_->points[model_mesh[k].vertices[ (maximum_index + number_vertices - 2) % number_vertices ] - 1].getVector3fMap ().cast<double> () - iteration_source_point_normal_cloud_ptr_->points[model_mesh[k].vertices[ maximum_index ] - 1].getVector3fMap ().cast<double> ();
+     eigen_vector_1 = iteration_source_point_normal_cloud_ptr_->points[model_mesh[k].vertices[ (maximum_index + number_vertices - 1) % number_vertices ] - 1].getVector3fMap ().cast<double> () - iteration_source_point_normal_cloud_ptr_->points[model_mesh[k].vertices[ maximum_index ] - 1].getVector3fMap ().cast<double> ();
+     eigen_vector_2 = iteration_source_point_normal_cloud_ptr_->points[model_mesh[k].vertices[ (maximum_index + number_vertices + 1) % number_vertices ] - 1].getVector3fMap ().cast<double> () - iteration_source_point_normal_cloud_ptr_->points[model_mesh[k].vertices[ maximum_index ] - 1].getVector3fMap ().cast<double> ();
 
+     /* The norm of the cross product is twice the area of the triangle */
 
-     normal_vector [ model_mesh_[k].vertices [ (maximum_index + number_vertices - 2) % number_vertices] - 1 ].push_back (normal_1);
-     normal_vector [ model_mesh_[k].vertices [ (maximum_index + number_vertices - 2) % number_vertices] - 1 ].push_back (normal_2);
-     surface_vector[ model_mesh_[k].vertices [ (maximum_index + number_vertices - 2) % number_vertices] - 1 ].push_back (area_1);
-     surface_vector[ model_mesh_[k].vertices [ (maximum_index + number_vertices - 2) % number_vertices] - 1 ].push_back (area_2);
+     Vector3 weighted_normal_1 = (edge.cross (eigen_vector_1) * 0.5).template cast<Scalar> ();
+     Vector3 weighted_normal_2 = (eigen_vector_2.cross (edge) * 0.5).template cast<Scalar> ();
 
-
-     normal_vector [ model_mesh_[k].vertices [ (maximum_index + number_vertices - 1) % number_vertices] - 1 ].push_back (normal_1);
-     surface_vector[ model_mesh_[k].vertices [ (maximum_index + number_vertices - 1) % number_vertices] - 1 ].push_back (area_1);
-
-     normal_vector [ model_mesh_[k].vertices [ (maximum_index + number_vertices + 1) % number_vertices] - 1 ].push_back (normal_2);
-     surface_vector[ model_mesh_[k].vertices [ (maximum_index + number_vertices + 1) % number_vertices] - 1 ].push_back (area_2);
+     normal_accumulator.template segment<3> ( (model_mesh[k].vertices [maximum_index] - 1) * 3) += weighted_normal_1 + weighted_normal_2;
+     normal_accumulator.template segment<3> ( (model_mesh[k].vertices [ (maximum_index + number_vertices - 2) % number_vertices] - 1) * 3) += weighted_normal_1 + weighted_normal_2;
+     normal_accumulator.template segment<3> ( (model_mesh[k].vertices [ (maximum_index + number_vertices - 1) % number_vertices] - 1) * 3) += weighted_normal_1;
+     normal_accumulator.template segment<3> ( (model_mesh[k].vertices [ (maximum_index + number_vertices + 1) % number_vertices] - 1) * 3) += weighted_normal_2;
 
    }
 
-   /* The following loops will calculate th average normal for each vertice */
+   /* The following loop will normalize the average normal of each vertice */
 
-   for ( i = 0; i < iteration_source_point_normal_cloud_ptr_->points.size (); ++i)
+   for ( i = 0; i < number_points; ++i)
    {
-     double ratio = 0.0;
-     Eigen::Vector3d normal_result = Eigen::Vector3d::Zero ();
-
-     for ( j = 0; j < normal_vector[i].size (); ++j)
-     {
-       ratio += surface_vector[i][j];
-     }
-
-     for ( j = 0; j < normal_vector[i].size (); ++j)
-     {
-       normal_result += ( ( surface_vector[i][j] * normal_vector[i][j] ) );
-     }
+     Vector3 normal_result = normal_accumulator.template segment<3> (i * 3);
 
-
-     normal_result /= ratio;
      normal_result.normalize ();
 
-
-
      iteration_source_point_normal_cloud_ptr_->points[i].normal_x = normal_result[0];
      iteration_source_point_normal_cloud_ptr_->points[i].normal_y = normal_result[1];
      iteration_source_point_normal_cloud_ptr_->points[i].normal_z = normal_result[2];
-
-
-   }
-
-
-   uint32_t rgb;
-   uint8_t value (255);
-
-   rgb = ( (uint32_t)value);
-
-   for ( i = 0; i < iteration_source_point_normal_cloud_ptr_->points.size (); ++i)
-   {
-     iteration_source_point_normal_cloud_ptr_->points[i].rgb = *reinterpret_cast<float*> (&rgb);
    }
 
 }
 
-void
-Registration::calculateRigidRegistration (int number_of_iterations, double angle_limit, double distance_limit, bool visualize)
+template <typename PolicyT> void
+Registration<PolicyT>::calculateRigidRegistration (int number_of_iterations, double angle_limit, double distance_limit, bool visualize)
 {
 
   int i,j,k;
 
+  workspace_.reserve (iteration_source_point_normal_cloud_ptr_->points.size (), 0);
 
-  Eigen::MatrixXd J (iteration_source_point_normal_cloud_ptr_->points.size (), 6);
-  Eigen::VectorXd y (iteration_source_point_normal_cloud_ptr_->points.size ());
-
-
-  Eigen::Matrix3d current_iteration_rotation = Eigen::Matrix3d::Identity ();
-  Eigen::Vector3d current_iteration_translation;
-
-  pcl::PointCloud <pcl::PointXYZRGBNormal>::Ptr current_iteration_source_points_ptr (new pcl::PointCloud<pcl::PointXYZRGBNormal>);
-
-  pcl::copyPointCloud (*iteration_source_point_normal_cloud_ptr_, *current_iteration_source_points_ptr);
-
-  if (visualize)
-  {
-
-    if (debug_mode_on_)
-    {
-      visualizer_ptr_->spin ();
-    }
-
-    else
-    {
-      visualizer_ptr_->spinOnce (500);
-    }
-
+  typename PolicyT::Matrix6& JJ = workspace_.rigid_system;
+  Vector6& right_side = workspace_.rigid_right_side;
+  Vector6 jacobian_row, solutions;
 
-    visualizer_ptr_->removeAllShapes ();
-    visualizer_ptr_->removeAllPointClouds ();
-    visualizer_ptr_->removeCorrespondences ();
+  Matrix3 current_iteration_rotation = Matrix3::Identity ();
+  Vector3 current_iteration_translation;
 
 
-  }
+  Matrix4 current_homogeneus_matrix = Matrix4::Identity ();
+  Matrix4 stage_homogeneus_matrix = Matrix4::Identity ();
 
-  Eigen::Matrix4f current_homogeneus_matrix;
+  pcl::Correspondences& iteration_correspondences = workspace_.correspondences;
 
-  pcl::Correspondences iteration_correspondences;
+  int point_index;
+  float point_distance;
 
+  Scalar residual_sum, residual;
 
-  pcl::registration::DefaultConvergenceCriteria < float > convergence(j, current_homogeneus_matrix,iteration_correspondences);
+  rigid_monitor_.reset (number_of_iterations);
 
   for (j = 0; j < number_of_iterations; ++j)
   {
 
+    ProfileScope profile_scope ("rigid_iteration", j);
+
     iteration_correspondences.clear ();
 
+    ++correspondence_passes_;
+
+    JJ.setZero ();
+    right_side.setZero ();
+    residual_sum = 0;
+
     k = 0;
 
-    for (i = 0; i < current_iteration_source_points_ptr->size (); ++i)
+    for (i = 0; i < iteration_source_point_normal_cloud_ptr_->size (); ++i)
     {
       /* The following part will establish the correspondences between the points of the model and the points of the target
        * by looking for the closest point in the kdtree of the target and analyzing the difference between their normals */
 
-      pcl::PointXYZRGBNormal search_point;
-
-
-      search_point = current_iteration_source_points_ptr->at (i);
-
-      std::vector < int > point_index (1);
-      std::vector < float > point_distance (1);
+      const pcl::PointNormal& search_point = iteration_source_point_normal_cloud_ptr_->points[i];
 
-
-      kdtree_.nearestKSearch (search_point,1,point_index,point_distance);
+      if ( !target_tree_.nearest (search_point,point_index,point_distance) )
+      {
+        continue;
+      }
 
 
-      Eigen::Vector3d cross_product, normal,eigen_point;
-      Eigen::Vector3d source_normal;
+      Vector3 cross_product, normal,eigen_point;
+      Vector3 source_normal;
 
-      double dot_product;
+      Scalar dot_product;
 
-      source_normal = search_point.getNormalVector3fMap ().cast<double> ();
+      source_normal = search_point.getNormalVector3fMap ().template cast<Scalar> ();
 
 
-      normal[0] = target_point_normal_cloud_ptr_->points[point_index[0]].normal_x;
-      normal[1] = target_point_normal_cloud_ptr_->points[point_index[0]].normal_y;
-      normal[2] = target_point_normal_cloud_ptr_->points[point_index[0]].normal_z;
+      normal[0] = target_point_normal_cloud_ptr_->points[point_index].normal_x;
+      normal[1] = target_point_normal_cloud_ptr_->points[point_index].normal_y;
+      normal[2] = target_point_normal_cloud_ptr_->points[point_index].normal_z;
 
 
       normal.normalize ();
@@ -496,38 +407,38 @@ Registration::calculateRigidRegistration (int number_of_iterations, double angle
       dot_product = source_normal.dot (normal);
 
 
-      if ( point_distance[0] < distance_limit && std::acos (dot_product) < angle_limit)
+      if ( point_distance < distance_limit && std::acos (dot_product) < angle_limit)
       {
 
-        /* If the correspondence is valid we initialize the Jacobian matrix so that we can determine the rotation angles for each axis and the translation in a point-to-plane fashion
+        /* If the correspondence is valid we add its row of the Jacobian matrix to the normal equations so that we can determine the rotation angles for each axis and the translation in a point-to-plane fashion
          * Since this is point to plane we need to minimize the sum of: ( R * p_i + t - q_i ) * normal_i
          * Note that we assume the rotation angles are small, therefore the equation becomes
          *                                                                             (angle_x)
          * normal_i * ( p_i -q_i ) + normal_i * translation + ( p_(i) X normal_(i) ) * (angle_y)
          *                                                                             (angle_z)
          * For more information consult: http://www.cs.princeton.edu/~smr/papers/icpstability.pdf
+         * The rows are never stored, J^T * J and J^T * y are accumulated directly
          */
 
-        Eigen::Vector3d aux_vector;
+        Vector3 aux_vector;
 
-        aux_vector = (current_iteration_source_points_ptr->at (i).getVector3fMap ()).cast<double> ();
+        aux_vector = eigen_source_points_.template segment<3> (i * 3);
 
         cross_product = aux_vector.cross (normal);
 
-        eigen_point = (target_point_normal_cloud_ptr_->at (point_index[0]).getVector3fMap ().cast<double> ()) - (search_point.getVector3fMap ().cast<double> ());
+        eigen_point = (target_point_normal_cloud_ptr_->at (point_index).getVector3fMap ().template cast<Scalar> ()) - aux_vector;
 
-        pcl::Correspondence correspondence (i,point_index[0],point_distance[0]);
+        pcl::Correspondence correspondence (i,point_index,point_distance);
 
         iteration_correspondences.push_back (correspondence);
 
-        y[k] = eigen_point.dot (normal);
+        jacobian_row << cross_product, normal;
+
+        residual = eigen_point.dot (normal);
 
-        J (k,0) = cross_product[0];
-        J (k,1) = cross_product[1];
-        J (k,2) = cross_product[2];
-        J (k,3) = normal[0];
-        J (k,4) = normal[1];
-        J (k,5) = normal[2];
+        JJ.noalias () += jacobian_row * jacobian_row.transpose ();
+        right_side += jacobian_row * residual;
+        residual_sum += residual * residual;
 
         ++k;
       }
@@ -536,53 +447,31 @@ Registration::calculateRigidRegistration (int number_of_iterations, double angle
     }
 
 
+    /* The snapshot is drawn by the viewer thread, the registration does not wait for it unless the debug mode is on */
+
     if (visualize)
     {
-      pcl::visualization::PointCloudColorHandlerRGBField<pcl::PointXYZRGBNormal> rgb_cloud_target (target_point_normal_cloud_ptr_);
-      pcl::visualization::PointCloudColorHandlerRGBField<pcl::PointXYZRGBNormal> rgb_cloud_current_source (current_iteration_source_points_ptr);
-
-
-      visualizer_ptr_->addPointCloud < pcl::PointXYZRGBNormal > (current_iteration_source_points_ptr, rgb_cloud_current_source, "source");
-      //visualizer_ptr_->addPolygonMesh < pcl::PointXYZRGBNormal > (current_iteration_source_points_ptr,debug_model_mesh_);
-      visualizer_ptr_->addPointCloud < pcl::PointXYZRGBNormal > (target_point_normal_cloud_ptr_, rgb_cloud_target, "scan");
-      visualizer_ptr_->addCorrespondences <pcl::PointXYZRGBNormal> (current_iteration_source_points_ptr, target_point_normal_cloud_ptr_, iteration_correspondences);
-
-      if(debug_mode_on_)
-      {
-        visualizer_ptr_->spin ();
-      }
-
-      else
-      {
-        visualizer_ptr_->spinOnce (500);
-      }
-
-      visualizer_ptr_->removeAllShapes ();
-      visualizer_ptr_->removeAllPointClouds ();
-      visualizer_ptr_->removeCorrespondences ();
-
+      visualizer_ptr_->publish (iteration_source_point_normal_cloud_ptr_, target_point_normal_cloud_ptr_, &iteration_correspondences);
     }
 
-    /* The following part calculates the solution of the liniearized system */
+    /* The correspondence search is fused with the accumulation of the system, so it is timed as part of the iteration */
 
-    Eigen::MatrixXd J_transpose,JJ, J_filtered (k,6);
+    profile_scope.setCorrespondences (k, iteration_source_point_normal_cloud_ptr_->size () - k);
+    profile_scope.setResidual (k > 0 ? residual_sum / k : 0.0);
 
-    Eigen::VectorXd solutions, y_filtered;
+    /* With less than 6 correspondences the system is not determined, the stage is given up and its remaining iterations are not counted as saved */
 
-    J_filtered = J.block (0,0,k,6);
-
-    y_filtered = y.block (0,0,k,1);
-
-
-
-    J_transpose = J_filtered.transpose ();
-    JJ = J_transpose * J_filtered;
+    if (k < 6)
+    {
+      PCL_WARN ("Rigid stage aborted after %d iterations, only %d correspondences\n", j, k);
+      break;
+    }
 
-    Eigen::MatrixXd right_side = J_transpose * y_filtered;
+    /* The following part calculates the solution of the liniearized system, the fixed-size solver does not touch the heap */
 
-    solutions = JJ.colPivHouseholderQr ().solve (right_side);
+    solutions = workspace_.rigid_solver.compute (JJ).solve (right_side);
 
-    current_iteration_rotation = Eigen::AngleAxisd (solutions[0],Eigen::Vector3d::UnitX ()) * Eigen::AngleAxisd (solutions[1],Eigen::Vector3d::UnitY ()) * Eigen::AngleAxisd (solutions[2],Eigen::Vector3d::UnitZ ()) ;
+    current_iteration_rotation = Eigen::AngleAxis<Scalar> (solutions[0],Vector3::UnitX ()) * Eigen::AngleAxis<Scalar> (solutions[1],Vector3::UnitY ()) * Eigen::AngleAxis<Scalar> (solutions[2],Vector3::UnitZ ()) ;
 
 
     for (i = 0; i < 3; ++i)
@@ -591,18 +480,18 @@ Registration::calculateRigidRegistration (int number_of_iterations, double angle
     }
 
 
-    current_homogeneus_matrix.block (0, 0, 3, 3) = current_iteration_rotation.cast < float > ();
-    current_homogeneus_matrix.block (0, 3, 3, 1) = current_iteration_translation.cast < float > ();
+    current_homogeneus_matrix.block (0, 0, 3, 3) = current_iteration_rotation;
+    current_homogeneus_matrix.block (0, 3, 3, 1) = current_iteration_translation;
     current_homogeneus_matrix.row (3) << 0, 0, 0, 1;
 
     /* The following commented code is used to compare the accuracy of the Rigid Registration method implemented in this project with the pcl::method */
 
     /*
-    pcl::registration::TransformationEstimationSVD < pcl::PointXYZRGBNormal, pcl::PointXYZRGBNormal, float > estimator;
+    pcl::registration::TransformationEstimationSVD < pcl::PointNormal, pcl::PointNormal, float > estimator;
 
     Eigen::Matrix4f estimation_matrix;
 
-    estimator.estimateRigidTransformation(*current_iteration_source_points_ptr, *target_point_normal_cloud_ptr_,iteration_correspondences,estimation_matrix);
+    estimator.estimateRigidTransformation(*iteration_source_point_normal_cloud_ptr_, *target_point_normal_cloud_ptr_,iteration_correspondences,estimation_matrix);
 
     std::ofstream ofs;
 
@@ -628,16 +517,13 @@ Registration::calculateRigidRegistration (int number_of_iterations, double angle
     ofs << "\n\n\n";
     */
 
-    pcl::PointCloud<pcl::PointXYZRGBNormal> result;
-
-    pcl::transformPointCloudWithNormals (*current_iteration_source_points_ptr,result,current_homogeneus_matrix);
+    applyRigidTransformToModel (current_homogeneus_matrix);
 
-    pcl::copyPointCloud (result,*current_iteration_source_points_ptr);
+    stage_homogeneus_matrix = current_homogeneus_matrix * stage_homogeneus_matrix;
 
-    /* Check if convergence was achieved by using the DefaultConvergence class */
+    /* Check if the pose has settled or if the residual stopped decreasing */
 
-
-    if( convergence.hasConverged () )
+    if ( rigid_monitor_.update (Eigen::AngleAxis<Scalar> (current_iteration_rotation).angle (), current_iteration_translation.norm (), 0.0, residual_sum / k) )
     {
       break;
     }
@@ -645,278 +531,748 @@ Registration::calculateRigidRegistration (int number_of_iterations, double angle
 
   }
 
-  pcl::copyPointCloud (*current_iteration_source_points_ptr,*iteration_source_point_normal_cloud_ptr_);
-  convertPointCloudToEigen ();
+  if ( rigid_monitor_.hasConverged () )
+  {
+    rigid_iterations_saved_ += rigid_monitor_.getIterationsSaved ();
+  }
+
+  /* The change of the whole stage is used by the outer loop of calculateAlternativeRegistrations() */
+
+  last_rotation_change_ = Eigen::AngleAxis<Scalar> (Matrix3 (stage_homogeneus_matrix.block (0, 0, 3, 3))).angle ();
+  last_translation_change_ = stage_homogeneus_matrix.block (0, 3, 3, 1).norm ();
 
 }
 
 
-void
-Registration::calculateNonRigidRegistration (int number_eigenvectors, double reg_weight, double angle_limit, double distance_limit, bool visualize)
+template <typename PolicyT> void
+Registration<PolicyT>::calculateNonRigidRegistration (int number_eigenvectors, double reg_weight, double angle_limit, double distance_limit, bool visualize)
 {
 
-  int i,j;
+  int i;
 
-  pcl::Correspondences correspondences;
+  const MatrixX& eigenvectors_matrix = model_ptr_->getEigenVectors ();
+  const VectorX& eigenvalues_vector = model_ptr_->getEigenValues ();
 
-  correspondences = filterNonRigidCorrespondences (angle_limit,distance_limit);
+  ProfileScope profile_scope ("non_rigid_iteration");
 
+  workspace_.reserve (iteration_source_point_normal_cloud_ptr_->points.size (), number_eigenvectors);
 
-  Eigen::MatrixXd J_transpose,JJ_total, J_point_to_plane (correspondences.size (), number_eigenvectors), Reg_diagonal_matrix;
-  Eigen::VectorXd d,Jy,y (correspondences.size ());
+  pcl::Correspondences& correspondences = workspace_.correspondences;
 
-  Reg_diagonal_matrix = Eigen::MatrixXd::Identity (number_eigenvectors,number_eigenvectors);
+  filterNonRigidCorrespondences (angle_limit,distance_limit,correspondences);
 
-  for (i = 0; i < Reg_diagonal_matrix.rows (); ++i)
-  {
-    Reg_diagonal_matrix (i,i) = 1.0 / eigenvalues_vector_[i];
-  }
+
+  Eigen::Map < MatrixX, Eigen::Aligned > JJ_total = workspace_.getNonRigidSystem (number_eigenvectors);
+  Eigen::Map < VectorX, Eigen::Aligned > Jy = workspace_.getNonRigidRightSide (number_eigenvectors);
+  Eigen::Map < VectorX, Eigen::Aligned > J_row = workspace_.getJacobianRow (number_eigenvectors);
+  Eigen::Map < VectorX, Eigen::Aligned > d = workspace_.getCoefficients (number_eigenvectors);
+
+  JJ_total.setZero ();
+  Jy.setZero ();
+
+  Scalar residual, residual_sum = 0;
 
   /* In the following for-loop the equations for the Non Rigid Registration are calculated
    * The sum to be minimized is: normal_i * (p_i - q_i + d_0 * eigenvector_0 + d_1 * eigenvector_1 + d_1 * eigenvector_1 + ... )
    * The "d" coefficients need to be determined
    *
-   *
+   * Each row of the Jacobian is added to J^T * J (lower triangle only) and J^T * y as soon as it is computed, so the N x K matrix is never stored
    */
 
 
   for ( i = 0; i < correspondences.size (); ++i)
   {
 
-    Eigen::Vector3d normal,source_point;
+    Vector3 normal,source_point;
 
 
     normal[0] = target_point_normal_cloud_ptr_->at (correspondences[i].index_match).normal_x;
     normal[1] = target_point_normal_cloud_ptr_->at (correspondences[i].index_match).normal_y;
     normal[2] = target_point_normal_cloud_ptr_->at (correspondences[i].index_match).normal_z;
 
-    source_point = iteration_source_point_normal_cloud_ptr_->at (correspondences[i].index_query).getVector3fMap ().cast<double> ();
-
-    for ( j = 0; j < number_eigenvectors; ++j)
-    {
+    source_point = eigen_source_points_.template segment<3> (correspondences[i].index_query * 3);
 
-      Eigen::Vector3d vector = eigenvectors_matrix_.block (correspondences[i].index_query * 3,j,3,1).cast<double> ();
+    J_row.noalias () = eigenvectors_matrix.block (correspondences[i].index_query * 3,0,3,number_eigenvectors).transpose () * normal;
 
-      J_point_to_plane(i,j) = (vector.dot (normal));
+    residual = (target_point_normal_cloud_ptr_->at (correspondences[i].index_match).getVector3fMap ().template cast<Scalar> () - source_point).dot(normal);
 
-    }
+    JJ_total.template selfadjointView<Eigen::Lower> ().rankUpdate (J_row);
 
-    y (i) += ((target_point_normal_cloud_ptr_->at (correspondences[i].index_match).getVector3fMap ().cast<double> () - source_point).dot(normal));
+    Jy += J_row * residual;
+    residual_sum += residual * residual;
 
   }
 
-
-
-  J_transpose = J_point_to_plane.transpose ();
-
   /* This is where the Regularizing Matrix is taken into account */
 
-  JJ_total = (J_transpose * J_point_to_plane) + (Reg_diagonal_matrix * reg_weight);
+  for (i = 0; i < number_eigenvectors; ++i)
+  {
+    JJ_total (i,i) += static_cast<Scalar> (reg_weight) / eigenvalues_vector[i];
+  }
 
+  d = workspace_.non_rigid_solver.compute (JJ_total).solve (Jy);
 
-  Jy = J_transpose * y;
+  eigen_source_points_.noalias () += eigenvectors_matrix.block (0,0,eigenvectors_matrix.rows (),number_eigenvectors) * d;
+  coefficients_.head (number_eigenvectors) += d;
 
-  d = JJ_total.colPivHouseholderQr ().solve (Jy);
+  last_coefficient_change_ = calculateCoefficientChange (d);
+  last_residual_ = correspondences.empty () ? 0.0 : residual_sum / correspondences.size ();
 
-  eigen_source_points_ += eigenvectors_matrix_.block (0,0,eigenvectors_matrix_.rows (),number_eigenvectors) * d;
+  profile_scope.setCorrespondences (correspondences.size (), iteration_source_point_normal_cloud_ptr_->size () - correspondences.size ());
+  profile_scope.setResidual (last_residual_);
 
   convertEigenToPointCLoud ();
 
   if (visualize)
   {
-    pcl::visualization::PointCloudColorHandlerRGBField<pcl::PointXYZRGBNormal> rgb_cloud_current_source (iteration_source_point_normal_cloud_ptr_);
+    visualizer_ptr_->publish (iteration_source_point_normal_cloud_ptr_, target_point_normal_cloud_ptr_);
+  }
 
 
-    visualizer_ptr_->addPointCloud < pcl::PointXYZRGBNormal > (iteration_source_point_normal_cloud_ptr_, rgb_cloud_current_source, "model");
+}
 
+template <typename PolicyT> void
+Registration<PolicyT>::calculateJointRegistration (int number_eigenvectors, double reg_weight, int number_of_iterations, double angle_limit, double distance_limit, bool visualize)
+{
 
-    if (debug_mode_on_)
-    {
-      visualizer_ptr_->spin ();
-    }
+  int i,j;
 
-    else
-    {
-      visualizer_ptr_->spinOnce (500);
-    }
+  const MatrixX& eigenvectors_matrix = model_ptr_->getEigenVectors ();
+  const VectorX& eigenvalues_vector = model_ptr_->getEigenValues ();
 
+  workspace_.reserve (iteration_source_point_normal_cloud_ptr_->points.size (), number_eigenvectors);
 
+  if (visualize && !visualizer_ptr_)
+  {
+    visualizer_ptr_.reset (new AsyncVisualizer ("3D Visualizer"));
+    visualizer_ptr_->setStepMode (debug_mode_on_);
   }
 
+  pcl::Correspondences& correspondences = workspace_.correspondences;
 
-}
+  Eigen::Map < MatrixX, Eigen::Aligned > JJ_total = workspace_.getJointSystem (number_eigenvectors);
+  Eigen::Map < VectorX, Eigen::Aligned > Jy = workspace_.getJointRightSide (number_eigenvectors);
+  Eigen::Map < VectorX, Eigen::Aligned > J_row = workspace_.getJointJacobianRow (number_eigenvectors);
+  Eigen::Map < VectorX, Eigen::Aligned > solutions = workspace_.getJointSolution (number_eigenvectors);
 
-void
-Registration::calculateAlternativeRegistrations (int number_eigenvectors, double reg_weight, int number_of_total_iterations, int number_of_rigid_iterations, double angle_limit, double distance_limit, bool visualize)
-{
-  int i;
+  Matrix4 current_homogeneus_matrix = Matrix4::Identity ();
 
-  if (visualize)
-  {
-    visualizer_ptr_.reset (new pcl::visualization::PCLVisualizer ("3D Visualizer"));
-    visualizer_ptr_->setBackgroundColor (1, 1, 1);
-    visualizer_ptr_->initCameraParameters ();
-  }
+  Scalar residual, residual_sum;
 
-  for ( i = 0; i < number_of_total_iterations; ++i)
-  {
+  outer_monitor_.reset (number_of_iterations);
 
-    calculateRigidRegistration (number_of_rigid_iterations,angle_limit,distance_limit,visualize);
+  for (j = 0; j < number_of_iterations; ++j)
+  {
 
-    calculateNonRigidRegistration (number_eigenvectors,reg_weight,angle_limit,distance_limit,visualize);
+    ProfileScope profile_scope ("joint_iteration", j);
 
-  }
-}
+    /* One set of correspondences is used for both the pose and the shape */
 
-void
-Registration::calculateKinfuTrackerRegistrations (int device, int number_eigenvectors, double reg_weight, int number_of_rigid_iterations, double angle_limit, double distance_limit)
-{
+    filterNonRigidCorrespondences (angle_limit,distance_limit,correspondences);
 
-  visualizer_ptr_.reset (new pcl::visualization::PCLVisualizer ("3D Visualizer"));
-  visualizer_ptr_->setBackgroundColor (1, 1, 1);
-  visualizer_ptr_->initCameraParameters ();
-  visualizer_ptr_->registerKeyboardCallback <Registration> (&Registration::keyboardCallback, *this,(void*) this);
+    profile_scope.setCorrespondences (correspondences.size (), iteration_source_point_normal_cloud_ptr_->size () - correspondences.size ());
 
-  tracker_ptr_.reset (new Tracker (device));
-  tracker_ptr_->startUp ();
+    /* With less than 6 correspondences the pose is not determined */
 
-  pcl::PointCloud<pcl::PointXYZ>::Ptr target_point_cloud_ptr;
-  target_point_cloud_ptr = tracker_ptr_->getKinfuCloud ();
+    if (correspondences.size () < 6)
+    {
+      PCL_WARN ("Joint fit aborted after %d iterations, only %d correspondences\n", j, static_cast<int> (correspondences.size ()));
+      break;
+    }
 
-  PCL_INFO("Press \' p \' to scan the first part of the cloud\n");
+    JJ_total.setZero ();
+    Jy.setZero ();
+    residual_sum = 0;
 
-  while ( continue_tracking_ )
-  {
+    /* The sum to be minimized combines the two linearized problems:
+     * normal_i * ( p_i - q_i ) + normal_i * translation + ( p_(i) X normal_(i) ) * angles + normal_i * ( d_0 * eigenvector_0 + d_1 * eigenvector_1 + ... )
+     * so each row of the Jacobian holds the 6 pose derivatives followed by the K shape derivatives
+     */
 
-    visualizer_ptr_->spinOnce (100);
-    if ( tracker_ptr_->execute () )
+    for (i = 0; i < correspondences.size (); ++i)
     {
+      Vector3 normal,source_point;
 
-      if ( !first_face_found_ && !tracker_ptr_->isFaceFound () )
-      {
-        PCL_ERROR ("No faces were found\n");
-        exit(1);
-      }
+      normal = target_point_normal_cloud_ptr_->at (correspondences[i].index_match).getNormalVector3fMap ().template cast<Scalar> ();
+      normal.normalize ();
 
-      if( !first_face_found_ )
-      {
+      source_point = eigen_source_points_.template segment<3> (correspondences[i].index_query * 3);
 
+      J_row.template head<3> () = source_point.cross (normal);
+      J_row.template segment<3> (3) = normal;
+      J_row.tail (number_eigenvectors).noalias () = eigenvectors_matrix.block (correspondences[i].index_query * 3,0,3,number_eigenvectors).transpose () * normal;
 
-        face_center_point_ = tracker_ptr_->getFaceCenter ();
-        calculateModelCenterPoint ();
-        alignModel ();
+      residual = (target_point_normal_cloud_ptr_->at (correspondences[i].index_match).getVector3fMap ().template cast<Scalar> () - source_point).dot(normal);
+
+      JJ_total.template selfadjointView<Eigen::Lower> ().rankUpdate (J_row);
+
+      Jy += J_row * residual;
+      residual_sum += residual * residual;
+    }
+
+    /* Only the shape coefficients are regularized, the pose is left free */
+
+    for (i = 0; i < number_eigenvectors; ++i)
+    {
+      JJ_total (i + 6,i + 6) += static_cast<Scalar> (reg_weight) / eigenvalues_vector[i];
+    }
+
+    solutions = workspace_.joint_solver.compute (JJ_total).solve (Jy);
+
+    /* The shape is updated first, then the whole model is moved with the pose update */
+
+    eigen_source_points_.noalias () += eigenvectors_matrix.block (0,0,eigenvectors_matrix.rows (),number_eigenvectors) * solutions.tail (number_eigenvectors);
+    coefficients_.head (number_eigenvectors) += solutions.tail (number_eigenvectors);
+
+    convertEigenToPointCLoud ();
+
+    current_homogeneus_matrix.block (0, 0, 3, 3) = (Eigen::AngleAxis<Scalar> (solutions[0],Vector3::UnitX ()) * Eigen::AngleAxis<Scalar> (solutions[1],Vector3::UnitY ()) * Eigen::AngleAxis<Scalar> (solutions[2],Vector3::UnitZ ())).toRotationMatrix ();
+    current_homogeneus_matrix.block (0, 3, 3, 1) = solutions.template segment<3> (3);
+
+    applyRigidTransformToModel (current_homogeneus_matrix);
+
+    if (visualize)
+    {
+      visualizer_ptr_->publish (iteration_source_point_normal_cloud_ptr_, target_point_normal_cloud_ptr_, &correspondences);
+    }
+
+    last_residual_ = residual_sum / correspondences.size ();
+
+    profile_scope.setResidual (last_residual_);
+
+    if ( outer_monitor_.update (Eigen::AngleAxis<Scalar> (Matrix3 (current_homogeneus_matrix.block (0, 0, 3, 3))).angle (), solutions.template segment<3> (3).norm (),
+                                calculateCoefficientChange (solutions.tail (number_eigenvectors)), residual_sum / correspondences.size ()) )
+    {
+      break;
+    }
+
+  }
+
+  PCL_INFO ("Joint fit %s after %d iterations, %d iterations saved\n", outer_monitor_.hasConverged () ? "converged" : "stopped", outer_monitor_.getIterations (),
+            outer_monitor_.hasConverged () ? outer_monitor_.getIterationsSaved () : 0);
+
+}
+
+template <typename PolicyT> void
+Registration<PolicyT>::calculateAlternativeRegistrations (int number_eigenvectors, double reg_weight, int number_of_total_iterations, int number_of_rigid_iterations, double angle_limit, double distance_limit, bool visualize)
+{
+  int i;
+
+  unsigned long allocations;
+
+  if (visualize && !visualizer_ptr_)
+  {
+    visualizer_ptr_.reset (new AsyncVisualizer ("3D Visualizer"));
+    visualizer_ptr_->setStepMode (debug_mode_on_);
+  }
+
+  /* All the buffers needed by the iterations are allocated here, once for the whole fit */
+
+  workspace_.reserve (iteration_source_point_normal_cloud_ptr_->points.size (), number_eigenvectors);
+
+  outer_monitor_.reset (number_of_total_iterations);
+  rigid_iterations_saved_ = 0;
+
+  for ( i = 0; i < number_of_total_iterations; ++i)
+  {
+
+    ProfileScope profile_scope ("alternating_round", i);
+
+    allocations = AllocationCounter::getThreadCount ();
+
+    calculateRigidRegistration (number_of_rigid_iterations,angle_limit,distance_limit,visualize);
+
+    calculateNonRigidRegistration (number_eigenvectors,reg_weight,angle_limit,distance_limit,visualize);
+
+    if (AllocationCounter::isEnabled ())
+    {
+      PCL_INFO ("Heap allocations in round %d: %lu\n", i, AllocationCounter::getThreadCount () - allocations);
+    }
+
+    profile_scope.setResidual (last_residual_);
+
+    /* The fit is stopped once a whole round leaves the pose and the shape unchanged or stops reducing the residual */
+
+    if ( outer_monitor_.update (last_rotation_change_, last_translation_change_, last_coefficient_change_, last_residual_) )
+    {
+      break;
+    }
+
+  }
+
+  PCL_INFO ("Fit %s after %d of %d rounds, %d rounds and %d rigid iterations saved\n", outer_monitor_.hasConverged () ? "converged" : "stopped",
+            outer_monitor_.getIterations (), number_of_total_iterations, outer_monitor_.getIterationsSaved (), rigid_iterations_saved_);
+}
+
+template <typename PolicyT> void
+Registration<PolicyT>::calculateKinfuTrackerRegistrations (FrameSource::Ptr source, FusionBackend::Ptr fusion, int number_eigenvectors, double reg_weight, int number_of_rigid_iterations, double angle_limit, double distance_limit,
+                                                           bool visualize)
+{
+
+  bool fit_running = false;
+
+  int number_scans = 0, number_fits = 0;
+
+  pcl::console::TicToc run_timer;
+
+  if (!visualize && !auto_scan_)
+  {
+    PCL_ERROR ("Without the window the scans need a scan policy\n");
+    exit (1);
+  }
+
+  /* The window is handled by the viewer thread, the keys pressed in it are forwarded to keyboardCallback () */
+
+  if (visualize)
+  {
+    visualizer_ptr_.reset (new AsyncVisualizer ("3D Visualizer"));
+    visualizer_ptr_->setStepMode (debug_mode_on_);
+    visualizer_ptr_->setKeyboardCallback (boost::bind (&Registration::keyboardCallback, this, _1, (void*) this));
+  }
+
+  tracker_ptr_.reset (new Tracker (source, face_locator_ptr_, fusion));
+  tracker_ptr_->setLateThreshold (late_threshold_);
+
+  if (auto_scan_)
+  {
+    tracker_ptr_->setScanPolicy (scan_translation_threshold_, scan_rotation_threshold_, scan_surface_growth_);
+  }
+
+  tracker_ptr_->startUp ();
+  run_timer.tic ();
+
+  pcl::PointCloud<pcl::PointXYZ>::Ptr target_point_cloud_ptr;
+  target_point_cloud_ptr = tracker_ptr_->getKinfuCloud ();
+
+  pcl::PointCloud<pcl::PointNormal>::Ptr pending_target_ptr;
+
+  pcl::search::KdTree<pcl::PointNormal>::Ptr pending_kdtree_ptr;
+
+  if (auto_scan_)
+  {
+    PCL_INFO("Scanning once the face is found\n");
+  }
+
+  else
+  {
+    PCL_INFO("Press \' p \' to scan the first part of the cloud\n");
+  }
+
+  while ( continue_tracking_ && !tracker_ptr_->isFinished () )
+  {
+    handlePressedKeys (fit_running);
+
+    if (!continue_tracking_)
+    {
+      break;
+    }
+
+    if ( tracker_ptr_->execute () )
+    {
+
+      if ( !first_face_found_ && !tracker_ptr_->isFaceFound () )
+      {
+        PCL_ERROR ("No faces were found\n");
+        exit(1);
+      }
+
+      if( !first_face_found_ )
+      {
+
+
+        face_center_point_ = tracker_ptr_->getFaceCenter ();
+        calculateModelCenterPoint ();
+        alignModel ();
         first_face_found_ = true;
       }
 
-      setKdTree (target_point_cloud_ptr);
+      /* Every scan is a new target with its own kdtree, a target in use by the fit is never modified */
+
+      pending_target_ptr.reset (new pcl::PointCloud<pcl::PointNormal>);
+      pending_kdtree_ptr.reset (new pcl::search::KdTree<pcl::PointNormal>);
+
+      pcl::copyPointCloud (*target_point_cloud_ptr, *pending_target_ptr);
+
+      prepareTarget (pending_target_ptr, pending_kdtree_ptr);
 
-      visualizer_ptr_->removeAllPointClouds();
-      pcl::visualization::PointCloudColorHandlerRGBField<pcl::PointXYZRGBNormal> rgb_target (target_point_normal_cloud_ptr_);
-      visualizer_ptr_->addPointCloud < pcl::PointXYZRGBNormal > (target_point_normal_cloud_ptr_, rgb_target, "target");
+      ++number_scans;
 
-      PCL_INFO("Press either \' p \' to scan the next part, \' t \' to start the transormation' or \' x \' to exit program\n");
+      if (visualize)
+      {
+        visualizer_ptr_->publish (AsyncVisualizer::Cloud::ConstPtr (), pending_target_ptr);
+      }
+
+      if (auto_scan_)
+      {
+        PCL_INFO ("Scan %d: %d points\n", number_scans, static_cast<int> (pending_target_ptr->size ()));
+      }
 
+      else if (fit_running)
+      {
+        PCL_INFO ("The scan becomes the target when the running fit is done\n");
+      }
+
+      else
+      {
+        PCL_INFO("Press either \' p \' to scan the next part, \' t \' to start the transormation' or \' x \' to exit program\n");
+      }
+
+    }
+
+    /* The fit runs on its own thread, meanwhile the frames are fused and new scans are taken */
+
+    if ( fit_running && fit_thread_.timed_join (boost::posix_time::seconds (0)) )
+    {
+      fit_running = false;
+
+      if (!auto_scan_)
+      {
+        PCL_INFO("Press either \' p \' to scan the next part, \' t \' to start the transormation' or \' x \' to exit program\n");
+      }
+    }
+
+    /* Scans taken while a fit runs replace each other, so the fits never fall behind by more than one scan */
+
+    if (!fit_running && pending_target_ptr)
+    {
+      target_point_normal_cloud_ptr_ = pending_target_ptr;
+      kdtree_ptr_ = pending_kdtree_ptr;
+      target_tree_.setInputCloud (*target_point_normal_cloud_ptr_);
+
+      pending_target_ptr.reset ();
+      pending_kdtree_ptr.reset ();
+
+      if (auto_scan_)
+      {
+        calculate_ = true;
+      }
     }
 
     if(calculate_)
     {
       calculate_ = false;
 
-      calculateRigidRegistration (number_of_rigid_iterations,angle_limit,distance_limit,true);
+      if (fit_running)
+      {
+        PCL_WARN ("The previous fit is still running\n");
+      }
+
+      else if (!first_face_found_)
+      {
+        PCL_WARN ("Press \' p \' to scan the face before the fit\n");
+      }
+
+      /* With the scan policy only the first scan gets the whole fit, the following ones refine it */
 
-      calculateNonRigidRegistration (number_eigenvectors,reg_weight,angle_limit,distance_limit,true);
+      else if (auto_scan_ && number_fits > 0)
+      {
+        fit_thread_ = boost::thread (&Registration::calculateKinfuRefinement, this, number_eigenvectors, reg_weight, angle_limit, distance_limit, visualize);
+        fit_running = true;
+        ++number_fits;
+      }
 
-      PCL_INFO("Press either \' p \' to scan the next part, \' t \' to start the transormation' or \' x \' to exit program\n");
+      else
+      {
+        fit_thread_ = boost::thread (&Registration::calculateKinfuFit, this, number_eigenvectors, reg_weight, number_of_rigid_iterations, angle_limit, distance_limit, visualize);
+        fit_running = true;
+        ++number_fits;
+      }
 
     }
   }
 
+  if (fit_running)
+  {
+    PCL_INFO ("Waiting for the fit to finish\n");
+    fit_thread_.join ();
+  }
+
+  /* A recording may end while a scan waits for the fit, it still gets its refinement */
+
+  if (auto_scan_ && pending_target_ptr)
+  {
+    target_point_normal_cloud_ptr_ = pending_target_ptr;
+    kdtree_ptr_ = pending_kdtree_ptr;
+    target_tree_.setInputCloud (*target_point_normal_cloud_ptr_);
+
+    calculateKinfuRefinement (number_eigenvectors, reg_weight, angle_limit, distance_limit, visualize);
+    ++number_fits;
+  }
+
   tracker_ptr_->close ();
 
+  PCL_INFO ("%d scans and %d fits in %f s\n", number_scans, number_fits, run_timer.toc () / 1000.0);
 
 }
 
+template <typename PolicyT> void
+Registration<PolicyT>::calculateKinfuFit (int number_eigenvectors, double reg_weight, int number_of_rigid_iterations, double angle_limit, double distance_limit, bool visualize)
+{
+  pcl::console::TicToc timer;
+
+  timer.tic ();
 
+  calculateRigidRegistration (number_of_rigid_iterations,angle_limit,distance_limit,visualize);
 
+  calculateNonRigidRegistration (number_eigenvectors,reg_weight,angle_limit,distance_limit,visualize);
 
-void
-Registration::writeDataToPCD (std::string file_path)
+  /* The result is handed to the viewer together with the target it was fitted on */
+
+  if (visualize)
+  {
+    visualizer_ptr_->publish (iteration_source_point_normal_cloud_ptr_, target_point_normal_cloud_ptr_);
+  }
+
+  PCL_INFO ("Fit done in %f ms\n", timer.toc ());
+}
+
+template <typename PolicyT> void
+Registration<PolicyT>::calculateKinfuRefinement (int number_eigenvectors, double reg_weight, double angle_limit, double distance_limit, bool visualize)
+{
+  pcl::console::TicToc timer;
+
+  timer.tic ();
+
+  /* The new scan differs from the previous one only where the camera has seen more of the face, so the pose and the shape are close already */
+
+  calculateJointRegistration (number_eigenvectors, reg_weight, refinement_iterations_, angle_limit, distance_limit, visualize);
+
+  PCL_INFO ("Refinement done in %f ms, residual %e\n", timer.toc (), last_residual_);
+}
+
+template <typename PolicyT> void
+Registration<PolicyT>::setScanPolicy (float translation_threshold, float rotation_threshold, float surface_growth, int refinement_iterations)
+{
+  auto_scan_ = true;
+  scan_translation_threshold_ = translation_threshold;
+  scan_rotation_threshold_ = rotation_threshold;
+  scan_surface_growth_ = surface_growth;
+  refinement_iterations_ = refinement_iterations;
+}
+
+template <typename PolicyT> void
+Registration<PolicyT>::setLateThreshold (double late_threshold)
+{
+  late_threshold_ = late_threshold;
+}
+
+
+
+template <typename PolicyT> void
+Registration<PolicyT>::calculateStreamingRegistrations (FrameSource& source, int number_eigenvectors, double reg_weight, int number_of_initial_iterations, int number_of_frame_iterations,
+                                                        double angle_limit, double distance_limit, double crop_margin, std::string output_path, bool visualize)
+{
+  int i, number_frames = 0;
+
+  bool model_aligned = false;
+
+  double fit_time, total_fit_time = 0.0;
+
+  Frame frame;
+
+  pcl::PointCloud<pcl::PointNormal>::Ptr cropped_cloud_ptr;
+
+  pcl::console::TicToc frame_timer, stream_timer;
+
+  std::ofstream output_file (output_path.c_str ());
+
+  if ( !output_file.is_open () )
+  {
+    PCL_ERROR ("Could not open file %s\n", output_path.c_str ());
+    exit (1);
+  }
+
+  output_file << "# frame timestamp fit_ms residual tx ty tz qx qy qz qw coefficients\n";
+
+  source.start ();
+  stream_timer.tic ();
+
+  while ( !source.isFinished () )
+  {
+
+    if ( !source.grab (frame, 100) )
+    {
+      continue;
+    }
+
+    frame_timer.tic ();
+
+    /* The first frame brings the model onto the face, every following frame starts from where the previous one ended */
+
+    if (!model_aligned)
+    {
+      alignModel ();
+      model_aligned = true;
+    }
+
+    /* Only the surroundings of the model are kept, so the normals and the kdtree are computed on a few thousand points instead of the whole frame */
+
+    cropped_cloud_ptr.reset (new pcl::PointCloud<pcl::PointNormal>);
+    cropTargetAroundModel (*frame.getCloud (), crop_margin, *cropped_cloud_ptr);
+
+    if (cropped_cloud_ptr->size () < 6)
+    {
+      PCL_WARN ("Frame %u: the face is out of sight\n", frame.index);
+      continue;
+    }
+
+    setKdTree (cropped_cloud_ptr);
+
+    calculateJointRegistration (number_eigenvectors, reg_weight, number_frames == 0 ? number_of_initial_iterations : number_of_frame_iterations, angle_limit, distance_limit, visualize);
+
+    fit_time = frame_timer.toc ();
+    total_fit_time += fit_time;
+    ++number_frames;
+
+    Eigen::Quaternion<Scalar> rotation (Matrix3 (pose_.block (0, 0, 3, 3)));
+
+    output_file << frame.index << " " << frame.timestamp << " " << fit_time << " " << last_residual_ << " "
+                << pose_ (0,3) << " " << pose_ (1,3) << " " << pose_ (2,3) << " "
+                << rotation.x () << " " << rotation.y () << " " << rotation.z () << " " << rotation.w ();
+
+    for (i = 0; i < number_eigenvectors; ++i)
+    {
+      output_file << " " << coefficients_[i];
+    }
+
+    output_file << "\n";
+
+  }
+
+  source.stop ();
+
+  if (number_frames > 0)
+  {
+    PCL_INFO ("Tracked %d frames, %f ms of fitting per frame, %f frames per second from capture to fit, %u frames dropped\n", number_frames, total_fit_time / number_frames,
+              number_frames * 1000.0 / stream_timer.toc (), source.getDroppedFrames ());
+  }
+
+}
+
+template <typename PolicyT> void
+Registration<PolicyT>::writeDataToPCD (std::string file_path)
 {
 
   pcl::PCDWriter pcd_writer;
 
-  pcd_writer.writeBinary < pcl::PointXYZRGBNormal > (file_path + ".pcd", *iteration_source_point_normal_cloud_ptr_);
-  pcd_writer.writeBinary < pcl::PointXYZRGBNormal > (file_path + "_target.pcd", *target_point_normal_cloud_ptr_);
+  pcd_writer.writeBinary < pcl::PointNormal > (file_path + ".pcd", *iteration_source_point_normal_cloud_ptr_);
+  pcd_writer.writeBinary < pcl::PointNormal > (file_path + "_target.pcd", *target_point_normal_cloud_ptr_);
 
 }
 
-void
-Registration::setKdTree (pcl::PointCloud<pcl::PointXYZ>::Ptr target_point_cloud_ptr)
+template <typename PolicyT> void
+Registration<PolicyT>::setKdTree (pcl::PointCloud<pcl::PointNormal>::Ptr target_point_normal_cloud_ptr)
 {
 
-  pcl::PointCloud<pcl::Normal>::Ptr target_normal_cloud_ptr (new pcl::PointCloud<pcl::Normal>);
-  pcl::NormalEstimation<pcl::PointXYZ, pcl::Normal> normal_estimator;
-  pcl::search::KdTree<pcl::PointXYZ>::Ptr tree (new pcl::search::KdTree<pcl::PointXYZ>);
+  /* The cloud becomes the target as it is, the previous target is not touched since it may still be shown by the viewer thread */
+
+  target_point_normal_cloud_ptr_ = target_point_normal_cloud_ptr;
+
+  prepareTarget (target_point_normal_cloud_ptr_, kdtree_ptr_);
+
+  target_tree_.setInputCloud (*target_point_normal_cloud_ptr_);
+
+}
+
+template <typename PolicyT> void
+Registration<PolicyT>::prepareTarget (pcl::PointCloud<pcl::PointNormal>::Ptr target_point_normal_cloud_ptr, pcl::search::KdTree<pcl::PointNormal>::Ptr kdtree_ptr)
+{
+
+  ProfileScope profile_scope ("preprocess");
+
+  pcl::NormalEstimation<pcl::PointNormal, pcl::PointNormal> normal_estimator;
+
+  profile_scope.setPoints (target_point_normal_cloud_ptr->size ());
 
+  /* The kdtree only indexes the coordinates, so it stays valid when the normals are written. The correspondences are looked up in target_tree_, which is built when the cloud becomes the target */
 
-  normal_estimator.setInputCloud (target_point_cloud_ptr);
-  tree->setInputCloud (target_point_cloud_ptr);
-  normal_estimator.setSearchMethod (tree);
+  kdtree_ptr->setInputCloud (target_point_normal_cloud_ptr);
+
+  normal_estimator.setInputCloud (target_point_normal_cloud_ptr);
+  normal_estimator.setSearchMethod (kdtree_ptr);
   normal_estimator.setKSearch (10);
-  normal_estimator.compute (*target_normal_cloud_ptr);
 
-  pcl::concatenateFields (*target_point_cloud_ptr, *target_normal_cloud_ptr, *target_point_normal_cloud_ptr_);
+  /* The normals are computed in place, the coordinates of the output are left untouched */
+
+  normal_estimator.compute (*target_point_normal_cloud_ptr);
 
-  kdtree_.setInputCloud (target_point_normal_cloud_ptr_);
+}
 
-  uint32_t rgb;
-  uint8_t value (255);
+template <typename PolicyT> void
+Registration<PolicyT>::cropTargetAroundModel (const pcl::PointCloud<pcl::PointXYZ>& frame_cloud, double crop_margin, pcl::PointCloud<pcl::PointNormal>& cropped_cloud)
+{
+  int i;
 
+  Eigen::Vector3f min_point, max_point;
 
-  rgb = ( (uint32_t)value) << 8;
+  pcl::PointNormal target_point;
 
+  min_point.setConstant (std::numeric_limits<float>::max ());
+  max_point.setConstant (-std::numeric_limits<float>::max ());
 
-  for ( int i = 0; i < target_point_normal_cloud_ptr_->points.size (); ++i)
+  for (i = 0; i < eigen_source_points_.rows (); i = i+3)
   {
-      target_point_normal_cloud_ptr_->points[i].rgb = *reinterpret_cast<float*> (&rgb);
+    min_point = min_point.cwiseMin (eigen_source_points_.template segment<3> (i).template cast<float> ());
+    max_point = max_point.cwiseMax (eigen_source_points_.template segment<3> (i).template cast<float> ());
   }
 
+  min_point.array () -= crop_margin;
+  max_point.array () += crop_margin;
+
+  cropped_cloud.clear ();
+
+  /* The comparisons are false for the NaN points of the organized cloud, so they are dropped too */
+
+  for (i = 0; i < frame_cloud.size (); ++i)
+  {
+    const pcl::PointXYZ& point = frame_cloud.points[i];
+
+    if ( point.x >= min_point[0] && point.x <= max_point[0] && point.y >= min_point[1] && point.y <= max_point[1] && point.z >= min_point[2] && point.z <= max_point[2] )
+    {
+      target_point.getVector3fMap () = point.getVector3fMap ();
+      cropped_cloud.push_back (target_point);
+    }
+  }
 
 }
 
 
-pcl::Correspondences
-Registration::filterNonRigidCorrespondences (double angle_limit, double distance_limit)
+template <typename PolicyT> void
+Registration<PolicyT>::filterNonRigidCorrespondences (double angle_limit, double distance_limit, pcl::Correspondences& correspondences_vector)
 {
   int i;
 
-  pcl::Correspondences correspondences_vector;
+  int point_index;
+  float point_distance;
 
-  for (i = 0; i < iteration_source_point_normal_cloud_ptr_->size (); ++i)
-  {
+  ProfileScope profile_scope ("correspondences");
 
-    pcl::PointXYZRGBNormal search_point;
+  correspondences_vector.clear ();
 
+  ++correspondence_passes_;
 
-    search_point = iteration_source_point_normal_cloud_ptr_->at (i);
+  for (i = 0; i < iteration_source_point_normal_cloud_ptr_->size (); ++i)
+  {
 
-    std::vector < int > point_index (1);
-    std::vector < float > point_distance (1);
+    const pcl::PointNormal& search_point = iteration_source_point_normal_cloud_ptr_->points[i];
 
-    kdtree_.nearestKSearch (search_point,1,point_index,point_distance);
+    if ( !target_tree_.nearest (search_point,point_index,point_distance) )
+    {
+      continue;
+    }
 
 
-    Eigen::Vector3d cross_product, normal,eigen_point;
-    Eigen::Vector3d source_normal;
+    Vector3 normal;
+    Vector3 source_normal;
 
-    double dot_product;
+    Scalar dot_product;
 
-    source_normal = search_point.getNormalVector3fMap ().cast<double> ();
+    source_normal = search_point.getNormalVector3fMap ().template cast<Scalar> ();
 
 
-    normal[0] = target_point_normal_cloud_ptr_->points[point_index[0]].normal_x;
-    normal[1] = target_point_normal_cloud_ptr_->points[point_index[0]].normal_y;
-    normal[2] = target_point_normal_cloud_ptr_->points[point_index[0]].normal_z;
+    normal[0] = target_point_normal_cloud_ptr_->points[point_index].normal_x;
+    normal[1] = target_point_normal_cloud_ptr_->points[point_index].normal_y;
+    normal[2] = target_point_normal_cloud_ptr_->points[point_index].normal_z;
 
 
     normal.normalize ();
@@ -926,39 +1282,123 @@ Registration::filterNonRigidCorrespondences (double angle_limit, double distance
     dot_product = source_normal.dot (normal);
 
 
-    if ( point_distance[0] < distance_limit )
+    if ( point_distance < distance_limit )
     {
 
       if ( std::acos (dot_product) < angle_limit )
       {
-        Eigen::Vector3d aux_vector;
+        pcl::Correspondence correspondence (i,point_index,point_distance);
 
-        aux_vector = (iteration_source_point_normal_cloud_ptr_->at (i).getVector3fMap ()).cast<double> ();
+        correspondences_vector.push_back (correspondence);
 
-        cross_product = aux_vector.cross (normal);
 
-        eigen_point = (target_point_normal_cloud_ptr_->at (point_index[0]).getVector3fMap ().cast<double> ()) - (search_point.getVector3fMap ().cast<double> ());
+      }
+    }
 
-        pcl::Correspondence correspondence (i,point_index[0],point_distance[0]);
 
-        correspondences_vector.push_back (correspondence);
+  }
 
+  profile_scope.setCorrespondences (correspondences_vector.size (), iteration_source_point_normal_cloud_ptr_->size () - correspondences_vector.size ());
 
-      }
-    }
+}
+
+template <typename PolicyT> double
+Registration<PolicyT>::computeResidual (double angle_limit, double distance_limit)
+{
+  int i;
 
+  pcl::Correspondences& correspondences = workspace_.correspondences;
 
+  filterNonRigidCorrespondences (angle_limit,distance_limit,correspondences);
+
+  if (correspondences.empty ())
+  {
+    return (0.0);
+  }
+
+  Scalar sum = 0;
+
+  for (i = 0; i < correspondences.size (); ++i)
+  {
+    Vector3 normal = target_point_normal_cloud_ptr_->at (correspondences[i].index_match).getNormalVector3fMap ().template cast<Scalar> ();
+    Vector3 difference = target_point_normal_cloud_ptr_->at (correspondences[i].index_match).getVector3fMap ().template cast<Scalar> () - eigen_source_points_.template segment<3> (correspondences[i].index_query * 3);
+
+    normal.normalize ();
+
+    sum += difference.dot (normal) * difference.dot (normal);
   }
 
-  return (correspondences_vector);
+  return (std::sqrt (static_cast<double> (sum) / correspondences.size ()));
 }
 
 
-void
-Registration::keyboardCallback (const pcl::visualization::KeyboardEvent &event, void* viewer_void)
+template <typename PolicyT> void
+Registration<PolicyT>::setConvergenceThresholds (double rotation_threshold, double translation_threshold, double coefficient_threshold, double relative_residual_threshold)
 {
+  rigid_monitor_.setThresholds (rotation_threshold, translation_threshold, coefficient_threshold, relative_residual_threshold);
+  outer_monitor_.setThresholds (rotation_threshold, translation_threshold, coefficient_threshold, relative_residual_threshold);
+}
 
-  char c = event.getKeyCode ();
+template <typename PolicyT> template <typename DerivedT> double
+Registration<PolicyT>::calculateCoefficientChange (const Eigen::MatrixBase<DerivedT>& coefficients)
+{
+  int i;
+
+  const VectorX& eigenvalues_vector = model_ptr_->getEigenValues ();
+
+  double change = 0.0;
+
+  /* Each coefficient is measured in standard deviations of its eigenvector, so that the threshold does not depend on the scale of the model */
+
+  for (i = 0; i < coefficients.rows (); ++i)
+  {
+    change += static_cast<double> (coefficients (i) * coefficients (i) / eigenvalues_vector (i));
+  }
+
+  return (std::sqrt (change));
+}
+
+template <typename PolicyT> int
+Registration<PolicyT>::getCorrespondencePasses ()
+{
+  return (correspondence_passes_);
+}
+
+template <typename PolicyT> bool
+Registration<PolicyT>::hasConverged ()
+{
+  return (outer_monitor_.hasConverged ());
+}
+
+template <typename PolicyT> void
+Registration<PolicyT>::keyboardCallback (const pcl::visualization::KeyboardEvent &event, void* viewer_void)
+{
+  /* Called on the viewer thread, the key is only queued so the state of the capture loop is changed by the capture loop itself */
+
+  boost::mutex::scoped_lock lock (key_mutex_);
+
+  pressed_keys_.push_back (event.getKeyCode ());
+}
+
+template <typename PolicyT> void
+Registration<PolicyT>::handlePressedKeys (bool fit_running)
+{
+  std::deque < char > pressed_keys;
+
+  {
+    boost::mutex::scoped_lock lock (key_mutex_);
+    pressed_keys.swap (pressed_keys_);
+  }
+
+  for (size_t i = 0; i < pressed_keys.size (); ++i)
+  {
+    handleKey (pressed_keys[i], fit_running);
+  }
+}
+
+template <typename PolicyT> void
+Registration<PolicyT>::handleKey (char c, bool fit_running)
+{
 
   if (c == 'p')
   {
@@ -976,6 +1416,13 @@ Registration::keyboardCallback (const pcl::visualization::KeyboardEvent &event,
     continue_tracking_ = false;
   }
 
+  /* The latencies and the dropped frames so far, the same report is printed when the tracker is closed */
+
+  if (c == 'l')
+  {
+    PCL_INFO ("%s", tracker_ptr_->getCaptureReport ().c_str ());
+  }
+
   if (c == '1' && debug_mode_on_)
   {
     pcl::io::savePCDFile ("target_cloud_bin_" + boost::lexical_cast<std::string> (index_) + ".pcd", *target_point_normal_cloud_ptr_, true);
@@ -987,7 +1434,14 @@ Registration::keyboardCallback (const pcl::visualization::KeyboardEvent &event,
 
   }
 
-  if (c == '2' && debug_mode_on_)
+  /* The model is written by the fit thread, so it is only saved between the fits */
+
+  if (c == '2' && debug_mode_on_ && fit_running)
+  {
+    PCL_WARN ("The fit is busy, press \' 2 \' again once it is done to save the model\n");
+  }
+
+  else if (c == '2' && debug_mode_on_)
   {
     pcl::io::savePCDFile ("model_cloud_bin_" + boost::lexical_cast<std::string> (index_) + ".pcd", *iteration_source_point_normal_cloud_ptr_, true);
     ++index_;
@@ -995,13 +1449,13 @@ Registration::keyboardCallback (const pcl::visualization::KeyboardEvent &event,
 
   if (c == '3' && debug_mode_on_)
   {
-    visualizer_ptr_->addSphere < pcl::PointXYZ > (face_center_point_,0.025,"sphere");
+    visualizer_ptr_->setMarker (true, face_center_point_);
   }
 
 
   if (c == '4' && debug_mode_on_)
   {
-    visualizer_ptr_->removeShape ("sphere");
+    visualizer_ptr_->setMarker (false, face_center_point_);
   }
 
 
@@ -1009,3 +1463,5 @@ Registration::keyboardCallback (const pcl::visualization::KeyboardEvent &event,
 
 }
 
+template class Registration < SinglePrecision >;
+template class Registration < DoublePrecision >;
@@ -0,0 +1,244 @@
+#include <replay_frame_source.h>
+
+#include <algorithm>
+#include <fstream>
+
+#include <boost/algorithm/string/predicate.hpp>
+
+ReplayFrameSource::ReplayFrameSource (const std::string& directory, double frame_rate, float focal_length)
+{
+  int i;
+
+  focal_length_ = focal_length;
+  real_time_ = false;
+  next_frame_ = 0;
+  running_ = false;
+  delivered_frames_ = 0;
+  dropped_frames_ = 0;
+
+  boost::filesystem::path directory_path (directory);
+
+  if ( !boost::filesystem::is_directory (directory_path) )
+  {
+    PCL_ERROR ("Could not find the recording %s\n", directory.c_str ());
+    exit (1);
+  }
+
+  for (boost::filesystem::directory_iterator it (directory_path); it != boost::filesystem::directory_iterator (); ++it)
+  {
+    std::string extension = it->path ().extension ().string ();
+
+    if ( !boost::filesystem::is_regular_file (it->status ()) || boost::algorithm::ends_with (it->path ().stem ().string (), "_gray") )
+    {
+      continue;
+    }
+
+    if (extension == ".pcd" || extension == ".png")
+    {
+      frame_paths_.push_back (it->path ().string ());
+    }
+  }
+
+  std::sort (frame_paths_.begin (), frame_paths_.end ());
+
+  for (i = 0; i < frame_paths_.size (); ++i)
+  {
+    boost::filesystem::path gray_path (frame_paths_[i]);
+
+    gray_path.replace_extension ();
+    gray_path = gray_path.string () + "_gray.png";
+
+    gray_paths_.push_back (boost::filesystem::exists (gray_path) ? gray_path.string () : std::string ());
+  }
+
+  /* The recorded timestamps are used if there are any, otherwise the frames are spaced evenly */
+
+  std::ifstream timestamps_file ( (directory_path / "timestamps.txt").string ().c_str () );
+  double timestamp;
+
+  while (timestamps_file >> timestamp)
+  {
+    timestamps_.push_back (timestamp);
+  }
+
+  if (timestamps_.size () != frame_paths_.size ())
+  {
+    timestamps_.resize (frame_paths_.size ());
+
+    for (i = 0; i < timestamps_.size (); ++i)
+    {
+      timestamps_[i] = i / frame_rate;
+    }
+  }
+
+  PCL_INFO ("Found %d frames in %s\n", (int) frame_paths_.size (), directory.c_str ());
+}
+
+void
+ReplayFrameSource::setRealTime (bool real_time)
+{
+  real_time_ = real_time;
+}
+
+void
+ReplayFrameSource::start ()
+{
+  next_frame_ = 0;
+  delivered_frames_ = 0;
+  dropped_frames_ = 0;
+  running_ = true;
+  start_time_ = boost::posix_time::microsec_clock::local_time ();
+}
+
+void
+ReplayFrameSource::stop ()
+{
+  if (!running_)
+  {
+    return;
+  }
+
+  running_ = false;
+
+  PCL_INFO ("Replayed %u frames in %f s: %f frames per second, %u frames dropped\n", delivered_frames_, getElapsedTime (), getFrameRate (), dropped_frames_);
+}
+
+bool
+ReplayFrameSource::grab (Frame& frame, int timeout)
+{
+  double elapsed_time, wait_time, receive_time;
+
+  if (!running_ || isFinished ())
+  {
+    return (false);
+  }
+
+  if (real_time_)
+  {
+    elapsed_time = getElapsedTime ();
+
+    /* The frames whose time has passed while the consumer was busy are skipped, only the newest one is delivered */
+
+    while ( next_frame_ + 1 < frame_paths_.size () && timestamps_[next_frame_ + 1] - timestamps_[0] <= elapsed_time )
+    {
+      ++next_frame_;
+      ++dropped_frames_;
+    }
+
+    wait_time = timestamps_[next_frame_] - timestamps_[0] - elapsed_time;
+
+    if (wait_time * 1000.0 > timeout)
+    {
+      boost::this_thread::sleep (boost::posix_time::millisec (timeout));
+      return (false);
+    }
+
+    if (wait_time > 0.0)
+    {
+      boost::this_thread::sleep (boost::posix_time::microsec (static_cast<long> (wait_time * 1e6)));
+    }
+  }
+
+  /* The frame is received once it is due, reading it from the disk counts in its latency as the copy from the sensor does */
+
+  receive_time = getTime ();
+
+  loadFrame (next_frame_, frame);
+
+  frame.receive_time = receive_time;
+
+  ++next_frame_;
+  ++delivered_frames_;
+
+  return (true);
+}
+
+bool
+ReplayFrameSource::isFinished ()
+{
+  return (next_frame_ >= static_cast<int> (frame_paths_.size ()));
+}
+
+unsigned int
+ReplayFrameSource::getDroppedFrames ()
+{
+  return (dropped_frames_);
+}
+
+int
+ReplayFrameSource::getNumberFrames ()
+{
+  return (frame_paths_.size ());
+}
+
+double
+ReplayFrameSource::getFrameRate ()
+{
+  double elapsed_time = getElapsedTime ();
+
+  return (elapsed_time > 0.0 ? delivered_frames_ / elapsed_time : 0.0);
+}
+
+void
+ReplayFrameSource::loadFrame (int frame_number, Frame& frame)
+{
+  const std::string& frame_path = frame_paths_[frame_number];
+
+  if (boost::filesystem::path (frame_path).extension () == ".pcd")
+  {
+    pcl::PointCloud<pcl::PointXYZ>::Ptr cloud (new pcl::PointCloud<pcl::PointXYZ>);
+
+    if (pcl::io::loadPCDFile<pcl::PointXYZ> (frame_path, *cloud) == -1)
+    {
+      PCL_ERROR ("Could not open file %s\n", frame_path.c_str ());
+      exit (1);
+    }
+
+    frame.cloud = cloud;
+    frame.depth = extractDepth (*cloud);
+    frame.width = cloud->width;
+    frame.height = cloud->height;
+  }
+
+  else
+  {
+    cv::Mat depth_image = cv::imread (frame_path, CV_LOAD_IMAGE_ANYDEPTH);
+
+    if (depth_image.empty () || depth_image.type () != CV_16UC1)
+    {
+      PCL_ERROR ("%s is not a 16 bit depth image\n", frame_path.c_str ());
+      exit (1);
+    }
+
+    boost::shared_ptr < std::vector < unsigned short > > depth_ptr (new std::vector < unsigned short > (depth_image.rows * depth_image.cols));
+
+    for (int i = 0; i < depth_image.rows; ++i)
+    {
+      std::copy (depth_image.ptr<unsigned short> (i), depth_image.ptr<unsigned short> (i) + depth_image.cols, depth_ptr->begin () + i * depth_image.cols);
+    }
+
+    /* The cloud is only back-projected by the consumers which need it */
+
+    frame.depth = depth_ptr;
+    frame.cloud.reset ();
+    frame.width = depth_image.cols;
+    frame.height = depth_image.rows;
+  }
+
+  frame.gray = cv::Mat ();
+
+  if ( !gray_paths_[frame_number].empty () )
+  {
+    frame.gray = cv::imread (gray_paths_[frame_number], CV_LOAD_IMAGE_GRAYSCALE);
+  }
+
+  frame.focal_length = focal_length_;
+  frame.index = frame_number;
+  frame.timestamp = timestamps_[frame_number];
+}
+
+double
+ReplayFrameSource::getElapsedTime ()
+{
+  return ( (boost::posix_time::microsec_clock::local_time () - start_time_).total_microseconds () * 1e-6 );
+}
@@ -0,0 +1,196 @@
+#include <statistical_model.h>
+#include <profiler.h>
+
+#include <boost/filesystem.hpp>
+
+#include <fstream>
+#include <sstream>
+
+template <typename PolicyT>
+StatisticalModel<PolicyT>::StatisticalModel (std::string database_path, Eigen::MatrixX3d transformation_matrix, Eigen::Vector3d translation, double scale)
+{
+  int i,j;
+
+  ProfileScope profile_scope ("model_load");
+
+  boost::filesystem::path data_path (database_path);
+
+
+
+  if ( boost::filesystem::exists (data_path) )
+  {
+    /* In case the database_path is a folder, the information is calculated from scratch with the methods from PositionModel */
+    if ( boost::filesystem::is_directory (data_path) )
+    {
+      PositionModel position_model;
+
+      position_model.readDataFromFolders (database_path,150,4,transformation_matrix,translation);
+
+      mean_points_ = position_model.calculateMeanFace (true).template cast<Scalar> ();
+
+      position_model.calculateEigenValuesAndVectors ();
+
+      mesh_ = position_model.getMeshes (true);
+
+      eigenvalues_ = position_model.getEigenValues (true).template cast<Scalar> ();
+      eigenvectors_ = position_model.getEigenVectors (true).template cast<Scalar> ();
+      PCL_INFO ("Done with eigenvectors\n");
+    }
+
+    /* In case the database_path is a folder, the information is calculated from scratch with the methods from PositionModel */
+
+    else if ( boost::filesystem::is_regular_file (data_path))
+    {
+
+      /* This section will read the coordinates of the of the vertices of the model */
+
+      std::ifstream ins (database_path.c_str ());
+
+      int i,j,rows,cols;
+
+      uint32_t vertice;
+
+      std::string line;
+
+      ins >> rows;
+
+      mean_points_.resize (rows);
+
+      double aux;
+
+
+      for (i = 0; i < rows; ++i)
+      {
+        ins >> aux;
+        mean_points_ (i) = static_cast<Scalar> (aux * scale);
+      }
+
+      std::getline (ins,line);
+      std::getline (ins,line);
+
+      /* This section will read the mesh the model */
+
+      while (true)
+      {
+        std::getline (ins,line);
+
+        if (line == "")
+        {
+          break;
+        }
+
+        std::istringstream iss (line);
+
+        pcl::Vertices vertice_vector;
+
+        while (iss >> vertice)
+        {
+          vertice_vector.vertices.push_back (vertice);
+        }
+
+        mesh_.push_back (vertice_vector);
+
+      }
+
+      /* This section will read the eigenvalues and eigenvectors */
+
+      ins >> rows;
+
+      eigenvalues_.resize (rows);
+
+
+      for (i = 0; i < rows; ++i)
+      {
+        ins >> aux;
+        eigenvalues_ (i) = static_cast<Scalar> (aux * scale);
+      }
+
+      std::getline (ins,line);
+
+
+      ins >> rows >> cols;
+
+      eigenvectors_.resize (rows,cols);
+
+
+
+      for (j = 0; j < cols; ++j)
+      {
+        for (i = 0; i < rows; ++i)
+        {
+          ins >> aux;
+          eigenvectors_ (i,j) = static_cast<Scalar> (aux * scale);
+        }
+      }
+
+    }
+
+    else
+    {
+      PCL_ERROR ("Unknown file type\n");
+      exit (1);
+    }
+  }
+
+  else
+  {
+    PCL_ERROR ("Could not find database\n");
+    exit (1);
+  }
+
+  /* This part will decrement the indices from the OBJ mesh in order to be used as PCL meshes since the numerotation in PCL starts at 0 and in OBJ at 1  */
+
+  pcl_mesh_ = mesh_;
+
+  for (i = 0; i < pcl_mesh_.size (); ++i)
+  {
+    for (j = 0; j < pcl_mesh_[i].vertices.size (); ++j)
+    {
+      pcl_mesh_[i].vertices[j] = pcl_mesh_[i].vertices[j] - 1;
+    }
+  }
+
+  profile_scope.setPoints (mean_points_.rows () / 3);
+
+  PCL_INFO ("Done with reading the statistical model\n");
+
+}
+
+template <typename PolicyT> const typename StatisticalModel<PolicyT>::VectorX&
+StatisticalModel<PolicyT>::getMeanPoints () const
+{
+  return (mean_points_);
+}
+
+template <typename PolicyT> const typename StatisticalModel<PolicyT>::VectorX&
+StatisticalModel<PolicyT>::getEigenValues () const
+{
+  return (eigenvalues_);
+}
+
+template <typename PolicyT> const typename StatisticalModel<PolicyT>::MatrixX&
+StatisticalModel<PolicyT>::getEigenVectors () const
+{
+  return (eigenvectors_);
+}
+
+template <typename PolicyT> const std::vector < pcl::Vertices >&
+StatisticalModel<PolicyT>::getMesh () const
+{
+  return (mesh_);
+}
+
+template <typename PolicyT> const std::vector < pcl::Vertices >&
+StatisticalModel<PolicyT>::getPclMesh () const
+{
+  return (pcl_mesh_);
+}
+
+template <typename PolicyT> int
+StatisticalModel<PolicyT>::getNumberPoints () const
+{
+  return (static_cast<int> (mean_points_.rows () / 3));
+}
+
+template class StatisticalModel < SinglePrecision >;
+template class StatisticalModel < DoublePrecision >;
@@ -0,0 +1,117 @@
+#include <synthetic_face.h>
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <vector>
+
+float
+SyntheticFace::getDepth (float x, float y)
+{
+  return (-0.03f * std::exp (- (x * x + y * y) / (2.0f * 0.05f * 0.05f)));
+}
+
+void
+SyntheticFace::writeModel (const std::string& path, int number_side, int number_eigenvectors)
+{
+  int i, j, k, number_points = number_side * number_side;
+
+  float x, y, step = 0.16f / (number_side - 1);
+
+  double norm, center_x, center_y, distance;
+
+  std::vector < double > mode (3 * number_points);
+
+  std::ofstream out (path.c_str ());
+
+  out << 3 * number_points << "\n";
+
+  for (j = 0; j < number_side; ++j)
+  {
+    for (i = 0; i < number_side; ++i)
+    {
+      x = -0.08f + i * step;
+      y = -0.08f + j * step;
+
+      out << x << "\n" << y << "\n" << getDepth (x, y) << "\n";
+    }
+  }
+
+  /* The blank line closes the vertices, the quads are numbered from 1 as in an obj file and wound so their normals face the camera */
+
+  out << "\n";
+
+  for (j = 0; j + 1 < number_side; ++j)
+  {
+    for (i = 0; i + 1 < number_side; ++i)
+    {
+      k = j * number_side + i + 1;
+
+      out << k << " " << k + number_side << " " << k + number_side + 1 << " " << k + 1 << "\n";
+    }
+  }
+
+  out << "\n" << number_eigenvectors << "\n";
+
+  for (k = 0; k < number_eigenvectors; ++k)
+  {
+    out << 1e-4 / (k + 1) << "\n";
+  }
+
+  out << number_side * number_side * 3 << " " << number_eigenvectors << "\n";
+
+  /* Every mode is a bump of the depth at a place spread over the face, stored column by column */
+
+  for (k = 0; k < number_eigenvectors; ++k)
+  {
+    center_x = -0.06 + 0.12 * std::fmod (k * 0.618034, 1.0);
+    center_y = -0.06 + 0.12 * std::fmod (k * 0.381966 + 0.5, 1.0);
+
+    norm = 0.0;
+
+    for (i = 0; i < number_points; ++i)
+    {
+      distance = std::pow (-0.08 + (i % number_side) * step - center_x, 2) + std::pow (-0.08 + (i / number_side) * step - center_y, 2);
+
+      mode[3 * i] = mode[3 * i + 1] = 0.0;
+      mode[3 * i + 2] = std::exp (- distance / (2.0 * 0.03 * 0.03));
+
+      norm += mode[3 * i + 2] * mode[3 * i + 2];
+    }
+
+    for (i = 0; i < 3 * number_points; ++i)
+    {
+      out << mode[i] / std::sqrt (norm) << "\n";
+    }
+  }
+}
+
+pcl::PointCloud<pcl::PointNormal>::Ptr
+SyntheticFace::makeTarget (int number_points, pcl::PointXYZ& face_point)
+{
+  int i, j, number_side = std::max (4, static_cast<int> (std::sqrt (static_cast<double> (number_points))));
+
+  float step = 0.2f / (number_side - 1);
+
+  pcl::PointNormal point;
+
+  pcl::PointCloud<pcl::PointNormal>::Ptr cloud_ptr (new pcl::PointCloud<pcl::PointNormal>);
+
+  for (j = 0; j < number_side; ++j)
+  {
+    for (i = 0; i < number_side; ++i)
+    {
+      point.x = -0.1f + i * step;
+      point.y = -0.1f + j * step;
+      point.z = 0.8f + getDepth (point.x - 0.003f, point.y);
+
+      cloud_ptr->push_back (point);
+    }
+  }
+
+  /* alignModel () puts the center of the model 5 centimeters behind the face point */
+
+  face_point = pcl::PointXYZ (0.003f, 0.0f, 0.75f);
+
+  return (cloud_ptr);
+}
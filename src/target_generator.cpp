@@ -0,0 +1,399 @@
+#include <target_generator.h>
+
+#include <boost/random/normal_distribution.hpp>
+#include <boost/random/uniform_int_distribution.hpp>
+#include <boost/random/uniform_real_distribution.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <limits>
+
+bool
+GroundTruth::write (const std::string& path) const
+{
+  int i, j;
+
+  std::ofstream out (path.c_str ());
+
+  out.precision (9);
+
+  for (i = 0; i < 4; ++i)
+  {
+    for (j = 0; j < 4; ++j)
+    {
+      out << pose (i, j) << (j < 3 ? " " : "\n");
+    }
+  }
+
+  out << face_point.x << " " << face_point.y << " " << face_point.z << "\n" << coefficients.rows () << "\n";
+
+  for (i = 0; i < coefficients.rows (); ++i)
+  {
+    out << coefficients[i] << "\n";
+  }
+
+  return (out.good ());
+}
+
+bool
+GroundTruth::read (const std::string& path)
+{
+  int i, j, number_coefficients;
+
+  std::ifstream in (path.c_str ());
+
+  for (i = 0; i < 4; ++i)
+  {
+    for (j = 0; j < 4; ++j)
+    {
+      in >> pose (i, j);
+    }
+  }
+
+  in >> face_point.x >> face_point.y >> face_point.z >> number_coefficients;
+
+  if (!in || number_coefficients < 0)
+  {
+    return (false);
+  }
+
+  coefficients.resize (number_coefficients);
+
+  for (i = 0; i < number_coefficients; ++i)
+  {
+    in >> coefficients[i];
+  }
+
+  return (!in.fail ());
+}
+
+template <typename PolicyT>
+TargetGenerator<PolicyT>::TargetGenerator (typename StatisticalModel<PolicyT>::ConstPtr model_ptr, unsigned int seed) : random_generator_ (seed)
+{
+  model_ptr_ = model_ptr;
+
+  width_ = 640;
+  height_ = 480;
+  focal_length_ = 525.0f;
+
+  distance_ = 0.8;
+  offset_range_ = 0.05;
+  rotation_range_ = 15.0 * std::atan (1.0) / 45.0;
+
+  number_eigenvectors_ = 0;
+
+  noise_ = 0.0012;
+
+  number_holes_ = 4;
+  hole_radius_ = 5;
+
+  wall_distance_ = 0.6;
+  number_clutter_ = 5;
+
+  face_jitter_ = 0.01;
+}
+
+template <typename PolicyT> void
+TargetGenerator<PolicyT>::setCamera (int width, int height, float focal_length)
+{
+  width_ = width;
+  height_ = height;
+  focal_length_ = focal_length;
+}
+
+template <typename PolicyT> void
+TargetGenerator<PolicyT>::setPoseRange (double distance, double offset_range, double rotation_range)
+{
+  distance_ = distance;
+  offset_range_ = offset_range;
+  rotation_range_ = rotation_range;
+}
+
+template <typename PolicyT> void
+TargetGenerator<PolicyT>::setNumberEigenvectors (int number_eigenvectors)
+{
+  number_eigenvectors_ = number_eigenvectors;
+}
+
+template <typename PolicyT> void
+TargetGenerator<PolicyT>::setNoise (double noise)
+{
+  noise_ = noise;
+}
+
+template <typename PolicyT> void
+TargetGenerator<PolicyT>::setHoles (int number_holes, int hole_radius)
+{
+  number_holes_ = number_holes;
+  hole_radius_ = hole_radius;
+}
+
+template <typename PolicyT> void
+TargetGenerator<PolicyT>::setClutter (double wall_distance, int number_clutter)
+{
+  wall_distance_ = wall_distance;
+  number_clutter_ = number_clutter;
+}
+
+template <typename PolicyT> void
+TargetGenerator<PolicyT>::setFaceJitter (double face_jitter)
+{
+  face_jitter_ = face_jitter;
+}
+
+template <typename PolicyT> void
+TargetGenerator<PolicyT>::generate (pcl::PointCloud<pcl::PointXYZ>& target, GroundTruth& truth)
+{
+  int i, j, k, u, v, number_coefficients, number_points = model_ptr_->getNumberPoints ();
+
+  double z, wall_z, clutter_x, clutter_y, clutter_z, size, x_range, y_range, center_x = width_ >> 1, center_y = height_ >> 1, bad_point = std::numeric_limits<double>::quiet_NaN ();
+
+  Eigen::Vector3d axis, centroid = Eigen::Vector3d::Zero (), placed_centroid;
+
+  Eigen::Matrix3d rotation;
+
+  Eigen::VectorXd vertices;
+
+  std::vector < int > face_pixels;
+
+  boost::random::normal_distribution<> normal;
+
+  boost::random::uniform_real_distribution<> uniform (-1.0, 1.0);
+
+  const std::vector < pcl::Vertices >& mesh = model_ptr_->getPclMesh ();
+  const typename StatisticalModel<PolicyT>::VectorX& eigenvalues = model_ptr_->getEigenValues ();
+
+  /* The coefficients follow the distribution of the model, the eigenvalues being the variances of the eigenvectors */
+
+  number_coefficients = model_ptr_->getEigenVectors ().cols ();
+
+  truth.coefficients = Eigen::VectorXd::Zero (number_coefficients);
+
+  for (i = 0; i < number_coefficients && (number_eigenvectors_ <= 0 || i < number_eigenvectors_); ++i)
+  {
+    truth.coefficients[i] = normal (random_generator_) * std::sqrt (std::max (0.0, static_cast<double> (eigenvalues[i])));
+  }
+
+  /* The shape is turned around its centroid by at most rotation_range_ and the centroid is placed in front of the camera */
+
+  truth.pose = Eigen::Matrix4d::Identity ();
+
+  vertices = getVertices (*model_ptr_, truth);
+
+  for (i = 0; i < number_points; ++i)
+  {
+    centroid += vertices.segment<3> (3 * i) / number_points;
+  }
+
+  axis = Eigen::Vector3d (normal (random_generator_), normal (random_generator_), normal (random_generator_)).normalized ();
+
+  rotation = Eigen::AngleAxisd (0.5 * (uniform (random_generator_) + 1.0) * rotation_range_, axis).toRotationMatrix ();
+
+  placed_centroid = Eigen::Vector3d (uniform (random_generator_) * offset_range_, uniform (random_generator_) * offset_range_, distance_ + uniform (random_generator_) * offset_range_);
+
+  truth.pose.block<3,3> (0,0) = rotation;
+  truth.pose.block<3,1> (0,3) = placed_centroid - rotation * centroid;
+
+  vertices = getVertices (*model_ptr_, truth);
+
+  /* alignModel () puts the centroid of the model 5 centimeters behind the face point, which is off by up to face_jitter_ like a detection */
+
+  truth.face_point.x = placed_centroid[0] + uniform (random_generator_) * face_jitter_;
+  truth.face_point.y = placed_centroid[1] + uniform (random_generator_) * face_jitter_;
+  truth.face_point.z = placed_centroid[2] - 0.05 + uniform (random_generator_) * face_jitter_;
+
+  depth_buffer_.assign (width_ * height_, std::numeric_limits<double>::infinity ());
+  face_buffer_.assign (width_ * height_, false);
+
+  /* The background: a wall covering the whole view and boxes standing between it and the face */
+
+  if (wall_distance_ > 0.0)
+  {
+    wall_z = placed_centroid[2] + wall_distance_;
+
+    renderRectangle (-10.0 * wall_z, -10.0 * wall_z, 10.0 * wall_z, 10.0 * wall_z, wall_z);
+
+    for (k = 0; k < number_clutter_; ++k)
+    {
+      clutter_z = placed_centroid[2] + 0.15 + 0.5 * (uniform (random_generator_) + 1.0) * std::max (0.0, wall_distance_ - 0.15);
+
+      x_range = center_x * clutter_z / focal_length_;
+      y_range = center_y * clutter_z / focal_length_;
+
+      size = 0.05 + 0.1 * (uniform (random_generator_) + 1.0);
+
+      clutter_x = uniform (random_generator_) * x_range;
+      clutter_y = uniform (random_generator_) * y_range;
+
+      renderRectangle (clutter_x - 0.5 * size, clutter_y - 0.5 * size, clutter_x + 0.5 * size, clutter_y + 0.5 * size, clutter_z);
+    }
+  }
+
+  /* The polygons of the mesh are split into triangles around their first vertex */
+
+  for (k = 0; k < mesh.size (); ++k)
+  {
+    for (j = 1; j + 1 < mesh[k].vertices.size (); ++j)
+    {
+      renderTriangle (vertices.segment<3> (3 * mesh[k].vertices[0]), vertices.segment<3> (3 * mesh[k].vertices[j]), vertices.segment<3> (3 * mesh[k].vertices[j + 1]), true);
+    }
+  }
+
+  /* The holes are disks around pixels of the face, where the sensor would have missed the pattern */
+
+  for (i = 0; i < face_buffer_.size (); ++i)
+  {
+    if (face_buffer_[i])
+    {
+      face_pixels.push_back (i);
+    }
+  }
+
+  for (k = 0; k < number_holes_ && !face_pixels.empty (); ++k)
+  {
+    i = face_pixels[ boost::random::uniform_int_distribution<> (0, face_pixels.size () - 1) (random_generator_) ];
+
+    for (v = std::max (0, i / width_ - hole_radius_); v <= std::min (height_ - 1, i / width_ + hole_radius_); ++v)
+    {
+      for (u = std::max (0, i % width_ - hole_radius_); u <= std::min (width_ - 1, i % width_ + hole_radius_); ++u)
+      {
+        if ( (u - i % width_) * (u - i % width_) + (v - i / width_) * (v - i / width_) <= hole_radius_ * hole_radius_ && face_buffer_[v * width_ + u] )
+        {
+          depth_buffer_[v * width_ + u] = std::numeric_limits<double>::infinity ();
+        }
+      }
+    }
+  }
+
+  /* The depth is back-projected with the same projection as FrameSource::backProject (), the noise growing with the square of the depth */
+
+  target.width = width_;
+  target.height = height_;
+  target.is_dense = false;
+  target.points.resize (width_ * height_);
+
+  for (v = 0, i = 0; v < height_; ++v)
+  {
+    for (u = 0; u < width_; ++u, ++i)
+    {
+      pcl::PointXYZ& point = target.points[i];
+
+      if ( !pcl_isfinite (depth_buffer_[i]) )
+      {
+        point.x = point.y = point.z = bad_point;
+        continue;
+      }
+
+      z = depth_buffer_[i] + normal (random_generator_) * noise_ * depth_buffer_[i] * depth_buffer_[i];
+
+      point.x = (u - center_x) * z / focal_length_;
+      point.y = (v - center_y) * z / focal_length_;
+      point.z = z;
+    }
+  }
+}
+
+template <typename PolicyT> Eigen::VectorXd
+TargetGenerator<PolicyT>::getVertices (const StatisticalModel<PolicyT>& model, const GroundTruth& truth)
+{
+  int i, number_coefficients = std::min (static_cast<int> (truth.coefficients.rows ()), static_cast<int> (model.getEigenVectors ().cols ()));
+
+  Eigen::VectorXd vertices = model.getMeanPoints ().template cast<double> ();
+
+  if (number_coefficients > 0)
+  {
+    vertices += model.getEigenVectors ().leftCols (number_coefficients).template cast<double> () * truth.coefficients.head (number_coefficients);
+  }
+
+  for (i = 0; i < vertices.rows () / 3; ++i)
+  {
+    vertices.segment<3> (3 * i) = truth.pose.block<3,3> (0,0) * vertices.segment<3> (3 * i) + truth.pose.block<3,1> (0,3);
+  }
+
+  return (vertices);
+}
+
+template <typename PolicyT> void
+TargetGenerator<PolicyT>::renderRectangle (double x_min, double y_min, double x_max, double y_max, double z)
+{
+  int u, v, u_begin, v_begin, u_end, v_end;
+
+  double center_x = width_ >> 1, center_y = height_ >> 1;
+
+  u_begin = std::max (0, static_cast<int> (std::ceil (x_min * focal_length_ / z + center_x)));
+  v_begin = std::max (0, static_cast<int> (std::ceil (y_min * focal_length_ / z + center_y)));
+  u_end = std::min (width_ - 1, static_cast<int> (std::floor (x_max * focal_length_ / z + center_x)));
+  v_end = std::min (height_ - 1, static_cast<int> (std::floor (y_max * focal_length_ / z + center_y)));
+
+  for (v = v_begin; v <= v_end; ++v)
+  {
+    for (u = u_begin; u <= u_end; ++u)
+    {
+      if (z < depth_buffer_[v * width_ + u])
+      {
+        depth_buffer_[v * width_ + u] = z;
+        face_buffer_[v * width_ + u] = false;
+      }
+    }
+  }
+}
+
+template <typename PolicyT> void
+TargetGenerator<PolicyT>::renderTriangle (const Eigen::Vector3d& a, const Eigen::Vector3d& b, const Eigen::Vector3d& c, bool face)
+{
+  int u, v, u_begin, v_begin, u_end, v_end;
+
+  double area, weight_a, weight_b, weight_c, inverse_depth, center_x = width_ >> 1, center_y = height_ >> 1;
+
+  Eigen::Vector2d pa, pb, pc;
+
+  if (a[2] <= 0.0 || b[2] <= 0.0 || c[2] <= 0.0)
+  {
+    return;
+  }
+
+  pa = Eigen::Vector2d (a[0] * focal_length_ / a[2] + center_x, a[1] * focal_length_ / a[2] + center_y);
+  pb = Eigen::Vector2d (b[0] * focal_length_ / b[2] + center_x, b[1] * focal_length_ / b[2] + center_y);
+  pc = Eigen::Vector2d (c[0] * focal_length_ / c[2] + center_x, c[1] * focal_length_ / c[2] + center_y);
+
+  area = (pb[0] - pa[0]) * (pc[1] - pa[1]) - (pb[1] - pa[1]) * (pc[0] - pa[0]);
+
+  if (std::abs (area) < 1e-12)
+  {
+    return;
+  }
+
+  u_begin = std::max (0, static_cast<int> (std::ceil (std::min (pa[0], std::min (pb[0], pc[0])))));
+  v_begin = std::max (0, static_cast<int> (std::ceil (std::min (pa[1], std::min (pb[1], pc[1])))));
+  u_end = std::min (width_ - 1, static_cast<int> (std::floor (std::max (pa[0], std::max (pb[0], pc[0])))));
+  v_end = std::min (height_ - 1, static_cast<int> (std::floor (std::max (pa[1], std::max (pb[1], pc[1])))));
+
+  /* The pixels inside the triangle get the depth of the surface, the inverse of the depth being linear on the image */
+
+  for (v = v_begin; v <= v_end; ++v)
+  {
+    for (u = u_begin; u <= u_end; ++u)
+    {
+      weight_a = ( (pb[0] - u) * (pc[1] - v) - (pb[1] - v) * (pc[0] - u) ) / area;
+      weight_b = ( (pc[0] - u) * (pa[1] - v) - (pc[1] - v) * (pa[0] - u) ) / area;
+      weight_c = 1.0 - weight_a - weight_b;
+
+      if (weight_a < 0.0 || weight_b < 0.0 || weight_c < 0.0)
+      {
+        continue;
+      }
+
+      inverse_depth = weight_a / a[2] + weight_b / b[2] + weight_c / c[2];
+
+      if (1.0 / inverse_depth < depth_buffer_[v * width_ + u])
+      {
+        depth_buffer_[v * width_ + u] = 1.0 / inverse_depth;
+        face_buffer_[v * width_ + u] = face;
+      }
+    }
+  }
+}
+
+template class TargetGenerator < SinglePrecision >;
+template class TargetGenerator < DoublePrecision >;
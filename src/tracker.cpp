@@ -1,182 +1,453 @@
 
 #include <tracker.h>
 
-Tracker::Tracker (int device)
+#include <pcl/console/time.h>
+
+#include <cmath>
+#include <sstream>
+
+namespace
+{
+  /* The names of the capture stages in the report, in the order of Tracker::CaptureStage */
+
+  const char* const CAPTURE_STAGE_NAMES[Tracker::NUMBER_CAPTURE_STAGES] = {"queue", "integration", "detection", "scan", "frame"};
+}
+
+Tracker::Tracker (FrameSource::Ptr source, FaceLocator::Ptr face_locator, FusionBackend::Ptr fusion)
 {
 
+  source_ = source;
+  face_locator_ptr_ = face_locator;
+  fusion_ = fusion;
+
   scan_ = false;
+  auto_scan_ = false;
+  has_scanned_ = false;
+  scan_translation_threshold_ = 0.0f;
+  scan_rotation_threshold_ = 0.0f;
+  scan_surface_growth_ = 0.0f;
+  scan_surface_ = 0;
   face_found_ = false;
+  has_detection_frame_ = false;
+  stop_detection_ = false;
+  region_timestamp_ = -1.0;
+  late_threshold_ = 1000.0 / 30.0;
+  late_frames_ = 0;
+  grab_timeouts_ = 0;
+  skipped_detections_ = 0;
+  lost_frames_ = 0;
+  report_printed_ = false;
 
   cloud_kinfu_ptr_.reset ( new pcl::PointCloud<pcl::PointXYZ>);
+}
+
+Tracker::~Tracker ()
+{
+  close ();
+}
+
+pcl::PointCloud <pcl::PointXYZ>::Ptr
+Tracker::getKinfuCloud ()
+{
+  return  (cloud_kinfu_ptr_);
+}
+
+pcl::PointXYZ
+Tracker::getFaceCenter ()
+{
+  return  (face_center_);
+}
 
+bool
+Tracker::isFaceFound ()
+{
+  return  (face_found_);
+}
 
-  Eigen::Vector3f volume_size = Eigen::Vector3f::Constant  (1.2f);
-  kinfu_.volume ().setSize  (volume_size);
+void
+Tracker::setScan (bool scan)
+{
+  scan_ = scan;
+}
+
+void
+Tracker::setScanPolicy (float translation_threshold, float rotation_threshold, float surface_growth)
+{
+  auto_scan_ = true;
+  scan_translation_threshold_ = translation_threshold;
+  scan_rotation_threshold_ = rotation_threshold;
+  scan_surface_growth_ = surface_growth;
+}
 
-  Eigen::Matrix3f R = Eigen::Matrix3f::Identity  ();
-  translation_ = volume_size * 0.5f - Eigen::Vector3f  (0, 0, volume_size  (2) / 2 * 1.2f);
+bool
+Tracker::isScanDue ()
+{
+  Eigen::Affine3f pose;
 
+  size_t surface;
 
-  Eigen::Affine3f pose = Eigen::Translation3f  (translation_) * Eigen::AngleAxisf  (R);
+  /* The first scan waits for the newest frame searched to contain a face, so it is never taken on the wrong spot */
 
-  kinfu_.setInitalCameraPose  (pose);
-  kinfu_.setCameraMovementThreshold (0.001f);
+  if (!has_scanned_)
+  {
+    boost::mutex::scoped_lock lock (detection_mutex_);
+    return (!detections_.empty () && detections_.back ().found);
+  }
 
+  pose = fusion_->getCameraPose ();
 
-  if ( !video_grabber_.open (device) )
+  if ( scan_translation_threshold_ > 0.0f && (pose.translation () - scan_translation_).norm () > scan_translation_threshold_ )
   {
-    PCL_ERROR ("The camera is disconnected\n");
-    exit (-1);
+    return (true);
   }
 
-  if ( !face_classifier_.load ( "haarcascade_frontalface_alt.xml" ) )
+  if ( scan_rotation_threshold_ > 0.0f && Eigen::AngleAxisf (scan_rotation_.transpose () * pose.rotation ()).angle () > scan_rotation_threshold_ )
   {
-    PCL_ERROR ("Did not find the XML file\n");
-    exit (-1);
+    return (true);
   }
 
-  boost::function<void  (const DepthImagePtr&)> func2_dev = boost::bind  (&Tracker::source_cb1_device, this, _1);
-  connection_ = registerCallback  (func2_dev);
+  surface = fusion_->getSurfaceSize ();
 
+  return ( scan_surface_growth_ > 0.0f && surface > scan_surface_ * (1.0f + scan_surface_growth_) );
 }
 
-Tracker::~Tracker () throw  ()
+bool
+Tracker::isFinished ()
 {
+  return  (source_->isFinished ());
+}
 
+void
+Tracker::setLateThreshold (double late_threshold)
+{
+  boost::mutex::scoped_lock lock (statistics_mutex_);
+  late_threshold_ = late_threshold;
 }
 
-pcl::PointCloud <pcl::PointXYZ>::Ptr
-Tracker::getKinfuCloud ()
+const LatencyHistogram&
+Tracker::getLatencyHistogram (CaptureStage stage) const
 {
-  return  (cloud_kinfu_ptr_);
+  return (latencies_[stage]);
 }
 
-pcl::PointXYZ
-Tracker::getFaceCenter ()
+unsigned int
+Tracker::getLateFrames ()
 {
-  return  (face_center_);
+  boost::mutex::scoped_lock lock (statistics_mutex_);
+  return (late_frames_);
 }
 
-bool
-Tracker::isFaceFound ()
+unsigned int
+Tracker::getGrabTimeouts ()
 {
-  return  (face_found_);
+  boost::mutex::scoped_lock lock (statistics_mutex_);
+  return (grab_timeouts_);
 }
 
-void
-Tracker::setScan (bool scan)
+unsigned int
+Tracker::getSkippedDetections ()
 {
-  scan_ = scan;
+  boost::mutex::scoped_lock lock (statistics_mutex_);
+  return (skipped_detections_);
+}
+
+unsigned int
+Tracker::getLostFrames ()
+{
+  boost::mutex::scoped_lock lock (statistics_mutex_);
+  return (lost_frames_);
 }
 
+std::string
+Tracker::getCaptureReport ()
+{
+  std::ostringstream report;
 
+  report.setf (std::ios::fixed);
+  report.precision (2);
+
+  report << "Capture latencies in ms (count, p50, p95, p99, max):\n";
+
+  for (int i = 0; i < NUMBER_CAPTURE_STAGES; ++i)
+  {
+    const LatencyHistogram& histogram = latencies_[i];
+
+    report << "  " << CAPTURE_STAGE_NAMES[i] << ": " << histogram.getCount () << ", " << histogram.getPercentile (50.0) << ", " << histogram.getPercentile (95.0) << ", "
+           << histogram.getPercentile (99.0) << ", " << histogram.getMaximum () << "\n";
+  }
+
+  boost::mutex::scoped_lock lock (statistics_mutex_);
+
+  report << "Frames: " << latencies_[FRAME_STAGE].getCount () << " processed, " << source_->getDroppedFrames () << " dropped by the source, " << late_frames_ << " late (over "
+         << late_threshold_ << " ms), " << lost_frames_ << " lost by the fusion, " << skipped_detections_ << " skipped by the face search, " << grab_timeouts_ << " grab timeouts\n";
+
+  return (report.str ());
+}
 
 void
-Tracker::takeKinfuCloud ()
+Tracker::takeKinfuCloud (const Frame& frame)
 {
 
-  /* OpenCV code to detect the center of the face */
+  /* The result closest in time to the scanned frame is used and moved into the coordinates of the volume with the pose of the camera in its own frame, the camera may have moved since */
 
-  face_found_ = false;
+  int closest = -1;
 
-  cv::Mat frame,frame_gray;
-  std::vector<cv::Rect> faces;
+  double start_time = FrameSource::getTime ();
 
-  video_grabber_.grab ();
+  Eigen::Vector3f face_center;
 
-  video_grabber_.retrieve ( frame, CV_CAP_OPENNI_GRAY_IMAGE );
+  Eigen::Affine3f pose = fusion_->getCameraPose ();
 
-  cv::equalizeHist ( frame, frame_gray);
+  face_found_ = false;
 
-  face_classifier_.detectMultiScale (frame_gray, faces, 1.1, 2, 0|CV_HAAR_SCALE_IMAGE, cv::Size (30, 30));
+  {
+    boost::mutex::scoped_lock lock (detection_mutex_);
 
+    for (int i = 0; i < static_cast<int> (detections_.size ()); ++i)
+    {
+      if (closest == -1 || std::fabs (detections_[i].timestamp - frame.timestamp) < std::fabs (detections_[closest].timestamp - frame.timestamp))
+      {
+        closest = i;
+      }
+    }
 
-  std::pair < int, int > center_coordinates;
+    if (closest != -1 && detections_[closest].found)
+    {
+      face_found_ = true;
 
-  if (faces.size () > 0)
-  {
-    face_found_ = true;
-    center_coordinates.first = faces[0].x + faces[0].width/2;
-    center_coordinates.second = faces[0].y + faces[0].height/2;
+      face_center = detections_[closest].camera_rotation * Eigen::Vector3f (detections_[closest].face_center.x, detections_[closest].face_center.y, detections_[closest].face_center.z) + detections_[closest].camera_translation;
 
-    face_center_.x = cloud_depth_ptr_->at (center_coordinates.first,center_coordinates.second).x + translation_[0];
-    face_center_.y = cloud_depth_ptr_->at (center_coordinates.first,center_coordinates.second).y + translation_[1];
-    face_center_.z = cloud_depth_ptr_->at (center_coordinates.first,center_coordinates.second).z + translation_[2];
+      face_center_.x = face_center[0];
+      face_center_.y = face_center[1];
+      face_center_.z = face_center[2];
+    }
 
+    if (closest != -1)
+    {
+      PCL_INFO ("Face of the frame taken %f ms from the scanned one\n", (detections_[closest].timestamp - frame.timestamp) * 1000.0);
+    }
   }
 
   /* This part accumulates the point cloud in cloud_kinfu_ptr_ */
 
+  fusion_->extractCloud (*cloud_kinfu_ptr_);
 
-  pcl::gpu::DeviceArray<pcl::PointXYZ> extracted = kinfu_.volume ().fetchCloud  (cloud_buffer_device_);
-
-  extracted.download  (cloud_kinfu_ptr_->points);
+  /* The scan policy measures the motion and the new surface from here */
 
-  cloud_kinfu_ptr_->width =  (int) cloud_kinfu_ptr_->points.size  ();
-  cloud_kinfu_ptr_->height = 1;
+  has_scanned_ = true;
+  scan_rotation_ = pose.rotation ();
+  scan_translation_ = pose.translation ();
+  scan_surface_ = fusion_->getSurfaceSize ();
 
+  latencies_[SCAN_STAGE].add ((FrameSource::getTime () - start_time) * 1000.0);
 
 }
 
 
-void
-Tracker::source_cb1_device (const boost::shared_ptr<openni_wrapper::DepthImage>& depth_wrapper)
+bool
+Tracker::execute ()
 {
+  Frame frame;
 
-  boost::mutex::scoped_try_lock lock (data_ready_mutex_);
+  double start_time, latency;
 
-  if (!lock)
-    return;
+  bool scanned = false;
 
+  if  (source_->grab (frame, 100))
+  {
+    start_time = FrameSource::getTime ();
 
-  depth_.cols = depth_wrapper->getWidth ();
-  depth_.rows = depth_wrapper->getHeight ();
-  depth_.step = depth_.cols * depth_.elemSize ();
+    latencies_[QUEUE_STAGE].add ((start_time - frame.receive_time) * 1000.0);
 
+    if ( !fusion_->integrate (frame) )
+    {
+      PCL_DEBUG ("Camera lost in frame %u\n", frame.index);
 
-  source_depth_data_.resize (depth_.cols * depth_.rows);
-  depth_wrapper->fillDepthImageRaw (depth_.cols, depth_.rows, &source_depth_data_[0]);
-  depth_.data = &source_depth_data_[0];
+      boost::mutex::scoped_lock lock (statistics_mutex_);
+      ++lost_frames_;
+    }
 
-  cloud_depth_ptr_ = convertToXYZPointCloud (depth_wrapper);
+    latencies_[INTEGRATION_STAGE].add ((FrameSource::getTime () - start_time) * 1000.0);
 
-  data_ready_cond_.notify_one ();
-}
+    updateFaceRegion ();
 
-bool
-Tracker::execute ()
-{
-  bool has_data = data_ready_cond_.timed_wait  (*lock_ptr_, boost::posix_time::millisec (100));
+    /* The frame is only handed over, the fusion goes on while the worker searches it */
 
-  if  (has_data)
-  {
-    depth_device_.upload (depth_.data, depth_.step, depth_.rows, depth_.cols);
-    kinfu_ (depth_device_);
+    if ( !face_locator_ptr_->needsGrayImage () || !frame.gray.empty () )
+    {
+      postDetectionFrame (frame, fusion_->getCameraPose ());
+    }
 
-    if (scan_)
+    if (auto_scan_ && !scan_ && isScanDue ())
+    {
+      scan_ = true;
+    }
+
+    /* A scan is delayed until the worker has searched its first frame */
+
+    if (scan_ && hasDetection ())
     {
       scan_ = false;
-      takeKinfuCloud ();
-      return (true);
+      takeKinfuCloud (frame);
+      scanned = true;
+    }
+
+    latency = (FrameSource::getTime () - frame.receive_time) * 1000.0;
+
+    latencies_[FRAME_STAGE].add (latency);
+
+    boost::mutex::scoped_lock lock (statistics_mutex_);
+
+    if (latency > late_threshold_)
+    {
+      ++late_frames_;
     }
+  }
+
+  /* Waiting in vain is only worth counting while the source is still expected to deliver */
 
+  else if (!source_->isFinished ())
+  {
+    boost::mutex::scoped_lock lock (statistics_mutex_);
+    ++grab_timeouts_;
   }
 
-  return (false);
+  return (scanned);
 
 }
 
 void
 Tracker::startUp ()
 {
-  lock_ptr_.reset ( new boost::unique_lock<boost::mutex> (data_ready_mutex_));
-  start ();
+  stop_detection_ = false;
+  detection_thread_ = boost::thread (&Tracker::detectionLoop, this);
+
+  source_->start ();
 
 }
 
 void
 Tracker::close ()
 {
-  stop ();
-  connection_.disconnect ();
+  source_->stop ();
+
+  {
+    boost::mutex::scoped_lock lock (detection_mutex_);
+    stop_detection_ = true;
+    detection_condition_.notify_all ();
+  }
+
+  if (detection_thread_.joinable ())
+  {
+    detection_thread_.join ();
+  }
+
+  /* The report is printed by the first close () after some frames were processed, the destructor calls it again */
+
+  if (!report_printed_ && latencies_[FRAME_STAGE].getCount () > 0)
+  {
+    report_printed_ = true;
+    PCL_INFO ("%s", getCaptureReport ().c_str ());
+  }
+}
+
+void
+Tracker::postDetectionFrame (const Frame& frame, const Eigen::Affine3f& camera_pose)
+{
+  boost::mutex::scoped_lock lock (detection_mutex_);
+
+  if (has_detection_frame_)
+  {
+    boost::mutex::scoped_lock statistics_lock (statistics_mutex_);
+    ++skipped_detections_;
+  }
+
+  detection_frame_ = frame;
+  detection_rotation_ = camera_pose.rotation ();
+  detection_translation_ = camera_pose.translation ();
+  has_detection_frame_ = true;
+
+  detection_condition_.notify_one ();
+}
+
+void
+Tracker::updateFaceRegion ()
+{
+  Detection detection;
+
+  {
+    boost::mutex::scoped_lock lock (detection_mutex_);
+
+    if ( detections_.empty () || !detections_.back ().found || detections_.back ().timestamp == region_timestamp_ )
+    {
+      return;
+    }
+
+    detection = detections_.back ();
+  }
+
+  /* Each new face found is handed to the fusion, which may then leave out the rest of the scene */
+
+  region_timestamp_ = detection.timestamp;
+
+  fusion_->setFaceCenter (detection.camera_rotation * Eigen::Vector3f (detection.face_center.x, detection.face_center.y, detection.face_center.z) + detection.camera_translation);
+}
+
+bool
+Tracker::hasDetection ()
+{
+  boost::mutex::scoped_lock lock (detection_mutex_);
+  return (!detections_.empty ());
+}
+
+void
+Tracker::detectionLoop ()
+{
+  pcl::console::TicToc timer;
+
+  Frame frame;
+
+  Detection detection;
+
+  while (true)
+  {
+    {
+      boost::mutex::scoped_lock lock (detection_mutex_);
+
+      while (!has_detection_frame_ && !stop_detection_)
+      {
+        detection_condition_.wait (lock);
+      }
+
+      if (stop_detection_)
+      {
+        break;
+      }
+
+      frame = detection_frame_;
+      detection.camera_rotation = detection_rotation_;
+      detection.camera_translation = detection_translation_;
+      has_detection_frame_ = false;
+    }
+
+    /* The locator runs without the lock, meanwhile newer frames replace each other in the slot */
+
+    timer.tic ();
+
+    detection.timestamp = frame.timestamp;
+    detection.found = face_locator_ptr_->locate (frame, detection.face_center);
+
+    face_locator_ptr_->printLatency (frame, timer.toc ());
+
+    latencies_[DETECTION_STAGE].add ((FrameSource::getTime () - frame.receive_time) * 1000.0);
+
+    boost::mutex::scoped_lock lock (detection_mutex_);
+
+    detections_.push_back (detection);
+
+    if (static_cast<int> (detections_.size ()) > DETECTION_HISTORY)
+    {
+      detections_.pop_front ();
+    }
+  }
 }
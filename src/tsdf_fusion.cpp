@@ -0,0 +1,1169 @@
+#include <tsdf_fusion.h>
+
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+/**
+ * @brief Division rounding towards minus infinity, so the voxels on the negative side of the origin fall into the right block
+ */
+
+static inline int
+floorDivide (int value, int divisor)
+{
+  return (value >= 0 ? value / divisor : - ((divisor - 1 - value) / divisor));
+}
+
+TsdfFusion::TsdfFusion (float volume_size, int resolution, int number_threads)
+{
+  volume_size_ = volume_size;
+  resolution_ = resolution;
+  voxel_size_ = volume_size / resolution;
+  truncation_distance_ = 0.01f;
+  icp_iterations_ = 10;
+
+  number_threads_ = number_threads > 0 ? number_threads : std::max (1u, boost::thread::hardware_concurrency ());
+
+  volume_placed_ = false;
+
+  has_region_ = false;
+  region_radius_ = 0.2f;
+  region_changed_ = false;
+
+  bounds_minimum_.setZero ();
+  bounds_maximum_.setZero ();
+
+  rotation_.setIdentity ();
+  translation_.setZero ();
+
+  current_frame_ = NULL;
+
+  map_width_ = 0;
+  map_height_ = 0;
+  map_focal_length_ = 0.0f;
+  map_center_x_ = 0.0f;
+  map_center_y_ = 0.0f;
+
+  icp_systems_.resize (number_threads_);
+  icp_right_sides_.resize (number_threads_);
+  icp_counts_.resize (number_threads_);
+  allocation_keys_.resize (number_threads_);
+  extracted_blocks_.resize (number_threads_);
+  last_extracted_blocks_ = 0;
+
+  job_ = NULL;
+  job_count_ = 0;
+  job_part_ = 0;
+  job_generation_ = 0;
+  pending_workers_ = 0;
+  stop_workers_ = false;
+
+  for (int i = 1; i < number_threads_; ++i)
+  {
+    workers_.create_thread (boost::bind (&TsdfFusion::workerLoop, this, i));
+  }
+}
+
+TsdfFusion::~TsdfFusion ()
+{
+  {
+    boost::mutex::scoped_lock lock (pool_mutex_);
+    stop_workers_ = true;
+    job_condition_.notify_all ();
+  }
+
+  workers_.join_all ();
+
+  for (size_t i = 0; i < block_list_.size (); ++i)
+  {
+    delete block_list_[i];
+  }
+}
+
+void
+TsdfFusion::setTruncationDistance (float truncation_distance)
+{
+  truncation_distance_ = truncation_distance;
+}
+
+void
+TsdfFusion::setIcpIterations (int icp_iterations)
+{
+  icp_iterations_ = icp_iterations;
+}
+
+void
+TsdfFusion::setRegionRadius (float region_radius)
+{
+  region_radius_ = region_radius;
+  region_changed_ = true;
+}
+
+void
+TsdfFusion::setFaceCenter (const Eigen::Vector3f& face_center)
+{
+  has_region_ = true;
+  region_center_ = face_center;
+  region_changed_ = true;
+}
+
+int
+TsdfFusion::getNumberThreads ()
+{
+  return (number_threads_);
+}
+
+int
+TsdfFusion::getNumberBlocks ()
+{
+  return (block_list_.size ());
+}
+
+size_t
+TsdfFusion::getSurfaceSize ()
+{
+  return (block_list_.size ());
+}
+
+size_t
+TsdfFusion::getMemoryUsage ()
+{
+  size_t i, number_bytes = block_list_.size () * sizeof (Block);
+
+  for (i = 0; i < block_list_.size (); ++i)
+  {
+    number_bytes += block_list_[i]->points.capacity () * sizeof (pcl::PointXYZ);
+  }
+
+  return (number_bytes);
+}
+
+int
+TsdfFusion::getExtractedBlocks ()
+{
+  return (last_extracted_blocks_);
+}
+
+bool
+TsdfFusion::integrate (const Frame& frame)
+{
+  bool tracked = true;
+
+  current_frame_ = &frame;
+
+  /* The maps are sized with the first frame, they are reused afterwards */
+
+  if ( map_width_ != frame.width / 2 || map_height_ != frame.height / 2 )
+  {
+    map_width_ = frame.width / 2;
+    map_height_ = frame.height / 2;
+
+    vertices_.resize (map_width_ * map_height_);
+    normals_.resize (map_width_ * map_height_);
+    model_vertices_.assign (map_width_ * map_height_, Eigen::Vector3f::Constant (std::numeric_limits<float>::quiet_NaN ()));
+    model_normals_.assign (map_width_ * map_height_, Eigen::Vector3f::Constant (std::numeric_limits<float>::quiet_NaN ()));
+  }
+
+  /* Same projection as FrameSource::backProject (), at half the resolution */
+
+  map_focal_length_ = frame.focal_length * 0.5f;
+  map_center_x_ = (frame.width >> 1) * 0.5f;
+  map_center_y_ = (frame.height >> 1) * 0.5f;
+
+  runParallel (boost::bind (&TsdfFusion::computeVertices, this, _1, _2, _3), map_height_);
+  runParallel (boost::bind (&TsdfFusion::computeNormals, this, _1, _2, _3), map_height_);
+
+  if (!volume_placed_)
+  {
+    placeVolume (frame);
+    volume_placed_ = true;
+  }
+
+  else
+  {
+    tracked = trackCamera ();
+  }
+
+  /* A frame in which the camera was lost is not fused, the next one is tracked from the last good pose */
+
+  if (tracked)
+  {
+    if (region_changed_)
+    {
+      evictBlocks ();
+      region_changed_ = false;
+    }
+
+    allocateBlocks ();
+
+    runParallel (boost::bind (&TsdfFusion::integrateBlocks, this, _1, _2, _3), block_list_.size ());
+    runParallel (boost::bind (&TsdfFusion::raycastRows, this, _1, _2, _3), map_height_);
+  }
+
+  current_frame_ = NULL;
+
+  return (tracked);
+}
+
+Eigen::Affine3f
+TsdfFusion::getCameraPose ()
+{
+  Eigen::Affine3f pose;
+
+  pose.linear () = rotation_;
+  pose.translation () = translation_;
+
+  return (pose);
+}
+
+void
+TsdfFusion::extractCloud (pcl::PointCloud < pcl::PointXYZ >& cloud)
+{
+  int i;
+
+  /* The counts are cleared here since a thread is not called when its part of the blocks is empty */
+
+  std::fill (extracted_blocks_.begin (), extracted_blocks_.end (), 0);
+
+  runParallel (boost::bind (&TsdfFusion::extractBlocks, this, _1, _2, _3), block_list_.size ());
+
+  /* The flags are only cleared once every block is done, since the extraction of a block also looks at its neighbors */
+
+  cloud.points.clear ();
+
+  for (i = 0; i < block_list_.size (); ++i)
+  {
+    block_list_[i]->touched = false;
+    cloud.points.insert (cloud.points.end (), block_list_[i]->points.begin (), block_list_[i]->points.end ());
+  }
+
+  last_extracted_blocks_ = 0;
+
+  for (i = 0; i < number_threads_; ++i)
+  {
+    last_extracted_blocks_ += extracted_blocks_[i];
+  }
+
+  cloud.width = (int) cloud.points.size ();
+  cloud.height = 1;
+  cloud.is_dense = true;
+
+  PCL_INFO ("Extracted %d of %d blocks, %d points, %f MB\n", last_extracted_blocks_, (int) block_list_.size (), (int) cloud.points.size (), getMemoryUsage () / 1048576.0);
+}
+
+const char*
+TsdfFusion::getName ()
+{
+  return ("cpu");
+}
+
+void
+TsdfFusion::runParallel (const boost::function < void (int, int, int) >& job, int count)
+{
+  int part = (count + number_threads_ - 1) / number_threads_;
+
+  {
+    boost::mutex::scoped_lock lock (pool_mutex_);
+
+    job_ = &job;
+    job_count_ = count;
+    job_part_ = part;
+    pending_workers_ = number_threads_ - 1;
+    ++job_generation_;
+
+    job_condition_.notify_all ();
+  }
+
+  /* The calling thread takes the first part, the job stays valid until every thread of the pool is done with it */
+
+  job (0, std::min (count, part), 0);
+
+  boost::mutex::scoped_lock lock (pool_mutex_);
+
+  while (pending_workers_ > 0)
+  {
+    done_condition_.wait (lock);
+  }
+}
+
+void
+TsdfFusion::workerLoop (int thread)
+{
+  int begin, end;
+
+  unsigned long generation = 0;
+
+  const boost::function < void (int, int, int) >* job;
+
+  while (true)
+  {
+    {
+      boost::mutex::scoped_lock lock (pool_mutex_);
+
+      while (job_generation_ == generation && !stop_workers_)
+      {
+        job_condition_.wait (lock);
+      }
+
+      if (stop_workers_)
+      {
+        return;
+      }
+
+      generation = job_generation_;
+      job = job_;
+      begin = thread * job_part_;
+      end = std::min (job_count_, begin + job_part_);
+    }
+
+    /* A small range leaves the last threads without a part */
+
+    if (begin < end)
+    {
+      (*job) (begin, end, thread);
+    }
+
+    boost::mutex::scoped_lock lock (pool_mutex_);
+
+    if (--pending_workers_ == 0)
+    {
+      done_condition_.notify_one ();
+    }
+  }
+}
+
+void
+TsdfFusion::placeVolume (const Frame& frame)
+{
+  int u, v;
+
+  float distance = 0.8f;
+
+  std::vector < unsigned short > depths;
+
+  /* The face is expected in front of the camera, so the volume is centered on the median depth of the middle third of the frame */
+
+  for (v = frame.height / 3; v < 2 * frame.height / 3; ++v)
+  {
+    for (u = frame.width / 3; u < 2 * frame.width / 3; ++u)
+    {
+      if ((*frame.depth)[v * frame.width + u] > 0)
+      {
+        depths.push_back ((*frame.depth)[v * frame.width + u]);
+      }
+    }
+  }
+
+  if (!depths.empty ())
+  {
+    std::nth_element (depths.begin (), depths.begin () + depths.size () / 2, depths.end ());
+    distance = depths[depths.size () / 2] * 0.001f;
+  }
+
+  rotation_.setIdentity ();
+  translation_ = Eigen::Vector3f (volume_size_ * 0.5f, volume_size_ * 0.5f, volume_size_ * 0.5f - distance);
+
+  PCL_INFO ("Fusing into blocks of %d^3 voxels of %f mm, in a %f m box centered %f m in front of the camera until the face is found, on %d threads\n", BLOCK_SIZE, voxel_size_ * 1000.0f, volume_size_, distance, number_threads_);
+}
+
+void
+TsdfFusion::computeVertices (int begin, int end, int thread)
+{
+  int u, v;
+
+  unsigned short depth;
+
+  const std::vector < unsigned short >& depth_image = *current_frame_->depth;
+
+  for (v = begin; v < end; ++v)
+  {
+    for (u = 0; u < map_width_; ++u)
+    {
+      Eigen::Vector3f& vertex = vertices_[v * map_width_ + u];
+
+      depth = depth_image[2 * v * current_frame_->width + 2 * u];
+
+      if (depth == 0)
+      {
+        vertex.setConstant (std::numeric_limits<float>::quiet_NaN ());
+        continue;
+      }
+
+      vertex[2] = depth * 0.001f;
+      vertex[0] = (u - map_center_x_) * vertex[2] / map_focal_length_;
+      vertex[1] = (v - map_center_y_) * vertex[2] / map_focal_length_;
+    }
+  }
+}
+
+void
+TsdfFusion::computeNormals (int begin, int end, int thread)
+{
+  int u, v, i;
+
+  for (v = begin; v < end; ++v)
+  {
+    for (u = 0; u < map_width_; ++u)
+    {
+      i = v * map_width_ + u;
+
+      Eigen::Vector3f& normal = normals_[i];
+
+      normal.setConstant (std::numeric_limits<float>::quiet_NaN ());
+
+      if ( u + 1 >= map_width_ || v + 1 >= map_height_ || !pcl_isfinite (vertices_[i][2]) || !pcl_isfinite (vertices_[i + 1][2]) || !pcl_isfinite (vertices_[i + map_width_][2]) )
+      {
+        continue;
+      }
+
+      normal = (vertices_[i + map_width_] - vertices_[i]).cross (vertices_[i + 1] - vertices_[i]);
+
+      if (normal.norm () < std::numeric_limits<float>::epsilon ())
+      {
+        normal.setConstant (std::numeric_limits<float>::quiet_NaN ());
+        continue;
+      }
+
+      /* The normals point towards the camera */
+
+      normal.normalize ();
+
+      if (normal.dot (vertices_[i]) > 0)
+      {
+        normal = -normal;
+      }
+    }
+  }
+}
+
+bool
+TsdfFusion::trackCamera ()
+{
+  int i, iteration, count, model_count = 0;
+
+  Matrix6d system;
+
+  Vector6d right_side, solution;
+
+  Eigen::Matrix3f increment_rotation;
+
+  Eigen::Vector3f increment_translation;
+
+  estimated_rotation_ = rotation_;
+  estimated_translation_ = translation_;
+
+  /* The volume covers only a part of the frame, so the matches are compared with the surface seen in the previous frame */
+
+  for (i = 0; i < model_vertices_.size (); ++i)
+  {
+    if ( pcl_isfinite (model_normals_[i][0]) )
+    {
+      ++model_count;
+    }
+  }
+
+  for (iteration = 0; iteration < icp_iterations_; ++iteration)
+  {
+    runParallel (boost::bind (&TsdfFusion::accumulateIcp, this, _1, _2, _3), map_height_);
+
+    system.setZero ();
+    right_side.setZero ();
+    count = 0;
+
+    for (i = 0; i < number_threads_; ++i)
+    {
+      system += icp_systems_[i];
+      right_side += icp_right_sides_[i];
+      count += icp_counts_[i];
+    }
+
+    /* With too few correspondences the camera has moved too far or looks at something else */
+
+    if (count < std::max (100, model_count / 4))
+    {
+      PCL_DEBUG ("Camera lost: %d correspondences\n", count);
+      return (false);
+    }
+
+    solution = system.ldlt ().solve (right_side);
+
+    /* The solution is a small rotation (alpha, beta, gamma) and a translation applied after the estimated pose */
+
+    increment_rotation = Eigen::AngleAxisf (solution[2], Eigen::Vector3f::UnitZ ()) * Eigen::AngleAxisf (solution[1], Eigen::Vector3f::UnitY ()) * Eigen::AngleAxisf (solution[0], Eigen::Vector3f::UnitX ());
+    increment_translation = solution.tail<3> ().cast<float> ();
+
+    estimated_rotation_ = increment_rotation * estimated_rotation_;
+    estimated_translation_ = increment_rotation * estimated_translation_ + increment_translation;
+
+    if ( solution.head<3> ().norm () < 1e-5 && solution.tail<3> ().norm () < 1e-5 )
+    {
+      break;
+    }
+  }
+
+  rotation_ = estimated_rotation_;
+  translation_ = estimated_translation_;
+
+  return (true);
+}
+
+void
+TsdfFusion::accumulateIcp (int begin, int end, int thread)
+{
+  int u, v, i, model_u, model_v;
+
+  Eigen::Vector3f point, normal, point_previous;
+
+  Eigen::Matrix<double, 6, 1> jacobian;
+
+  double residual;
+
+  Matrix6d& system = icp_systems_[thread];
+  Vector6d& right_side = icp_right_sides_[thread];
+
+  /* The surface was raycast from the pose of the previous frame, which maps the volume back to its camera */
+
+  Eigen::Matrix3f rotation_inverse = rotation_.transpose ();
+
+  system.setZero ();
+  right_side.setZero ();
+  icp_counts_[thread] = 0;
+
+  for (v = begin; v < end; ++v)
+  {
+    for (u = 0; u < map_width_; ++u)
+    {
+      i = v * map_width_ + u;
+
+      if ( !pcl_isfinite (normals_[i][0]) )
+      {
+        continue;
+      }
+
+      point = estimated_rotation_ * vertices_[i] + estimated_translation_;
+      point_previous = rotation_inverse * (point - translation_);
+
+      if (point_previous[2] <= 0)
+      {
+        continue;
+      }
+
+      model_u = static_cast<int> (point_previous[0] * map_focal_length_ / point_previous[2] + map_center_x_ + 0.5f);
+      model_v = static_cast<int> (point_previous[1] * map_focal_length_ / point_previous[2] + map_center_y_ + 0.5f);
+
+      if (model_u < 0 || model_v < 0 || model_u >= map_width_ || model_v >= map_height_)
+      {
+        continue;
+      }
+
+      const Eigen::Vector3f& model_vertex = model_vertices_[model_v * map_width_ + model_u];
+      const Eigen::Vector3f& model_normal = model_normals_[model_v * map_width_ + model_u];
+
+      if ( !pcl_isfinite (model_normal[0]) )
+      {
+        continue;
+      }
+
+      /* Same rejection of the pairs as the KinfuTracker: 10 cm apart at most and normals within 20 degrees */
+
+      normal = estimated_rotation_ * normals_[i];
+
+      if ( (point - model_vertex).squaredNorm () > 0.01f || normal.dot (model_normal) < 0.94f )
+      {
+        continue;
+      }
+
+      residual = model_normal.dot (model_vertex - point);
+
+      jacobian.head<3> () = point.cross (model_normal).cast<double> ();
+      jacobian.tail<3> () = model_normal.cast<double> ();
+
+      system.selfadjointView<Eigen::Lower> ().rankUpdate (jacobian);
+      right_side += jacobian * residual;
+
+      ++icp_counts_[thread];
+    }
+  }
+
+  system.triangularView<Eigen::StrictlyUpper> () = system.transpose ();
+}
+
+boost::uint64_t
+TsdfFusion::getBlockKey (int x, int y, int z)
+{
+  /* 21 bits for each coordinate, which is far more than a head needs */
+
+  return ( (static_cast<boost::uint64_t> (x + (1 << 20)) << 42) | (static_cast<boost::uint64_t> (y + (1 << 20)) << 21) | static_cast<boost::uint64_t> (z + (1 << 20)) );
+}
+
+TsdfFusion::Block*
+TsdfFusion::findBlock (int x, int y, int z) const
+{
+  BlockMap::const_iterator iterator = block_map_.find (getBlockKey (x, y, z));
+
+  return (iterator == block_map_.end () ? NULL : iterator->second);
+}
+
+bool
+TsdfFusion::getVoxel (int x, int y, int z, Block*& block, float& value) const
+{
+  int block_x = floorDivide (x, BLOCK_SIZE), block_y = floorDivide (y, BLOCK_SIZE), block_z = floorDivide (z, BLOCK_SIZE), i;
+
+  /* Neighboring lookups mostly fall into the same block, so the hash map is only searched when the block changes */
+
+  if (block == NULL || block->x != block_x || block->y != block_y || block->z != block_z)
+  {
+    block = findBlock (block_x, block_y, block_z);
+  }
+
+  if (block == NULL)
+  {
+    return (false);
+  }
+
+  i = ((z - block_z * BLOCK_SIZE) * BLOCK_SIZE + (y - block_y * BLOCK_SIZE)) * BLOCK_SIZE + (x - block_x * BLOCK_SIZE);
+
+  if (block->weights[i] == 0)
+  {
+    return (false);
+  }
+
+  value = block->tsdf[i];
+
+  return (true);
+}
+
+bool
+TsdfFusion::isInRegion (int x, int y, int z) const
+{
+  float block_length = BLOCK_SIZE * voxel_size_;
+
+  Eigen::Vector3f center = (Eigen::Vector3f (x, y, z) + Eigen::Vector3f::Constant (0.5f)) * block_length;
+
+  if (has_region_)
+  {
+    return ( (center - region_center_).norm () < region_radius_ + block_length );
+  }
+
+  return ( (center.array () > - block_length * 0.5f).all () && (center.array () < volume_size_ + block_length * 0.5f).all () );
+}
+
+void
+TsdfFusion::collectBlocks (int begin, int end, int thread)
+{
+  int u, v, sample, x, y, z;
+
+  float block_length = BLOCK_SIZE * voxel_size_;
+
+  Eigen::Vector3f point, direction, sample_point;
+
+  boost::unordered_set < boost::uint64_t >& keys = allocation_keys_[thread];
+
+  keys.clear ();
+
+  for (v = begin; v < end; ++v)
+  {
+    for (u = 0; u < map_width_; ++u)
+    {
+      if ( !pcl_isfinite (vertices_[v * map_width_ + u][2]) )
+      {
+        continue;
+      }
+
+      point = rotation_ * vertices_[v * map_width_ + u] + translation_;
+      direction = (point - translation_).normalized ();
+
+      /* The truncation band along the ray is thinner than a block, so its ends and its middle are enough */
+
+      for (sample = -1; sample <= 1; ++sample)
+      {
+        sample_point = point + direction * (sample * truncation_distance_);
+
+        x = static_cast<int> (std::floor (sample_point[0] / block_length));
+        y = static_cast<int> (std::floor (sample_point[1] / block_length));
+        z = static_cast<int> (std::floor (sample_point[2] / block_length));
+
+        if ( isInRegion (x, y, z) )
+        {
+          keys.insert (getBlockKey (x, y, z));
+        }
+      }
+    }
+  }
+}
+
+void
+TsdfFusion::allocateBlocks ()
+{
+  int i;
+
+  boost::unordered_set < boost::uint64_t >::const_iterator key;
+
+  runParallel (boost::bind (&TsdfFusion::collectBlocks, this, _1, _2, _3), map_height_);
+
+  for (i = 0; i < number_threads_; ++i)
+  {
+    for (key = allocation_keys_[i].begin (); key != allocation_keys_[i].end (); ++key)
+    {
+      if (block_map_.find (*key) != block_map_.end ())
+      {
+        continue;
+      }
+
+      Block& block = *new Block;
+
+      block.x = static_cast<int> ((*key >> 42) & 0x1fffff) - (1 << 20);
+      block.y = static_cast<int> ((*key >> 21) & 0x1fffff) - (1 << 20);
+      block.z = static_cast<int> (*key & 0x1fffff) - (1 << 20);
+
+      std::fill (block.tsdf, block.tsdf + BLOCK_VOXELS, 1.0f);
+      std::fill (block.weights, block.weights + BLOCK_VOXELS, 0);
+
+      block.touched = false;
+
+      block_map_[*key] = &block;
+      block_list_.push_back (&block);
+
+      /* The rays are marched only inside of the box around the blocks */
+
+      Eigen::Vector3f minimum = Eigen::Vector3f (block.x, block.y, block.z) * (BLOCK_SIZE * voxel_size_);
+
+      if (block_list_.size () == 1)
+      {
+        bounds_minimum_ = minimum;
+        bounds_maximum_ = minimum;
+      }
+
+      bounds_minimum_ = bounds_minimum_.cwiseMin (minimum);
+      bounds_maximum_ = bounds_maximum_.cwiseMax (minimum + Eigen::Vector3f::Constant (BLOCK_SIZE * voxel_size_));
+    }
+  }
+}
+
+void
+TsdfFusion::evictBlocks ()
+{
+  size_t i, kept = 0;
+
+  float block_length = BLOCK_SIZE * voxel_size_;
+
+  Eigen::Vector3f center, minimum;
+
+  std::vector < Block* > evicted;
+
+  Block* neighbor_block;
+
+  if (!has_region_)
+  {
+    return;
+  }
+
+  /* A block is kept a block farther than isInRegion () allocates, so the blocks at the edge are not freed and allocated again as the face moves a little */
+
+  for (i = 0; i < block_list_.size (); ++i)
+  {
+    Block* block = block_list_[i];
+
+    center = (Eigen::Vector3f (block->x, block->y, block->z) + Eigen::Vector3f::Constant (0.5f)) * block_length;
+
+    if ( (center - region_center_).norm () < region_radius_ + 2.0f * block_length )
+    {
+      block_list_[kept++] = block;
+      continue;
+    }
+
+    block_map_.erase (getBlockKey (block->x, block->y, block->z));
+    evicted.push_back (block);
+  }
+
+  if (evicted.empty ())
+  {
+    return;
+  }
+
+  block_list_.resize (kept);
+
+  /* The blocks before an evicted one along x, y and z may have points on the crossings into it, they are extracted again */
+
+  for (i = 0; i < evicted.size (); ++i)
+  {
+    if ( (neighbor_block = findBlock (evicted[i]->x - 1, evicted[i]->y, evicted[i]->z)) )
+    {
+      neighbor_block->touched = true;
+    }
+
+    if ( (neighbor_block = findBlock (evicted[i]->x, evicted[i]->y - 1, evicted[i]->z)) )
+    {
+      neighbor_block->touched = true;
+    }
+
+    if ( (neighbor_block = findBlock (evicted[i]->x, evicted[i]->y, evicted[i]->z - 1)) )
+    {
+      neighbor_block->touched = true;
+    }
+
+    delete evicted[i];
+  }
+
+  /* The box in which the rays are marched shrinks with the blocks */
+
+  for (i = 0; i < block_list_.size (); ++i)
+  {
+    minimum = Eigen::Vector3f (block_list_[i]->x, block_list_[i]->y, block_list_[i]->z) * block_length;
+
+    if (i == 0)
+    {
+      bounds_minimum_ = minimum;
+      bounds_maximum_ = minimum;
+    }
+
+    bounds_minimum_ = bounds_minimum_.cwiseMin (minimum);
+    bounds_maximum_ = bounds_maximum_.cwiseMax (minimum + Eigen::Vector3f::Constant (block_length));
+  }
+
+  PCL_DEBUG ("Freed %d blocks outside of the face region, %d left\n", (int) evicted.size (), (int) block_list_.size ());
+}
+
+void
+TsdfFusion::integrateBlocks (int begin, int end, int thread)
+{
+  int b, x, y, z, u, v, i, width = current_frame_->width, height = current_frame_->height;
+
+  float focal_length = current_frame_->focal_length, center_x = width >> 1, center_y = height >> 1, distance, value, previous_value;
+
+  unsigned short depth;
+
+  const std::vector < unsigned short >& depth_image = *current_frame_->depth;
+
+  /* The voxels are moved into the camera, a step along x is a constant step in the camera */
+
+  Eigen::Matrix3f rotation_inverse = rotation_.transpose ();
+
+  Eigen::Vector3f step = rotation_inverse.col (0) * voxel_size_, row_start;
+
+  typedef Eigen::Array < float, BLOCK_SIZE, 1 > RowArray;
+
+  RowArray index = RowArray::LinSpaced (BLOCK_SIZE, 0.0f, BLOCK_SIZE - 1.0f), camera_x, camera_y, camera_z, pixel_u, pixel_v;
+
+  for (b = begin; b < end; ++b)
+  {
+    Block& block = *block_list_[b];
+
+    for (z = 0; z < BLOCK_SIZE; ++z)
+    {
+      for (y = 0; y < BLOCK_SIZE; ++y)
+      {
+        row_start = rotation_inverse * (Eigen::Vector3f (block.x * BLOCK_SIZE + 0.5f, block.y * BLOCK_SIZE + y + 0.5f, block.z * BLOCK_SIZE + z + 0.5f) * voxel_size_ - translation_);
+
+        /* The projection of a whole row of the block is computed with fixed-size Eigen arrays, which are vectorized */
+
+        camera_x = row_start[0] + index * step[0];
+        camera_y = row_start[1] + index * step[1];
+        camera_z = row_start[2] + index * step[2];
+
+        pixel_u = camera_x / camera_z * focal_length + center_x + 0.5f;
+        pixel_v = camera_y / camera_z * focal_length + center_y + 0.5f;
+
+        i = (z * BLOCK_SIZE + y) * BLOCK_SIZE;
+
+        for (x = 0; x < BLOCK_SIZE; ++x, ++i)
+        {
+          if (camera_z[x] <= 0 || pixel_u[x] < 0 || pixel_v[x] < 0 || pixel_u[x] >= width || pixel_v[x] >= height)
+          {
+            continue;
+          }
+
+          u = static_cast<int> (pixel_u[x]);
+          v = static_cast<int> (pixel_v[x]);
+
+          depth = depth_image[v * width + u];
+
+          if (depth == 0)
+          {
+            continue;
+          }
+
+          /* Voxels far behind the surface are hidden, they are left as they are */
+
+          distance = depth * 0.001f - camera_z[x];
+
+          if (distance < -truncation_distance_)
+          {
+            continue;
+          }
+
+          value = std::min (1.0f, distance / truncation_distance_);
+
+          previous_value = block.tsdf[i];
+
+          block.tsdf[i] = (previous_value * block.weights[i] + value) / (block.weights[i] + 1);
+
+          /* Free space seen again stays at 1 and cannot move the surface, only a voxel inside of the band, seen for the first time or changing sign can */
+
+          if ( distance < truncation_distance_ || block.weights[i] == 0 || (previous_value > 0) != (block.tsdf[i] > 0) )
+          {
+            block.touched = true;
+          }
+
+          if (block.weights[i] < 128)
+          {
+            ++block.weights[i];
+          }
+        }
+      }
+    }
+  }
+}
+
+void
+TsdfFusion::raycastRows (int begin, int end, int thread)
+{
+  int u, v, x, y, z;
+
+  float step = 0.0f, previous_step = 0.0f, sample_distance, near_distance, far_distance, ray_distance, previous_value, value, entry, exit, forward = 0.0f, backward = 0.0f;
+
+  bool has_previous, has_gradient;
+
+  Block* block = NULL;
+
+  Eigen::Vector3f direction, point, normal, offset;
+
+  for (v = begin; v < end; ++v)
+  {
+    for (u = 0; u < map_width_; ++u)
+    {
+      Eigen::Vector3f& model_vertex = model_vertices_[v * map_width_ + u];
+      Eigen::Vector3f& model_normal = model_normals_[v * map_width_ + u];
+
+      model_vertex.setConstant (std::numeric_limits<float>::quiet_NaN ());
+      model_normal.setConstant (std::numeric_limits<float>::quiet_NaN ());
+
+      direction = rotation_ * Eigen::Vector3f ((u - map_center_x_) / map_focal_length_, (v - map_center_y_) / map_focal_length_, 1.0f).normalized ();
+
+      /* Only the part of the ray inside of the box around the blocks is marched */
+
+      near_distance = 0.0f;
+      far_distance = std::numeric_limits<float>::max ();
+
+      for (int axis = 0; axis < 3; ++axis)
+      {
+        if (std::fabs (direction[axis]) < 1e-6f)
+        {
+          continue;
+        }
+
+        entry = (bounds_minimum_[axis] - translation_[axis]) / direction[axis];
+        exit = (bounds_maximum_[axis] - translation_[axis]) / direction[axis];
+
+        near_distance = std::max (near_distance, std::min (entry, exit));
+        far_distance = std::min (far_distance, std::max (entry, exit));
+      }
+
+      has_previous = false;
+      previous_value = 0.0f;
+
+      /* The ray is marched over the nearest voxels, in steps as long as the distance stored in them allows */
+
+      for (ray_distance = near_distance + voxel_size_; ray_distance < far_distance - voxel_size_; ray_distance += step)
+      {
+        point = translation_ + direction * ray_distance;
+
+        x = static_cast<int> (std::floor (point[0] / voxel_size_));
+        y = static_cast<int> (std::floor (point[1] / voxel_size_));
+        z = static_cast<int> (std::floor (point[2] / voxel_size_));
+
+        step = truncation_distance_ * 0.8f;
+
+        if ( !getVoxel (x, y, z, block, value) )
+        {
+          /* The blocks cover the truncation band around every surface seen, so half a block can be skipped where there is none */
+
+          if (block == NULL)
+          {
+            step = std::max (step, BLOCK_SIZE * voxel_size_ * 0.5f);
+          }
+
+          has_previous = false;
+          continue;
+        }
+
+        /* The surface is where the distance turns from positive to negative, its position is interpolated between the two samples */
+
+        if (has_previous && previous_value > 0 && value < 0)
+        {
+          point = translation_ + direction * (ray_distance - previous_step * value / (value - previous_value));
+
+          /* The nearest voxels only bracket the surface, the crossing is searched again in half voxel steps with the interpolated distance */
+
+          has_previous = false;
+
+          for (sample_distance = ray_distance - previous_step - voxel_size_; sample_distance < ray_distance + voxel_size_; sample_distance += voxel_size_ * 0.5f)
+          {
+            if ( !interpolate (translation_ + direction * sample_distance, value) )
+            {
+              has_previous = false;
+              continue;
+            }
+
+            if (has_previous && previous_value > 0 && value < 0)
+            {
+              point = translation_ + direction * (sample_distance - voxel_size_ * 0.5f * value / (value - previous_value));
+              break;
+            }
+
+            previous_value = value;
+            has_previous = true;
+          }
+
+          /* The gradient of the distance points out of the surface, towards the camera like the normals of the frame */
+
+          has_gradient = true;
+
+          for (int axis = 0; axis < 3 && has_gradient; ++axis)
+          {
+            offset.setZero ();
+            offset[axis] = voxel_size_;
+
+            has_gradient = interpolate (point + offset, forward) && interpolate (point - offset, backward);
+
+            normal[axis] = forward - backward;
+          }
+
+          model_vertex = point;
+
+          if (has_gradient && normal.norm () > 0)
+          {
+            model_normal = normal.normalized ();
+          }
+
+          break;
+        }
+
+        step = std::max (voxel_size_, value * truncation_distance_ * 0.8f);
+        previous_step = step;
+
+        /* Behind the surface the ray has no more use */
+
+        if (value < 0)
+        {
+          break;
+        }
+
+        previous_value = value;
+        has_previous = true;
+      }
+    }
+  }
+}
+
+void
+TsdfFusion::extractBlocks (int begin, int end, int thread)
+{
+  int b, x, y, z, axis, voxel[3];
+
+  float value, neighbor_value, position;
+
+  Block* neighbor_blocks[3];
+
+  Block* own_block;
+
+  pcl::PointXYZ point;
+
+  for (b = begin; b < end; ++b)
+  {
+    Block& block = *block_list_[b];
+
+    /* The crossings towards the next blocks along x, y and z belong to this block, so it is extracted again if one of them has changed as well */
+
+    neighbor_blocks[0] = findBlock (block.x + 1, block.y, block.z);
+    neighbor_blocks[1] = findBlock (block.x, block.y + 1, block.z);
+    neighbor_blocks[2] = findBlock (block.x, block.y, block.z + 1);
+
+    if ( !block.touched && !(neighbor_blocks[0] && neighbor_blocks[0]->touched) && !(neighbor_blocks[1] && neighbor_blocks[1]->touched) && !(neighbor_blocks[2] && neighbor_blocks[2]->touched) )
+    {
+      continue;
+    }
+
+    ++extracted_blocks_[thread];
+
+    block.points.clear ();
+
+    for (z = 0; z < BLOCK_SIZE; ++z)
+    {
+      for (y = 0; y < BLOCK_SIZE; ++y)
+      {
+        for (x = 0; x < BLOCK_SIZE; ++x)
+        {
+          voxel[0] = block.x * BLOCK_SIZE + x;
+          voxel[1] = block.y * BLOCK_SIZE + y;
+          voxel[2] = block.z * BLOCK_SIZE + z;
+
+          own_block = &block;
+
+          if ( !getVoxel (voxel[0], voxel[1], voxel[2], own_block, value) )
+          {
+            continue;
+          }
+
+          /* A point is made for every change of sign towards the next voxel along x, y and z */
+
+          for (axis = 0; axis < 3; ++axis)
+          {
+            Block* neighbor_block = &block;
+
+            if ( !getVoxel (voxel[0] + (axis == 0), voxel[1] + (axis == 1), voxel[2] + (axis == 2), neighbor_block, neighbor_value) || (value > 0) == (neighbor_value > 0) )
+            {
+              continue;
+            }
+
+            position = value / (value - neighbor_value);
+
+            point.x = (voxel[0] + 0.5f + (axis == 0 ? position : 0.0f)) * voxel_size_;
+            point.y = (voxel[1] + 0.5f + (axis == 1 ? position : 0.0f)) * voxel_size_;
+            point.z = (voxel[2] + 0.5f + (axis == 2 ? position : 0.0f)) * voxel_size_;
+
+            block.points.push_back (point);
+          }
+        }
+      }
+    }
+  }
+}
+
+bool
+TsdfFusion::interpolate (const Eigen::Vector3f& point, float& value) const
+{
+  int x, y, z, corner;
+
+  float fraction_x, fraction_y, fraction_z, corner_values[8];
+
+  Block* block = NULL;
+
+  Eigen::Vector3f grid = point / voxel_size_ - Eigen::Vector3f::Constant (0.5f);
+
+  x = static_cast<int> (std::floor (grid[0]));
+  y = static_cast<int> (std::floor (grid[1]));
+  z = static_cast<int> (std::floor (grid[2]));
+
+  for (corner = 0; corner < 8; ++corner)
+  {
+    if ( !getVoxel (x + (corner & 1), y + ((corner >> 1) & 1), z + ((corner >> 2) & 1), block, corner_values[corner]) )
+    {
+      return (false);
+    }
+  }
+
+  fraction_x = grid[0] - x;
+  fraction_y = grid[1] - y;
+  fraction_z = grid[2] - z;
+
+  value = ( (corner_values[0] * (1 - fraction_x) + corner_values[1] * fraction_x) * (1 - fraction_y) +
+            (corner_values[2] * (1 - fraction_x) + corner_values[3] * fraction_x) * fraction_y ) * (1 - fraction_z) +
+          ( (corner_values[4] * (1 - fraction_x) + corner_values[5] * fraction_x) * (1 - fraction_y) +
+            (corner_values[6] * (1 - fraction_x) + corner_values[7] * fraction_x) * fraction_y ) * fraction_z;
+
+  return (true);
+}
@@ -0,0 +1,78 @@
+#include <allocation_counter.h>
+#include <registration.h>
+#include <statistical_model.h>
+#include <synthetic_face.h>
+
+#include <boost/filesystem.hpp>
+
+#include <cmath>
+
+/**
+ * @brief Fits the synthetic face once to size the workspace, then fits it again and fails if the rounds of the second fit made any heap allocation
+ */
+
+template <typename PolicyT> static bool
+checkAllocations (const std::string& model_path)
+{
+  int number_eigenvectors = 20, number_rounds = 4, number_rigid_iterations = 10;
+
+  double angle_limit = std::atan (1.0), distance_limit = 0.001, energy_weight = 0.001;
+
+  unsigned long allocations;
+
+  pcl::PointXYZ face_point;
+
+  typename StatisticalModel < PolicyT >::ConstPtr model_ptr (new StatisticalModel < PolicyT > (model_path, Eigen::Matrix3d::Identity (), Eigen::Vector3d::Zero (), 1.0));
+
+  Registration < PolicyT > registration;
+
+  pcl::PointCloud<pcl::PointNormal>::Ptr target_ptr = SyntheticFace::makeTarget (20000, face_point);
+
+  /* With thresholds of 0 the monitors never stop the fit early, so every round and every rigid iteration runs */
+
+  registration.setConvergenceThresholds (0.0, 0.0, 0.0, 0.0);
+  registration.setModel (model_ptr);
+  registration.setTargetPointCloud (target_ptr, face_point);
+  registration.alignModel ();
+
+  registration.calculateAlternativeRegistrations (number_eigenvectors, energy_weight, 1, number_rigid_iterations, angle_limit, distance_limit);
+
+  allocations = AllocationCounter::getThreadCount ();
+
+  registration.calculateAlternativeRegistrations (number_eigenvectors, energy_weight, number_rounds, number_rigid_iterations, angle_limit, distance_limit);
+
+  allocations = AllocationCounter::getThreadCount () - allocations;
+
+  if (allocations > 0)
+  {
+    PCL_ERROR ("%s: %lu heap allocations in %d rounds after the setup\n", PolicyT::name (), allocations, number_rounds);
+    return (false);
+  }
+
+  PCL_INFO ("%s: no heap allocation in %d rounds\n", PolicyT::name (), number_rounds);
+
+  return (true);
+}
+
+int
+main (int argc, char** argv)
+{
+  bool passed;
+
+  if (!AllocationCounter::isEnabled ())
+  {
+    PCL_WARN ("The allocations are only counted with cmake -DCOUNT_ALLOCATIONS=ON, nothing to check\n");
+    return (0);
+  }
+
+  boost::filesystem::path model_path = boost::filesystem::temp_directory_path () / boost::filesystem::unique_path ("allocation_test_%%%%%%%%.txt");
+
+  SyntheticFace::writeModel (model_path.string (), 40, 20);
+
+  passed = checkAllocations < SinglePrecision > (model_path.string ());
+  passed = checkAllocations < DoublePrecision > (model_path.string ()) && passed;
+
+  boost::filesystem::remove (model_path);
+
+  return (passed ? 0 : 1);
+}
@@ -0,0 +1,76 @@
+#include <camera_grabber.h>
+#include <replay_frame_source.h>
+#include <depth_face_locator.h>
+
+#include <cmath>
+
+namespace
+{
+  /* The recording of test/data/replay is 80x60, the default sensor scaled down 8 times. Its first frame has no depth, the second only a hand 0.6 meters away, the third and the fourth the hand and a head whose nose is 0.78 meters away in front of the camera, all on a wall at 1.5 meters */
+
+  const float FOCAL_LENGTH = 525.0f / 8.0f;
+
+  const int WIDTH = 80;
+
+  const int HEIGHT = 60;
+
+  /* The wall is kept out of the search, otherwise a piece of it would pass for a head as well */
+
+  const double MAXIMUM_DEPTH = 1.2;
+
+  /* The face has to be found within 2 centimeters of the nose */
+
+  const double MAXIMUM_ERROR = 0.02;
+}
+
+int
+main (int argc, char** argv)
+{
+  bool passed = true;
+
+  pcl::PointXYZ face_center;
+
+  if (argc < 2)
+  {
+    PCL_ERROR ("Usage: %s <recording directory>\n", argv[0]);
+    return (1);
+  }
+
+  boost::shared_ptr < ReplayFrameSource > source (new ReplayFrameSource (argv[1], 30.0, FOCAL_LENGTH));
+
+  boost::shared_ptr < DepthFaceLocator > face_locator (new DepthFaceLocator);
+
+  CameraGrabber camera_grabber;
+
+  face_locator->setDepthRange (0.4, MAXIMUM_DEPTH);
+
+  /* The replay delivers every frame as soon as it is asked for, so the grabber never waits for the clock */
+
+  camera_grabber.setCamera (source, face_locator);
+
+  pcl::PointCloud<pcl::PointXYZ>::ConstPtr cloud_ptr = camera_grabber.getPointCloud (face_center);
+
+  PCL_INFO ("Face found at %f %f %f\n", face_center.x, face_center.y, face_center.z);
+
+  if ( !cloud_ptr || cloud_ptr->width != WIDTH || cloud_ptr->height != HEIGHT )
+  {
+    PCL_ERROR ("The cloud of the face is not the organized %dx%d frame\n", WIDTH, HEIGHT);
+    passed = false;
+  }
+
+  if ( std::fabs (face_center.x) > MAXIMUM_ERROR || std::fabs (face_center.y) > MAXIMUM_ERROR || std::fabs (face_center.z - 0.78) > MAXIMUM_ERROR )
+  {
+    PCL_ERROR ("The face is %f m away from the nose\n", Eigen::Vector3f (face_center.x, face_center.y, face_center.z - 0.78f).norm ());
+    passed = false;
+  }
+
+  /* The empty frame and the hand are skipped, the grabber returns the third frame and leaves the fourth */
+
+  if ( source->isFinished () )
+  {
+    PCL_ERROR ("The grabber read the whole recording instead of stopping at the first face\n");
+    passed = false;
+  }
+
+  return (passed ? 0 : 1);
+}
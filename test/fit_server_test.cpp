@@ -0,0 +1,294 @@
+#include <fit_server.h>
+#include <fit_client.h>
+#include <synthetic_face.h>
+
+#include <boost/filesystem.hpp>
+
+#include <cmath>
+#include <sstream>
+
+namespace
+{
+  /* The server fits with 50 eigenvectors, the model needs at least as many */
+
+  const int NUMBER_EIGENVECTORS = 50;
+
+  /* One thread and one waiting request, so that two stalled requests fill the server and the third is turned away */
+
+  const int MAX_PENDING = 1;
+
+  /* The time the server gets to start and to reach a state, in seconds, it is polled every 10 milliseconds until then */
+
+  const double STATE_TIMEOUT = 10.0;
+}
+
+/**
+ * @brief Checks that a response has the format of an answered fit: OK, POSE, COEFFICIENTS, MESH if it was asked for, and END
+ */
+
+static bool
+checkFitResponse (const std::string& response, bool mesh)
+{
+  int i, j, number_coefficients, number_vertices, number_faces, number_indices;
+
+  double value;
+
+  std::string word;
+
+  std::istringstream iss (response);
+
+  if ( !(iss >> word) || word != "OK" || !(iss >> value >> value) )
+  {
+    return (false);
+  }
+
+  if ( !(iss >> word) || word != "POSE" )
+  {
+    return (false);
+  }
+
+  for (i = 0; i < 16; ++i)
+  {
+    if ( !(iss >> value) || !pcl_isfinite (value) )
+    {
+      return (false);
+    }
+  }
+
+  if ( !(iss >> word >> number_coefficients) || word != "COEFFICIENTS" || number_coefficients != NUMBER_EIGENVECTORS )
+  {
+    return (false);
+  }
+
+  for (i = 0; i < number_coefficients; ++i)
+  {
+    if ( !(iss >> value) || !pcl_isfinite (value) )
+    {
+      return (false);
+    }
+  }
+
+  if (mesh)
+  {
+    if ( !(iss >> word >> number_vertices >> number_faces) || word != "MESH" || number_vertices <= 0 || number_faces <= 0 )
+    {
+      return (false);
+    }
+
+    for (i = 0; i < 3 * number_vertices; ++i)
+    {
+      if ( !(iss >> value) )
+      {
+        return (false);
+      }
+    }
+
+    for (i = 0; i < number_faces; ++i)
+    {
+      if ( !(iss >> number_indices) || number_indices < 3 )
+      {
+        return (false);
+      }
+
+      for (j = 0; j < number_indices; ++j)
+      {
+        if ( !(iss >> value) || value < 0 || value >= number_vertices )
+        {
+          return (false);
+        }
+      }
+    }
+  }
+
+  return ( (iss >> word) && word == "END" && !(iss >> word) );
+}
+
+/**
+ * @brief Reads a counter from a STATS response, -1 if it is missing
+ */
+
+static int
+getCounter (const std::string& stats, const std::string& name)
+{
+  int value = -1;
+
+  size_t position = stats.find (" " + name + "=");
+
+  if (position == std::string::npos)
+  {
+    return (-1);
+  }
+
+  std::istringstream iss (stats.substr (position + name.size () + 2));
+
+  iss >> value;
+
+  return (value);
+}
+
+/**
+ * @brief Polls STATS until a counter reaches a value, the server gets STATE_TIMEOUT seconds for it
+ */
+
+static bool
+waitForCounter (FitClient& client, const std::string& name, int value)
+{
+  std::string stats;
+
+  boost::system_time deadline = boost::get_system_time () + boost::posix_time::millisec (static_cast<long> (STATE_TIMEOUT * 1000.0));
+
+  while (boost::get_system_time () < deadline)
+  {
+    if ( client.getStats (stats) && getCounter (stats, name) == value )
+    {
+      return (true);
+    }
+
+    boost::this_thread::sleep (boost::posix_time::millisec (10));
+  }
+
+  PCL_ERROR ("The server did not reach %s=%d, last %s", name.c_str (), value, stats.empty () ? "STATS not answered\n" : stats.c_str ());
+
+  return (false);
+}
+
+/**
+ * @brief Opens a POINTS request and sends only its line, the thread which takes it waits for the points until the connection is shut
+ */
+
+static LocalSocket::Ptr
+openStalledRequest (const std::string& socket_path, pcl::PointXYZ face_point)
+{
+  std::ostringstream line;
+
+  LocalSocket::Ptr socket = LocalSocket::connect (socket_path);
+
+  line << "POINTS 100 " << face_point.x << " " << face_point.y << " " << face_point.z << "\n";
+
+  if ( socket && !socket->writeString (line.str ()) )
+  {
+    socket.reset ();
+  }
+
+  return (socket);
+}
+
+int
+main (int argc, char** argv)
+{
+  int i;
+
+  bool passed = true;
+
+  std::string response;
+
+  pcl::PointXYZ face_point;
+
+  pcl::PointCloud<pcl::PointXYZ> target;
+
+  LocalSocket::Ptr stalled[2];
+
+  boost::filesystem::path model_path = boost::filesystem::temp_directory_path () / boost::filesystem::unique_path ("fit_server_test_%%%%%%%%.txt");
+  boost::filesystem::path target_path = boost::filesystem::temp_directory_path () / boost::filesystem::unique_path ("fit_server_test_%%%%%%%%.pcd");
+  boost::filesystem::path socket_path = boost::filesystem::temp_directory_path () / boost::filesystem::unique_path ("fit_server_test_%%%%%%%%.sock");
+
+  SyntheticFace::writeModel (model_path.string (), 40, NUMBER_EIGENVECTORS);
+
+  pcl::PointCloud<pcl::PointNormal>::Ptr target_ptr = SyntheticFace::makeTarget (20000, face_point);
+
+  pcl::io::savePCDFileBinary (target_path.string (), *target_ptr);
+  pcl::copyPointCloud (*target_ptr, target);
+
+  StatisticalModel < SinglePrecision >::ConstPtr model_ptr (new StatisticalModel < SinglePrecision > (model_path.string (), Eigen::Matrix3d::Identity (), Eigen::Vector3d::Zero (), 1.0));
+
+  FitServer < SinglePrecision > server (model_ptr, 1, MAX_PENDING);
+
+  FitClient client (socket_path.string ());
+
+  boost::thread server_thread (boost::bind (&FitServer < SinglePrecision >::run, &server, socket_path.string ()));
+
+  /* The server is up once it answers, the thread cannot be joined if it never does */
+
+  if ( !waitForCounter (client, "served", 0) )
+  {
+    exit (1);
+  }
+
+  /* A fit of a target read by the server and one of points sent along, with the mesh */
+
+  if ( !client.fit (target_path.string (), face_point, "", response) || !checkFitResponse (response, false) )
+  {
+    PCL_ERROR ("Bad response to FIT: %s\n", response.substr (0, 200).c_str ());
+    passed = false;
+  }
+
+  if ( !client.fitPoints (target, face_point, "mesh=1", response) || !checkFitResponse (response, true) )
+  {
+    PCL_ERROR ("Bad response to POINTS: %s\n", response.substr (0, 200).c_str ());
+    passed = false;
+  }
+
+  if ( !client.fit (target_path.string (), face_point, "colour=1", response) || response != "ERROR unknown option colour=1\n" )
+  {
+    PCL_ERROR ("Bad response to an unknown option: %s\n", response.c_str ());
+    passed = false;
+  }
+
+  /* The first stalled request holds the only thread, the second one waits for it, then the admission is full */
+
+  stalled[0] = openStalledRequest (socket_path.string (), face_point);
+  passed = stalled[0] && waitForCounter (client, "running", 1) && passed;
+
+  stalled[1] = openStalledRequest (socket_path.string (), face_point);
+  passed = stalled[1] && waitForCounter (client, "waiting", 1) && passed;
+
+  if ( !client.fit (target_path.string (), face_point, "", response) || response != "BUSY\n" )
+  {
+    PCL_ERROR ("Expected BUSY with %d request waiting, got: %s\n", MAX_PENDING, response.substr (0, 200).c_str ());
+    passed = false;
+  }
+
+  /* The stalled requests are let go without their points */
+
+  for (i = 0; i < 2; ++i)
+  {
+    if (!stalled[i])
+    {
+      continue;
+    }
+
+    stalled[i]->shutdownWrite ();
+
+    if ( !stalled[i]->readAll (response) || response != "ERROR missing points\n" )
+    {
+      PCL_ERROR ("Bad response to a POINTS request without points: %s\n", response.c_str ());
+      passed = false;
+    }
+  }
+
+  if ( !client.getStats (response) || response.compare (0, 6, "STATS ") != 0 || response[response.size () - 1] != '\n' || getCounter (response, "served") != 2 ||
+       getCounter (response, "failed") != 3 || getCounter (response, "rejected") != 1 || getCounter (response, "running") != 0 || getCounter (response, "waiting") != 0 ||
+       getCounter (response, "threads") != 1 )
+  {
+    PCL_ERROR ("Bad response to STATS: %s\n", response.c_str ());
+    passed = false;
+  }
+
+  else
+  {
+    PCL_INFO ("%s", response.c_str ());
+  }
+
+  if ( !client.stop (response) || response != "OK\n" )
+  {
+    PCL_ERROR ("Bad response to STOP: %s\n", response.c_str ());
+    passed = false;
+  }
+
+  server_thread.join ();
+
+  boost::filesystem::remove (model_path);
+  boost::filesystem::remove (target_path);
+
+  return (passed ? 0 : 1);
+}
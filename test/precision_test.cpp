@@ -0,0 +1,98 @@
+#include <registration.h>
+#include <statistical_model.h>
+#include <synthetic_face.h>
+#include <target_generator.h>
+
+#include <boost/filesystem.hpp>
+
+#include <cmath>
+
+namespace
+{
+  const int NUMBER_EIGENVECTORS = 20;
+
+  /* The residuals of the two precisions may differ by 2 percent at most */
+
+  const double MAXIMUM_RELATIVE_DIFFERENCE = 0.02;
+}
+
+/**
+ * @brief Fits the synthetic face to a target with the precision of PolicyT, with the limits of comparePrecision () in main.cpp but twice the rounds so that both fits can settle, and returns true if the fit converged
+ */
+
+template <typename PolicyT> static bool
+fitTarget (const std::string& model_path, pcl::PointCloud<pcl::PointNormal>::Ptr target_ptr, pcl::PointXYZ face_point, double& residual)
+{
+  int number_rounds = 30, number_rigid_iterations = 100;
+
+  double angle_limit = std::atan (1.0), distance_limit = 0.001, energy_weight = 0.001;
+
+  typename StatisticalModel < PolicyT >::ConstPtr model_ptr (new StatisticalModel < PolicyT > (model_path, Eigen::Matrix3d::Identity (), Eigen::Vector3d::Zero (), 1.0));
+
+  Registration < PolicyT > registration;
+
+  registration.setModel (model_ptr);
+  registration.setTargetPointCloud (target_ptr, face_point);
+  registration.alignModel ();
+
+  registration.calculateAlternativeRegistrations (NUMBER_EIGENVECTORS, energy_weight, number_rounds, number_rigid_iterations, angle_limit, distance_limit);
+
+  residual = registration.computeResidual (angle_limit, distance_limit);
+
+  PCL_INFO ("%s: %s, residual %e\n", PolicyT::name (), registration.hasConverged () ? "converged" : "not converged", residual);
+
+  return (registration.hasConverged ());
+}
+
+int
+main (int argc, char** argv)
+{
+  bool passed = true;
+
+  double float_residual, double_residual;
+
+  pcl::PointCloud<pcl::PointXYZ> target;
+
+  GroundTruth truth;
+
+  boost::filesystem::path model_path = boost::filesystem::temp_directory_path () / boost::filesystem::unique_path ("precision_test_%%%%%%%%.txt");
+
+  SyntheticFace::writeModel (model_path.string (), 40, NUMBER_EIGENVECTORS);
+
+  /* One target with a known seed, the two precisions fit the very same points */
+
+  StatisticalModel < DoublePrecision >::ConstPtr model_ptr (new StatisticalModel < DoublePrecision > (model_path.string (), Eigen::Matrix3d::Identity (), Eigen::Vector3d::Zero (), 1.0));
+
+  TargetGenerator < DoublePrecision > generator (model_ptr, 7);
+
+  generator.generate (target, truth);
+
+  /* Each fit gets its own copy, the normals are computed in place when the target is set */
+
+  pcl::PointCloud<pcl::PointNormal>::Ptr float_target_ptr (new pcl::PointCloud<pcl::PointNormal>);
+  pcl::PointCloud<pcl::PointNormal>::Ptr double_target_ptr (new pcl::PointCloud<pcl::PointNormal>);
+
+  pcl::copyPointCloud (target, *float_target_ptr);
+  pcl::copyPointCloud (target, *double_target_ptr);
+
+  passed = fitTarget < SinglePrecision > (model_path.string (), float_target_ptr, truth.face_point, float_residual) && passed;
+  passed = fitTarget < DoublePrecision > (model_path.string (), double_target_ptr, truth.face_point, double_residual) && passed;
+
+  boost::filesystem::remove (model_path);
+
+  if (!passed)
+  {
+    PCL_ERROR ("A fit did not converge\n");
+    return (1);
+  }
+
+  if ( std::fabs (float_residual - double_residual) > MAXIMUM_RELATIVE_DIFFERENCE * double_residual )
+  {
+    PCL_ERROR ("The residuals differ by %e, %f percent\n", float_residual - double_residual, 100.0 * std::fabs (float_residual - double_residual) / double_residual);
+    return (1);
+  }
+
+  PCL_INFO ("The residuals differ by %e\n", float_residual - double_residual);
+
+  return (0);
+}
@@ -0,0 +1,299 @@
+#include <synthetic_face.h>
+#include <tsdf_fusion.h>
+
+#include <cmath>
+#include <vector>
+
+namespace
+{
+  /* The camera of the frames, the one of the default sensor */
+
+  const int WIDTH = 640;
+
+  const int HEIGHT = 480;
+
+  const float FOCAL_LENGTH = 525.0f;
+
+  const int NUMBER_FRAMES = 20;
+
+  /* The largest errors allowed for the pose of the camera and for the fused surface */
+
+  const double MAXIMUM_TRANSLATION_ERROR = 0.002;
+
+  const double MAXIMUM_ROTATION_ERROR = 0.3 * M_PI / 180.0;
+
+  const double MAXIMUM_SURFACE_ERROR = 0.001;
+
+  /* Once the face is found the blocks follow a sphere around it, which is moved along the wall in steps of 5 centimeters */
+
+  const float REGION_RADIUS = 0.1f;
+
+  const int NUMBER_REGIONS = 7;
+
+  /* The blocks and the memory may grow by half at most as the sphere moves, with the blocks it leaves kept they would grow 2.5 times */
+
+  const double MAXIMUM_GROWTH = 1.5;
+
+  /**
+   * @brief Depth of the scene at a point of the world: the synthetic face on a plate in front of a wall
+   */
+
+  float
+  getSceneDepth (float x, float y)
+  {
+    if (std::fabs (x) < 0.12f && std::fabs (y) < 0.15f)
+    {
+      return (0.8f + SyntheticFace::getDepth (x, y));
+    }
+
+    /* The wall has a dome beside the face and ripples, the planes facing the camera and the smooth face alone would let the camera slide sideways and turn around its axis */
+
+    return (0.9f + 2.0f * SyntheticFace::getDepth (x + 0.25f, y - 0.05f) + 0.01f * std::sin (x * 62.8f) * std::sin (y * 62.8f));
+  }
+
+  /**
+   * @brief Method to check if the scene is smooth around a point, the error of the surface is only measured there since the depth jumps at the edges
+   */
+
+  bool
+  isSmooth (float x, float y)
+  {
+    const float margin = 0.01f;
+
+    float depth = getSceneDepth (x, y);
+
+    return ( std::fabs (getSceneDepth (x - margin, y) - depth) < 0.005f && std::fabs (getSceneDepth (x + margin, y) - depth) < 0.005f &&
+             std::fabs (getSceneDepth (x, y - margin) - depth) < 0.005f && std::fabs (getSceneDepth (x, y + margin) - depth) < 0.005f );
+  }
+
+  /**
+   * @brief The pose of the camera in a frame, from the coordinates of the camera to the ones of the world. It turns by 0.4 degrees and moves by 2.4 millimeters per frame
+   */
+
+  Eigen::Affine3f
+  getCameraPose (int index)
+  {
+    Eigen::Affine3f pose;
+
+    pose = Eigen::Translation3f (0.002f * index, -0.001f * index, 0.001f * index) * Eigen::AngleAxisf (0.4f * M_PI / 180.0f * index, Eigen::Vector3f::UnitY ()) *
+           Eigen::AngleAxisf (0.2f * M_PI / 180.0f * index, Eigen::Vector3f::UnitX ());
+
+    return (pose);
+  }
+
+  /**
+   * @brief Method to render the depth of the scene seen from a pose, by marching along the ray of every pixel until it passes behind the surface
+   */
+
+  void
+  renderFrame (int index, Frame& frame)
+  {
+    int u, v, step;
+
+    float near, far, middle;
+
+    Eigen::Affine3f pose = getCameraPose (index);
+
+    Eigen::Vector3f direction, point;
+
+    boost::shared_ptr < std::vector < unsigned short > > depth (new std::vector < unsigned short > (WIDTH * HEIGHT, 0));
+
+    for (v = 0; v < HEIGHT; ++v)
+    {
+      for (u = 0; u < WIDTH; ++u)
+      {
+        /* The direction is scaled so that the distance along the ray is the depth seen by the camera */
+
+        direction = pose.linear () * Eigen::Vector3f ((u - (WIDTH >> 1)) / FOCAL_LENGTH, (v - (HEIGHT >> 1)) / FOCAL_LENGTH, 1.0f);
+
+        for (near = 0.5f; near < 1.2f; near += 0.004f)
+        {
+          point = pose.translation () + direction * (near + 0.004f);
+
+          if (point[2] >= getSceneDepth (point[0], point[1]))
+          {
+            break;
+          }
+        }
+
+        if (near >= 1.2f)
+        {
+          continue;
+        }
+
+        far = near + 0.004f;
+
+        for (step = 0; step < 16; ++step)
+        {
+          middle = 0.5f * (near + far);
+          point = pose.translation () + direction * middle;
+
+          if (point[2] >= getSceneDepth (point[0], point[1]))
+          {
+            far = middle;
+          }
+
+          else
+          {
+            near = middle;
+          }
+        }
+
+        (*depth)[v * WIDTH + u] = static_cast<unsigned short> (far * 1000.0f + 0.5f);
+      }
+    }
+
+    frame.index = index;
+    frame.timestamp = index / 30.0;
+    frame.width = WIDTH;
+    frame.height = HEIGHT;
+    frame.focal_length = FOCAL_LENGTH;
+    frame.depth = depth;
+  }
+
+  /**
+   * @brief Method to measure how far the camera pose tracked by the fusion is from the true one. The volume is placed by the first frame, which sets the transformation from the world to the volume
+   */
+
+  void
+  getPoseError (const Eigen::Affine3f& first_pose, const Eigen::Affine3f& pose, int index, double& translation_error, double& rotation_error)
+  {
+    Eigen::Affine3f true_pose = first_pose * getCameraPose (0).inverse () * getCameraPose (index);
+
+    translation_error = (pose.translation () - true_pose.translation ()).norm ();
+    rotation_error = Eigen::AngleAxisf (true_pose.linear ().transpose () * pose.linear ()).angle ();
+  }
+}
+
+int
+main (int argc, char** argv)
+{
+  int i, number_checked = 0, scene_blocks, first_blocks = 0;
+
+  size_t first_memory = 0;
+
+  bool passed = true;
+
+  double translation_error, rotation_error, surface_error = 0.0;
+
+  Eigen::Affine3f first_pose, volume_to_world;
+
+  Eigen::Vector3f point, face_center;
+
+  std::vector < Frame > frames (NUMBER_FRAMES);
+
+  pcl::PointCloud < pcl::PointXYZ > cloud;
+
+  TsdfFusion fusion;
+
+  /* The camera moves through the scene, every frame must be tracked within the tolerance */
+
+  for (i = 0; i < NUMBER_FRAMES; ++i)
+  {
+    renderFrame (i, frames[i]);
+
+    if ( !fusion.integrate (frames[i]) )
+    {
+      PCL_ERROR ("The camera was lost in frame %d\n", i);
+      return (1);
+    }
+
+    if (i == 0)
+    {
+      first_pose = fusion.getCameraPose ();
+    }
+
+    getPoseError (first_pose, fusion.getCameraPose (), i, translation_error, rotation_error);
+
+    if (translation_error > MAXIMUM_TRANSLATION_ERROR || rotation_error > MAXIMUM_ROTATION_ERROR)
+    {
+      PCL_ERROR ("Frame %d: the pose is %f mm and %f degrees off\n", i, translation_error * 1000.0, rotation_error * 180.0 / M_PI);
+      passed = false;
+    }
+  }
+
+  PCL_INFO ("Last frame: the pose is %f mm and %f degrees off\n", translation_error * 1000.0, rotation_error * 180.0 / M_PI);
+
+  /* The fused surface is brought back into the world and compared with the depth of the scene where it is smooth */
+
+  fusion.extractCloud (cloud);
+
+  volume_to_world = getCameraPose (0) * first_pose.inverse ();
+
+  for (i = 0; i < cloud.size (); ++i)
+  {
+    point = volume_to_world * cloud.points[i].getVector3fMap ();
+
+    if ( !isSmooth (point[0], point[1]) )
+    {
+      continue;
+    }
+
+    surface_error += std::fabs (point[2] - getSceneDepth (point[0], point[1]));
+    ++number_checked;
+  }
+
+  if (number_checked < 1000)
+  {
+    PCL_ERROR ("Only %d points of the surface were extracted\n", number_checked);
+    return (1);
+  }
+
+  surface_error /= number_checked;
+
+  PCL_INFO ("Mean error of %d points of the surface: %f mm\n", number_checked, surface_error * 1000.0);
+
+  if (surface_error > MAXIMUM_SURFACE_ERROR)
+  {
+    PCL_ERROR ("The surface is %f mm off on average\n", surface_error * 1000.0);
+    passed = false;
+  }
+
+  /* The sphere moves along the wall while the camera stays still, the blocks it leaves must be freed */
+
+  fusion.setRegionRadius (REGION_RADIUS);
+
+  scene_blocks = fusion.getNumberBlocks ();
+
+  for (i = 0; i < NUMBER_REGIONS; ++i)
+  {
+    face_center = Eigen::Vector3f (0.3f, -0.15f + 0.05f * i, getSceneDepth (0.3f, -0.15f + 0.05f * i));
+
+    fusion.setFaceCenter (volume_to_world.inverse () * face_center);
+    fusion.integrate (frames[NUMBER_FRAMES - 1]);
+    fusion.extractCloud (cloud);
+
+    if (i == 0)
+    {
+      first_blocks = fusion.getNumberBlocks ();
+      first_memory = fusion.getMemoryUsage ();
+
+      /* The sphere covers only a part of the scene fused so far */
+
+      if (first_blocks >= scene_blocks)
+      {
+        PCL_ERROR ("%d blocks in the first region, %d before, the blocks outside of it were not freed\n", first_blocks, scene_blocks);
+        passed = false;
+      }
+    }
+
+    else if (fusion.getNumberBlocks () > MAXIMUM_GROWTH * first_blocks || fusion.getMemoryUsage () > MAXIMUM_GROWTH * first_memory)
+    {
+      PCL_ERROR ("Region %d: %d blocks and %f MB, %d blocks and %f MB at the first region\n", i, fusion.getNumberBlocks (), fusion.getMemoryUsage () / 1048576.0,
+                 first_blocks, first_memory / 1048576.0);
+      passed = false;
+    }
+
+    /* Without a new frame no block has changed, so nothing is extracted again */
+
+    fusion.extractCloud (cloud);
+
+    if (fusion.getExtractedBlocks () > 0)
+    {
+      PCL_ERROR ("Region %d: %d blocks extracted again without a new frame\n", i, fusion.getExtractedBlocks ());
+      passed = false;
+    }
+  }
+
+  return (passed ? 0 : 1);
+}